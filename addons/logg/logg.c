@@ -14,10 +14,149 @@
 
 static int logg_bufsize = 1024*64;
 
+/* Ogg files are read through a packfile with read-ahead, so the next block
+ * of the file is being fetched while Vorbis decodes the current one.
+ */
+typedef struct LOGG_File {
+	PACKFILE* f;
+	char* filename;
+	long pos;
+	long size;
+} LOGG_File;
+
+static PACKFILE* logg_pack_open(const char* filename)
+{
+	PACKFILE* f = pack_fopen(filename, F_READ);
+	PACKFILE* ahead;
+
+	if (!f) {
+		return 0;
+	}
+
+	ahead = pack_fopen_readahead(f, logg_bufsize);
+	if (!ahead) {
+		return f;
+	}
+
+	return ahead;
+}
+
+static size_t logg_read(void* ptr, size_t size, size_t nmemb, void* datasource)
+{
+	LOGG_File* lf = (LOGG_File*)datasource;
+	long numRead;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	numRead = pack_fread(ptr, (long)(size * nmemb), lf->f);
+	if (numRead < 0) {
+		return 0;
+	}
+
+	lf->pos += numRead;
+
+	return numRead / size;
+}
+
+static int logg_seek(void* datasource, ogg_int64_t offset, int whence)
+{
+	LOGG_File* lf = (LOGG_File*)datasource;
+	ogg_int64_t target;
+
+	switch (whence) {
+		case SEEK_SET:
+			target = offset;
+			break;
+		case SEEK_CUR:
+			target = lf->pos + offset;
+			break;
+		case SEEK_END:
+			target = lf->size + offset;
+			break;
+		default:
+			return -1;
+	}
+
+	if (target < 0 || target > lf->size) {
+		return -1;
+	}
+
+	/* packfiles only seek forwards, so start over to go back */
+	if (target < lf->pos) {
+		PACKFILE* f = logg_pack_open(lf->filename);
+		if (!f) {
+			return -1;
+		}
+		pack_fclose(lf->f);
+		lf->f = f;
+		lf->pos = 0;
+	}
+
+	if (target > lf->pos) {
+		if (pack_fseek(lf->f, (int)(target - lf->pos)) != 0) {
+			return -1;
+		}
+		lf->pos = (long)target;
+	}
+
+	return 0;
+}
+
+static int logg_close(void* datasource)
+{
+	LOGG_File* lf = (LOGG_File*)datasource;
+
+	pack_fclose(lf->f);
+	free(lf->filename);
+	free(lf);
+
+	return 0;
+}
+
+static long logg_tell(void* datasource)
+{
+	return ((LOGG_File*)datasource)->pos;
+}
+
+static int logg_open(const char* filename, OggVorbis_File* ovf)
+{
+	ov_callbacks callbacks = { logg_read, logg_seek, logg_close, logg_tell };
+	LOGG_File* lf = calloc(1, sizeof(LOGG_File));
+
+	if (!lf) {
+		return 1;
+	}
+
+	lf->filename = strdup(filename);
+	if (!lf->filename) {
+		free(lf);
+		return 1;
+	}
+
+	lf->f = logg_pack_open(filename);
+	if (!lf->f) {
+		uszprintf(allegro_error, ALLEGRO_ERROR_SIZE, "Unable to open file: %s", filename);
+		free(lf->filename);
+		free(lf);
+		return 1;
+	}
+
+	lf->size = (long)file_size_ex(filename);
+
+	if (ov_open_callbacks(lf, ovf, 0, 0, callbacks) != 0) {
+		strncpy(allegro_error, "ov_open_callbacks failed.", ALLEGRO_ERROR_SIZE);
+		logg_close(lf);
+		return 1;
+	}
+
+	return 0;
+}
+
 SAMPLE* logg_load(const char* filename)
 {
 	OggVorbis_File ovf;
-	FILE* file;
 	vorbis_info* vi;
 	SAMPLE* samp;
 	int numRead;
@@ -25,16 +164,7 @@ SAMPLE* logg_load(const char* filename)
 	int bitstream;
 	char *buf = malloc(logg_bufsize);
 
-	file = fopen(filename, "rb");
-	if (!file) {
-		uszprintf(allegro_error, ALLEGRO_ERROR_SIZE, "Unable to open file: %s", filename);
-		free(buf);
-		return 0;
-	}
-
-	if (ov_open_callbacks(file, &ovf, 0, 0, OV_CALLBACKS_DEFAULT) != 0) {
-		strncpy(allegro_error, "ov_open_callbacks failed.", ALLEGRO_ERROR_SIZE);
-		fclose(file);
+	if (logg_open(filename, &ovf)) {
 		free(buf);
 		return 0;
 	}
@@ -82,18 +212,9 @@ void logg_set_buffer_size(int size)
 
 static int logg_open_file_for_streaming(LOGG_Stream* s)
 {
-	FILE* file;
 	vorbis_info* vi;
 
-	file = fopen(s->filename, "rb");
-	if (!file) {
-		uszprintf(allegro_error, ALLEGRO_ERROR_SIZE, "Unable to open file: %s", s->filename);
-		return 1;
-	}
-
-	if (ov_open_callbacks(file, &s->ovf, 0, 0, OV_CALLBACKS_DEFAULT) != 0) {
-		strncpy(allegro_error, "ov_open_callbacks failed.", ALLEGRO_ERROR_SIZE);
-		fclose(file);
+	if (logg_open(s->filename, &s->ovf)) {
 		return 1;
 	}
 
@@ -1,5 +1,6 @@
 set(ALLEGRO_SRC_FILES
         src/allegro.c
+        src/bands.c
         src/blit.c
         src/bmp.c
         src/clip3d.c
@@ -8,15 +9,20 @@ set(ALLEGRO_SRC_FILES
         src/color.c
         src/config.c
         src/datafile.c
+        src/datalazy.c
         src/dataregi.c
         src/digmid.c
         src/dither.c
         src/dispsw.c
+        src/drawbuf.c
         src/drvlist.c
         src/file.c
+        src/fileasync.c
         src/fli.c
         src/flood.c
         src/font.c
+        src/fontaa.c
+        src/fontcache.c
         src/fontbios.c
         src/fontbmp.c
         src/fontdat.c
@@ -34,6 +40,7 @@ set(ALLEGRO_SRC_FILES
         src/keyboard.c
         src/lbm.c
         src/libc.c
+        src/lz4.c
         src/lzss.c
         src/math.c
         src/math3d.c
@@ -57,6 +64,7 @@ set(ALLEGRO_SRC_FILES
         src/spline.c
         src/stream.c
         src/text.c
+        src/textcache.c
         src/tga.c
         src/timer.c
         src/unicode.c
@@ -86,6 +94,12 @@ set(ALLEGRO_SRC_C_FILES
         src/c/cscan24.c
         src/c/cscan32.c
         src/c/cscan8.c
+        src/c/csimd.c
+        src/c/cblend.c
+        src/c/cconv.c
+        src/c/cptex.c
+        src/c/cxform.c
+        src/c/ccover.c
         src/c/cspr15.c
         src/c/cspr16.c
         src/c/cspr24.c
@@ -365,6 +379,7 @@ set(ALLEGRO_INCLUDE_ALLEGRO_FILES
         include/allegro/debug.h
         include/allegro/digi.h
         include/allegro/draw.h
+        include/allegro/drawbuf.h
         include/allegro/file.h
         include/allegro/fix.h
         include/allegro/fixed.h
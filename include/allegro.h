@@ -42,6 +42,7 @@
 #include "allegro/compiled.h"
 #include "allegro/text.h"
 #include "allegro/font.h"
+#include "allegro/drawbuf.h"
 
 #include "allegro/fli.h"
 #include "allegro/config.h"
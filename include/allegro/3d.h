@@ -27,6 +27,8 @@
 #endif
 
 struct BITMAP;
+struct MATRIX;
+struct MATRIX_f;
 
 typedef struct V3D                  /* a 3d point (fixed point version) */
 {
@@ -76,6 +78,11 @@ AL_FUNC(int, clip3d_f, (int type, float min_z, float max_z, int vc, AL_CONST V3D
 AL_FUNC(fixed, polygon_z_normal, (AL_CONST V3D *v1, AL_CONST V3D *v2, AL_CONST V3D *v3));
 AL_FUNC(float, polygon_z_normal_f, (AL_CONST V3D_f *v1, AL_CONST V3D_f *v2, AL_CONST V3D_f *v3));
 
+AL_FUNC(void, apply_matrix_v3d, (AL_CONST struct MATRIX *m, int n, AL_CONST V3D *in, V3D *out));
+AL_FUNC(void, apply_matrix_v3d_f, (AL_CONST struct MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out));
+AL_FUNC(void, persp_project_v3d, (AL_CONST struct MATRIX *m, int n, AL_CONST V3D *in, V3D *out));
+AL_FUNC(void, persp_project_v3d_f, (AL_CONST struct MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out));
+
 /* Note: You are not supposed to mix ZBUFFER with BITMAP even though it is
  * currently possible. This is just the internal representation, and it may
  * change in the future.
@@ -83,6 +90,7 @@ AL_FUNC(float, polygon_z_normal_f, (AL_CONST V3D_f *v1, AL_CONST V3D_f *v2, AL_C
 typedef struct BITMAP ZBUFFER;
 
 AL_FUNC(ZBUFFER *, create_zbuffer, (struct BITMAP *bmp));
+AL_FUNC(ZBUFFER *, create_hierarchical_zbuffer, (struct BITMAP *bmp));
 AL_FUNC(ZBUFFER *, create_sub_zbuffer, (ZBUFFER *parent, int x, int y, int width, int height));
 AL_FUNC(void, set_zbuffer, (ZBUFFER *zbuf));
 AL_FUNC(void, clear_zbuffer, (ZBUFFER *zbuf, float z));
@@ -43,9 +43,18 @@ typedef struct COMPILED_SPRITE
 
 #else
 
-/* emulate compiled sprites using RLE on other platforms */
-struct RLE_SPRITE;
-typedef struct RLE_SPRITE COMPILED_SPRITE;
+/* compiled sprite structure: lists of solid runs, plus machine code on x86-64 */
+typedef struct COMPILED_SPRITE
+{
+   short planar;                    /* not supported, always FALSE */
+   short color_depth;               /* color depth of the image */
+   short w, h;                      /* size of the sprite */
+   void *draw;                      /* generated drawing routine, or NULL */
+   int len;                         /* size of its code mapping */
+   int *line_runs;                  /* index of the first run of each line */
+   void *runs;                      /* the solid runs */
+   unsigned char *pixels;           /* the image data of the runs */
+} COMPILED_SPRITE;
 
 #endif
 
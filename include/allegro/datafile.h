@@ -27,6 +27,7 @@
 
 struct BITMAP;
 struct PACKFILE;
+struct PACKFILE_REQUEST;
 struct RGB;
 
 #define DAT_ID(a,b,c,d)    AL_ID(a,b,c,d)
@@ -74,15 +75,21 @@ typedef struct DATAFILE_INDEX
 
 AL_FUNC(DATAFILE *, load_datafile, (AL_CONST char *filename));
 AL_FUNC(DATAFILE *, load_datafile_callback, (AL_CONST char *filename, AL_METHOD(void, callback, (DATAFILE *))));
+AL_FUNC(DATAFILE *, load_datafile_mapped, (AL_CONST char *filename, AL_METHOD(void, callback, (DATAFILE *))));
+AL_FUNC(DATAFILE *, load_datafile_parallel, (AL_CONST char *filename, AL_METHOD(void, callback, (DATAFILE *)), int threads));
+AL_FUNC(DATAFILE *, load_datafile_lazy, (AL_CONST char *filename));
 AL_FUNC(DATAFILE_INDEX *, create_datafile_index, (AL_CONST char *filename));
 AL_FUNC(void, unload_datafile, (DATAFILE *dat));
 AL_FUNC(void, destroy_datafile_index, (DATAFILE_INDEX *index));
 
 AL_FUNC(DATAFILE *, load_datafile_object, (AL_CONST char *filename, AL_CONST char *objectname));
 AL_FUNC(DATAFILE *, load_datafile_object_indexed, (AL_CONST DATAFILE_INDEX *index, int item));
+AL_FUNC(struct PACKFILE_REQUEST *, load_datafile_object_async, (AL_CONST DATAFILE_INDEX *index, int item, DATAFILE **dat, AL_METHOD(void, callback, (struct PACKFILE_REQUEST *req, void *arg)), void *arg));
 AL_FUNC(void, unload_datafile_object, (DATAFILE *dat));
 
 AL_FUNC(DATAFILE *, find_datafile_object, (AL_CONST DATAFILE *dat, AL_CONST char *objectname));
+AL_FUNC(void *, get_datafile_object, (DATAFILE *dat));
+AL_FUNC(void, set_datafile_budget, (DATAFILE *dat, long budget));
 AL_FUNC(AL_CONST char *, get_datafile_property, (AL_CONST DATAFILE *dat, int type));
 AL_FUNC(void, register_datafile_object, (int id_, AL_METHOD(void *, load, (struct PACKFILE *f, long size)), AL_METHOD(void, destroy, (void *data))));
 
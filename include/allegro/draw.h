@@ -34,9 +34,14 @@
 #define DRAW_MODE_MASKED_PATTERN    4
 #define DRAW_MODE_TRANS             5
 
+#define STRETCH_NEAREST             0        /* flags for set_stretch_filter() */
+#define STRETCH_BILINEAR            1
+#define STRETCH_AREA                2
+
 AL_FUNC(void, drawing_mode, (int mode, struct BITMAP *pattern, int x_anchor, int y_anchor));
 AL_FUNC(void, xor_mode, (int on));
 AL_FUNC(void, solid_mode, (void));
+AL_FUNC(int, set_drawing_threads, (int threads));
 AL_FUNC(void, do_line, (struct BITMAP *bmp, int x1, int y_1, int x2, int y2, int d, AL_METHOD(void, proc, (struct BITMAP *, int, int, int))));
 AL_FUNC(void, _soft_triangle, (struct BITMAP *bmp, int x1, int y_1, int x2, int y2, int x3, int y3, int color));
 AL_FUNC(void, _soft_polygon, (struct BITMAP *bmp, int vertices, AL_CONST int *points, int color));
@@ -52,11 +57,13 @@ AL_FUNC(void, _soft_arc, (struct BITMAP *bmp, int x, int y, fixed ang1, fixed an
 AL_FUNC(void, calc_spline, (AL_CONST int points[8], int npts, int *x, int *y));
 AL_FUNC(void, _soft_spline, (struct BITMAP *bmp, AL_CONST int points[8], int color));
 AL_FUNC(void, _soft_floodfill, (struct BITMAP *bmp, int x, int y, int color));
+AL_FUNC(void, floodfill_ex, (struct BITMAP *bmp, int x, int y, int color, int tolerance, struct BITMAP *mask));
 AL_FUNC(void, blit, (struct BITMAP *source, struct BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
 AL_FUNC(void, masked_blit, (struct BITMAP *source, struct BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
 AL_FUNC(void, stretch_blit, (struct BITMAP *s, struct BITMAP *d, int s_x, int s_y, int s_w, int s_h, int d_x, int d_y, int d_w, int d_h));
 AL_FUNC(void, masked_stretch_blit, (struct BITMAP *s, struct BITMAP *d, int s_x, int s_y, int s_w, int s_h, int d_x, int d_y, int d_w, int d_h));
 AL_FUNC(void, stretch_sprite, (struct BITMAP *bmp, struct BITMAP *sprite, int x, int y, int w, int h));
+AL_FUNC(int, set_stretch_filter, (int filter));
 AL_FUNC(void, _soft_draw_gouraud_sprite, (struct BITMAP *bmp, struct BITMAP *sprite, int x, int y, int c1, int c2, int c3, int c4));
 
 /* rotate+trans */
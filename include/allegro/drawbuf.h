@@ -0,0 +1,50 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Deferred drawing buffers.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#ifndef ALLEGRO_DRAWBUF_H
+#define ALLEGRO_DRAWBUF_H
+
+#include "base.h"
+
+#ifdef __cplusplus
+   extern "C" {
+#endif
+
+struct BITMAP;
+struct FONT;
+
+typedef struct DRAW_BUFFER DRAW_BUFFER;
+
+AL_FUNC(DRAW_BUFFER *, create_draw_buffer, (struct BITMAP *bmp));
+AL_FUNC(void, destroy_draw_buffer, (DRAW_BUFFER *buf));
+AL_FUNC(void, flush_draw_buffer, (DRAW_BUFFER *buf));
+AL_FUNC(void, discard_draw_buffer, (DRAW_BUFFER *buf));
+
+AL_FUNC(void, buffer_clear_to_color, (DRAW_BUFFER *buf, int color));
+AL_FUNC(void, buffer_rectfill, (DRAW_BUFFER *buf, int x1, int y_1, int x2, int y2, int color));
+AL_FUNC(void, buffer_blit, (DRAW_BUFFER *buf, struct BITMAP *source, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+AL_FUNC(void, buffer_masked_blit, (DRAW_BUFFER *buf, struct BITMAP *source, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+AL_FUNC(void, buffer_draw_sprite, (DRAW_BUFFER *buf, struct BITMAP *sprite, int x, int y));
+AL_FUNC(void, buffer_draw_trans_sprite, (DRAW_BUFFER *buf, struct BITMAP *sprite, int x, int y));
+AL_FUNC(void, buffer_textout_ex, (DRAW_BUFFER *buf, AL_CONST struct FONT *f, AL_CONST char *str, int x, int y, int color, int bg));
+
+#ifdef __cplusplus
+   }
+#endif
+
+#endif          /* ifndef ALLEGRO_DRAWBUF_H */
+
+
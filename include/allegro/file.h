@@ -75,6 +75,8 @@ AL_FUNC(void, al_findclose, (struct al_ffblk *info));
 #define F_PACK_MAGIC    0x736C6821L    /* magic number for packed files */
 #define F_NOPACK_MAGIC  0x736C682EL    /* magic number for autodetect */
 #define F_EXE_MAGIC     0x736C682BL    /* magic number for appended data */
+#define F_LZ4_MAGIC     0x736C6834L    /* magic number for LZ4 packed files */
+#define F_LZ4I_MAGIC    0x736C6869L    /* LZ4 with a block index, for seeking */
 
 #define PACKFILE_FLAG_WRITE      1     /* the file is being written */
 #define PACKFILE_FLAG_PACK       2     /* data is compressed */
@@ -87,9 +89,8 @@ AL_FUNC(void, al_findclose, (struct al_ffblk *info));
 
 typedef struct PACKFILE_VTABLE PACKFILE_VTABLE;
 typedef struct PACKFILE PACKFILE;
-
-struct LZSS_PACK_DATA;
-struct LZSS_UNPACK_DATA;
+typedef struct PACKFILE_CODEC PACKFILE_CODEC;
+typedef struct PACKFILE_REQUEST PACKFILE_REQUEST;
 
 
 struct _al_normal_packfile_details
@@ -100,12 +101,16 @@ struct _al_normal_packfile_details
    int buf_size;                       /* number of bytes in the buffer */
    long todo;                          /* number of bytes still on the disk */
    struct PACKFILE *parent;            /* nested, parent file */
-   struct LZSS_PACK_DATA *pack_data;   /* for LZSS compression */
-   struct LZSS_UNPACK_DATA *unpack_data; /* for LZSS decompression */
+   void *pack_data;                    /* for compression */
+   void *unpack_data;                  /* for decompression */
    char *filename;                     /* name of the file */
    char *passdata;                     /* encryption key data */
    char *passpos;                      /* current key position */
-   unsigned char buf[F_BUF_SIZE];      /* the actual data buffer */
+   unsigned char buf[F_BUF_SIZE];      /* the built-in data buffer */
+   unsigned char *buf_base;            /* buf, or one set by pack_setbuf() */
+   int buf_max;                        /* size of the buffer in use */
+   AL_CONST PACKFILE_CODEC *codec;     /* how the data is compressed */
+   int type;                           /* of the object, for "file.dat#obj" */
 };
 
 
@@ -138,6 +143,19 @@ struct PACKFILE_VTABLE
 };
 
 
+struct PACKFILE_CODEC
+{
+   AL_METHOD(void *, create_packer, (void));
+   AL_METHOD(void, destroy_packer, (void *dat));
+   AL_METHOD(int, pack, (PACKFILE *f, void *dat, int size, unsigned char *buf, int last));
+   AL_METHOD(void *, create_unpacker, (void));
+   AL_METHOD(void, destroy_unpacker, (void *dat));
+   AL_METHOD(int, unpack, (PACKFILE *f, void *dat, int size, unsigned char *buf));
+   AL_METHOD(int, unpack_pending, (void *dat));
+   AL_METHOD(long, unpack_seek, (PACKFILE *f, void *dat, long offset));
+};
+
+
 #define uconvert_tofilename(s, buf)      uconvert(s, U_CURRENT, buf, get_filename_encoding(), sizeof(buf))
 
 AL_FUNC(void, set_filename_encoding, (int encoding));
@@ -148,6 +166,9 @@ AL_FUNC(PACKFILE *, pack_fopen, (AL_CONST char *filename, AL_CONST char *mode));
 AL_FUNC(PACKFILE *, pack_fopen_vtable, (AL_CONST PACKFILE_VTABLE *vtable, void *userdata));
 AL_FUNC(int, pack_fclose, (PACKFILE *f));
 AL_FUNC(int, pack_fseek, (PACKFILE *f, int offset));
+AL_FUNC(int, pack_setbuf, (PACKFILE *f, int size));
+AL_FUNC(int, register_packfile_codec, (int magic, AL_CONST PACKFILE_CODEC *codec));
+AL_FUNC(int, set_packfile_codec, (int magic));
 AL_FUNC(PACKFILE *, pack_fopen_chunk, (PACKFILE *f, int pack));
 AL_FUNC(PACKFILE *, pack_fclose_chunk, (PACKFILE *f));
 AL_FUNC(int, pack_getc, (PACKFILE *f));
@@ -169,6 +190,11 @@ AL_FUNC(char *, pack_fgets, (char *p, int max, PACKFILE *f));
 AL_FUNC(int, pack_fputs, (AL_CONST char *p, PACKFILE *f));
 AL_FUNC(void *, pack_get_userdata, (PACKFILE *f));
 
+AL_FUNC(PACKFILE_REQUEST *, pack_fread_async, (void *p, long n, PACKFILE *f, AL_METHOD(void, callback, (PACKFILE_REQUEST *req, void *arg)), void *arg));
+AL_FUNC(int, pack_async_done, (PACKFILE_REQUEST *req));
+AL_FUNC(long, pack_async_wait, (PACKFILE_REQUEST *req));
+AL_FUNC(PACKFILE *, pack_fopen_readahead, (PACKFILE *f, long size));
+
 
 
 #ifdef __cplusplus
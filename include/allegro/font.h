@@ -32,6 +32,14 @@ typedef struct FONT_GLYPH           /* a single monochrome font character */
 } FONT_GLYPH;
 
 
+typedef struct FONT_AA_GLYPH        /* a single anti-aliased font character */
+{
+   short w, h;                      /* size of the coverage map */
+   int advance;                     /* pen movement, in 1/64ths of a pixel */
+   ZERO_SIZE_ARRAY(unsigned char, dat);   /* w*h coverage values, 0-255 */
+} FONT_AA_GLYPH;
+
+
 struct FONT_VTABLE;
 
 typedef struct FONT
@@ -47,6 +55,7 @@ AL_FUNC(void, make_trans_font, (FONT *f));
 AL_FUNC(int, is_trans_font, (FONT *f));
 AL_FUNC(int, is_color_font, (FONT *f));
 AL_FUNC(int, is_mono_font, (FONT *f));
+AL_FUNC(int, is_aa_font, (FONT *f));
 AL_FUNC(int, is_compatible_font, (FONT *f1, FONT *f2));
 
 AL_FUNC(void, register_font_file_type, (AL_CONST char *ext, FONT *(*load)(AL_CONST char *filename, RGB *pal, void *param)));
@@ -67,6 +76,10 @@ AL_FUNC(int, get_font_range_end, (FONT *f, int range));
 AL_FUNC(FONT *, extract_font_range, (FONT *f, int begin, int end));
 AL_FUNC(FONT *, merge_fonts, (FONT *f1, FONT *f2));
 AL_FUNC(int, transpose_font, (FONT *f, int drange));
+AL_FUNC(FONT *, create_aa_font, (FONT *f, int height));
+
+AL_FUNC(void, flush_font_cache, (FONT *f));
+
 #ifdef __cplusplus
    }
 #endif
@@ -91,6 +91,39 @@ AL_FUNC(void, _add_exit_func, (AL_METHOD(void, func, (void)), AL_CONST char *des
 AL_FUNC(void, _remove_exit_func, (AL_METHOD(void, func, (void))));
 
 
+/* pool of worker threads for splitting up big jobs, implemented by
+ * the platform files (src/unix/uthreads.c and src/win/wthread.c)
+ */
+#if (defined ALLEGRO_WINDOWS) || \
+    (((defined ALLEGRO_UNIX) || (defined ALLEGRO_MACOSX)) && (defined ALLEGRO_HAVE_LIBPTHREAD))
+   #define ALLEGRO_WORKER_THREADS
+#endif
+
+#define _AL_MAX_WORKERS    32
+
+#ifdef ALLEGRO_WORKER_THREADS
+AL_FUNC(int, _al_cpu_count, (void));
+AL_FUNC(int, _al_start_workers, (int threads));
+AL_FUNC(int, _al_grow_workers, (int threads));
+AL_FUNC(void, _al_stop_workers, (void));
+AL_FUNC(void, _al_run_workers, (AL_METHOD(void, proc, (void *data, int job)), void *data, int jobs));
+
+/* a thread of its own for background file reads, see src/fileasync.c */
+AL_FUNC(int, _al_start_io_thread, (AL_METHOD(void, proc, (void))));
+AL_FUNC(void, _al_stop_io_thread, (void));
+AL_FUNC(int, _al_in_io_thread, (void));
+AL_FUNC(void, _al_lock_io, (void));
+AL_FUNC(void, _al_unlock_io, (void));
+AL_FUNC(void, _al_wait_io, (void));
+AL_FUNC(void, _al_wake_io, (void));
+
+/* banded drawing onto memory bitmaps, see src/bands.c */
+AL_FUNC(int, _drawing_bands, (BITMAP *bmp, int w, int h));
+#endif
+
+AL_VAR(int, _drawing_threads);
+
+
 /* helper structure for talking to Unicode strings */
 typedef struct UTYPE_INFO
 {
@@ -115,6 +148,8 @@ AL_FUNC(UTYPE_INFO *, _find_utype, (int type));
 AL_FUNC(int, _al_file_isok, (AL_CONST char *filename));
 AL_FUNC(uint64_t, _al_file_size_ex, (AL_CONST char *filename));
 AL_FUNC(time_t, _al_file_time, (AL_CONST char *filename));
+AL_FUNC(void *, _al_file_map, (AL_CONST char *filename, uint64_t *size));
+AL_FUNC(void, _al_file_unmap, (void *p, uint64_t size));
 AL_FUNC(int, _al_drive_exists, (int drive));
 AL_FUNC(int, _al_getdrive, (void));
 AL_FUNC(void, _al_getdcwd, (int drive, char *buf, int size));
@@ -125,13 +160,29 @@ AL_FUNC(void, _al_detect_filename_encoding, (void));
 AL_FUNC(long, _al_file_size, (AL_CONST char *filename));
 
 
-/* packfile stuff */
+/* packfile stuff; the sizes are those of the last chunk written */
 AL_VAR(int, _packfile_filesize);
 AL_VAR(int, _packfile_datasize);
+
+/* obsolete; only exists for binary compatibility, see PACKFILE.normal.type */
 AL_VAR(int, _packfile_type);
 AL_FUNC(PACKFILE *, _pack_fdopen, (int fd, AL_CONST char *mode));
 
 AL_FUNC(int, _al_lzss_incomplete_state, (AL_CONST LZSS_UNPACK_DATA *dat));
+AL_FUNC(AL_CONST PACKFILE_CODEC *, _al_find_packfile_codec, (int magic));
+
+AL_VAR(PACKFILE_CODEC, _al_lzss_codec);
+AL_VAR(PACKFILE_CODEC, _al_lz4_codec);
+AL_VAR(PACKFILE_CODEC, _al_lz4i_codec);
+
+AL_FUNC(int, _al_normal_seek, (PACKFILE *f, long offset));
+AL_FUNC(PACKFILE *, _al_pack_fopen_read_chunk, (PACKFILE *f, int datasize, AL_CONST PACKFILE_CODEC *codec));
+
+#define LZ4_BLOCK_SIZE        65536
+#define LZ4_BLOCK_BOUND(n)    ((n) + (n)/255 + 16)
+
+AL_FUNC(int, _al_lz4_pack_block, (AL_CONST unsigned char *src, int size, unsigned char *dst, int *hash));
+AL_FUNC(int, _al_lz4_unpack_block, (AL_CONST unsigned char *src, int size, unsigned char *dst, int max));
 
 
 /* config stuff */
@@ -293,10 +344,43 @@ AL_VAR(FONT_VTABLE, _font_vtable_color);
 AL_VAR(FONT_VTABLE *, font_vtable_color);
 AL_VAR(FONT_VTABLE, _font_vtable_trans);
 AL_VAR(FONT_VTABLE *, font_vtable_trans);
+AL_VAR(FONT_VTABLE, _font_vtable_aa);
+AL_VAR(FONT_VTABLE *, font_vtable_aa);
 
 AL_FUNC(FONT_GLYPH *, _mono_find_glyph, (AL_CONST FONT *f, int ch));
 AL_FUNC(BITMAP *, _color_find_glyph, (AL_CONST FONT *f, int ch));
 
+typedef struct FONT_CACHE_SLOT      /* a glyph cache entry, see fontcache.c */
+{
+   int ch;                          /* character held, or -1 if free */
+   void *glyph;                     /* FONT_GLYPH or BITMAP, or NULL if none */
+   int ax, ay;                      /* position in the atlas, or -1 */
+} FONT_CACHE_SLOT;
+
+AL_FUNC(FONT_CACHE_SLOT *, _font_cache_slot, (AL_CONST FONT *f, int ch));
+AL_FUNC(int, _font_cache_render, (AL_CONST FONT *f, AL_CONST char *text, int fg, int bg, BITMAP *bmp, int x, int y));
+
+#define TEXT_LAYOUT_MAX_WORDS  128  /* words textout_justify_ex() spreads out */
+
+typedef struct TEXT_LAYOUT_WORD     /* a word of a justified string */
+{
+   int offset;                      /* where it starts in the tokens */
+   int width;                       /* its text_length() */
+} TEXT_LAYOUT_WORD;
+
+typedef struct TEXT_LAYOUT          /* a measured string, see textcache.c */
+{
+   int size;                        /* bytes, including the terminator */
+   int length;                      /* text_length() of the whole string */
+   int words;                       /* number of words, or -1 if not split */
+   int minlen;                      /* sum of the word widths */
+   char *tokens;                    /* copy of the string split into words */
+   TEXT_LAYOUT_WORD *word;
+} TEXT_LAYOUT;
+
+AL_FUNC(TEXT_LAYOUT *, _text_layout, (AL_CONST FONT *f, AL_CONST char *str, int words));
+AL_FUNC(void, _text_layout_flush, (AL_CONST FONT *f));
+
 typedef struct FONT_MONO_DATA 
 {
    int begin, end;                  /* first char and one-past-the-end char */
@@ -311,6 +395,13 @@ typedef struct FONT_COLOR_DATA
    struct FONT_COLOR_DATA *next;    /* linked list structure */
 } FONT_COLOR_DATA;
 
+typedef struct FONT_AA_DATA
+{
+   int begin, end;                  /* first char and one-past-the-end char */
+   FONT_AA_GLYPH **glyphs;          /* our glyphs */
+   struct FONT_AA_DATA *next;       /* linked list structure */
+} FONT_AA_DATA;
+
 
 /* caches and tables for svga bank switching */
 AL_VAR(int, _last_bank_1);
@@ -462,6 +553,18 @@ AL_VAR(int, _blender_col_32);
 
 AL_VAR(int, _blender_alpha);
 
+/* scanline versions of the current blenders, NULL for custom ones */
+typedef AL_METHOD(void, BLENDER_ROW_FUNC, (void *dst, AL_CONST void *src, int w, int n, int mask));
+
+AL_VAR(BLENDER_ROW_FUNC, _blender_row15);
+AL_VAR(BLENDER_ROW_FUNC, _blender_row16);
+AL_VAR(BLENDER_ROW_FUNC, _blender_row32);
+
+AL_VAR(BLENDER_ROW_FUNC, _blender_row15x);
+AL_VAR(BLENDER_ROW_FUNC, _blender_row16x);
+
+AL_FUNC(void, _update_blender_rows, (void));
+
 AL_FUNC(unsigned long, _blender_black, (unsigned long x, unsigned long y, unsigned long n));
 
 #ifdef ALLEGRO_COLOR16
@@ -519,6 +622,9 @@ AL_FUNC(unsigned long, _blender_alpha16, (unsigned long x, unsigned long y, unsi
 AL_FUNC(unsigned long, _blender_alpha24, (unsigned long x, unsigned long y, unsigned long n));
 AL_FUNC(unsigned long, _blender_alpha32, (unsigned long x, unsigned long y, unsigned long n));
 
+AL_FUNC(unsigned long, _blender_alpha15_rgb, (unsigned long x, unsigned long y, unsigned long n));
+AL_FUNC(unsigned long, _blender_alpha16_rgb, (unsigned long x, unsigned long y, unsigned long n));
+
 AL_FUNC(unsigned long, _blender_write_alpha, (unsigned long x, unsigned long y, unsigned long n));
 
 
@@ -645,6 +751,9 @@ AL_FUNC(void, _linear_clear_to_color32, (BITMAP *bitmap, int color));
 
 #endif
 
+/* SIMD replacements for the linear vtable entries, see src/c/csimd.c */
+AL_FUNC(void, _al_simd_init, (void));
+
 #ifdef ALLEGRO_GFX_HAS_VGA
 
 AL_FUNC(int,  _x_getpixel, (BITMAP *bmp, int x, int y));
@@ -688,6 +797,9 @@ AL_FUNC(void, _release_colorconv_blitter, (COLORCONV_BLITTER_FUNC *blitter));
 AL_FUNC(void, _set_colorconv_palette, (AL_CONST struct RGB *p, int from, int to));
 AL_FUNC(unsigned char *, _get_colorconv_map, (void));
 
+/* vectorized blitters for some of the above, see src/c/cconv.c */
+AL_FUNC(COLORCONV_BLITTER_FUNC *, _get_colorconv_simd_blitter, (int from_depth, int to_depth));
+
 #ifdef ALLEGRO_COLOR8
 
 AL_FUNC(void, _colorconv_blit_8_to_8, (GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect));
@@ -1184,7 +1296,12 @@ AL_FUNC(void, _dummy_key_on, (int inst, int note, int bend, int vol, int pan));
 
 
 /* datafile object loading functions */
+AL_FUNC(int, _load_datafile_object, (DATAFILE *obj, PACKFILE *f, int type));
 AL_FUNC(void, _unload_datafile_object, (DATAFILE *dat));
+AL_FUNC(void, _lazy_datafile_unload, (DATAFILE *dat));
+AL_FUNC(int, _load_property, (DATAFILE_PROPERTY *prop, PACKFILE *f));
+AL_FUNC(int, _add_property, (DATAFILE_PROPERTY **list, DATAFILE_PROPERTY *prop));
+AL_FUNC(void, _destroy_property_list, (DATAFILE_PROPERTY *list));
 
 
 /* information about a datafile object */
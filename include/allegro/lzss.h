@@ -29,6 +29,7 @@ typedef struct LZSS_PACK_DATA LZSS_PACK_DATA;
 typedef struct LZSS_UNPACK_DATA LZSS_UNPACK_DATA;
 
 
+AL_FUNC(int, set_lzss_pack_level, (int level));
 AL_FUNC(LZSS_PACK_DATA *, create_lzss_pack_data, (void));
 AL_FUNC(void, free_lzss_pack_data, (LZSS_PACK_DATA *dat));
 AL_FUNC(int, lzss_write, (PACKFILE *file, LZSS_PACK_DATA *dat, int size, unsigned char *buf, int last));
@@ -117,6 +117,9 @@ AL_FUNC(void, check_cpu, (void));
 #define CPU_SSSE3    0x1000
 #define CPU_SSE41    0x2000
 #define CPU_SSE42    0x4000
+#define CPU_AVX      0x8000
+#define CPU_AVX2     0x10000
+#define CPU_NEON     0x20000
 
 /* CPU families - PC */
 #define CPU_FAMILY_UNKNOWN  0
@@ -387,6 +387,9 @@ static int _install_allegro(int system_id, int *errno_ptr, int (*atexit_ptr)(voi
    /* detect CPU type */
    check_cpu();
 
+   /* pick the vectorized blitters for this CPU */
+   _al_simd_init();
+
 #if defined(ALLEGRO_UNIX) || defined(ALLEGRO_WINDOWS)
    /* detect filename encoding used by libc */
    /* XXX This should be done for all platforms but I'm not set up to check
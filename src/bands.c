@@ -0,0 +1,508 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Multi-threaded drawing onto large memory bitmaps.
+ *
+ *      When enabled with set_drawing_threads(), the clear, blit, masked
+ *      blit, rectfill and translucent sprite entries of the linear
+ *      vtables are replaced by wrappers which cut big operations into
+ *      horizontal bands and hand them to the worker pool. Each band is
+ *      drawn by the original routine, either with adjusted coordinates
+ *      or onto a private copy of the bitmap header whose clipping
+ *      rectangle covers just that band, so the pixel results are the
+ *      same as drawing on a single thread.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* number of threads used for drawing, 1 when disabled */
+int _drawing_threads = 1;
+
+
+
+#ifdef ALLEGRO_WORKER_THREADS
+
+
+/* don't bother splitting anything smaller than this */
+#define BAND_MIN_PIXELS    65536
+#define BAND_MIN_ROWS      16
+
+
+/* the vtable entries we replace, saved for each color depth */
+typedef struct BAND_VTABLE
+{
+   GFX_VTABLE *vtable;
+   AL_METHOD(void, clear_to_color, (BITMAP *bitmap, int color));
+   AL_METHOD(void, blit_to_self, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+   AL_METHOD(void, masked_blit, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+   AL_METHOD(void, rectfill, (BITMAP *bmp, int x1, int y1, int x2, int y2, int color));
+   AL_METHOD(void, draw_trans_sprite, (BITMAP *bmp, BITMAP *sprite, int x, int y));
+   AL_METHOD(void, draw_trans_rgba_sprite, (BITMAP *bmp, BITMAP *sprite, int x, int y));
+} BAND_VTABLE;
+
+
+static GFX_VTABLE *band_vtable_list[] =
+{
+#ifdef ALLEGRO_COLOR8
+   &__linear_vtable8,
+#endif
+#ifdef ALLEGRO_COLOR16
+   &__linear_vtable15,
+   &__linear_vtable16,
+#endif
+#ifdef ALLEGRO_COLOR24
+   &__linear_vtable24,
+#endif
+#ifdef ALLEGRO_COLOR32
+   &__linear_vtable32,
+#endif
+   NULL
+};
+
+
+static BAND_VTABLE band_vtables[sizeof(band_vtable_list) / sizeof(band_vtable_list[0])];
+
+
+static int bands_installed = FALSE;
+
+
+/* operations that can be split up */
+enum { BAND_CLEAR, BAND_BLIT, BAND_MASKED_BLIT, BAND_RECTFILL,
+       BAND_TRANS_SPRITE, BAND_TRANS_RGBA_SPRITE };
+
+
+/* description of one split operation */
+typedef struct BAND_JOB
+{
+   int op;
+   BAND_VTABLE *orig;
+   BITMAP *dst;
+   BITMAP *src;
+   int sx, sy, dx, dy, w, h;
+   int color;
+   int y;         /* first row affected */
+   int rows;      /* number of rows affected */
+   int bands;
+   char *headers; /* a clipped copy of the bitmap header for each band */
+   size_t header_size;
+} BAND_JOB;
+
+
+
+/* find_vtable:
+ *  Returns the saved entries for the vtable of a bitmap, or NULL if it is
+ *  not one of ours.
+ */
+static BAND_VTABLE *find_vtable(BITMAP *bmp)
+{
+   BAND_VTABLE *bv;
+
+   for (bv = band_vtables; bv->vtable; bv++) {
+      if (bv->vtable->color_depth == bmp->vtable->color_depth)
+	 return bv;
+   }
+
+   return NULL;
+}
+
+
+
+/* _drawing_bands:
+ *  Returns how many bands an operation covering w x h pixels of a bitmap
+ *  should be split into, or zero if it should be left alone.
+ */
+int _drawing_bands(BITMAP *dst, int w, int h)
+{
+   int bands;
+
+   if ((!is_memory_bitmap(dst)) || (w <= 0) || (h < BAND_MIN_ROWS * 2))
+      return 0;
+
+   if (w * h < BAND_MIN_PIXELS)
+      return 0;
+
+   bands = MIN(_drawing_threads, h / BAND_MIN_ROWS);
+
+   return (bands > 1) ? bands : 0;
+}
+
+
+
+/* do_band:
+ *  Worker callback drawing a single band of a job.
+ */
+static void do_band(void *data, int band)
+{
+   BAND_JOB *job = (BAND_JOB *)data;
+   BITMAP *bmp;
+   int y1 = job->rows * band / job->bands;
+   int y2 = job->rows * (band + 1) / job->bands;
+
+   switch (job->op) {
+
+      case BAND_BLIT:
+	 job->orig->blit_to_self(job->src, job->dst, job->sx, job->sy + y1,
+				 job->dx, job->dy + y1, job->w, y2 - y1);
+	 return;
+
+      case BAND_MASKED_BLIT:
+	 job->orig->masked_blit(job->src, job->dst, job->sx, job->sy + y1,
+				job->dx, job->dy + y1, job->w, y2 - y1);
+	 return;
+   }
+
+   /* the rest draw onto a copy of the header clipped to the band */
+   bmp = (BITMAP *)(job->headers + job->header_size * band);
+   memcpy(bmp, job->dst, job->header_size);
+
+   /* clear_to_color() uses the clipping rectangle even with clipping off */
+   if ((!bmp->clip) && (job->op != BAND_CLEAR)) {
+      bmp->clip = TRUE;
+      bmp->cl = 0;
+      bmp->cr = bmp->w;
+   }
+
+   bmp->ct = job->y + y1;
+   bmp->cb = job->y + y2;
+
+   switch (job->op) {
+
+      case BAND_CLEAR:
+	 job->orig->clear_to_color(bmp, job->color);
+	 break;
+
+      case BAND_RECTFILL:
+	 job->orig->rectfill(bmp, job->dx, job->dy, job->w, job->h, job->color);
+	 break;
+
+      case BAND_TRANS_SPRITE:
+	 job->orig->draw_trans_sprite(bmp, job->src, job->dx, job->dy);
+	 break;
+
+      case BAND_TRANS_RGBA_SPRITE:
+	 job->orig->draw_trans_rgba_sprite(bmp, job->src, job->dx, job->dy);
+	 break;
+   }
+}
+
+
+
+/* run_bands:
+ *  Splits a job over the worker threads and waits for it to finish.
+ *  Returns FALSE without drawing anything if there is no memory for the
+ *  band headers, in which case the caller draws it on its own.
+ */
+static int run_bands(BAND_JOB *job, int bands)
+{
+   job->bands = bands;
+   job->headers = NULL;
+
+   if ((job->op != BAND_BLIT) && (job->op != BAND_MASKED_BLIT)) {
+      job->header_size = sizeof(BITMAP) + sizeof(char *) * job->dst->h;
+      job->headers = _AL_MALLOC(job->header_size * bands);
+      if (!job->headers)
+	 return FALSE;
+   }
+
+   _al_run_workers(do_band, job, bands);
+
+   if (job->headers)
+      _AL_FREE(job->headers);
+
+   return TRUE;
+}
+
+
+
+/* clip_rows:
+ *  Intersects the rows [y, y+h) with the vertical clipping range of a
+ *  bitmap, storing the result in the job.
+ */
+static void clip_rows(BAND_JOB *job, BITMAP *bmp, int y, int h)
+{
+   int top = (bmp->clip) ? bmp->ct : 0;
+   int bottom = (bmp->clip) ? bmp->cb : bmp->h;
+
+   job->y = MAX(y, top);
+   job->rows = MIN(y + h, bottom) - job->y;
+}
+
+
+
+/* band_clear_to_color:
+ *  Threaded version of the clear_to_color vtable entry.
+ */
+static void band_clear_to_color(BITMAP *bmp, int color)
+{
+   BAND_VTABLE *orig = find_vtable(bmp);
+   BAND_JOB job;
+   int bands;
+
+   job.op = BAND_CLEAR;
+   job.orig = orig;
+   job.dst = bmp;
+   job.color = color;
+   job.y = bmp->ct;
+   job.rows = bmp->cb - bmp->ct;
+
+   bands = _drawing_bands(bmp, bmp->cr - bmp->cl, bmp->cb - bmp->ct);
+   if ((!bands) || (!run_bands(&job, bands)))
+      orig->clear_to_color(bmp, color);
+}
+
+
+
+/* band_blit_to_self:
+ *  Threaded version of the blit_to_self vtable entry. The blit is already
+ *  clipped and known not to overlap, so the bands can go in any order.
+ */
+static void band_blit_to_self(BITMAP *src, BITMAP *dst, int sx, int sy, int dx, int dy, int w, int h)
+{
+   BAND_VTABLE *orig = find_vtable(dst);
+   BAND_JOB job;
+   int bands;
+
+   bands = _drawing_bands(dst, w, h);
+   if ((!bands) || (!is_memory_bitmap(src))) {
+      orig->blit_to_self(src, dst, sx, sy, dx, dy, w, h);
+      return;
+   }
+
+   job.op = BAND_BLIT;
+   job.orig = orig;
+   job.src = src;
+   job.dst = dst;
+   job.sx = sx;
+   job.sy = sy;
+   job.dx = dx;
+   job.dy = dy;
+   job.w = w;
+   job.rows = h;
+
+   run_bands(&job, bands);
+}
+
+
+
+/* band_masked_blit:
+ *  Threaded version of the masked_blit vtable entry.
+ */
+static void band_masked_blit(BITMAP *src, BITMAP *dst, int sx, int sy, int dx, int dy, int w, int h)
+{
+   BAND_VTABLE *orig = find_vtable(dst);
+   BAND_JOB job;
+   int bands;
+
+   bands = _drawing_bands(dst, w, h);
+   if ((!bands) || (!is_memory_bitmap(src)) || (is_same_bitmap(src, dst))) {
+      orig->masked_blit(src, dst, sx, sy, dx, dy, w, h);
+      return;
+   }
+
+   job.op = BAND_MASKED_BLIT;
+   job.orig = orig;
+   job.src = src;
+   job.dst = dst;
+   job.sx = sx;
+   job.sy = sy;
+   job.dx = dx;
+   job.dy = dy;
+   job.w = w;
+   job.rows = h;
+
+   run_bands(&job, bands);
+}
+
+
+
+/* band_rectfill:
+ *  Threaded version of the rectfill vtable entry.
+ */
+static void band_rectfill(BITMAP *bmp, int x1, int y1, int x2, int y2, int color)
+{
+   BAND_VTABLE *orig = find_vtable(bmp);
+   BAND_JOB job;
+   int bands;
+
+   job.op = BAND_RECTFILL;
+   job.orig = orig;
+   job.dst = bmp;
+   job.dx = x1;
+   job.dy = y1;
+   job.w = x2;
+   job.h = y2;
+   job.color = color;
+
+   clip_rows(&job, bmp, MIN(y1, y2), ABS(y2 - y1) + 1);
+
+   bands = _drawing_bands(bmp, ABS(x2 - x1) + 1, job.rows);
+   if ((!bands) || (!run_bands(&job, bands)))
+      orig->rectfill(bmp, x1, y1, x2, y2, color);
+}
+
+
+
+/* band_trans_sprite:
+ *  Helper for the two translucent sprite wrappers.
+ */
+static int band_trans_sprite(int op, BITMAP *bmp, BITMAP *sprite, int x, int y)
+{
+   BAND_JOB job;
+   int bands;
+
+   if ((!is_memory_bitmap(sprite)) || (is_same_bitmap(bmp, sprite)))
+      return FALSE;
+
+   job.op = op;
+   job.orig = find_vtable(bmp);
+   job.dst = bmp;
+   job.src = sprite;
+   job.dx = x;
+   job.dy = y;
+
+   clip_rows(&job, bmp, y, sprite->h);
+
+   bands = _drawing_bands(bmp, sprite->w, job.rows);
+   if (!bands)
+      return FALSE;
+
+   return run_bands(&job, bands);
+}
+
+
+
+/* band_draw_trans_sprite:
+ *  Threaded version of the draw_trans_sprite vtable entry.
+ */
+static void band_draw_trans_sprite(BITMAP *bmp, BITMAP *sprite, int x, int y)
+{
+   if (!band_trans_sprite(BAND_TRANS_SPRITE, bmp, sprite, x, y))
+      find_vtable(bmp)->draw_trans_sprite(bmp, sprite, x, y);
+}
+
+
+
+/* band_draw_trans_rgba_sprite:
+ *  Threaded version of the draw_trans_rgba_sprite vtable entry.
+ */
+static void band_draw_trans_rgba_sprite(BITMAP *bmp, BITMAP *sprite, int x, int y)
+{
+   if (!band_trans_sprite(BAND_TRANS_RGBA_SPRITE, bmp, sprite, x, y))
+      find_vtable(bmp)->draw_trans_rgba_sprite(bmp, sprite, x, y);
+}
+
+
+
+/* install_bands:
+ *  Swaps the wrappers into the linear vtables.
+ */
+static void install_bands(void)
+{
+   BAND_VTABLE *bv;
+   int i;
+
+   for (i = 0; band_vtable_list[i]; i++) {
+      bv = &band_vtables[i];
+      bv->vtable = band_vtable_list[i];
+      bv->clear_to_color = bv->vtable->clear_to_color;
+      bv->blit_to_self = bv->vtable->blit_to_self;
+      bv->masked_blit = bv->vtable->masked_blit;
+      bv->rectfill = bv->vtable->rectfill;
+      bv->draw_trans_sprite = bv->vtable->draw_trans_sprite;
+      bv->draw_trans_rgba_sprite = bv->vtable->draw_trans_rgba_sprite;
+
+      bv->vtable->clear_to_color = band_clear_to_color;
+      bv->vtable->blit_to_self = band_blit_to_self;
+      bv->vtable->masked_blit = band_masked_blit;
+      bv->vtable->rectfill = band_rectfill;
+      bv->vtable->draw_trans_sprite = band_draw_trans_sprite;
+      bv->vtable->draw_trans_rgba_sprite = band_draw_trans_rgba_sprite;
+   }
+
+   bands_installed = TRUE;
+}
+
+
+
+/* remove_bands:
+ *  Puts the original vtable entries back.
+ */
+static void remove_bands(void)
+{
+   BAND_VTABLE *bv;
+
+   for (bv = band_vtables; bv->vtable; bv++) {
+      bv->vtable->clear_to_color = bv->clear_to_color;
+      bv->vtable->blit_to_self = bv->blit_to_self;
+      bv->vtable->masked_blit = bv->masked_blit;
+      bv->vtable->rectfill = bv->rectfill;
+      bv->vtable->draw_trans_sprite = bv->draw_trans_sprite;
+      bv->vtable->draw_trans_rgba_sprite = bv->draw_trans_rgba_sprite;
+   }
+
+   bands_installed = FALSE;
+}
+
+
+
+/* drawing_threads_exit:
+ *  Shuts the drawing threads down when Allegro exits.
+ */
+static void drawing_threads_exit(void)
+{
+   set_drawing_threads(1);
+}
+
+
+#endif /* ALLEGRO_WORKER_THREADS */
+
+
+
+/* set_drawing_threads:
+ *  Sets how many threads are used for drawing onto large memory bitmaps.
+ *  Pass 1 to draw on the calling thread only, or 0 to use one thread per
+ *  processor. Returns the number of threads that will actually be used.
+ */
+int set_drawing_threads(int threads)
+{
+#ifdef ALLEGRO_WORKER_THREADS
+
+   if (threads <= 0)
+      threads = _al_cpu_count();
+
+   _drawing_threads = _al_start_workers(threads);
+
+   if ((_drawing_threads > 1) && (!bands_installed)) {
+      install_bands();
+      _add_exit_func(drawing_threads_exit, "drawing_threads_exit");
+   }
+   else if ((_drawing_threads <= 1) && (bands_installed)) {
+      remove_bands();
+      _remove_exit_func(drawing_threads_exit);
+   }
+
+#else
+
+   (void)threads;
+   _drawing_threads = 1;
+
+#endif
+
+   return _drawing_threads;
+}
+
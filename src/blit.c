@@ -23,6 +23,7 @@
 #include <string.h>
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
+#include "c/csimd.h"
 
 
 
@@ -558,6 +559,114 @@ static void blit_to_or_from_modex(BITMAP *src, BITMAP *dest, int s_x, int s_y, i
 
 
 
+#if (defined ALLEGRO_SIMD) && (defined ALLEGRO_LITTLE_ENDIAN)
+
+/* field_order:
+ *  Returns 0 if red is in the lowest field of the current pixel format
+ *  for this depth, 1 if it is in the highest one, -1 for anything else.
+ */
+static int field_order(int depth)
+{
+   int r, g, b, mid, high;
+
+   switch (depth) {
+
+      case 15:
+	 r = _rgb_r_shift_15; g = _rgb_g_shift_15; b = _rgb_b_shift_15;
+	 mid = 5; high = 10;
+	 break;
+
+      case 16:
+	 r = _rgb_r_shift_16; g = _rgb_g_shift_16; b = _rgb_b_shift_16;
+	 mid = 5; high = 11;
+	 break;
+
+      case 24:
+	 r = _rgb_r_shift_24; g = _rgb_g_shift_24; b = _rgb_b_shift_24;
+	 mid = 8; high = 16;
+	 break;
+
+      case 32:
+	 r = _rgb_r_shift_32; g = _rgb_g_shift_32; b = _rgb_b_shift_32;
+	 mid = 8; high = 16;
+	 break;
+
+      default:
+	 return -1;
+   }
+
+   if (g != mid)
+      return -1;
+
+   if ((r == 0) && (b == high))
+      return 0;
+
+   if ((r == high) && (b == 0))
+      return 1;
+
+   return -1;
+}
+
+
+
+/* simd_blit_between_formats:
+ *  Converts with one of the row converters from src/c/cconv.c, if there
+ *  is one for these depths and the result would be the same as with the
+ *  generic code. Returns FALSE otherwise.
+ */
+static int simd_blit_between_formats(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, int d_y, int w, int h)
+{
+   int src_depth = bitmap_color_depth(src);
+   int dest_depth = bitmap_color_depth(dest);
+   AL_SIMD_CONV_ROW conv = NULL;
+   AL_CONST int *table = NULL;
+   int y;
+
+   if (_color_conv & COLORCONV_KEEP_TRANS)
+      return FALSE;
+
+   if (src_depth == 8) {
+      if (dest_depth == 32) {
+	 conv = _al_simd_conv_8_to_32;
+	 table = _palette_expansion_table(32);
+      }
+   }
+   else {
+      if ((field_order(src_depth) < 0) || (field_order(src_depth) != field_order(dest_depth)))
+	 return FALSE;
+
+      if ((src_depth == 15) && (dest_depth == 32))
+	 conv = _al_simd_conv_15_to_32;
+      else if ((src_depth == 16) && (dest_depth == 32))
+	 conv = _al_simd_conv_16_to_32;
+      else if ((src_depth == 24) && (dest_depth == 32))
+	 conv = _al_simd_conv_24_to_32;
+      else if ((src_depth == 32) && (dest_depth == 24))
+	 conv = _al_simd_conv_32_to_24;
+      else if ((src_depth == 32) && (dest_depth == 16) && (!(_color_conv & COLORCONV_DITHER_HI)))
+	 conv = _al_simd_conv_32_to_16;
+   }
+
+   if (!conv)
+      return FALSE;
+
+   for (y=0; y<h; y++) {
+      uintptr_t s = bmp_read_line(src, s_y+y) + s_x*BYTES_PER_PIXEL(src_depth);
+      uintptr_t d = bmp_write_line(dest, d_y+y) + d_x*BYTES_PER_PIXEL(dest_depth);
+
+      conv((void *)d, (void *)s, w, table);
+   }
+
+   bmp_unwrite_line(src);
+   bmp_unwrite_line(dest);
+
+   return TRUE;
+}
+
+#endif
+
+
+
 /* blit_between_formats:
  *  Blits an (already clipped) region between two bitmaps of different
  *  color depths, doing the appopriate format conversions.
@@ -566,30 +675,35 @@ void _blit_between_formats(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x,
 {
    if ((is_planar_bitmap(src)) || (is_planar_bitmap(dest))) {
       blit_to_or_from_modex(src, dest, s_x, s_y, d_x, d_y, w, h);
+      return;
    }
-   else {
-      switch (bitmap_color_depth(src)) {
 
-	 case 8:
-	    blit_from_256(src, dest, s_x, s_y, d_x, d_y, w, h);
-	    break;
+#if (defined ALLEGRO_SIMD) && (defined ALLEGRO_LITTLE_ENDIAN)
+   if (simd_blit_between_formats(src, dest, s_x, s_y, d_x, d_y, w, h))
+      return;
+#endif
+
+   switch (bitmap_color_depth(src)) {
 
-	 case 15:
-	    blit_from_15(src, dest, s_x, s_y, d_x, d_y, w, h);
-	    break;
+      case 8:
+	 blit_from_256(src, dest, s_x, s_y, d_x, d_y, w, h);
+	 break;
 
-	 case 16:
-	    blit_from_16(src, dest, s_x, s_y, d_x, d_y, w, h);
-	    break;
+      case 15:
+	 blit_from_15(src, dest, s_x, s_y, d_x, d_y, w, h);
+	 break;
 
-	 case 24:
-	    blit_from_24(src, dest, s_x, s_y, d_x, d_y, w, h);
-	    break;
+      case 16:
+	 blit_from_16(src, dest, s_x, s_y, d_x, d_y, w, h);
+	 break;
 
-	 case 32:
-	    blit_from_32(src, dest, s_x, s_y, d_x, d_y, w, h);
-	    break;
-      }
+      case 24:
+	 blit_from_24(src, dest, s_x, s_y, d_x, d_y, w, h);
+	 break;
+
+      case 32:
+	 blit_from_32(src, dest, s_x, s_y, d_x, d_y, w, h);
+	 break;
    }
 }
 
@@ -0,0 +1,710 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SSE2, AVX2 and NEON scanline versions of the common truecolor
+ *      blenders, used by the translucent sprite routines.
+ *
+ *      Every kernel gives exactly the same result as the matching
+ *      function in colblend.c, which is also used for the leftover
+ *      pixels at the end of each row.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+
+#ifdef ALLEGRO_SIMD
+
+AL_SIMD_BLEND_ROW _al_simd_blend_trans15 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_trans16 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_alpha15 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_alpha16 = NULL;
+
+AL_SIMD_BLEND_ROW _al_simd_blend_trans32 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_alpha32 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_add32 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_multiply32 = NULL;
+AL_SIMD_BLEND_ROW _al_simd_blend_screen32 = NULL;
+
+
+/* The blenders take their alpha as an unsigned long, so these mirror
+ * the C arithmetic exactly, including for silly values of n. Only the
+ * low 32 bits are needed, since the kernels only keep bits below that.
+ */
+#define TRANS32_N(n)    ((n) ? (int)((unsigned long)(n) + 1) : 0)
+#define TRANS16_N(n)    ((int)(((unsigned long)(n) + 1) / 8))
+
+/* _blender_add24() scales each channel by n, done in 16 bit lanes */
+#define ADD32_N(n)      ((n) * 0x10001)
+
+/* the bit layouts used by the 15 and 16 bit trans arithmetic */
+#define TRANS15_MASK    0x3E07C1F
+#define TRANS16_MASK    0x7E0F81F
+
+
+
+#ifdef ALLEGRO_SIMD_SSE2
+
+/* mullo32_sse2:
+ *  32 bit multiply keeping the low half, which SSE2 lacks.
+ */
+static INLINE __m128i mullo32_sse2(__m128i a, __m128i b)
+{
+   __m128i even = _mm_mul_epu32(a, b);
+   __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+   return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			     _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+
+#ifdef ALLEGRO_COLOR32
+
+/* trans32_sse2:
+ *  _blender_trans24() on four pixels, with n already incremented.
+ */
+static INLINE __m128i trans32_sse2(__m128i x, __m128i y, __m128i n)
+{
+   __m128i rb = _mm_set1_epi32(0xFF00FF);
+   __m128i gm = _mm_set1_epi32(0xFF00);
+   __m128i res, g, yg;
+
+   res = mullo32_sse2(_mm_sub_epi32(_mm_and_si128(x, rb), _mm_and_si128(y, rb)), n);
+   res = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(res, 8), y), rb);
+
+   yg = _mm_and_si128(y, gm);
+   g = mullo32_sse2(_mm_sub_epi32(_mm_and_si128(x, gm), yg), n);
+   g = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g, 8), yg), gm);
+
+   return _mm_or_si128(res, g);
+}
+
+
+
+/* alpha32_sse2:
+ *  _blender_alpha32(), taking n from the source alpha.
+ */
+static INLINE __m128i alpha32_sse2(__m128i x, __m128i y, __m128i n)
+{
+   __m128i a = _mm_srli_epi32(x, 24);
+
+   n = _mm_andnot_si128(_mm_cmpeq_epi32(a, _mm_setzero_si128()), _mm_set1_epi32(1));
+
+   return trans32_sse2(x, y, _mm_add_epi32(a, n));
+}
+
+
+
+/* add32_sse2:
+ *  _blender_add24(), the saturating pack does the clamp to 255.
+ */
+static INLINE __m128i add32_sse2(__m128i x, __m128i y, __m128i n)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i lo, hi;
+
+   lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), n), 8);
+   hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), n), 8);
+   lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(y, zero));
+   hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(y, zero));
+
+   return _mm_and_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFFFFFF));
+}
+
+
+
+/* mul8_sse2:
+ *  Per byte x * y / 256.
+ */
+static INLINE __m128i mul8_sse2(__m128i x, __m128i y)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i lo, hi;
+
+   lo = _mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+   hi = _mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+
+   return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+
+
+/* multiply32_sse2:
+ *  _blender_multiply24().
+ */
+static INLINE __m128i multiply32_sse2(__m128i x, __m128i y, __m128i n)
+{
+   return trans32_sse2(mul8_sse2(x, y), y, n);
+}
+
+
+
+/* screen32_sse2:
+ *  _blender_screen24(), 255 - c is the same as flipping all the bits.
+ */
+static INLINE __m128i screen32_sse2(__m128i x, __m128i y, __m128i n)
+{
+   __m128i ones = _mm_set1_epi32(-1);
+   __m128i s = mul8_sse2(_mm_xor_si128(x, ones), _mm_xor_si128(y, ones));
+
+   return trans32_sse2(_mm_xor_si128(s, ones), y, n);
+}
+
+
+
+/* SSE2_BLEND_ROW32:
+ *  Generates a 32 bit row kernel from one of the above, skipping groups
+ *  of four masked pixels altogether.
+ */
+#define SSE2_BLEND_ROW32(name, blend, vn, tail)                               \
+static void name(void *dst, AL_CONST void *src, int w, int n, int mask)      \
+{                                                                             \
+   uint32_t *d = dst;                                                         \
+   AL_CONST uint32_t *s = src;                                                \
+   __m128i m = _mm_set1_epi32(mask);                                          \
+   __m128i nv = _mm_set1_epi32(vn);                                           \
+									      \
+   for (; w >= 4; w -= 4, s += 4, d += 4) {                                   \
+      __m128i x = _mm_loadu_si128((AL_CONST __m128i *)s);                     \
+      __m128i t = _mm_cmpeq_epi32(x, m);                                      \
+      __m128i y;                                                              \
+									      \
+      if (_mm_movemask_epi8(t) == 0xFFFF)                                     \
+	 continue;                                                            \
+									      \
+      y = _mm_loadu_si128((__m128i *)d);                                      \
+      x = blend(x, y, nv);                                                    \
+      x = _mm_or_si128(_mm_and_si128(t, y), _mm_andnot_si128(t, x));          \
+      _mm_storeu_si128((__m128i *)d, x);                                      \
+   }                                                                          \
+									      \
+   for (; w > 0; w--, s++, d++) {                                             \
+      if (*s != (uint32_t)mask)                                               \
+	 *d = tail(*s, *d, n);                                                \
+   }                                                                          \
+}
+
+SSE2_BLEND_ROW32(trans_row32_sse2, trans32_sse2, TRANS32_N(n), _blender_trans24)
+SSE2_BLEND_ROW32(alpha_row32_sse2, alpha32_sse2, 0, _blender_alpha32)
+SSE2_BLEND_ROW32(add_row32_sse2, add32_sse2, ADD32_N(n), _blender_add24)
+SSE2_BLEND_ROW32(multiply_row32_sse2, multiply32_sse2, TRANS32_N(n), _blender_multiply24)
+SSE2_BLEND_ROW32(screen_row32_sse2, screen32_sse2, TRANS32_N(n), _blender_screen24)
+
+#endif /* ALLEGRO_COLOR32 */
+
+
+
+#ifdef ALLEGRO_COLOR16
+
+/* trans16_sse2:
+ *  The 15 and 16 bit trans arithmetic on four pixels held in 32 bit
+ *  lanes. The result is sign extended, ready for _mm_packs_epi32().
+ */
+static INLINE __m128i trans16_sse2(__m128i x, __m128i y, __m128i n, __m128i cmask)
+{
+   x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 16)), cmask);
+   y = _mm_and_si128(_mm_or_si128(y, _mm_slli_epi32(y, 16)), cmask);
+
+   x = mullo32_sse2(_mm_sub_epi32(x, y), n);
+   x = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(x, 5), y), cmask);
+   x = _mm_or_si128(x, _mm_srli_epi32(x, 16));
+
+   return _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+}
+
+
+
+/* rgba_to_16_sse2, rgba_to_15_sse2:
+ *  The pixel conversions done by _blender_alpha16_rgb() and
+ *  _blender_alpha15_rgb().
+ */
+static INLINE __m128i rgba_to_16_sse2(__m128i x)
+{
+   return _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 3), _mm_set1_epi32(0x001F)),
+				    _mm_and_si128(_mm_srli_epi32(x, 5), _mm_set1_epi32(0x07E0))),
+		       _mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0xF800)));
+}
+
+static INLINE __m128i rgba_to_15_sse2(__m128i x)
+{
+   return _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 3), _mm_set1_epi32(0x001F)),
+				    _mm_and_si128(_mm_srli_epi32(x, 6), _mm_set1_epi32(0x03E0))),
+		       _mm_and_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0xEC00)));
+}
+
+
+
+/* SSE2_TRANS_ROW16:
+ *  Row kernel for _blender_trans15() and _blender_trans16().
+ */
+#define SSE2_TRANS_ROW16(name, cmask, tail)                                   \
+static void name(void *dst, AL_CONST void *src, int w, int n, int mask)      \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   AL_CONST uint16_t *s = src;                                                \
+   __m128i m = _mm_set1_epi16((short)mask);                                   \
+   __m128i nv = _mm_set1_epi32(TRANS16_N(n));                                 \
+   __m128i c = _mm_set1_epi32(cmask);                                         \
+   __m128i zero = _mm_setzero_si128();                                        \
+									      \
+   for (; w >= 8; w -= 8, s += 8, d += 8) {                                   \
+      __m128i x = _mm_loadu_si128((AL_CONST __m128i *)s);                     \
+      __m128i t = _mm_cmpeq_epi16(x, m);                                      \
+      __m128i y, lo, hi;                                                      \
+									      \
+      if (_mm_movemask_epi8(t) == 0xFFFF)                                     \
+	 continue;                                                            \
+									      \
+      y = _mm_loadu_si128((__m128i *)d);                                      \
+      lo = trans16_sse2(_mm_unpacklo_epi16(x, zero), _mm_unpacklo_epi16(y, zero), nv, c); \
+      hi = trans16_sse2(_mm_unpackhi_epi16(x, zero), _mm_unpackhi_epi16(y, zero), nv, c); \
+      x = _mm_packs_epi32(lo, hi);                                            \
+      x = _mm_or_si128(_mm_and_si128(t, y), _mm_andnot_si128(t, x));          \
+      _mm_storeu_si128((__m128i *)d, x);                                      \
+   }                                                                          \
+									      \
+   for (; w > 0; w--, s++, d++) {                                             \
+      if (*s != (uint16_t)mask)                                               \
+	 *d = tail(*s, *d, n);                                                \
+   }                                                                          \
+}
+
+SSE2_TRANS_ROW16(trans_row15_sse2, TRANS15_MASK, _blender_trans15)
+SSE2_TRANS_ROW16(trans_row16_sse2, TRANS16_MASK, _blender_trans16)
+
+
+
+/* SSE2_ALPHA_ROW16:
+ *  Row kernel for drawing 32 bit RGBA sprites onto 15 and 16 bit
+ *  pixels, four at a time.
+ */
+#define SSE2_ALPHA_ROW16(name, convert, cmask, tail)                          \
+static void name(void *dst, AL_CONST void *src, int w, int n, int mask)      \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   AL_CONST uint32_t *s = src;                                                \
+   __m128i m = _mm_set1_epi32(mask);                                          \
+   __m128i c = _mm_set1_epi32(cmask);                                         \
+   __m128i one = _mm_set1_epi32(1);                                           \
+   __m128i zero = _mm_setzero_si128();                                        \
+									      \
+   for (; w >= 4; w -= 4, s += 4, d += 4) {                                   \
+      __m128i x = _mm_loadu_si128((AL_CONST __m128i *)s);                     \
+      __m128i t = _mm_cmpeq_epi32(x, m);                                      \
+      __m128i y, a;                                                           \
+									      \
+      if (_mm_movemask_epi8(t) == 0xFFFF)                                     \
+	 continue;                                                            \
+									      \
+      y = _mm_loadl_epi64((AL_CONST __m128i *)d);                             \
+      a = _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(x, 24), one), 3);       \
+      x = trans16_sse2(convert(x), _mm_unpacklo_epi16(y, zero), a, c);        \
+      x = _mm_packs_epi32(x, x);                                              \
+      t = _mm_packs_epi32(t, t);                                              \
+      x = _mm_or_si128(_mm_and_si128(t, y), _mm_andnot_si128(t, x));          \
+      _mm_storel_epi64((__m128i *)d, x);                                      \
+   }                                                                          \
+									      \
+   for (; w > 0; w--, s++, d++) {                                             \
+      if (*s != (uint32_t)mask)                                               \
+	 *d = tail(*s, *d, n);                                                \
+   }                                                                          \
+}
+
+SSE2_ALPHA_ROW16(alpha_row15_sse2, rgba_to_15_sse2, TRANS15_MASK, _blender_alpha15_rgb)
+SSE2_ALPHA_ROW16(alpha_row16_sse2, rgba_to_16_sse2, TRANS16_MASK, _blender_alpha16_rgb)
+
+#endif /* ALLEGRO_COLOR16 */
+
+#endif /* ALLEGRO_SIMD_SSE2 */
+
+
+
+#if (defined ALLEGRO_SIMD_AVX2) && (defined ALLEGRO_COLOR32)
+
+/* The AVX2 versions only cover 32 bit destinations, where eight pixels
+ * fit a register and AVX2 has a real 32 bit multiply.
+ */
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i trans32_avx2(__m256i x, __m256i y, __m256i n)
+{
+   __m256i rb = _mm256_set1_epi32(0xFF00FF);
+   __m256i gm = _mm256_set1_epi32(0xFF00);
+   __m256i res, g, yg;
+
+   res = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_and_si256(x, rb), _mm256_and_si256(y, rb)), n);
+   res = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(res, 8), y), rb);
+
+   yg = _mm256_and_si256(y, gm);
+   g = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_and_si256(x, gm), yg), n);
+   g = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g, 8), yg), gm);
+
+   return _mm256_or_si256(res, g);
+}
+
+
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i alpha32_avx2(__m256i x, __m256i y, __m256i n)
+{
+   __m256i a = _mm256_srli_epi32(x, 24);
+
+   n = _mm256_andnot_si256(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()), _mm256_set1_epi32(1));
+
+   return trans32_avx2(x, y, _mm256_add_epi32(a, n));
+}
+
+
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i add32_avx2(__m256i x, __m256i y, __m256i n)
+{
+   __m256i zero = _mm256_setzero_si256();
+   __m256i lo, hi;
+
+   lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), n), 8);
+   hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), n), 8);
+   lo = _mm256_add_epi16(lo, _mm256_unpacklo_epi8(y, zero));
+   hi = _mm256_add_epi16(hi, _mm256_unpackhi_epi8(y, zero));
+
+   return _mm256_and_si256(_mm256_packus_epi16(lo, hi), _mm256_set1_epi32(0xFFFFFF));
+}
+
+
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i mul8_avx2(__m256i x, __m256i y)
+{
+   __m256i zero = _mm256_setzero_si256();
+   __m256i lo, hi;
+
+   lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), _mm256_unpacklo_epi8(y, zero));
+   hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), _mm256_unpackhi_epi8(y, zero));
+
+   return _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i multiply32_avx2(__m256i x, __m256i y, __m256i n)
+{
+   return trans32_avx2(mul8_avx2(x, y), y, n);
+}
+
+
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i screen32_avx2(__m256i x, __m256i y, __m256i n)
+{
+   __m256i ones = _mm256_set1_epi32(-1);
+   __m256i s = mul8_avx2(_mm256_xor_si256(x, ones), _mm256_xor_si256(y, ones));
+
+   return trans32_avx2(_mm256_xor_si256(s, ones), y, n);
+}
+
+
+
+/* AVX2_BLEND_ROW32:
+ *  Same as SSE2_BLEND_ROW32 with twice the width, the remainder goes
+ *  through the SSE2 version.
+ */
+#define AVX2_BLEND_ROW32(name, blend, vn, sse2_version)                       \
+AL_SIMD_AVX2_FUNC static void name(void *dst, AL_CONST void *src, int w, int n, int mask) \
+{                                                                             \
+   uint32_t *d = dst;                                                         \
+   AL_CONST uint32_t *s = src;                                                \
+   __m256i m = _mm256_set1_epi32(mask);                                       \
+   __m256i nv = _mm256_set1_epi32(vn);                                        \
+									      \
+   for (; w >= 8; w -= 8, s += 8, d += 8) {                                   \
+      __m256i x = _mm256_loadu_si256((AL_CONST __m256i *)s);                  \
+      __m256i t = _mm256_cmpeq_epi32(x, m);                                   \
+      __m256i y;                                                              \
+									      \
+      if (_mm256_movemask_epi8(t) == -1)                                      \
+	 continue;                                                            \
+									      \
+      y = _mm256_loadu_si256((__m256i *)d);                                   \
+      x = blend(x, y, nv);                                                    \
+      _mm256_storeu_si256((__m256i *)d, _mm256_blendv_epi8(x, y, t));         \
+   }                                                                          \
+									      \
+   sse2_version(d, s, w, n, mask);                                            \
+}
+
+AVX2_BLEND_ROW32(trans_row32_avx2, trans32_avx2, TRANS32_N(n), trans_row32_sse2)
+AVX2_BLEND_ROW32(alpha_row32_avx2, alpha32_avx2, 0, alpha_row32_sse2)
+AVX2_BLEND_ROW32(add_row32_avx2, add32_avx2, ADD32_N(n), add_row32_sse2)
+AVX2_BLEND_ROW32(multiply_row32_avx2, multiply32_avx2, TRANS32_N(n), multiply_row32_sse2)
+AVX2_BLEND_ROW32(screen_row32_avx2, screen32_avx2, TRANS32_N(n), screen_row32_sse2)
+
+#endif /* ALLEGRO_SIMD_AVX2 && ALLEGRO_COLOR32 */
+
+
+
+#ifdef ALLEGRO_SIMD_NEON
+
+#ifdef ALLEGRO_COLOR32
+
+static INLINE uint32x4_t trans32_neon(uint32x4_t x, uint32x4_t y, uint32x4_t n)
+{
+   uint32x4_t rb = vdupq_n_u32(0xFF00FF);
+   uint32x4_t gm = vdupq_n_u32(0xFF00);
+   uint32x4_t res, g, yg;
+
+   res = vmulq_u32(vsubq_u32(vandq_u32(x, rb), vandq_u32(y, rb)), n);
+   res = vandq_u32(vaddq_u32(vshrq_n_u32(res, 8), y), rb);
+
+   yg = vandq_u32(y, gm);
+   g = vmulq_u32(vsubq_u32(vandq_u32(x, gm), yg), n);
+   g = vandq_u32(vaddq_u32(vshrq_n_u32(g, 8), yg), gm);
+
+   return vorrq_u32(res, g);
+}
+
+
+
+static INLINE uint32x4_t alpha32_neon(uint32x4_t x, uint32x4_t y, uint32x4_t n)
+{
+   uint32x4_t a = vshrq_n_u32(x, 24);
+
+   n = vandq_u32(vtstq_u32(a, a), vdupq_n_u32(1));
+
+   return trans32_neon(x, y, vaddq_u32(a, n));
+}
+
+
+
+static INLINE uint32x4_t add32_neon(uint32x4_t x, uint32x4_t y, uint32x4_t n)
+{
+   uint8x16_t xb = vreinterpretq_u8_u32(x);
+   uint8x16_t yb = vreinterpretq_u8_u32(y);
+   uint16x8_t n16 = vreinterpretq_u16_u32(n);
+   uint16x8_t lo, hi;
+
+   lo = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(xb)), n16), 8);
+   hi = vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(xb)), n16), 8);
+   lo = vaddq_u16(lo, vmovl_u8(vget_low_u8(yb)));
+   hi = vaddq_u16(hi, vmovl_u8(vget_high_u8(yb)));
+
+   return vandq_u32(vreinterpretq_u32_u8(vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi))),
+		    vdupq_n_u32(0xFFFFFF));
+}
+
+
+
+static INLINE uint32x4_t mul8_neon(uint8x16_t x, uint8x16_t y)
+{
+   uint8x8_t lo = vshrn_n_u16(vmull_u8(vget_low_u8(x), vget_low_u8(y)), 8);
+   uint8x8_t hi = vshrn_n_u16(vmull_u8(vget_high_u8(x), vget_high_u8(y)), 8);
+
+   return vreinterpretq_u32_u8(vcombine_u8(lo, hi));
+}
+
+
+
+static INLINE uint32x4_t multiply32_neon(uint32x4_t x, uint32x4_t y, uint32x4_t n)
+{
+   return trans32_neon(mul8_neon(vreinterpretq_u8_u32(x), vreinterpretq_u8_u32(y)), y, n);
+}
+
+
+
+static INLINE uint32x4_t screen32_neon(uint32x4_t x, uint32x4_t y, uint32x4_t n)
+{
+   uint32x4_t s = mul8_neon(vmvnq_u8(vreinterpretq_u8_u32(x)),
+			    vmvnq_u8(vreinterpretq_u8_u32(y)));
+
+   return trans32_neon(vmvnq_u32(s), y, n);
+}
+
+
+
+#define NEON_BLEND_ROW32(name, blend, vn, tail)                               \
+static void name(void *dst, AL_CONST void *src, int w, int n, int mask)      \
+{                                                                             \
+   uint32_t *d = dst;                                                         \
+   AL_CONST uint32_t *s = src;                                                \
+   uint32x4_t m = vdupq_n_u32(mask);                                          \
+   uint32x4_t nv = vdupq_n_u32(vn);                                           \
+									      \
+   for (; w >= 4; w -= 4, s += 4, d += 4) {                                   \
+      uint32x4_t x = vld1q_u32(s);                                            \
+      uint32x4_t y = vld1q_u32(d);                                            \
+      vst1q_u32(d, vbslq_u32(vceqq_u32(x, m), y, blend(x, y, nv)));          \
+   }                                                                          \
+									      \
+   for (; w > 0; w--, s++, d++) {                                             \
+      if (*s != (uint32_t)mask)                                               \
+	 *d = tail(*s, *d, n);                                                \
+   }                                                                          \
+}
+
+NEON_BLEND_ROW32(trans_row32_neon, trans32_neon, TRANS32_N(n), _blender_trans24)
+NEON_BLEND_ROW32(alpha_row32_neon, alpha32_neon, 0, _blender_alpha32)
+NEON_BLEND_ROW32(add_row32_neon, add32_neon, ADD32_N(n), _blender_add24)
+NEON_BLEND_ROW32(multiply_row32_neon, multiply32_neon, TRANS32_N(n), _blender_multiply24)
+NEON_BLEND_ROW32(screen_row32_neon, screen32_neon, TRANS32_N(n), _blender_screen24)
+
+#endif /* ALLEGRO_COLOR32 */
+
+
+
+#ifdef ALLEGRO_COLOR16
+
+static INLINE uint32x4_t trans16_neon(uint32x4_t x, uint32x4_t y, uint32x4_t n, uint32x4_t cmask)
+{
+   x = vandq_u32(vorrq_u32(x, vshlq_n_u32(x, 16)), cmask);
+   y = vandq_u32(vorrq_u32(y, vshlq_n_u32(y, 16)), cmask);
+
+   x = vmulq_u32(vsubq_u32(x, y), n);
+   x = vandq_u32(vaddq_u32(vshrq_n_u32(x, 5), y), cmask);
+
+   return vorrq_u32(x, vshrq_n_u32(x, 16));
+}
+
+
+
+static INLINE uint32x4_t rgba_to_16_neon(uint32x4_t x)
+{
+   return vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(x, 3), vdupq_n_u32(0x001F)),
+			      vandq_u32(vshrq_n_u32(x, 5), vdupq_n_u32(0x07E0))),
+		    vandq_u32(vshrq_n_u32(x, 8), vdupq_n_u32(0xF800)));
+}
+
+static INLINE uint32x4_t rgba_to_15_neon(uint32x4_t x)
+{
+   return vorrq_u32(vorrq_u32(vandq_u32(vshrq_n_u32(x, 3), vdupq_n_u32(0x001F)),
+			      vandq_u32(vshrq_n_u32(x, 6), vdupq_n_u32(0x03E0))),
+		    vandq_u32(vshrq_n_u32(x, 9), vdupq_n_u32(0xEC00)));
+}
+
+
+
+#define NEON_TRANS_ROW16(name, cmask, tail)                                   \
+static void name(void *dst, AL_CONST void *src, int w, int n, int mask)      \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   AL_CONST uint16_t *s = src;                                                \
+   uint16x8_t m = vdupq_n_u16((uint16_t)mask);                                \
+   uint32x4_t nv = vdupq_n_u32(TRANS16_N(n));                                 \
+   uint32x4_t c = vdupq_n_u32(cmask);                                         \
+									      \
+   for (; w >= 8; w -= 8, s += 8, d += 8) {                                   \
+      uint16x8_t x = vld1q_u16(s);                                            \
+      uint16x8_t y = vld1q_u16(d);                                            \
+      uint32x4_t lo, hi;                                                      \
+									      \
+      lo = trans16_neon(vmovl_u16(vget_low_u16(x)), vmovl_u16(vget_low_u16(y)), nv, c); \
+      hi = trans16_neon(vmovl_u16(vget_high_u16(x)), vmovl_u16(vget_high_u16(y)), nv, c); \
+      vst1q_u16(d, vbslq_u16(vceqq_u16(x, m), y,                             \
+			     vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));    \
+   }                                                                          \
+									      \
+   for (; w > 0; w--, s++, d++) {                                             \
+      if (*s != (uint16_t)mask)                                               \
+	 *d = tail(*s, *d, n);                                                \
+   }                                                                          \
+}
+
+NEON_TRANS_ROW16(trans_row15_neon, TRANS15_MASK, _blender_trans15)
+NEON_TRANS_ROW16(trans_row16_neon, TRANS16_MASK, _blender_trans16)
+
+
+
+#define NEON_ALPHA_ROW16(name, convert, cmask, tail)                          \
+static void name(void *dst, AL_CONST void *src, int w, int n, int mask)      \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   AL_CONST uint32_t *s = src;                                                \
+   uint32x4_t m = vdupq_n_u32(mask);                                          \
+   uint32x4_t c = vdupq_n_u32(cmask);                                         \
+   uint32x4_t one = vdupq_n_u32(1);                                           \
+									      \
+   for (; w >= 4; w -= 4, s += 4, d += 4) {                                   \
+      uint32x4_t x = vld1q_u32(s);                                            \
+      uint16x4_t y = vld1_u16(d);                                             \
+      uint32x4_t a = vshrq_n_u32(vaddq_u32(vshrq_n_u32(x, 24), one), 3);      \
+      uint16x4_t r = vmovn_u32(trans16_neon(convert(x), vmovl_u16(y), a, c)); \
+      vst1_u16(d, vbsl_u16(vmovn_u32(vceqq_u32(x, m)), y, r));               \
+   }                                                                          \
+									      \
+   for (; w > 0; w--, s++, d++) {                                             \
+      if (*s != (uint32_t)mask)                                               \
+	 *d = tail(*s, *d, n);                                                \
+   }                                                                          \
+}
+
+NEON_ALPHA_ROW16(alpha_row15_neon, rgba_to_15_neon, TRANS15_MASK, _blender_alpha15_rgb)
+NEON_ALPHA_ROW16(alpha_row16_neon, rgba_to_16_neon, TRANS16_MASK, _blender_alpha16_rgb)
+
+#endif /* ALLEGRO_COLOR16 */
+
+#endif /* ALLEGRO_SIMD_NEON */
+
+
+
+/* _al_simd_init_blenders:
+ *  Selects the scanline blenders for the CPU found by check_cpu(). The
+ *  caller must then run _update_blender_rows() so the current blender
+ *  mode picks them up.
+ */
+void _al_simd_init_blenders(void)
+{
+#ifdef ALLEGRO_SIMD_SSE2
+#ifdef ALLEGRO_COLOR16
+   _al_simd_blend_trans15 = trans_row15_sse2;
+   _al_simd_blend_trans16 = trans_row16_sse2;
+   _al_simd_blend_alpha15 = alpha_row15_sse2;
+   _al_simd_blend_alpha16 = alpha_row16_sse2;
+#endif
+
+#ifdef ALLEGRO_COLOR32
+   _al_simd_blend_trans32 = trans_row32_sse2;
+   _al_simd_blend_alpha32 = alpha_row32_sse2;
+   _al_simd_blend_add32 = add_row32_sse2;
+   _al_simd_blend_multiply32 = multiply_row32_sse2;
+   _al_simd_blend_screen32 = screen_row32_sse2;
+
+#ifdef ALLEGRO_SIMD_AVX2
+   if (cpu_capabilities & CPU_AVX2) {
+      _al_simd_blend_trans32 = trans_row32_avx2;
+      _al_simd_blend_alpha32 = alpha_row32_avx2;
+      _al_simd_blend_add32 = add_row32_avx2;
+      _al_simd_blend_multiply32 = multiply_row32_avx2;
+      _al_simd_blend_screen32 = screen_row32_avx2;
+   }
+#endif
+#endif
+#endif
+
+#ifdef ALLEGRO_SIMD_NEON
+   if (cpu_capabilities & CPU_NEON) {
+#ifdef ALLEGRO_COLOR16
+      _al_simd_blend_trans15 = trans_row15_neon;
+      _al_simd_blend_trans16 = trans_row16_neon;
+      _al_simd_blend_alpha15 = alpha_row15_neon;
+      _al_simd_blend_alpha16 = alpha_row16_neon;
+#endif
+
+#ifdef ALLEGRO_COLOR32
+      _al_simd_blend_trans32 = trans_row32_neon;
+      _al_simd_blend_alpha32 = alpha_row32_neon;
+      _al_simd_blend_add32 = add_row32_neon;
+      _al_simd_blend_multiply32 = multiply_row32_neon;
+      _al_simd_blend_screen32 = screen_row32_neon;
+#endif
+   }
+#endif
+}
+
+#endif /* ALLEGRO_SIMD */
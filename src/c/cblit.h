@@ -180,5 +180,84 @@ void FUNC_LINEAR_MASKED_BLIT(BITMAP *src, BITMAP *dst, int sx, int sy,
    bmp_unwrite_line(dst);
 }
 
+
+
+#ifdef ALLEGRO_SIMD
+
+/* _linear_clear_to_color_simd:
+ *  Version of _linear_clear_to_color using the SIMD row kernels.
+ */
+void FUNC_LINEAR_CLEAR_TO_COLOR_SIMD(BITMAP *dst, int color)
+{
+   int y;
+   int w;
+
+   ASSERT(dst);
+
+   w = dst->cr - dst->cl;
+   if (w <= 0)
+      return;
+
+   for (y = dst->ct; y < dst->cb; y++) {
+      PIXEL_PTR d = OFFSET_PIXEL_PTR(bmp_write_line(dst, y), dst->cl);
+      SIMD_FILL_ROW(d, w, color);
+   }
+
+   bmp_unwrite_line(dst);
+}
+
+
+
+/* _linear_blit_simd:
+ *  Version of _linear_blit using the SIMD row kernels.
+ */
+void FUNC_LINEAR_BLIT_SIMD(BITMAP *src, BITMAP *dst, int sx, int sy,
+			   int dx, int dy, int w, int h)
+{
+   int y;
+
+   ASSERT(src);
+   ASSERT(dst);
+
+   for (y = 0; y < h; y++) {
+      PIXEL_PTR s = OFFSET_PIXEL_PTR(bmp_read_line(src, sy + y), sx);
+      PIXEL_PTR d = OFFSET_PIXEL_PTR(bmp_write_line(dst, dy + y), dx);
+
+      _al_simd_copy_row(d, s, w * sizeof(*s) * PTR_PER_PIXEL);
+   }
+
+   bmp_unwrite_line(src);
+   bmp_unwrite_line(dst);
+}
+
+
+
+/* _linear_masked_blit_simd:
+ *  Version of _linear_masked_blit using the SIMD row kernels.
+ */
+void FUNC_LINEAR_MASKED_BLIT_SIMD(BITMAP *src, BITMAP *dst, int sx, int sy,
+				  int dx, int dy, int w, int h)
+{
+   int y;
+   int mask_color;
+
+   ASSERT(src);
+   ASSERT(dst);
+
+   mask_color = bitmap_mask_color(dst);
+
+   for (y = 0; y < h; y++) {
+      PIXEL_PTR s = OFFSET_PIXEL_PTR(bmp_read_line(src, sy + y), sx);
+      PIXEL_PTR d = OFFSET_PIXEL_PTR(bmp_write_line(dst, dy + y), dx);
+
+      SIMD_MASKED_ROW(d, s, w, mask_color);
+   }
+
+   bmp_unwrite_line(src);
+   bmp_unwrite_line(dst);
+}
+
+#endif /* ALLEGRO_SIMD */
+
 #endif /* !__bma_cblit_h */
 
@@ -21,6 +21,7 @@
 #ifdef ALLEGRO_COLOR16
 
 #include "cdefs16.h"
+#include "csimd.h"
 #include "cblit.h"
 
 #endif
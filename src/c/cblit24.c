@@ -21,6 +21,7 @@
 #ifdef ALLEGRO_COLOR24
 
 #include "cdefs24.h"
+#include "csimd.h"
 #include "cblit.h"
 
 #endif
@@ -21,6 +21,7 @@
 #ifdef ALLEGRO_COLOR32
 
 #include "cdefs32.h"
+#include "csimd.h"
 #include "cblit.h"
 
 #endif
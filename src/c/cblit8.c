@@ -21,6 +21,7 @@
 #ifdef ALLEGRO_COLOR8
 
 #include "cdefs8.h"
+#include "csimd.h"
 #include "cblit.h"
 
 #endif
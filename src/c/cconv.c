@@ -0,0 +1,599 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SSE2, AVX2 and NEON row converters between pixel formats, used
+ *      by blit() between memory bitmaps of different depths and by the
+ *      color conversion blitters of the windowed drivers.
+ *
+ *      The converters work on field positions, not on channel names:
+ *      the lowest field of the source goes to the lowest byte of the
+ *      destination and so on. 5 and 6 bit fields are scaled up exactly
+ *      like the _rgb_scale_5[] and _rgb_scale_6[] tables do.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+extern int *_colorconv_indexed_palette;    /* for conversion from 8-bit */
+
+
+#if (defined ALLEGRO_SIMD) && (defined ALLEGRO_LITTLE_ENDIAN)
+
+AL_SIMD_CONV_ROW _al_simd_conv_8_to_32 = NULL;
+AL_SIMD_CONV_ROW _al_simd_conv_15_to_32 = NULL;
+AL_SIMD_CONV_ROW _al_simd_conv_16_to_32 = NULL;
+AL_SIMD_CONV_ROW _al_simd_conv_32_to_16 = NULL;
+AL_SIMD_CONV_ROW _al_simd_conv_24_to_32 = NULL;
+AL_SIMD_CONV_ROW _al_simd_conv_32_to_24 = NULL;
+
+
+
+/* conv_tail_*:
+ *  Plain C versions for the pixels that do not fill a whole vector.
+ */
+static void conv_tail_8_to_32(uint32_t *d, AL_CONST unsigned char *s, int w, AL_CONST int *table)
+{
+   for (; w > 0; w--)
+      *d++ = table[*s++];
+}
+
+static void conv_tail_15_to_32(uint32_t *d, AL_CONST uint16_t *s, int w)
+{
+   for (; w > 0; w--) {
+      int c = *s++;
+      *d++ = _rgb_scale_5[c & 0x1F] | (_rgb_scale_5[(c >> 5) & 0x1F] << 8) |
+	     (_rgb_scale_5[(c >> 10) & 0x1F] << 16);
+   }
+}
+
+static void conv_tail_16_to_32(uint32_t *d, AL_CONST uint16_t *s, int w)
+{
+   for (; w > 0; w--) {
+      int c = *s++;
+      *d++ = _rgb_scale_5[c & 0x1F] | (_rgb_scale_6[(c >> 5) & 0x3F] << 8) |
+	     (_rgb_scale_5[(c >> 11) & 0x1F] << 16);
+   }
+}
+
+static void conv_tail_32_to_16(uint16_t *d, AL_CONST uint32_t *s, int w)
+{
+   for (; w > 0; w--) {
+      uint32_t c = *s++;
+      *d++ = ((c >> 3) & 0x001F) | ((c >> 5) & 0x07E0) | ((c >> 8) & 0xF800);
+   }
+}
+
+static void conv_tail_24_to_32(uint32_t *d, AL_CONST unsigned char *s, int w)
+{
+   for (; w > 0; w--, s += 3)
+      *d++ = READ3BYTES(s);
+}
+
+static void conv_tail_32_to_24(unsigned char *d, AL_CONST uint32_t *s, int w)
+{
+   for (; w > 0; w--, s++, d += 3)
+      WRITE3BYTES(d, *s);
+}
+
+
+
+#ifdef ALLEGRO_SIMD_SSE2
+
+/* SSE2_HICOLOR_TO_32:
+ *  Expands 8 pixels per vector. The three fields are scaled up in 16 bit
+ *  lanes, the middle one by gup/gdown, and interleaved into 32 bits.
+ */
+#define SSE2_HICOLOR_TO_32(name, gmask, gup, gdown, hshift, tail)             \
+static void name(void *dst, AL_CONST void *src, int w, AL_CONST int *table)   \
+{                                                                             \
+   uint32_t *d = dst;                                                         \
+   AL_CONST uint16_t *s = src;                                                \
+   __m128i m5 = _mm_set1_epi16(0x1F);                                         \
+   __m128i mg = _mm_set1_epi16(gmask);                                        \
+   (void)table;                                                               \
+									      \
+   for (; w >= 8; w -= 8, s += 8, d += 8) {                                   \
+      __m128i c = _mm_loadu_si128((__m128i *)s);                              \
+      __m128i f0 = _mm_and_si128(c, m5);                                      \
+      __m128i f1 = _mm_and_si128(_mm_srli_epi16(c, 5), mg);                   \
+      __m128i f2 = _mm_and_si128(_mm_srli_epi16(c, hshift), m5);              \
+      __m128i lo;                                                             \
+									      \
+      f0 = _mm_or_si128(_mm_slli_epi16(f0, 3), _mm_srli_epi16(f0, 2));        \
+      f1 = _mm_or_si128(_mm_slli_epi16(f1, gup), _mm_srli_epi16(f1, gdown));  \
+      f2 = _mm_or_si128(_mm_slli_epi16(f2, 3), _mm_srli_epi16(f2, 2));        \
+									      \
+      lo = _mm_or_si128(f0, _mm_slli_epi16(f1, 8));                           \
+      _mm_storeu_si128((__m128i *)(d), _mm_unpacklo_epi16(lo, f2));           \
+      _mm_storeu_si128((__m128i *)(d + 4), _mm_unpackhi_epi16(lo, f2));       \
+   }                                                                          \
+									      \
+   tail(d, s, w);                                                             \
+}
+
+SSE2_HICOLOR_TO_32(conv_15_to_32_sse2, 0x1F, 3, 2, 10, conv_tail_15_to_32)
+SSE2_HICOLOR_TO_32(conv_16_to_32_sse2, 0x3F, 2, 4, 11, conv_tail_16_to_32)
+
+
+
+/* pack_32_to_16_sse2:
+ *  Packs 4 pixels down to 16 bits, sign extended so that the saturating
+ *  pack leaves them alone.
+ */
+static INLINE __m128i pack_32_to_16_sse2(__m128i c)
+{
+   __m128i p = _mm_or_si128(_mm_or_si128(
+		  _mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x001F)),
+		  _mm_and_si128(_mm_srli_epi32(c, 5), _mm_set1_epi32(0x07E0))),
+		  _mm_and_si128(_mm_srli_epi32(c, 8), _mm_set1_epi32(0xF800)));
+
+   return _mm_srai_epi32(_mm_slli_epi32(p, 16), 16);
+}
+
+
+
+static void conv_32_to_16_sse2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint16_t *d = dst;
+   AL_CONST uint32_t *s = src;
+   (void)table;
+
+   for (; w >= 8; w -= 8, s += 8, d += 8) {
+      __m128i a = pack_32_to_16_sse2(_mm_loadu_si128((__m128i *)(s)));
+      __m128i b = pack_32_to_16_sse2(_mm_loadu_si128((__m128i *)(s + 4)));
+      _mm_storeu_si128((__m128i *)d, _mm_packs_epi32(a, b));
+   }
+
+   conv_tail_32_to_16(d, s, w);
+}
+
+
+
+/* expand_24_to_32_sse2:
+ *  Spreads the 4 pixels in the low 12 bytes of g over 32 bit lanes.
+ */
+static INLINE __m128i expand_24_to_32_sse2(__m128i g, __m128i m)
+{
+   __m128i a = _mm_unpacklo_epi32(g, _mm_srli_si128(g, 3));
+   __m128i b = _mm_unpacklo_epi32(_mm_srli_si128(g, 6), _mm_srli_si128(g, 9));
+
+   return _mm_and_si128(_mm_unpacklo_epi64(a, b), m);
+}
+
+
+
+/* conv_24_to_32_sse2:
+ *  Reads 16 pixels as three whole vectors and regroups them 4 at a time.
+ */
+static void conv_24_to_32_sse2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint32_t *d = dst;
+   AL_CONST unsigned char *s = src;
+   __m128i m = _mm_set1_epi32(0xFFFFFF);
+   (void)table;
+
+   for (; w >= 16; w -= 16, s += 48, d += 16) {
+      __m128i v0 = _mm_loadu_si128((__m128i *)(s));
+      __m128i v1 = _mm_loadu_si128((__m128i *)(s + 16));
+      __m128i v2 = _mm_loadu_si128((__m128i *)(s + 32));
+
+      _mm_storeu_si128((__m128i *)(d), expand_24_to_32_sse2(v0, m));
+      _mm_storeu_si128((__m128i *)(d + 4), expand_24_to_32_sse2(_mm_or_si128(_mm_srli_si128(v0, 12), _mm_slli_si128(v1, 4)), m));
+      _mm_storeu_si128((__m128i *)(d + 8), expand_24_to_32_sse2(_mm_or_si128(_mm_srli_si128(v1, 8), _mm_slli_si128(v2, 8)), m));
+      _mm_storeu_si128((__m128i *)(d + 12), expand_24_to_32_sse2(_mm_srli_si128(v2, 4), m));
+   }
+
+   conv_tail_24_to_32(d, s, w);
+}
+
+
+
+/* conv_32_to_24_sse2:
+ *  Squeezes each pair of pixels into the low 6 bytes of a 64 bit lane
+ *  and stores both lanes with 8 byte writes, the second one overwriting
+ *  the padding of the first. That writes 2 bytes past the 4 pixels, so
+ *  the loop stops while there is still one more pixel to come.
+ */
+static void conv_32_to_24_sse2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   unsigned char *d = dst;
+   AL_CONST uint32_t *s = src;
+   __m128i mlo = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+   __m128i mhi = _mm_set_epi32(0xFFFF, 0xFF000000, 0xFFFF, 0xFF000000);
+   (void)table;
+
+   for (; w >= 5; w -= 4, s += 4, d += 12) {
+      __m128i c = _mm_loadu_si128((__m128i *)s);
+      __m128i p = _mm_or_si128(_mm_and_si128(c, mlo),
+			       _mm_and_si128(_mm_srli_epi64(c, 8), mhi));
+
+      _mm_storel_epi64((__m128i *)(d), p);
+      _mm_storel_epi64((__m128i *)(d + 6), _mm_srli_si128(p, 8));
+   }
+
+   conv_tail_32_to_24(d, s, w);
+}
+
+#endif /* ALLEGRO_SIMD_SSE2 */
+
+
+
+#ifdef ALLEGRO_SIMD_AVX2
+
+/* conv_8_to_32_avx2:
+ *  Looks up 8 palette entries at a time with a gather.
+ */
+AL_SIMD_AVX2_FUNC static void conv_8_to_32_avx2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint32_t *d = dst;
+   AL_CONST unsigned char *s = src;
+
+   for (; w >= 8; w -= 8, s += 8, d += 8) {
+      __m256i i = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)s));
+      _mm256_storeu_si256((__m256i *)d, _mm256_i32gather_epi32(table, i, 4));
+   }
+
+   conv_tail_8_to_32(d, s, w, table);
+}
+
+
+
+/* AVX2_HICOLOR_TO_32:
+ *  Same as SSE2_HICOLOR_TO_32 with 16 pixels per vector. The unpacks
+ *  work within 128 bit halves, so the results are put back in order
+ *  with a lane permute.
+ */
+#define AVX2_HICOLOR_TO_32(name, gmask, gup, gdown, hshift, sse2_version)     \
+AL_SIMD_AVX2_FUNC static void name(void *dst, AL_CONST void *src, int w, AL_CONST int *table) \
+{                                                                             \
+   uint32_t *d = dst;                                                         \
+   AL_CONST uint16_t *s = src;                                                \
+   __m256i m5 = _mm256_set1_epi16(0x1F);                                      \
+   __m256i mg = _mm256_set1_epi16(gmask);                                     \
+									      \
+   for (; w >= 16; w -= 16, s += 16, d += 16) {                               \
+      __m256i c = _mm256_loadu_si256((__m256i *)s);                           \
+      __m256i f0 = _mm256_and_si256(c, m5);                                   \
+      __m256i f1 = _mm256_and_si256(_mm256_srli_epi16(c, 5), mg);             \
+      __m256i f2 = _mm256_and_si256(_mm256_srli_epi16(c, hshift), m5);        \
+      __m256i lo, a, b;                                                       \
+									      \
+      f0 = _mm256_or_si256(_mm256_slli_epi16(f0, 3), _mm256_srli_epi16(f0, 2)); \
+      f1 = _mm256_or_si256(_mm256_slli_epi16(f1, gup), _mm256_srli_epi16(f1, gdown)); \
+      f2 = _mm256_or_si256(_mm256_slli_epi16(f2, 3), _mm256_srli_epi16(f2, 2)); \
+									      \
+      lo = _mm256_or_si256(f0, _mm256_slli_epi16(f1, 8));                     \
+      a = _mm256_unpacklo_epi16(lo, f2);                                      \
+      b = _mm256_unpackhi_epi16(lo, f2);                                      \
+      _mm256_storeu_si256((__m256i *)(d), _mm256_permute2x128_si256(a, b, 0x20)); \
+      _mm256_storeu_si256((__m256i *)(d + 8), _mm256_permute2x128_si256(a, b, 0x31)); \
+   }                                                                          \
+									      \
+   sse2_version(d, s, w, table);                                              \
+}
+
+AVX2_HICOLOR_TO_32(conv_15_to_32_avx2, 0x1F, 3, 2, 10, conv_15_to_32_sse2)
+AVX2_HICOLOR_TO_32(conv_16_to_32_avx2, 0x3F, 2, 4, 11, conv_16_to_32_sse2)
+
+
+
+AL_SIMD_AVX2_FUNC static INLINE __m256i pack_32_to_16_avx2(__m256i c)
+{
+   __m256i p = _mm256_or_si256(_mm256_or_si256(
+		  _mm256_and_si256(_mm256_srli_epi32(c, 3), _mm256_set1_epi32(0x001F)),
+		  _mm256_and_si256(_mm256_srli_epi32(c, 5), _mm256_set1_epi32(0x07E0))),
+		  _mm256_and_si256(_mm256_srli_epi32(c, 8), _mm256_set1_epi32(0xF800)));
+
+   return _mm256_srai_epi32(_mm256_slli_epi32(p, 16), 16);
+}
+
+
+
+AL_SIMD_AVX2_FUNC static void conv_32_to_16_avx2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint16_t *d = dst;
+   AL_CONST uint32_t *s = src;
+
+   for (; w >= 16; w -= 16, s += 16, d += 16) {
+      __m256i a = pack_32_to_16_avx2(_mm256_loadu_si256((__m256i *)(s)));
+      __m256i b = pack_32_to_16_avx2(_mm256_loadu_si256((__m256i *)(s + 8)));
+      _mm256_storeu_si256((__m256i *)d, _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+   }
+
+   conv_32_to_16_sse2(d, s, w, table);
+}
+
+
+
+/* conv_24_to_32_avx2:
+ *  Loads 4 pixels into each 128 bit half and spreads them with a byte
+ *  shuffle. The second load reads 4 bytes past the 8 pixels, so the
+ *  loop stops while there are still 2 more pixels to come.
+ */
+AL_SIMD_AVX2_FUNC static void conv_24_to_32_avx2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint32_t *d = dst;
+   AL_CONST unsigned char *s = src;
+   __m256i shuf = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+				   0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+   for (; w >= 10; w -= 8, s += 24, d += 8) {
+      __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((__m128i *)(s))),
+					  _mm_loadu_si128((__m128i *)(s + 12)), 1);
+      _mm256_storeu_si256((__m256i *)d, _mm256_shuffle_epi8(c, shuf));
+   }
+
+   conv_24_to_32_sse2(d, s, w, table);
+}
+
+
+
+/* conv_32_to_24_avx2:
+ *  The reverse of conv_24_to_32_avx2(): each half is squeezed into 12
+ *  bytes and stored with a 16 byte write, the second overwriting the
+ *  padding of the first.
+ */
+AL_SIMD_AVX2_FUNC static void conv_32_to_24_avx2(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   unsigned char *d = dst;
+   AL_CONST uint32_t *s = src;
+   __m256i shuf = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+				   0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+   for (; w >= 10; w -= 8, s += 8, d += 24) {
+      __m256i p = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *)s), shuf);
+      _mm_storeu_si128((__m128i *)(d), _mm256_castsi256_si128(p));
+      _mm_storeu_si128((__m128i *)(d + 12), _mm256_extracti128_si256(p, 1));
+   }
+
+   conv_32_to_24_sse2(d, s, w, table);
+}
+
+#endif /* ALLEGRO_SIMD_AVX2 */
+
+
+
+#ifdef ALLEGRO_SIMD_NEON
+
+/* NEON_HICOLOR_TO_32:
+ *  Narrows the three fields of 8 pixels to bytes, scales them up and
+ *  interleaves them with a zero byte on the store.
+ */
+#define NEON_HICOLOR_TO_32(name, gmask, gup, gdown, hshift, tail)             \
+static void name(void *dst, AL_CONST void *src, int w, AL_CONST int *table)   \
+{                                                                             \
+   uint32_t *d = dst;                                                         \
+   AL_CONST uint16_t *s = src;                                                \
+   uint16x8_t m5 = vdupq_n_u16(0x1F);                                         \
+   uint16x8_t mg = vdupq_n_u16(gmask);                                        \
+   uint8x8x4_t o;                                                             \
+   (void)table;                                                               \
+									      \
+   o.val[3] = vdup_n_u8(0);                                                   \
+									      \
+   for (; w >= 8; w -= 8, s += 8, d += 8) {                                   \
+      uint16x8_t c = vld1q_u16(s);                                            \
+      uint8x8_t f0 = vmovn_u16(vandq_u16(c, m5));                             \
+      uint8x8_t f1 = vmovn_u16(vandq_u16(vshrq_n_u16(c, 5), mg));             \
+      uint8x8_t f2 = vmovn_u16(vandq_u16(vshrq_n_u16(c, hshift), m5));        \
+									      \
+      o.val[0] = vorr_u8(vshl_n_u8(f0, 3), vshr_n_u8(f0, 2));                 \
+      o.val[1] = vorr_u8(vshl_n_u8(f1, gup), vshr_n_u8(f1, gdown));           \
+      o.val[2] = vorr_u8(vshl_n_u8(f2, 3), vshr_n_u8(f2, 2));                 \
+      vst4_u8((uint8_t *)d, o);                                               \
+   }                                                                          \
+									      \
+   tail(d, s, w);                                                             \
+}
+
+NEON_HICOLOR_TO_32(conv_15_to_32_neon, 0x1F, 3, 2, 10, conv_tail_15_to_32)
+NEON_HICOLOR_TO_32(conv_16_to_32_neon, 0x3F, 2, 4, 11, conv_tail_16_to_32)
+
+
+
+static void conv_32_to_16_neon(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint16_t *d = dst;
+   AL_CONST uint32_t *s = src;
+   (void)table;
+
+   for (; w >= 8; w -= 8, s += 8, d += 8) {
+      uint8x8x4_t c = vld4_u8((AL_CONST uint8_t *)s);
+      uint16x8_t p = vmovl_u8(vshr_n_u8(c.val[0], 3));
+
+      p = vorrq_u16(p, vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[1], 2)), 5));
+      p = vorrq_u16(p, vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[2], 3)), 11));
+      vst1q_u16(d, p);
+   }
+
+   conv_tail_32_to_16(d, s, w);
+}
+
+
+
+static void conv_24_to_32_neon(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   uint32_t *d = dst;
+   AL_CONST unsigned char *s = src;
+   uint8x16x4_t o;
+   (void)table;
+
+   o.val[3] = vdupq_n_u8(0);
+
+   for (; w >= 16; w -= 16, s += 48, d += 16) {
+      uint8x16x3_t c = vld3q_u8(s);
+      o.val[0] = c.val[0];
+      o.val[1] = c.val[1];
+      o.val[2] = c.val[2];
+      vst4q_u8((uint8_t *)d, o);
+   }
+
+   conv_tail_24_to_32(d, s, w);
+}
+
+
+
+static void conv_32_to_24_neon(void *dst, AL_CONST void *src, int w, AL_CONST int *table)
+{
+   unsigned char *d = dst;
+   AL_CONST uint32_t *s = src;
+   (void)table;
+
+   for (; w >= 16; w -= 16, s += 16, d += 48) {
+      uint8x16x4_t c = vld4q_u8((AL_CONST uint8_t *)s);
+      uint8x16x3_t o;
+
+      o.val[0] = c.val[0];
+      o.val[1] = c.val[1];
+      o.val[2] = c.val[2];
+      vst3q_u8(d, o);
+   }
+
+   conv_tail_32_to_24(d, s, w);
+}
+
+#endif /* ALLEGRO_SIMD_NEON */
+
+
+
+/* _al_simd_init_converters:
+ *  Selects the row converters for the CPU found by check_cpu(). There is
+ *  no vector version of the 8-bit palette lookup without a gather.
+ */
+void _al_simd_init_converters(void)
+{
+#ifdef ALLEGRO_SIMD_SSE2
+   _al_simd_conv_15_to_32 = conv_15_to_32_sse2;
+   _al_simd_conv_16_to_32 = conv_16_to_32_sse2;
+   _al_simd_conv_32_to_16 = conv_32_to_16_sse2;
+   _al_simd_conv_24_to_32 = conv_24_to_32_sse2;
+   _al_simd_conv_32_to_24 = conv_32_to_24_sse2;
+
+#ifdef ALLEGRO_SIMD_AVX2
+   if (cpu_capabilities & CPU_AVX2) {
+      _al_simd_conv_8_to_32 = conv_8_to_32_avx2;
+      _al_simd_conv_15_to_32 = conv_15_to_32_avx2;
+      _al_simd_conv_16_to_32 = conv_16_to_32_avx2;
+      _al_simd_conv_32_to_16 = conv_32_to_16_avx2;
+      _al_simd_conv_24_to_32 = conv_24_to_32_avx2;
+      _al_simd_conv_32_to_24 = conv_32_to_24_avx2;
+   }
+#endif
+#endif
+
+#ifdef ALLEGRO_SIMD_NEON
+   if (cpu_capabilities & CPU_NEON) {
+      _al_simd_conv_15_to_32 = conv_15_to_32_neon;
+      _al_simd_conv_16_to_32 = conv_16_to_32_neon;
+      _al_simd_conv_32_to_16 = conv_32_to_16_neon;
+      _al_simd_conv_24_to_32 = conv_24_to_32_neon;
+      _al_simd_conv_32_to_24 = conv_32_to_24_neon;
+   }
+#endif
+}
+
+
+
+/* colorconv_rows:
+ *  Runs a row converter over a color conversion rectangle.
+ */
+static void colorconv_rows(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect, AL_SIMD_CONV_ROW conv, AL_CONST int *table)
+{
+   unsigned char *s = src_rect->data;
+   unsigned char *d = dest_rect->data;
+   int y;
+
+   for (y = src_rect->height; y; y--) {
+      conv(d, s, src_rect->width, table);
+      s += src_rect->pitch;
+      d += dest_rect->pitch;
+   }
+}
+
+
+
+static void colorconv_blit_simd_8_to_32(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect)
+{
+   colorconv_rows(src_rect, dest_rect, _al_simd_conv_8_to_32, _colorconv_indexed_palette);
+}
+
+static void colorconv_blit_simd_15_to_32(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect)
+{
+   colorconv_rows(src_rect, dest_rect, _al_simd_conv_15_to_32, NULL);
+}
+
+static void colorconv_blit_simd_16_to_32(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect)
+{
+   colorconv_rows(src_rect, dest_rect, _al_simd_conv_16_to_32, NULL);
+}
+
+static void colorconv_blit_simd_32_to_16(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect)
+{
+   colorconv_rows(src_rect, dest_rect, _al_simd_conv_32_to_16, NULL);
+}
+
+static void colorconv_blit_simd_24_to_32(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect)
+{
+   colorconv_rows(src_rect, dest_rect, _al_simd_conv_24_to_32, NULL);
+}
+
+static void colorconv_blit_simd_32_to_24(GRAPHICS_RECT *src_rect, GRAPHICS_RECT *dest_rect)
+{
+   colorconv_rows(src_rect, dest_rect, _al_simd_conv_32_to_24, NULL);
+}
+
+#endif /* ALLEGRO_SIMD && ALLEGRO_LITTLE_ENDIAN */
+
+
+
+/* _get_colorconv_simd_blitter:
+ *  Returns a vectorized color conversion blitter for the specified depths,
+ *  or NULL if there is none for this CPU. The 8-bit one reads the palette
+ *  built by _get_colorconv_blitter().
+ */
+COLORCONV_BLITTER_FUNC *_get_colorconv_simd_blitter(int from_depth, int to_depth)
+{
+#if (defined ALLEGRO_SIMD) && (defined ALLEGRO_LITTLE_ENDIAN)
+   #define SIMD_PAIR(from, to)   (((from) << 8) | (to))
+
+   switch (SIMD_PAIR(from_depth, to_depth)) {
+
+      case SIMD_PAIR(8, 32):
+	 return _al_simd_conv_8_to_32 ? colorconv_blit_simd_8_to_32 : NULL;
+
+      case SIMD_PAIR(15, 32):
+	 return _al_simd_conv_15_to_32 ? colorconv_blit_simd_15_to_32 : NULL;
+
+      case SIMD_PAIR(16, 32):
+	 return _al_simd_conv_16_to_32 ? colorconv_blit_simd_16_to_32 : NULL;
+
+      case SIMD_PAIR(32, 16):
+	 return _al_simd_conv_32_to_16 ? colorconv_blit_simd_32_to_16 : NULL;
+
+      case SIMD_PAIR(24, 32):
+	 return _al_simd_conv_24_to_32 ? colorconv_blit_simd_24_to_32 : NULL;
+
+      case SIMD_PAIR(32, 24):
+	 return _al_simd_conv_32_to_24 ? colorconv_blit_simd_32_to_24 : NULL;
+   }
+
+   #undef SIMD_PAIR
+#else
+   (void)from_depth;
+   (void)to_depth;
+#endif
+
+   return NULL;
+}
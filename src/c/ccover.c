@@ -0,0 +1,408 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SSE2, AVX2 and NEON coverage blenders for anti-aliased fonts.
+ *
+ *      Each channel becomes (f * a + d * (255 - a)) / 255, rounded to
+ *      nearest, which fits in 16 bit lanes. The division is done as
+ *      (v + (v >> 8)) >> 8 after adding 128, which is exact over that
+ *      range, so the kernels match the C loops in fontaa.c bit for bit.
+ *      Pixels with no coverage are left alone, as the C code does.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+
+#ifdef ALLEGRO_SIMD
+
+AL_SIMD_COVER_ROW _al_simd_cover_row15 = NULL;
+AL_SIMD_COVER_ROW _al_simd_cover_row16 = NULL;
+AL_SIMD_COVER_ROW _al_simd_cover_row32 = NULL;
+
+
+
+#ifdef ALLEGRO_SIMD_SSE2
+
+/* cover_mix_sse2:
+ *  Blends f and d by the coverage a, in 16 bit lanes.
+ */
+static INLINE __m128i cover_mix_sse2(__m128i f, __m128i d, __m128i a)
+{
+   __m128i v;
+
+   v = _mm_add_epi16(_mm_mullo_epi16(f, a),
+		     _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+   v = _mm_add_epi16(v, _mm_set1_epi16(128));
+
+   return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+
+
+#ifdef ALLEGRO_COLOR32
+
+/* cover_row32_sse2:
+ *  Does four pixels at a time, spreading each coverage value over the
+ *  four bytes of its pixel.
+ */
+static int cover_row32_sse2(void *dst, AL_CONST unsigned char *cov, int w, int color)
+{
+   uint32_t *d = dst;
+   __m128i zero = _mm_setzero_si128();
+   __m128i c = _mm_set1_epi32(color);
+   __m128i f = _mm_unpacklo_epi8(c, zero);
+   int i;
+
+   for (i = 0; i + 4 <= w; i += 4) {
+      uint32_t c4;
+      __m128i a, x, lo, hi;
+
+      memcpy(&c4, cov + i, 4);
+
+      if (!c4)
+	 continue;
+
+      if (c4 == 0xFFFFFFFF) {
+	 _mm_storeu_si128((__m128i *)(d + i), c);
+	 continue;
+      }
+
+      a = _mm_cvtsi32_si128(c4);
+      a = _mm_unpacklo_epi8(a, a);
+      a = _mm_unpacklo_epi16(a, a);
+
+      x = _mm_loadu_si128((__m128i *)(d + i));
+      lo = cover_mix_sse2(f, _mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(a, zero));
+      hi = cover_mix_sse2(f, _mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(a, zero));
+      _mm_storeu_si128((__m128i *)(d + i), _mm_packus_epi16(lo, hi));
+   }
+
+   return i;
+}
+
+#endif /* ALLEGRO_COLOR32 */
+
+
+
+#ifdef ALLEGRO_COLOR16
+
+/* SSE2_COVER_ROW16:
+ *  Eight 15 or 16 bit pixels at a time, blending the fields at their
+ *  own precision.
+ */
+#define SSE2_COVER_ROW16(name, rshift, gmask)                                 \
+static int name(void *dst, AL_CONST unsigned char *cov, int w, int color)    \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   __m128i zero = _mm_setzero_si128();                                        \
+   __m128i m5 = _mm_set1_epi16(0x1F);                                         \
+   __m128i mg = _mm_set1_epi16(gmask);                                        \
+   __m128i fr = _mm_set1_epi16((color >> rshift) & 0x1F);                     \
+   __m128i fg = _mm_set1_epi16((color >> 5) & gmask);                         \
+   __m128i fb = _mm_set1_epi16(color & 0x1F);                                 \
+   int i;                                                                     \
+									      \
+   for (i = 0; i + 8 <= w; i += 8) {                                          \
+      __m128i c = _mm_loadl_epi64((AL_CONST __m128i *)(cov + i));             \
+      __m128i a, t, x, r, g, b;                                               \
+									      \
+      if ((_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)) & 0xFF) == 0xFF)        \
+	 continue;                                                            \
+									      \
+      a = _mm_unpacklo_epi8(c, zero);                                         \
+      t = _mm_cmpeq_epi16(a, zero);                                           \
+      x = _mm_loadu_si128((__m128i *)(d + i));                                \
+      r = cover_mix_sse2(fr, _mm_and_si128(_mm_srli_epi16(x, rshift), m5), a); \
+      g = cover_mix_sse2(fg, _mm_and_si128(_mm_srli_epi16(x, 5), mg), a);     \
+      b = cover_mix_sse2(fb, _mm_and_si128(x, m5), a);                        \
+      r = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, rshift),                \
+				    _mm_slli_epi16(g, 5)), b);                \
+      x = _mm_or_si128(_mm_and_si128(t, x), _mm_andnot_si128(t, r));          \
+      _mm_storeu_si128((__m128i *)(d + i), x);                                \
+   }                                                                          \
+									      \
+   return i;                                                                  \
+}
+
+SSE2_COVER_ROW16(cover_row15_sse2, 10, 0x1F)
+SSE2_COVER_ROW16(cover_row16_sse2, 11, 0x3F)
+
+#endif /* ALLEGRO_COLOR16 */
+
+#endif /* ALLEGRO_SIMD_SSE2 */
+
+
+
+#ifdef ALLEGRO_SIMD_AVX2
+
+/* cover_mix_avx2:
+ *  cover_mix_sse2() on sixteen lanes.
+ */
+AL_SIMD_AVX2_FUNC static INLINE __m256i cover_mix_avx2(__m256i f, __m256i d, __m256i a)
+{
+   __m256i v;
+
+   v = _mm256_add_epi16(_mm256_mullo_epi16(f, a),
+			_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a)));
+   v = _mm256_add_epi16(v, _mm256_set1_epi16(128));
+
+   return _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+}
+
+
+
+#ifdef ALLEGRO_COLOR32
+
+/* cover_row32_avx2:
+ *  Eight pixels at a time. The unpacks work within 128 bit halves, but
+ *  they are undone by the pack in the same way.
+ */
+AL_SIMD_AVX2_FUNC static int cover_row32_avx2(void *dst, AL_CONST unsigned char *cov, int w, int color)
+{
+   uint32_t *d = dst;
+   __m256i zero = _mm256_setzero_si256();
+   __m256i c = _mm256_set1_epi32(color);
+   __m256i f = _mm256_unpacklo_epi8(c, zero);
+   __m256i spread = _mm256_set1_epi32(0x01010101);
+   int i;
+
+   for (i = 0; i + 8 <= w; i += 8) {
+      uint32_t c8[2];
+      __m256i a, x, lo, hi;
+
+      memcpy(c8, cov + i, 8);
+
+      if (!(c8[0] | c8[1]))
+	 continue;
+
+      if ((c8[0] & c8[1]) == 0xFFFFFFFF) {
+	 _mm256_storeu_si256((__m256i *)(d + i), c);
+	 continue;
+      }
+
+      a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((AL_CONST __m128i *)(cov + i)));
+      a = _mm256_mullo_epi32(a, spread);
+
+      x = _mm256_loadu_si256((__m256i *)(d + i));
+      lo = cover_mix_avx2(f, _mm256_unpacklo_epi8(x, zero), _mm256_unpacklo_epi8(a, zero));
+      hi = cover_mix_avx2(f, _mm256_unpackhi_epi8(x, zero), _mm256_unpackhi_epi8(a, zero));
+      _mm256_storeu_si256((__m256i *)(d + i), _mm256_packus_epi16(lo, hi));
+   }
+
+   return i;
+}
+
+#endif /* ALLEGRO_COLOR32 */
+
+
+
+#ifdef ALLEGRO_COLOR16
+
+/* AVX2_COVER_ROW16:
+ *  SSE2_COVER_ROW16() on sixteen pixels at a time.
+ */
+#define AVX2_COVER_ROW16(name, rshift, gmask)                                 \
+AL_SIMD_AVX2_FUNC static int name(void *dst, AL_CONST unsigned char *cov, int w, int color) \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   __m256i zero = _mm256_setzero_si256();                                     \
+   __m256i m5 = _mm256_set1_epi16(0x1F);                                      \
+   __m256i mg = _mm256_set1_epi16(gmask);                                     \
+   __m256i fr = _mm256_set1_epi16((color >> rshift) & 0x1F);                  \
+   __m256i fg = _mm256_set1_epi16((color >> 5) & gmask);                      \
+   __m256i fb = _mm256_set1_epi16(color & 0x1F);                              \
+   int i;                                                                     \
+									      \
+   for (i = 0; i + 16 <= w; i += 16) {                                        \
+      __m128i c = _mm_loadu_si128((AL_CONST __m128i *)(cov + i));             \
+      __m256i a, t, x, r, g, b;                                               \
+									      \
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_setzero_si128())) == 0xFFFF) \
+	 continue;                                                            \
+									      \
+      a = _mm256_cvtepu8_epi16(c);                                            \
+      t = _mm256_cmpeq_epi16(a, zero);                                        \
+      x = _mm256_loadu_si256((__m256i *)(d + i));                             \
+      r = cover_mix_avx2(fr, _mm256_and_si256(_mm256_srli_epi16(x, rshift), m5), a); \
+      g = cover_mix_avx2(fg, _mm256_and_si256(_mm256_srli_epi16(x, 5), mg), a); \
+      b = cover_mix_avx2(fb, _mm256_and_si256(x, m5), a);                     \
+      r = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(r, rshift),       \
+					  _mm256_slli_epi16(g, 5)), b);       \
+      x = _mm256_blendv_epi8(r, x, t);                                        \
+      _mm256_storeu_si256((__m256i *)(d + i), x);                             \
+   }                                                                          \
+									      \
+   return i;                                                                  \
+}
+
+AVX2_COVER_ROW16(cover_row15_avx2, 10, 0x1F)
+AVX2_COVER_ROW16(cover_row16_avx2, 11, 0x3F)
+
+#endif /* ALLEGRO_COLOR16 */
+
+#endif /* ALLEGRO_SIMD_AVX2 */
+
+
+
+#ifdef ALLEGRO_SIMD_NEON
+
+/* cover_mix_neon:
+ *  Blends f and d by the coverage a, in 16 bit lanes.
+ */
+static INLINE uint16x8_t cover_mix_neon(uint16x8_t f, uint16x8_t d, uint16x8_t a)
+{
+   uint16x8_t v;
+
+   v = vmlaq_u16(vmulq_u16(f, a), d, vsubq_u16(vdupq_n_u16(255), a));
+   v = vaddq_u16(v, vdupq_n_u16(128));
+
+   return vshrq_n_u16(vsraq_n_u16(v, v, 8), 8);
+}
+
+
+
+#ifdef ALLEGRO_COLOR32
+
+/* cover_row32_neon:
+ *  Four pixels at a time.
+ */
+static int cover_row32_neon(void *dst, AL_CONST unsigned char *cov, int w, int color)
+{
+   uint32_t *d = dst;
+   uint32x4_t c = vdupq_n_u32(color);
+   uint16x8_t f = vmovl_u8(vget_low_u8(vreinterpretq_u8_u32(c)));
+   int i;
+
+   for (i = 0; i + 4 <= w; i += 4) {
+      uint32_t c4;
+      uint8x16_t a, x;
+      uint16x8_t lo, hi;
+
+      memcpy(&c4, cov + i, 4);
+
+      if (!c4)
+	 continue;
+
+      if (c4 == 0xFFFFFFFF) {
+	 vst1q_u32(d + i, c);
+	 continue;
+      }
+
+      a = vreinterpretq_u8_u32(vmulq_n_u32(vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(c4)))), 0x01010101));
+      x = vreinterpretq_u8_u32(vld1q_u32(d + i));
+
+      lo = cover_mix_neon(f, vmovl_u8(vget_low_u8(x)), vmovl_u8(vget_low_u8(a)));
+      hi = cover_mix_neon(f, vmovl_u8(vget_high_u8(x)), vmovl_u8(vget_high_u8(a)));
+      vst1q_u32(d + i, vreinterpretq_u32_u8(vcombine_u8(vmovn_u16(lo), vmovn_u16(hi))));
+   }
+
+   return i;
+}
+
+#endif /* ALLEGRO_COLOR32 */
+
+
+
+#ifdef ALLEGRO_COLOR16
+
+/* NEON_COVER_ROW16:
+ *  Eight 15 or 16 bit pixels at a time.
+ */
+#define NEON_COVER_ROW16(name, rshift, gmask)                                 \
+static int name(void *dst, AL_CONST unsigned char *cov, int w, int color)    \
+{                                                                             \
+   uint16_t *d = dst;                                                         \
+   uint16x8_t m5 = vdupq_n_u16(0x1F);                                         \
+   uint16x8_t mg = vdupq_n_u16(gmask);                                        \
+   uint16x8_t fr = vdupq_n_u16((color >> rshift) & 0x1F);                     \
+   uint16x8_t fg = vdupq_n_u16((color >> 5) & gmask);                         \
+   uint16x8_t fb = vdupq_n_u16(color & 0x1F);                                 \
+   int i;                                                                     \
+									      \
+   for (i = 0; i + 8 <= w; i += 8) {                                          \
+      uint32_t c8[2];                                                         \
+      uint16x8_t a, t, x, r, g, b;                                            \
+									      \
+      memcpy(c8, cov + i, 8);                                                 \
+									      \
+      if (!(c8[0] | c8[1]))                                                   \
+	 continue;                                                            \
+									      \
+      a = vmovl_u8(vld1_u8(cov + i));                                         \
+      t = vceqq_u16(a, vdupq_n_u16(0));                                       \
+      x = vld1q_u16(d + i);                                                   \
+      r = cover_mix_neon(fr, vandq_u16(vshrq_n_u16(x, rshift), m5), a);       \
+      g = cover_mix_neon(fg, vandq_u16(vshrq_n_u16(x, 5), mg), a);            \
+      b = cover_mix_neon(fb, vandq_u16(x, m5), a);                            \
+      r = vorrq_u16(vorrq_u16(vshlq_n_u16(r, rshift), vshlq_n_u16(g, 5)), b); \
+      vst1q_u16(d + i, vbslq_u16(t, x, r));                                   \
+   }                                                                          \
+									      \
+   return i;                                                                  \
+}
+
+NEON_COVER_ROW16(cover_row15_neon, 10, 0x1F)
+NEON_COVER_ROW16(cover_row16_neon, 11, 0x3F)
+
+#endif /* ALLEGRO_COLOR16 */
+
+#endif /* ALLEGRO_SIMD_NEON */
+
+
+
+/* _al_simd_init_coverers:
+ *  Picks the coverage blenders for the running CPU.
+ */
+void _al_simd_init_coverers(void)
+{
+#ifdef ALLEGRO_SIMD_SSE2
+#ifdef ALLEGRO_COLOR16
+   _al_simd_cover_row15 = cover_row15_sse2;
+   _al_simd_cover_row16 = cover_row16_sse2;
+#endif
+#ifdef ALLEGRO_COLOR32
+   _al_simd_cover_row32 = cover_row32_sse2;
+#endif
+
+#ifdef ALLEGRO_SIMD_AVX2
+   if (cpu_capabilities & CPU_AVX2) {
+#ifdef ALLEGRO_COLOR16
+      _al_simd_cover_row15 = cover_row15_avx2;
+      _al_simd_cover_row16 = cover_row16_avx2;
+#endif
+#ifdef ALLEGRO_COLOR32
+      _al_simd_cover_row32 = cover_row32_avx2;
+#endif
+   }
+#endif
+#endif
+
+#ifdef ALLEGRO_SIMD_NEON
+   if (cpu_capabilities & CPU_NEON) {
+#ifdef ALLEGRO_COLOR16
+      _al_simd_cover_row15 = cover_row15_neon;
+      _al_simd_cover_row16 = cover_row16_neon;
+#endif
+#ifdef ALLEGRO_COLOR32
+      _al_simd_cover_row32 = cover_row32_neon;
+#endif
+   }
+#endif
+}
+
+#endif /* ALLEGRO_SIMD */
@@ -12,23 +12,139 @@
  *
  *      By Michael Bukin.
  *
+ *      Compiler intrinsic based detection for x86-64 and ARM NEON
+ *      builds without assembler support.
+ *
  *      See readme.txt for copyright information.
  */
 
 
 #include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+#if (defined __x86_64__) || (defined _M_X64)
+   #if (defined __GNUC__) || (defined __clang__)
+      #include <cpuid.h>
+      #define CPU_HAS_CPUID
+   #elif (defined _MSC_VER)
+      #include <intrin.h>
+      #define CPU_HAS_CPUID
+   #endif
+#endif
 
 /* MacOS X has its own check_cpu function, see src/macosx/pcpu.m */
 #ifndef ALLEGRO_MACOSX
 
+
+#ifdef CPU_HAS_CPUID
+
+/* get_cpuid_info:
+ *  Fills reg[] with eax, ebx, ecx and edx for the given cpuid leaf.
+ */
+static void get_cpuid_info(uint32_t leaf, uint32_t subleaf, uint32_t reg[4])
+{
+#ifdef _MSC_VER
+   int r[4];
+
+   __cpuidex(r, leaf, subleaf);
+   reg[0] = r[0];
+   reg[1] = r[1];
+   reg[2] = r[2];
+   reg[3] = r[3];
+#else
+   unsigned int a, b, c, d;
+
+   __cpuid_count(leaf, subleaf, a, b, c, d);
+   reg[0] = a;
+   reg[1] = b;
+   reg[2] = c;
+   reg[3] = d;
+#endif
+}
+
+
+
+/* os_saves_ymm_state:
+ *  Checks with xgetbv that the OS preserves the AVX register state.
+ */
+static int os_saves_ymm_state(void)
+{
+   uint32_t lo;
+
+#ifdef _MSC_VER
+   lo = (uint32_t)_xgetbv(0);
+#else
+   uint32_t hi;
+
+   __asm__ __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+   (void)hi;
+#endif
+
+   return ((lo & 6) == 6);
+}
+
+#endif
+
+
+
 /* check_cpu:
  *  This is the function to call to set the globals.
  */
 void check_cpu(void)
 {
+#ifdef CPU_HAS_CPUID
+   uint32_t cpuid_levels;
+   uint32_t vendor_temp[4];
+   uint32_t reg[4];
+#endif
+
    cpu_family = 0;
    cpu_model = 0;
    cpu_capabilities = 0;
+
+#ifdef CPU_HAS_CPUID
+   cpu_capabilities |= CPU_ID | CPU_FPU | CPU_AMD64;
+
+   get_cpuid_info(0, 0, reg);
+   cpuid_levels = reg[0];
+   vendor_temp[0] = reg[1];
+   vendor_temp[1] = reg[3];
+   vendor_temp[2] = reg[2];
+   vendor_temp[3] = 0;
+   do_uconvert((char *)vendor_temp, U_ASCII, cpu_vendor, U_CURRENT,
+	       _AL_CPU_VENDOR_SIZE);
+
+   if (cpuid_levels > 0) {
+      get_cpuid_info(1, 0, reg);
+
+      cpu_family = (reg[0] & 0xF00) >> 8;
+      cpu_model = (reg[0] & 0xF0) >> 4;
+
+      cpu_capabilities |= (reg[3] & 0x00800000 ? CPU_MMX : 0);
+      cpu_capabilities |= (reg[3] & 0x02000000 ? CPU_SSE | CPU_MMXPLUS : 0);
+      cpu_capabilities |= (reg[3] & 0x04000000 ? CPU_SSE2 : 0);
+      cpu_capabilities |= (reg[3] & 0x00008000 ? CPU_CMOV : 0);
+      cpu_capabilities |= (reg[2] & 0x00000001 ? CPU_SSE3 : 0);
+      cpu_capabilities |= (reg[2] & 0x00000200 ? CPU_SSSE3 : 0);
+      cpu_capabilities |= (reg[2] & 0x00080000 ? CPU_SSE41 : 0);
+      cpu_capabilities |= (reg[2] & 0x00100000 ? CPU_SSE42 : 0);
+
+      /* AVX needs both the cpu flag and an OS that saves the ymm registers */
+      if ((reg[2] & 0x18000000) == 0x18000000 && os_saves_ymm_state()) {
+	 cpu_capabilities |= CPU_AVX;
+
+	 if (cpuid_levels >= 7) {
+	    get_cpuid_info(7, 0, reg);
+	    cpu_capabilities |= (reg[1] & 0x00000020 ? CPU_AVX2 : 0);
+	 }
+      }
+   }
+#endif
+
+#if (defined __ARM_NEON) || (defined __ARM_NEON__)
+   /* the compiler was told NEON is there, so it must be */
+   cpu_capabilities |= CPU_NEON;
+#endif
 }
 
 #endif
@@ -8,7 +8,12 @@
  *                                           /\____/
  *                                           \_/__/
  *
- *      Compiled sprite routines for some unknown platforms.
+ *      Compiled sprite routines for platforms without the i386 compiler.
+ *
+ *      A compiled sprite is a list of the solid runs of each line, which
+ *      is drawn with one copy per run and clips like an RLE sprite. On
+ *      x86-64 the runs are also turned into a routine of immediate
+ *      stores, used for unclipped drawing onto memory bitmaps.
  *
  *      By Michael Bukin.
  *
@@ -16,7 +21,306 @@
  */
 
 
+#include <string.h>
+
 #include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+#if (defined ALLEGRO_AMD64) && \
+    ((defined ALLEGRO_WINDOWS) || ((defined ALLEGRO_UNIX) && (defined ALLEGRO_HAVE_MPROTECT)))
+   #define ALLEGRO_SPRITE_JIT
+#endif
+
+#ifdef ALLEGRO_SPRITE_JIT
+   #ifdef ALLEGRO_WINDOWS
+      #include "winalleg.h"   /* for VirtualAlloc */
+   #else
+      #include "allegro/platform/aintunix.h"   /* for _unix_get_page_size */
+      #include <sys/types.h>
+      #include <sys/mman.h>
+      #ifndef MAP_ANONYMOUS
+	 #define MAP_ANONYMOUS   MAP_ANON
+      #endif
+   #endif
+#endif
+
+
+
+/* one solid run of a sprite line */
+typedef struct COMPILED_RUN
+{
+   int x;                           /* first pixel */
+   int w;                           /* length in pixels */
+   int offset;                      /* position of its pixels in the data */
+} COMPILED_RUN;
+
+
+
+/* solid_pixel:
+ *  Tells whether a pixel of a memory bitmap is not the mask color.
+ */
+static int solid_pixel(BITMAP *bmp, int x, int y)
+{
+   unsigned char *p = bmp->line[y];
+   unsigned long mask = bitmap_mask_color(bmp);
+
+   switch (bitmap_color_depth(bmp)) {
+
+      case 8:
+	 return p[x] != mask;
+
+      case 15:
+      case 16:
+	 return ((uint16_t *)p)[x] != mask;
+
+      case 24:
+	 return (unsigned long)READ3BYTES(p + x * 3) != mask;
+
+      case 32:
+	 return ((uint32_t *)p)[x] != (uint32_t)mask;
+   }
+
+   return FALSE;
+}
+
+
+
+#ifdef ALLEGRO_SPRITE_JIT
+
+/* Generated routines are called with the dst line table at the first
+ * sprite line and the byte offset of the sprite in those lines. They
+ * only use registers that are scratch in both the SysV and Win64
+ * conventions: rcx holds the line table, rdx the offset, r8 the current
+ * line, rax and xmm0 the data. Runs of 16 bytes or more are copied from
+ * a constant pool after the code.
+ */
+typedef void (*COMPILED_DRAW)(unsigned char **lines, uintptr_t offset);
+
+
+typedef struct SPRITE_JIT
+{
+   unsigned char *code;             /* NULL while measuring */
+   int pos;                         /* size of the code so far */
+   int pool;                        /* start of the constant pool */
+   int pool_pos;                    /* size of the pool so far */
+} SPRITE_JIT;
+
+
+
+static void jit_byte(SPRITE_JIT *j, int b)
+{
+   if (j->code)
+      j->code[j->pos] = b;
+
+   j->pos++;
+}
+
+
+
+static void jit_bytes(SPRITE_JIT *j, AL_CONST unsigned char *data, int n)
+{
+   if (j->code)
+      memcpy(j->code + j->pos, data, n);
+
+   j->pos += n;
+}
+
+
+
+static void jit_int32(SPRITE_JIT *j, int32_t v)
+{
+   unsigned char b[4];
+
+   b[0] = v;
+   b[1] = v >> 8;
+   b[2] = v >> 16;
+   b[3] = v >> 24;
+
+   jit_bytes(j, b, 4);
+}
+
+
+
+/* jit_store:
+ *  Emits the stores of n bytes of data at offset in the current line.
+ */
+static void jit_store(SPRITE_JIT *j, int offset, AL_CONST unsigned char *data, int n)
+{
+   static AL_CONST unsigned char movdqu_load[] = { 0xF3, 0x0F, 0x6F, 0x05 };
+   static AL_CONST unsigned char movdqu_store[] = { 0xF3, 0x41, 0x0F, 0x7F, 0x80 };
+   static AL_CONST unsigned char mov_store64[] = { 0x49, 0x89, 0x80 };
+   static AL_CONST unsigned char mov_store32[] = { 0x41, 0xC7, 0x80 };
+   static AL_CONST unsigned char mov_store16[] = { 0x66, 0x41, 0xC7, 0x80 };
+   static AL_CONST unsigned char mov_store8[] = { 0x41, 0xC6, 0x80 };
+
+   /* movdqu xmm0, [rip+pool]; movdqu [r8+offset], xmm0 */
+   for (; n >= 16; n -= 16, data += 16, offset += 16) {
+      jit_bytes(j, movdqu_load, sizeof(movdqu_load));
+      jit_int32(j, j->pool + j->pool_pos - (j->pos + 4));
+      jit_bytes(j, movdqu_store, sizeof(movdqu_store));
+      jit_int32(j, offset);
+
+      if (j->code)
+	 memcpy(j->code + j->pool + j->pool_pos, data, 16);
+      j->pool_pos += 16;
+   }
+
+   /* mov rax, imm64; mov [r8+offset], rax */
+   if (n >= 8) {
+      jit_byte(j, 0x48);
+      jit_byte(j, 0xB8);
+      jit_bytes(j, data, 8);
+      jit_bytes(j, mov_store64, sizeof(mov_store64));
+      jit_int32(j, offset);
+      n -= 8, data += 8, offset += 8;
+   }
+
+   /* mov dword [r8+offset], imm32 */
+   if (n >= 4) {
+      jit_bytes(j, mov_store32, sizeof(mov_store32));
+      jit_int32(j, offset);
+      jit_bytes(j, data, 4);
+      n -= 4, data += 4, offset += 4;
+   }
+
+   /* mov word [r8+offset], imm16 */
+   if (n >= 2) {
+      jit_bytes(j, mov_store16, sizeof(mov_store16));
+      jit_int32(j, offset);
+      jit_bytes(j, data, 2);
+      n -= 2, data += 2, offset += 2;
+   }
+
+   /* mov byte [r8+offset], imm8 */
+   if (n > 0) {
+      jit_bytes(j, mov_store8, sizeof(mov_store8));
+      jit_int32(j, offset);
+      jit_byte(j, *data);
+   }
+}
+
+
+
+/* jit_sprite:
+ *  Emits the drawing routine of a sprite, or just measures it if the
+ *  code pointer is NULL.
+ */
+static void jit_sprite(SPRITE_JIT *j, AL_CONST COMPILED_SPRITE *s)
+{
+   static AL_CONST unsigned char mov_line[] = { 0x4C, 0x8B, 0x81 };
+   static AL_CONST unsigned char add_offset[] = { 0x49, 0x01, 0xD0 };
+   AL_CONST COMPILED_RUN *runs = s->runs;
+   int size = BYTES_PER_PIXEL(s->color_depth);
+   int y, i;
+
+   j->pos = 0;
+   j->pool_pos = 0;
+
+#ifndef ALLEGRO_WINDOWS
+   /* mov rcx, rdi; mov rdx, rsi */
+   jit_byte(j, 0x48);
+   jit_byte(j, 0x89);
+   jit_byte(j, 0xF9);
+   jit_byte(j, 0x48);
+   jit_byte(j, 0x89);
+   jit_byte(j, 0xF2);
+#endif
+
+   for (y = 0; y < s->h; y++) {
+      if (s->line_runs[y] == s->line_runs[y+1])
+	 continue;
+
+      /* mov r8, [rcx+y*8]; add r8, rdx */
+      jit_bytes(j, mov_line, sizeof(mov_line));
+      jit_int32(j, y * sizeof(unsigned char *));
+      jit_bytes(j, add_offset, sizeof(add_offset));
+
+      for (i = s->line_runs[y]; i < s->line_runs[y+1]; i++)
+	 jit_store(j, runs[i].x * size, s->pixels + runs[i].offset, runs[i].w * size);
+   }
+
+   /* ret */
+   jit_byte(j, 0xC3);
+}
+
+
+
+/* compile_sprite:
+ *  Generates the machine code for a sprite whose runs are already set up.
+ *  Returns FALSE if no executable memory could be had, in which case the
+ *  run lists are used on their own.
+ */
+static int compile_sprite(COMPILED_SPRITE *s)
+{
+   SPRITE_JIT j;
+   int len;
+   void *p;
+
+   j.code = NULL;
+   j.pool = 0;
+   jit_sprite(&j, s);
+
+   j.pool = (j.pos + 15) & ~15;
+   len = j.pool + j.pool_pos;
+
+#ifdef ALLEGRO_WINDOWS
+   {
+      DWORD old_protect;
+
+      p = VirtualAlloc(NULL, len, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+      if (!p)
+	 return FALSE;
+
+      j.code = p;
+      jit_sprite(&j, s);
+
+      if (!VirtualProtect(p, len, PAGE_EXECUTE_READ, &old_protect)) {
+	 VirtualFree(p, 0, MEM_RELEASE);
+	 return FALSE;
+      }
+   }
+#else
+   {
+      size_t page_size = _unix_get_page_size();
+
+      /* the code is never writable and executable at the same time */
+      len = (len + page_size - 1) & ~(page_size - 1);
+      p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+	 return FALSE;
+
+      j.code = p;
+      jit_sprite(&j, s);
+
+      if (mprotect(p, len, PROT_READ | PROT_EXEC)) {
+	 munmap(p, len);
+	 return FALSE;
+      }
+   }
+#endif
+
+   s->draw = p;
+   s->len = len;
+
+   return TRUE;
+}
+
+
+
+/* free_sprite_code:
+ *  Releases the memory of a generated routine.
+ */
+static void free_sprite_code(COMPILED_SPRITE *s)
+{
+#ifdef ALLEGRO_WINDOWS
+   VirtualFree(s->draw, 0, MEM_RELEASE);
+#else
+   munmap(s->draw, s->len);
+#endif
+}
+
+#endif /* ALLEGRO_SPRITE_JIT */
 
 
 
@@ -25,8 +329,76 @@
  */
 COMPILED_SPRITE *get_compiled_sprite(BITMAP *bitmap, int planar)
 {
+   COMPILED_SPRITE *s;
+   COMPILED_RUN *runs;
+   int size = BYTES_PER_PIXEL(bitmap_color_depth(bitmap));
+   int nruns = 0;
+   int npixels = 0;
+   int x, y, x0;
    ASSERT(bitmap);
-   return get_rle_sprite(bitmap);
+
+   /* count the runs */
+   for (y=0; y<bitmap->h; y++) {
+      for (x=0; x<bitmap->w; x++) {
+	 if (solid_pixel(bitmap, x, y)) {
+	    x0 = x;
+	    while ((x < bitmap->w) && (solid_pixel(bitmap, x, y)))
+	       x++;
+	    nruns++;
+	    npixels += x - x0;
+	 }
+      }
+   }
+
+   /* the runs and their pixels live in the same block as the sprite */
+   s = _AL_MALLOC(sizeof(COMPILED_SPRITE) + (bitmap->h + 1) * sizeof(int) +
+		  nruns * sizeof(COMPILED_RUN) + npixels * size);
+   if (!s)
+      return NULL;
+
+   s->planar = FALSE;
+   s->color_depth = bitmap_color_depth(bitmap);
+   s->w = bitmap->w;
+   s->h = bitmap->h;
+   s->draw = NULL;
+   s->len = 0;
+   s->line_runs = (int *)(s + 1);
+   s->runs = runs = (COMPILED_RUN *)(s->line_runs + bitmap->h + 1);
+   s->pixels = (unsigned char *)(runs + nruns);
+
+   nruns = 0;
+   npixels = 0;
+
+   for (y=0; y<bitmap->h; y++) {
+      s->line_runs[y] = nruns;
+
+      for (x=0; x<bitmap->w; x++) {
+	 if (solid_pixel(bitmap, x, y)) {
+	    x0 = x;
+	    while ((x < bitmap->w) && (solid_pixel(bitmap, x, y)))
+	       x++;
+
+	    runs[nruns].x = x0;
+	    runs[nruns].w = x - x0;
+	    runs[nruns].offset = npixels * size;
+	    memcpy(s->pixels + npixels * size, bitmap->line[y] + x0 * size, (x - x0) * size);
+
+	    nruns++;
+	    npixels += x - x0;
+	 }
+      }
+   }
+
+   s->line_runs[bitmap->h] = nruns;
+
+#ifdef ALLEGRO_SPRITE_JIT
+   if (nruns > 0)
+      compile_sprite(s);
+#endif
+
+   (void)planar;
+
+   return s;
 }
 
 
@@ -36,8 +408,79 @@ COMPILED_SPRITE *get_compiled_sprite(BITMAP *bitmap, int planar)
  */
 void destroy_compiled_sprite(COMPILED_SPRITE *sprite)
 {
-   ASSERT(sprite);
-   destroy_rle_sprite(sprite);
+   if (sprite) {
+#ifdef ALLEGRO_SPRITE_JIT
+      if (sprite->draw)
+	 free_sprite_code(sprite);
+#endif
+      _AL_FREE(sprite);
+   }
+}
+
+
+
+/* draw_runs:
+ *  Draws a compiled sprite from its run lists, clipping it like an RLE
+ *  sprite.
+ */
+static void draw_runs(BITMAP *dst, AL_CONST COMPILED_SPRITE *src, int x, int y)
+{
+   AL_CONST COMPILED_RUN *runs = src->runs;
+   int size = BYTES_PER_PIXEL(src->color_depth);
+   int cl, cr, ct, cb;
+   int i, j, x0, x1;
+
+   /* clip rectangle relative to the sprite */
+   if (dst->clip) {
+      cl = MAX(dst->cl - x, 0);
+      cr = MIN(dst->cr - x, src->w);
+      ct = MAX(dst->ct - y, 0);
+      cb = MIN(dst->cb - y, src->h);
+   }
+   else {
+      cl = 0;
+      cr = src->w;
+      ct = 0;
+      cb = src->h;
+   }
+
+   if ((cl >= cr) || (ct >= cb))
+      return;
+
+   bmp_select(dst);
+
+   for (j = ct; j < cb; j++) {
+      uintptr_t addr = bmp_write_line(dst, y + j) + x * size;
+
+      for (i = src->line_runs[j]; i < src->line_runs[j+1]; i++) {
+	 AL_CONST unsigned char *p;
+
+	 x0 = MAX(runs[i].x, cl);
+	 x1 = MIN(runs[i].x + runs[i].w, cr);
+	 if (x0 >= x1)
+	    continue;
+
+	 p = src->pixels + runs[i].offset + (x0 - runs[i].x) * size;
+
+#ifdef ALLEGRO_DOS
+	 {
+	    uintptr_t d = addr + x0 * size;
+	    int n = (x1 - x0) * size;
+	    for (; n > 0; n--)
+	       bmp_write8(d++, *p++);
+	 }
+#elif defined ALLEGRO_SIMD
+	 if (_al_simd_copy_row)
+	    _al_simd_copy_row((void *)(addr + x0 * size), p, (x1 - x0) * size);
+	 else
+	    memcpy((void *)(addr + x0 * size), p, (x1 - x0) * size);
+#else
+	 memcpy((void *)(addr + x0 * size), p, (x1 - x0) * size);
+#endif
+      }
+   }
+
+   bmp_unwrite_line(dst);
 }
 
 
@@ -50,6 +493,17 @@ void draw_compiled_sprite(BITMAP *dst, AL_CONST COMPILED_SPRITE *src, int x, int
 {
    ASSERT(dst);
    ASSERT(src);
-   draw_rle_sprite(dst, (COMPILED_SPRITE *)src, x, y);
-}
+   ASSERT(bitmap_color_depth(dst) == src->color_depth);
+
+#ifdef ALLEGRO_SPRITE_JIT
+   /* the generated code stores straight into the lines, without clipping */
+   if ((src->draw) && (is_memory_bitmap(dst)) &&
+       ((!dst->clip) || ((x >= dst->cl) && (y >= dst->ct) &&
+			 (x + src->w <= dst->cr) && (y + src->h <= dst->cb)))) {
+      ((COMPILED_DRAW)(uintptr_t)src->draw)(dst->line + y, x * BYTES_PER_PIXEL(src->color_depth));
+      return;
+   }
+#endif
 
+   draw_runs(dst, src, x, y);
+}
@@ -44,6 +44,7 @@
 #define DTS_BLENDER            BLENDER_FUNC
 #define MAKE_DTS_BLENDER()     _blender_func15
 #define DTS_BLEND(b,o,n)       ((*(b))((n), (o), _blender_alpha))
+#define MAKE_DTS_ROW_BLENDER() _blender_row15
 
 /* Blender for draw_lit_*_sprite.  */
 #define DLS_BLENDER            BLENDER_FUNC
@@ -55,6 +56,7 @@
 #define RGBA_BLENDER           BLENDER_FUNC
 #define MAKE_RGBA_BLENDER()    _blender_func15x
 #define RGBA_BLEND(b,o,n)      ((*(b))((n), (o), _blender_alpha))
+#define MAKE_RGBA_ROW_BLENDER() _blender_row15x
 
 /* Blender for poly_scanline_*_lit.  */
 #define PS_BLENDER             BLENDER_FUNC
@@ -75,6 +77,10 @@
 #define FUNC_LINEAR_BLIT_BACKWARD           _linear_blit_backward15
 #define FUNC_LINEAR_MASKED_BLIT             _linear_masked_blit15
 
+#define SIMD_RLE_RUN(d, s, n)               _al_simd_copy_row((d), (s), (n) * 2)
+#define SIMD_RLE_RUN_OK                     (_al_simd_copy_row)
+#define SIMD_PTEX_ROW                       _al_simd_ptex_row16
+
 #define FUNC_LINEAR_PUTPIXEL                _linear_putpixel15
 #define FUNC_LINEAR_GETPIXEL                _linear_getpixel15
 #define FUNC_LINEAR_HLINE                   _linear_hline15
@@ -112,5 +118,10 @@
 #define FUNC_POLY_SCANLINE_PTEX_TRANS       _poly_scanline_ptex_trans15
 #define FUNC_POLY_SCANLINE_PTEX_MASK_TRANS  _poly_scanline_ptex_mask_trans15
 
+#define FUNC_POLY_SCANLINE_PTEX_SIMD        _poly_scanline_ptex_simd15
+#define FUNC_POLY_SCANLINE_PTEX_MASK_SIMD   _poly_scanline_ptex_mask_simd15
+#define FUNC_POLY_SCANLINE_PTEX_LIT_SIMD    _poly_scanline_ptex_lit_simd15
+#define FUNC_POLY_SCANLINE_PTEX_MASK_LIT_SIMD _poly_scanline_ptex_mask_lit_simd15
+
 #endif /* !__bma_cdefs15_h */
 
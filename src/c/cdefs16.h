@@ -45,6 +45,7 @@
 #define DTS_BLENDER            BLENDER_FUNC
 #define MAKE_DTS_BLENDER()     _blender_func16
 #define DTS_BLEND(b,o,n)       ((*(b))((n), (o), _blender_alpha))
+#define MAKE_DTS_ROW_BLENDER() _blender_row16
 
 /* Blender for draw_lit_*_sprite.  */
 #define DLS_BLENDER            BLENDER_FUNC
@@ -56,6 +57,7 @@
 #define RGBA_BLENDER           BLENDER_FUNC
 #define MAKE_RGBA_BLENDER()    _blender_func16x
 #define RGBA_BLEND(b,o,n)      ((*(b))((n), (o), _blender_alpha))
+#define MAKE_RGBA_ROW_BLENDER() _blender_row16x
 
 /* Blender for poly_scanline_*_lit.  */
 #define PS_BLENDER             BLENDER_FUNC
@@ -76,6 +78,16 @@
 #define FUNC_LINEAR_BLIT_BACKWARD           _linear_blit_backward16
 #define FUNC_LINEAR_MASKED_BLIT             _linear_masked_blit16
 
+#define FUNC_LINEAR_CLEAR_TO_COLOR_SIMD     _linear_clear_to_color_simd16
+#define FUNC_LINEAR_BLIT_SIMD               _linear_blit_simd16
+#define FUNC_LINEAR_MASKED_BLIT_SIMD        _linear_masked_blit_simd16
+
+#define SIMD_FILL_ROW                       _al_simd_fill_row16
+#define SIMD_MASKED_ROW                     _al_simd_masked_row16
+#define SIMD_RLE_RUN(d, s, n)               _al_simd_copy_row((d), (s), (n) * 2)
+#define SIMD_RLE_RUN_OK                     (_al_simd_copy_row)
+#define SIMD_PTEX_ROW                       _al_simd_ptex_row16
+
 #define FUNC_LINEAR_PUTPIXEL                _linear_putpixel16
 #define FUNC_LINEAR_GETPIXEL                _linear_getpixel16
 #define FUNC_LINEAR_HLINE                   _linear_hline16
@@ -113,5 +125,10 @@
 #define FUNC_POLY_SCANLINE_PTEX_TRANS       _poly_scanline_ptex_trans16
 #define FUNC_POLY_SCANLINE_PTEX_MASK_TRANS  _poly_scanline_ptex_mask_trans16
 
+#define FUNC_POLY_SCANLINE_PTEX_SIMD        _poly_scanline_ptex_simd16
+#define FUNC_POLY_SCANLINE_PTEX_MASK_SIMD   _poly_scanline_ptex_mask_simd16
+#define FUNC_POLY_SCANLINE_PTEX_LIT_SIMD    _poly_scanline_ptex_lit_simd16
+#define FUNC_POLY_SCANLINE_PTEX_MASK_LIT_SIMD _poly_scanline_ptex_mask_lit_simd16
+
 #endif /* !__bma_cdefs16_h */
 
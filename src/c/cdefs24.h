@@ -75,6 +75,18 @@
 #define FUNC_LINEAR_BLIT_BACKWARD           _linear_blit_backward24
 #define FUNC_LINEAR_MASKED_BLIT             _linear_masked_blit24
 
+#define FUNC_LINEAR_CLEAR_TO_COLOR_SIMD     _linear_clear_to_color_simd24
+#define FUNC_LINEAR_BLIT_SIMD               _linear_blit_simd24
+#define FUNC_LINEAR_MASKED_BLIT_SIMD        _linear_masked_blit_simd24
+
+#define SIMD_FILL_ROW                       _al_simd_fill_row24
+#define SIMD_MASKED_ROW                     _al_simd_masked_row24
+
+#ifdef ALLEGRO_LITTLE_ENDIAN
+   #define SIMD_RLE_RUN(d, s, n)            _al_simd_conv_32_to_24((d), (s), (n), NULL)
+   #define SIMD_RLE_RUN_OK                  (_al_simd_conv_32_to_24)
+#endif
+
 #define FUNC_LINEAR_PUTPIXEL                _linear_putpixel24
 #define FUNC_LINEAR_GETPIXEL                _linear_getpixel24
 #define FUNC_LINEAR_HLINE                   _linear_hline24
@@ -70,6 +70,15 @@
 #define FUNC_LINEAR_BLIT_BACKWARD           _linear_blit_backward8
 #define FUNC_LINEAR_MASKED_BLIT             _linear_masked_blit8
 
+#define FUNC_LINEAR_CLEAR_TO_COLOR_SIMD     _linear_clear_to_color_simd8
+#define FUNC_LINEAR_BLIT_SIMD               _linear_blit_simd8
+#define FUNC_LINEAR_MASKED_BLIT_SIMD        _linear_masked_blit_simd8
+
+#define SIMD_FILL_ROW                       _al_simd_fill_row8
+#define SIMD_MASKED_ROW                     _al_simd_masked_row8
+#define SIMD_RLE_RUN(d, s, n)               _al_simd_copy_row((d), (s), (n))
+#define SIMD_RLE_RUN_OK                     (_al_simd_copy_row)
+
 #define FUNC_LINEAR_PUTPIXEL                _linear_putpixel8
 #define FUNC_LINEAR_GETPIXEL                _linear_getpixel8
 #define FUNC_LINEAR_HLINE                   _linear_hline8
@@ -0,0 +1,396 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SSE2, AVX2 and NEON texel fetchers for the perspective correct
+ *      polygon scanline fillers.
+ *
+ *      The true texture position is worked out with one divide every
+ *      8 or 16 pixels, and the texel offsets in between are interpolated
+ *      in vector registers. The positions are 16.16 fixed
+ *      point; the lanes only keep their low 32 bits, which is all the
+ *      masking by the texture size ever looks at.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+
+#ifdef ALLEGRO_SIMD
+
+AL_SIMD_PTEX_ROW _al_simd_ptex_row16 = NULL;
+AL_SIMD_PTEX_ROW _al_simd_ptex_row32 = NULL;
+
+
+
+/* ptex_curvature:
+ *  Returns the largest second derivative of the 16.16 position a/(c+dx)
+ *  over a scanline of w pixels, where a moves on by b each pixel.
+ */
+static double ptex_curvature(double a, double b, double c, double d, int w)
+{
+   double zmin = MIN(ABS(c), ABS(c + d * w));
+   double k = 2. * (b * c - a * d) * d;
+
+   if (zmin <= 0.)
+      return 1e30;
+
+   return ABS(k) / (zmin * zmin * zmin);
+}
+
+
+
+/* _al_simd_ptex_start:
+ *  Sets up a texture walk from the start of a scanline segment of w
+ *  pixels. Straight interpolation over n pixels strays from the true
+ *  position by at most n*n/8 times the second derivative, so the long
+ *  span is only used where that stays under a quarter of a texel.
+ */
+void _al_simd_ptex_start(AL_SIMD_PTEX *p, AL_CONST POLYGON_SEGMENT *info, int w)
+{
+   double z1 = 1. / info->z;
+   double e;
+   int span;
+
+   e = MAX(ptex_curvature(info->fu, info->dfu, info->z, info->dz, w),
+	   ptex_curvature(info->fv, info->dfv, info->z, info->dz, w));
+
+   if (e * (AL_SIMD_PTEX_SPAN * AL_SIMD_PTEX_SPAN / 8) < 0x4000)
+      p->shift = 4;
+   else
+      p->shift = 3;
+
+   span = 1 << p->shift;
+
+   p->texture = info->texture;
+   p->fu = info->fu;
+   p->fv = info->fv;
+   p->fz = info->z;
+   p->dfu = info->dfu * span;
+   p->dfv = info->dfv * span;
+   p->dfz = info->dz * span;
+   p->u = p->fu * z1;
+   p->v = p->fv * z1;
+   p->umask = info->umask;
+   p->vmask = info->vmask << info->vshift;
+   p->vshift = 16 - info->vshift;
+}
+
+
+
+/* _al_simd_ptex_skip:
+ *  Moves a texture walk on by w pixels without fetching anything. The
+ *  same rules for w apply as for the texel fetchers.
+ */
+void _al_simd_ptex_skip(AL_SIMD_PTEX *p, int w)
+{
+   double z1;
+
+   for (; w > 0; w -= (1 << p->shift)) {
+      p->fu += p->dfu;
+      p->fv += p->dfv;
+      p->fz += p->dfz;
+   }
+
+   z1 = 1. / p->fz;
+   p->u = p->fu * z1;
+   p->v = p->fv * z1;
+}
+
+
+
+/* ptex_step:
+ *  Moves the walk on by one span, returning the start position and the
+ *  per pixel step of the span just passed.
+ */
+static INLINE void ptex_step(AL_SIMD_PTEX *p, int *u, int *v, int *du, int *dv)
+{
+   int64_t nextu, nextv;
+   double z1;
+
+   p->fu += p->dfu;
+   p->fv += p->dfv;
+   p->fz += p->dfz;
+   z1 = 1. / p->fz;
+   nextu = p->fu * z1;
+   nextv = p->fv * z1;
+
+   *u = (int)p->u;
+   *v = (int)p->v;
+   *du = (int)((nextu - p->u) >> p->shift);
+   *dv = (int)((nextv - p->v) >> p->shift);
+
+   p->u = nextu;
+   p->v = nextv;
+}
+
+
+
+#ifdef ALLEGRO_SIMD_SSE2
+
+/* ptex_offsets_sse2:
+ *  Works out the texel offsets of the n pixels of a span.
+ */
+static INLINE void ptex_offsets_sse2(__m128i *off, int n, AL_SIMD_PTEX *p)
+{
+   __m128i umask = _mm_set1_epi32(p->umask);
+   __m128i vmask = _mm_set1_epi32(p->vmask);
+   __m128i vshift = _mm_cvtsi32_si128(p->vshift);
+   __m128i uu, vv, ustep, vstep;
+   int u, v, du, dv;
+
+   ptex_step(p, &u, &v, &du, &dv);
+
+   uu = _mm_add_epi32(_mm_set1_epi32(u), _mm_setr_epi32(0, du, du * 2, du * 3));
+   vv = _mm_add_epi32(_mm_set1_epi32(v), _mm_setr_epi32(0, dv, dv * 2, dv * 3));
+   ustep = _mm_set1_epi32(du * 4);
+   vstep = _mm_set1_epi32(dv * 4);
+
+   for (; n > 0; n -= 4) {
+      *off++ = _mm_add_epi32(_mm_and_si128(_mm_sra_epi32(vv, vshift), vmask),
+			     _mm_and_si128(_mm_srai_epi32(uu, 16), umask));
+      uu = _mm_add_epi32(uu, ustep);
+      vv = _mm_add_epi32(vv, vstep);
+   }
+}
+
+
+
+/* SSE2_PTEX_ROW:
+ *  Generates a fetcher which loads the texels one by one from the
+ *  vector computed offsets.
+ */
+#define SSE2_PTEX_ROW(name, type)                                             \
+static void name(void *dst, int w, AL_SIMD_PTEX *p)                           \
+{                                                                             \
+   AL_CONST type *texture = (AL_CONST type *)p->texture;                      \
+   type *d = dst;                                                             \
+   __m128i off[AL_SIMD_PTEX_SPAN / 4];                                        \
+   int32_t *o = (int32_t *)off;                                               \
+   int i, n;                                                                  \
+									      \
+   for (; w > 0; w -= n, d += n) {                                            \
+      n = MIN(w, 1 << p->shift);                                              \
+      ptex_offsets_sse2(off, n, p);                                           \
+									      \
+      for (i = 0; i < n; i++)                                                 \
+	 d[i] = texture[o[i]];                                                \
+   }                                                                          \
+}
+
+SSE2_PTEX_ROW(ptex_row16_sse2, uint16_t)
+SSE2_PTEX_ROW(ptex_row32_sse2, uint32_t)
+
+#endif /* ALLEGRO_SIMD_SSE2 */
+
+
+
+#ifdef ALLEGRO_SIMD_AVX2
+
+/* ptex_offsets_avx2:
+ *  Sets up the offsets of the first eight pixels of a span and the step
+ *  to the next eight.
+ */
+AL_SIMD_AVX2_FUNC static INLINE void ptex_offsets_avx2(AL_SIMD_PTEX *p, __m256i *uu, __m256i *vv, __m256i *ustep, __m256i *vstep)
+{
+   __m256i ramp = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+   int u, v, du, dv;
+
+   ptex_step(p, &u, &v, &du, &dv);
+
+   *uu = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(ramp, _mm256_set1_epi32(du)));
+   *vv = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(ramp, _mm256_set1_epi32(dv)));
+   *ustep = _mm256_set1_epi32(du * 8);
+   *vstep = _mm256_set1_epi32(dv * 8);
+}
+
+
+
+/* ptex_row16_avx2:
+ *  16-bit texels are gathered eight at a time as 32-bit words, which
+ *  would read past the end of the texture for its very last texel, so
+ *  that one is left out of the gather and filled in afterwards.
+ */
+AL_SIMD_AVX2_FUNC static void ptex_row16_avx2(void *dst, int w, AL_SIMD_PTEX *p)
+{
+   AL_CONST uint16_t *texture = (AL_CONST uint16_t *)p->texture;
+   uint16_t *d = dst;
+   int last = p->vmask | p->umask;
+   __m256i umask = _mm256_set1_epi32(p->umask);
+   __m256i vmask = _mm256_set1_epi32(p->vmask);
+   __m256i vlast = _mm256_set1_epi32(last);
+   __m256i low = _mm256_set1_epi32(0xFFFF);
+   __m128i vshift = _mm_cvtsi32_si128(p->vshift);
+   __m256i uu, vv, ustep, vstep, o, edge, t;
+   uint16_t rest[8];
+   int i, k, n, edges;
+
+   for (; w > 0; w -= n, d += n) {
+      n = MIN(w, 1 << p->shift);
+      ptex_offsets_avx2(p, &uu, &vv, &ustep, &vstep);
+
+      for (i = 0; i < n; i += 8) {
+	 uint16_t *out = (n - i >= 8) ? d + i : rest;
+
+	 o = _mm256_add_epi32(_mm256_and_si256(_mm256_sra_epi32(vv, vshift), vmask),
+			      _mm256_and_si256(_mm256_srai_epi32(uu, 16), umask));
+	 edge = _mm256_cmpeq_epi32(o, vlast);
+	 t = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (AL_CONST int *)texture, o,
+					 _mm256_xor_si256(edge, _mm256_set1_epi32(-1)), 2);
+	 t = _mm256_packus_epi32(_mm256_and_si256(t, low), _mm256_setzero_si256());
+	 t = _mm256_permute4x64_epi64(t, 0x08);
+	 _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(t));
+
+	 edges = _mm256_movemask_ps(_mm256_castsi256_ps(edge));
+	 for (k = 0; edges; k++, edges >>= 1) {
+	    if (edges & 1)
+	       out[k] = texture[last];
+	 }
+
+	 if (out == rest)
+	    memcpy(d + i, rest, (n - i) * sizeof(uint16_t));
+
+	 uu = _mm256_add_epi32(uu, ustep);
+	 vv = _mm256_add_epi32(vv, vstep);
+      }
+   }
+}
+
+
+
+/* ptex_row32_avx2:
+ *  32-bit texels are gathered eight at a time.
+ */
+AL_SIMD_AVX2_FUNC static void ptex_row32_avx2(void *dst, int w, AL_SIMD_PTEX *p)
+{
+   AL_CONST int *texture = (AL_CONST int *)p->texture;
+   uint32_t *d = dst;
+   __m256i umask = _mm256_set1_epi32(p->umask);
+   __m256i vmask = _mm256_set1_epi32(p->vmask);
+   __m128i vshift = _mm_cvtsi32_si128(p->vshift);
+   __m256i uu, vv, ustep, vstep, t;
+   uint32_t rest[8];
+   int i, n;
+
+   for (; w > 0; w -= n, d += n) {
+      n = MIN(w, 1 << p->shift);
+      ptex_offsets_avx2(p, &uu, &vv, &ustep, &vstep);
+
+      for (i = 0; i < n; i += 8) {
+	 t = _mm256_add_epi32(_mm256_and_si256(_mm256_sra_epi32(vv, vshift), vmask),
+			      _mm256_and_si256(_mm256_srai_epi32(uu, 16), umask));
+	 t = _mm256_i32gather_epi32(texture, t, 4);
+
+	 if (n - i >= 8) {
+	    _mm256_storeu_si256((__m256i *)(d + i), t);
+	 }
+	 else {
+	    _mm256_storeu_si256((__m256i *)rest, t);
+	    memcpy(d + i, rest, (n - i) * sizeof(uint32_t));
+	 }
+
+	 uu = _mm256_add_epi32(uu, ustep);
+	 vv = _mm256_add_epi32(vv, vstep);
+      }
+   }
+}
+
+#endif /* ALLEGRO_SIMD_AVX2 */
+
+
+
+#ifdef ALLEGRO_SIMD_NEON
+
+/* ptex_offsets_neon:
+ *  Works out the texel offsets of the n pixels of a span.
+ */
+static INLINE void ptex_offsets_neon(int32_t *off, int n, AL_SIMD_PTEX *p)
+{
+   static AL_CONST int32_t ramp_data[4] = { 0, 1, 2, 3 };
+   int32x4_t ramp = vld1q_s32(ramp_data);
+   int32x4_t umask = vdupq_n_s32(p->umask);
+   int32x4_t vmask = vdupq_n_s32(p->vmask);
+   int32x4_t vshift = vdupq_n_s32(-p->vshift);
+   int32x4_t uu, vv, ustep, vstep;
+   int u, v, du, dv;
+
+   ptex_step(p, &u, &v, &du, &dv);
+
+   uu = vmlaq_n_s32(vdupq_n_s32(u), ramp, du);
+   vv = vmlaq_n_s32(vdupq_n_s32(v), ramp, dv);
+   ustep = vdupq_n_s32(du * 4);
+   vstep = vdupq_n_s32(dv * 4);
+
+   for (; n > 0; n -= 4, off += 4) {
+      vst1q_s32(off, vaddq_s32(vandq_s32(vshlq_s32(vv, vshift), vmask),
+			       vandq_s32(vshrq_n_s32(uu, 16), umask)));
+      uu = vaddq_s32(uu, ustep);
+      vv = vaddq_s32(vv, vstep);
+   }
+}
+
+
+
+#define NEON_PTEX_ROW(name, type)                                             \
+static void name(void *dst, int w, AL_SIMD_PTEX *p)                           \
+{                                                                             \
+   AL_CONST type *texture = (AL_CONST type *)p->texture;                      \
+   type *d = dst;                                                             \
+   int32_t o[AL_SIMD_PTEX_SPAN];                                              \
+   int i, n;                                                                  \
+									      \
+   for (; w > 0; w -= n, d += n) {                                            \
+      n = MIN(w, 1 << p->shift);                                              \
+      ptex_offsets_neon(o, n, p);                                             \
+									      \
+      for (i = 0; i < n; i++)                                                 \
+	 d[i] = texture[o[i]];                                                \
+   }                                                                          \
+}
+
+NEON_PTEX_ROW(ptex_row16_neon, uint16_t)
+NEON_PTEX_ROW(ptex_row32_neon, uint32_t)
+
+#endif /* ALLEGRO_SIMD_NEON */
+
+
+
+/* _al_simd_init_texturers:
+ *  Picks the texel fetchers for the running CPU.
+ */
+void _al_simd_init_texturers(void)
+{
+#ifdef ALLEGRO_SIMD_SSE2
+   _al_simd_ptex_row16 = ptex_row16_sse2;
+   _al_simd_ptex_row32 = ptex_row32_sse2;
+
+#ifdef ALLEGRO_SIMD_AVX2
+   if (cpu_capabilities & CPU_AVX2) {
+      _al_simd_ptex_row16 = ptex_row16_avx2;
+      _al_simd_ptex_row32 = ptex_row32_avx2;
+   }
+#endif
+#endif
+
+#ifdef ALLEGRO_SIMD_NEON
+   if (cpu_capabilities & CPU_NEON) {
+      _al_simd_ptex_row16 = ptex_row16_neon;
+      _al_simd_ptex_row32 = ptex_row32_neon;
+   }
+#endif
+}
+
+#endif /* ALLEGRO_SIMD */
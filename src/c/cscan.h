@@ -728,5 +728,144 @@ void FUNC_POLY_SCANLINE_PTEX_MASK_TRANS(uintptr_t addr, int w, POLYGON_SEGMENT *
    }
 }
 
+#if (defined ALLEGRO_SIMD) && (defined FUNC_POLY_SCANLINE_PTEX_SIMD)
+
+/* Texels are fetched into a buffer this many pixels at a time when they
+ * still need masking or lighting. It must be a multiple of the span.
+ */
+#define PTEX_SIMD_CHUNK   (AL_SIMD_PTEX_SPAN * 4)
+
+
+
+/* _poly_scanline_ptex_simd:
+ *  Version of _poly_scanline_ptex using the SIMD texel fetchers.
+ */
+void FUNC_POLY_SCANLINE_PTEX_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   AL_SIMD_PTEX p;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   SIMD_PTEX_ROW((void *)addr, w, &p);
+}
+
+
+
+/* _poly_scanline_ptex_mask_simd:
+ *  Version of _poly_scanline_ptex_mask using the SIMD texel fetchers.
+ */
+void FUNC_POLY_SCANLINE_PTEX_MASK_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   PIXEL_PTR d;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   d = (PIXEL_PTR) addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 unsigned long color = GET_MEMORY_PIXEL(s);
+
+	 if (!IS_MASK(color)) {
+	    PUT_PIXEL(d, color);
+	 }
+      }
+   }
+}
+
+
+
+/* _poly_scanline_ptex_lit_simd:
+ *  Version of _poly_scanline_ptex_lit using the SIMD texel fetchers.
+ */
+void FUNC_POLY_SCANLINE_PTEX_LIT_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   fixed c, dc;
+   PS_BLENDER blender;
+   PIXEL_PTR d;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   c = info->c;
+   dc = info->dc;
+   blender = MAKE_PS_BLENDER();
+   d = (PIXEL_PTR) addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 unsigned long color = GET_MEMORY_PIXEL(s);
+	 color = PS_BLEND(blender, (c >> 16), color);
+
+	 PUT_PIXEL(d, color);
+	 c += dc;
+      }
+   }
+}
+
+
+
+/* _poly_scanline_ptex_mask_lit_simd:
+ *  Version of _poly_scanline_ptex_mask_lit using the SIMD texel fetchers.
+ */
+void FUNC_POLY_SCANLINE_PTEX_MASK_LIT_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   fixed c, dc;
+   PS_BLENDER blender;
+   PIXEL_PTR d;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   c = info->c;
+   dc = info->dc;
+   blender = MAKE_PS_BLENDER();
+   d = (PIXEL_PTR) addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 unsigned long color = GET_MEMORY_PIXEL(s);
+
+	 if (!IS_MASK(color)) {
+	    color = PS_BLEND(blender, (c >> 16), color);
+	    PUT_PIXEL(d, color);
+	 }
+	 c += dc;
+      }
+   }
+}
+
+#endif /* ALLEGRO_SIMD && FUNC_POLY_SCANLINE_PTEX_SIMD */
+
 #endif /* !__bma_cscan_h */
 
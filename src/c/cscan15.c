@@ -24,6 +24,7 @@
 
 #include "allegro/internal/aintern.h"
 #include "cdefs15.h"
+#include "csimd.h"
 #include "cscan.h"
 
 #endif
@@ -0,0 +1,1136 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SSE2, AVX2 and NEON row kernels for the linear bitmap blitters,
+ *      and the code that plugs them into the linear vtables.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+
+#ifdef ALLEGRO_SIMD
+
+AL_SIMD_FILL_ROW _al_simd_fill_row8 = NULL;
+AL_SIMD_FILL_ROW _al_simd_fill_row16 = NULL;
+AL_SIMD_FILL_ROW _al_simd_fill_row24 = NULL;
+AL_SIMD_FILL_ROW _al_simd_fill_row32 = NULL;
+
+AL_SIMD_COPY_ROW _al_simd_copy_row = NULL;
+
+AL_SIMD_MASKED_ROW _al_simd_masked_row8 = NULL;
+AL_SIMD_MASKED_ROW _al_simd_masked_row16 = NULL;
+AL_SIMD_MASKED_ROW _al_simd_masked_row24 = NULL;
+AL_SIMD_MASKED_ROW _al_simd_masked_row32 = NULL;
+
+AL_SIMD_SCALE_ROW _al_simd_scale_row16 = NULL;
+AL_SIMD_SCALE_ROW _al_simd_scale_row32 = NULL;
+
+AL_SIMD_LERP_ROW _al_simd_lerp_row = NULL;
+
+AL_SIMD_SPAN_ROW _al_simd_span_row8 = NULL;
+AL_SIMD_SPAN_ROW _al_simd_span_row16 = NULL;
+AL_SIMD_SPAN_ROW _al_simd_span_row32 = NULL;
+
+
+/* Rows longer than this are handed to memmove(), which libc already
+ * implements with the widest stores the machine has. The inline copy
+ * only wins for the short rows typical of sprites.
+ */
+#define COPY_ROW_MEMMOVE_SIZE    256
+
+
+
+/* make_pattern24:
+ *  Writes n pixels of the given 24-bit color to pat, in memory order.
+ */
+static void make_pattern24(unsigned char *pat, int n, int color)
+{
+   int i;
+
+   for (i = 0; i < n; i++)
+      WRITE3BYTES(pat + i * 3, color);
+}
+
+
+
+/* make_pattern32:
+ *  Replicates an 8, 16 or 32-bit color across 32 bits.
+ */
+static uint32_t make_pattern32(int color, int bpp)
+{
+   if (bpp == 1)
+      return (color & 0xFF) * 0x01010101U;
+   else if (bpp == 2)
+      return (color & 0xFFFF) * 0x00010001U;
+   else
+      return (uint32_t)color;
+}
+
+
+
+/* masked_tail*:
+ *  Plain C versions for the pixels that do not fill a whole vector.
+ */
+static void masked_tail8(unsigned char *d, AL_CONST unsigned char *s, int w, int mask)
+{
+   for (; w > 0; w--, s++, d++) {
+      if (*s != (unsigned char)mask)
+	 *d = *s;
+   }
+}
+
+static void masked_tail16(uint16_t *d, AL_CONST uint16_t *s, int w, int mask)
+{
+   for (; w > 0; w--, s++, d++) {
+      if (*s != (uint16_t)mask)
+	 *d = *s;
+   }
+}
+
+static void masked_tail24(unsigned char *d, AL_CONST unsigned char *s, int w, int mask)
+{
+   for (; w > 0; w--, s += 3, d += 3) {
+      unsigned long c = READ3BYTES(s);
+      if (c != (unsigned long)mask)
+	 WRITE3BYTES(d, c);
+   }
+}
+
+static void masked_tail32(uint32_t *d, AL_CONST uint32_t *s, int w, int mask)
+{
+   for (; w > 0; w--, s++, d++) {
+      if (*s != (uint32_t)mask)
+	 *d = *s;
+   }
+}
+
+
+
+static void scale_tail16(uint16_t *d, AL_CONST uint16_t *s, int w, int k)
+{
+   int i;
+
+   for (; w > 0; w--, s++)
+      for (i = 0; i < k; i++)
+	 *d++ = *s;
+}
+
+static void scale_tail32(uint32_t *d, AL_CONST uint32_t *s, int w, int k)
+{
+   int i;
+
+   for (; w > 0; w--, s++)
+      for (i = 0; i < k; i++)
+	 *d++ = *s;
+}
+
+static void lerp_tail(unsigned char *d, AL_CONST unsigned char *a, AL_CONST unsigned char *b, int bytes, int f)
+{
+   for (; bytes > 0; bytes--)
+      *d++ = (*a++ * (256 - f) + *b++ * f + 128) >> 8;
+}
+
+
+
+/* SPAN_TAIL:
+ *  Finishes a span in C from pixel x on, see AL_SIMD_SPAN_ROW.
+ */
+#define SPAN_TAIL(name, type, keep)                                           \
+static int name(AL_CONST type *s, int x, int w, int mask, int solid)          \
+{                                                                             \
+   for (solid = (solid != 0); x < w; x++)                                     \
+      if (((int)(s[x] & keep) != mask) != solid)                              \
+	 break;                                                               \
+									      \
+   return x;                                                                  \
+}
+
+SPAN_TAIL(span_tail8, unsigned char, 0xFF)
+SPAN_TAIL(span_tail16, uint16_t, 0xFFFF)
+SPAN_TAIL(span_tail32, uint32_t, 0xFFFFFF)
+
+
+
+/* span_stop:
+ *  Returns the position of the first pixel in a vector whose compare
+ *  bits are not the wanted ones, with bytes compare bits per pixel.
+ */
+static INLINE int span_stop(unsigned int bits, int bytes)
+{
+   int n = 0;
+
+   while (!(bits & 1)) {
+      bits >>= 1;
+      n++;
+   }
+
+   return n / bytes;
+}
+
+
+
+#ifdef ALLEGRO_SIMD_SSE2
+
+/* fill_bytes_sse2:
+ *  Fills bytes with a pattern whose period divides 16.
+ */
+static void fill_bytes_sse2(unsigned char *d, int bytes, __m128i c)
+{
+   unsigned char *end = d + bytes;
+
+   if (bytes < 16) {
+      unsigned char tmp[16];
+      _mm_storeu_si128((__m128i *)tmp, c);
+      memcpy(d, tmp, bytes);
+      return;
+   }
+
+   for (; d + 16 <= end; d += 16)
+      _mm_storeu_si128((__m128i *)d, c);
+
+   /* finish with an overlapping store, the pattern period keeps it in phase */
+   if (d < end)
+      _mm_storeu_si128((__m128i *)(end - 16), c);
+}
+
+
+
+static void fill_row8_sse2(void *dst, int w, int color)
+{
+   fill_bytes_sse2(dst, w, _mm_set1_epi32(make_pattern32(color, 1)));
+}
+
+static void fill_row16_sse2(void *dst, int w, int color)
+{
+   fill_bytes_sse2(dst, w * 2, _mm_set1_epi32(make_pattern32(color, 2)));
+}
+
+static void fill_row32_sse2(void *dst, int w, int color)
+{
+   fill_bytes_sse2(dst, w * 4, _mm_set1_epi32(color));
+}
+
+
+
+/* fill_row24_sse2:
+ *  24-bit pixels repeat every 48 bytes, so this writes three vectors at
+ *  a time.
+ */
+static void fill_row24_sse2(void *dst, int w, int color)
+{
+   unsigned char pat[48];
+   unsigned char *d = dst;
+   unsigned char *end = d + w * 3;
+   __m128i c0, c1, c2;
+
+   make_pattern24(pat, 16, color);
+
+   if (w < 16) {
+      memcpy(d, pat, w * 3);
+      return;
+   }
+
+   c0 = _mm_loadu_si128((__m128i *)(pat));
+   c1 = _mm_loadu_si128((__m128i *)(pat + 16));
+   c2 = _mm_loadu_si128((__m128i *)(pat + 32));
+
+   for (; d + 48 <= end; d += 48) {
+      _mm_storeu_si128((__m128i *)(d), c0);
+      _mm_storeu_si128((__m128i *)(d + 16), c1);
+      _mm_storeu_si128((__m128i *)(d + 32), c2);
+   }
+
+   if (d < end) {
+      d = end - 48;
+      _mm_storeu_si128((__m128i *)(d), c0);
+      _mm_storeu_si128((__m128i *)(d + 16), c1);
+      _mm_storeu_si128((__m128i *)(d + 32), c2);
+   }
+}
+
+
+
+/* copy_row_sse2:
+ *  Inline copy for short, non overlapping rows.
+ */
+static void copy_row_sse2(void *dst, AL_CONST void *src, int bytes)
+{
+   unsigned char *d = dst;
+   AL_CONST unsigned char *s = src;
+
+   if ((bytes >= COPY_ROW_MEMMOVE_SIZE) || (bytes < 16) ||
+       ((d < s + bytes) && (s < d + bytes))) {
+      memmove(d, s, bytes);
+      return;
+   }
+
+   for (; bytes >= 16; bytes -= 16, s += 16, d += 16)
+      _mm_storeu_si128((__m128i *)d, _mm_loadu_si128((__m128i *)s));
+
+   if (bytes > 0)
+      _mm_storeu_si128((__m128i *)(d + bytes - 16), _mm_loadu_si128((__m128i *)(s + bytes - 16)));
+}
+
+
+
+/* SSE2_MASKED_ROW:
+ *  Compares a vector of pixels against the mask color, skips the store
+ *  if they are all masked, stores directly if none are, and merges with
+ *  the destination otherwise.
+ */
+#define SSE2_MASKED_ROW(name, type, per_vec, set1, cmpeq, tail)               \
+static void name(void *dst, AL_CONST void *src, int w, int mask)              \
+{                                                                             \
+   type *d = dst;                                                             \
+   AL_CONST type *s = src;                                                    \
+   __m128i m = set1(mask);                                                    \
+									      \
+   for (; w >= per_vec; w -= per_vec, s += per_vec, d += per_vec) {           \
+      __m128i c = _mm_loadu_si128((__m128i *)s);                              \
+      __m128i t = cmpeq(c, m);                                                \
+      int bits = _mm_movemask_epi8(t);                                        \
+									      \
+      if (bits == 0) {                                                        \
+	 _mm_storeu_si128((__m128i *)d, c);                                   \
+      }                                                                       \
+      else if (bits != 0xFFFF) {                                              \
+	 __m128i o = _mm_loadu_si128((__m128i *)d);                           \
+	 _mm_storeu_si128((__m128i *)d, _mm_or_si128(_mm_and_si128(t, o),     \
+						     _mm_andnot_si128(t, c)));\
+      }                                                                       \
+   }                                                                          \
+									      \
+   tail(d, s, w, mask);                                                       \
+}
+
+SSE2_MASKED_ROW(masked_row8_sse2, unsigned char, 16, _mm_set1_epi8, _mm_cmpeq_epi8, masked_tail8)
+SSE2_MASKED_ROW(masked_row16_sse2, uint16_t, 8, _mm_set1_epi16, _mm_cmpeq_epi16, masked_tail16)
+SSE2_MASKED_ROW(masked_row32_sse2, uint32_t, 4, _mm_set1_epi32, _mm_cmpeq_epi32, masked_tail32)
+
+
+
+/* masked_row24_sse2:
+ *  Handles 16 pixels (three vectors) at a time. A pixel is masked only if
+ *  all three of its bytes match, which is worked out on the byte compare
+ *  bitmask. Groups that are neither fully masked nor fully solid fall
+ *  back to the C loop.
+ */
+static void masked_row24_sse2(void *dst, AL_CONST void *src, int w, int mask)
+{
+   unsigned char pat[48];
+   unsigned char *d = dst;
+   AL_CONST unsigned char *s = src;
+   __m128i m0, m1, m2;
+
+   make_pattern24(pat, 16, mask);
+   m0 = _mm_loadu_si128((__m128i *)(pat));
+   m1 = _mm_loadu_si128((__m128i *)(pat + 16));
+   m2 = _mm_loadu_si128((__m128i *)(pat + 32));
+
+   for (; w >= 16; w -= 16, s += 48, d += 48) {
+      __m128i c0 = _mm_loadu_si128((__m128i *)(s));
+      __m128i c1 = _mm_loadu_si128((__m128i *)(s + 16));
+      __m128i c2 = _mm_loadu_si128((__m128i *)(s + 32));
+      uint64_t eq, px;
+
+      eq = (uint64_t)(_mm_movemask_epi8(_mm_cmpeq_epi8(c0, m0)) & 0xFFFF) |
+	   ((uint64_t)(_mm_movemask_epi8(_mm_cmpeq_epi8(c1, m1)) & 0xFFFF) << 16) |
+	   ((uint64_t)(_mm_movemask_epi8(_mm_cmpeq_epi8(c2, m2)) & 0xFFFF) << 32);
+
+      /* one bit per pixel, at bit 3*n */
+      px = eq & (eq >> 1) & (eq >> 2) & 0x249249249249ULL;
+
+      if (px == 0) {
+	 _mm_storeu_si128((__m128i *)(d), c0);
+	 _mm_storeu_si128((__m128i *)(d + 16), c1);
+	 _mm_storeu_si128((__m128i *)(d + 32), c2);
+      }
+      else if (px != 0x249249249249ULL) {
+	 masked_tail24(d, s, 16, mask);
+      }
+   }
+
+   masked_tail24(d, s, w, mask);
+}
+
+
+
+/* scale_row16_sse2:
+ *  Duplicates 8 pixels per vector by interleaving them with themselves.
+ *  Tripling has no cheap shuffle for 16 bit lanes and stays in C.
+ */
+static void scale_row16_sse2(void *dst, AL_CONST void *src, int w, int k)
+{
+   uint16_t *d = dst;
+   AL_CONST uint16_t *s = src;
+
+   if (k == 2) {
+      for (; w >= 8; w -= 8, s += 8, d += 16) {
+	 __m128i c = _mm_loadu_si128((__m128i *)s);
+	 _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(c, c));
+	 _mm_storeu_si128((__m128i *)(d + 8), _mm_unpackhi_epi16(c, c));
+      }
+   }
+   else if (k == 4) {
+      for (; w >= 8; w -= 8, s += 8, d += 32) {
+	 __m128i c = _mm_loadu_si128((__m128i *)s);
+	 __m128i lo = _mm_unpacklo_epi16(c, c);
+	 __m128i hi = _mm_unpackhi_epi16(c, c);
+	 _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi32(lo, lo));
+	 _mm_storeu_si128((__m128i *)(d + 8), _mm_unpackhi_epi32(lo, lo));
+	 _mm_storeu_si128((__m128i *)(d + 16), _mm_unpacklo_epi32(hi, hi));
+	 _mm_storeu_si128((__m128i *)(d + 24), _mm_unpackhi_epi32(hi, hi));
+      }
+   }
+
+   scale_tail16(d, s, w, k);
+}
+
+
+
+/* scale_row32_sse2:
+ *  Replicates 4 pixels per vector with 32 bit shuffles.
+ */
+static void scale_row32_sse2(void *dst, AL_CONST void *src, int w, int k)
+{
+   uint32_t *d = dst;
+   AL_CONST uint32_t *s = src;
+
+   if (k == 2) {
+      for (; w >= 4; w -= 4, s += 4, d += 8) {
+	 __m128i c = _mm_loadu_si128((__m128i *)s);
+	 _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi32(c, c));
+	 _mm_storeu_si128((__m128i *)(d + 4), _mm_unpackhi_epi32(c, c));
+      }
+   }
+   else if (k == 3) {
+      for (; w >= 4; w -= 4, s += 4, d += 12) {
+	 __m128i c = _mm_loadu_si128((__m128i *)s);
+	 _mm_storeu_si128((__m128i *)d, _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 0, 0)));
+	 _mm_storeu_si128((__m128i *)(d + 4), _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 2, 1, 1)));
+	 _mm_storeu_si128((__m128i *)(d + 8), _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 3, 3, 2)));
+      }
+   }
+   else {
+      for (; w >= 4; w -= 4, s += 4, d += 16) {
+	 __m128i c = _mm_loadu_si128((__m128i *)s);
+	 _mm_storeu_si128((__m128i *)d, _mm_shuffle_epi32(c, _MM_SHUFFLE(0, 0, 0, 0)));
+	 _mm_storeu_si128((__m128i *)(d + 4), _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 1, 1, 1)));
+	 _mm_storeu_si128((__m128i *)(d + 8), _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 2, 2, 2)));
+	 _mm_storeu_si128((__m128i *)(d + 12), _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 3, 3, 3)));
+      }
+   }
+
+   scale_tail32(d, s, w, k);
+}
+
+
+
+/* lerp_row_sse2:
+ *  Mixes 16 bytes per vector in 16 bit lanes. The weights add up to 256,
+ *  so the sum never overflows a lane and the result matches lerp_tail().
+ */
+static void lerp_row_sse2(void *dst, AL_CONST void *a, AL_CONST void *b, int bytes, int f)
+{
+   unsigned char *d = dst;
+   AL_CONST unsigned char *pa = a;
+   AL_CONST unsigned char *pb = b;
+   __m128i zero = _mm_setzero_si128();
+   __m128i fa = _mm_set1_epi16(256 - f);
+   __m128i fb = _mm_set1_epi16(f);
+   __m128i half = _mm_set1_epi16(128);
+
+   for (; bytes >= 16; bytes -= 16, pa += 16, pb += 16, d += 16) {
+      __m128i ca = _mm_loadu_si128((__m128i *)pa);
+      __m128i cb = _mm_loadu_si128((__m128i *)pb);
+      __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(ca, zero), fa),
+				 _mm_mullo_epi16(_mm_unpacklo_epi8(cb, zero), fb));
+      __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(ca, zero), fa),
+				 _mm_mullo_epi16(_mm_unpackhi_epi8(cb, zero), fb));
+      lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+      hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+      _mm_storeu_si128((__m128i *)d, _mm_packus_epi16(lo, hi));
+   }
+
+   lerp_tail(d, pa, pb, bytes, f);
+}
+
+
+
+/* SSE2_SPAN_ROW:
+ *  Compares a vector of pixels against the mask color and stops at the
+ *  first one which ends the span.
+ */
+#define SSE2_SPAN_ROW(name, type, per_vec, set1, cmpeq, keep, tail)           \
+static int name(AL_CONST void *src, int w, int mask, int solid)               \
+{                                                                             \
+   AL_CONST type *s = src;                                                    \
+   __m128i m = set1(mask);                                                    \
+   __m128i k = _mm_set1_epi32(keep);                                          \
+   unsigned int want = solid ? 0 : 0xFFFF;                                    \
+   int x;                                                                     \
+									      \
+   for (x = 0; x + per_vec <= w; x += per_vec) {                              \
+      __m128i c = _mm_and_si128(_mm_loadu_si128((__m128i *)(s + x)), k);      \
+      unsigned int bits = _mm_movemask_epi8(cmpeq(c, m)) ^ want;              \
+									      \
+      if (bits)                                                               \
+	 return x + span_stop(bits, sizeof(type));                            \
+   }                                                                          \
+									      \
+   return tail(s, x, w, mask, solid);                                         \
+}
+
+SSE2_SPAN_ROW(span_row8_sse2, unsigned char, 16, _mm_set1_epi8, _mm_cmpeq_epi8, -1, span_tail8)
+SSE2_SPAN_ROW(span_row16_sse2, uint16_t, 8, _mm_set1_epi16, _mm_cmpeq_epi16, -1, span_tail16)
+SSE2_SPAN_ROW(span_row32_sse2, uint32_t, 4, _mm_set1_epi32, _mm_cmpeq_epi32, 0xFFFFFF, span_tail32)
+
+#endif /* ALLEGRO_SIMD_SSE2 */
+
+
+
+#ifdef ALLEGRO_SIMD_AVX2
+
+AL_SIMD_AVX2_FUNC static void fill_bytes_avx2(unsigned char *d, int bytes, uint32_t pattern)
+{
+   unsigned char *end = d + bytes;
+   __m256i c = _mm256_set1_epi32(pattern);
+
+   if (bytes < 32) {
+      fill_bytes_sse2(d, bytes, _mm_set1_epi32(pattern));
+      return;
+   }
+
+   for (; d + 32 <= end; d += 32)
+      _mm256_storeu_si256((__m256i *)d, c);
+
+   if (d < end)
+      _mm256_storeu_si256((__m256i *)(end - 32), c);
+}
+
+
+
+static void fill_row8_avx2(void *dst, int w, int color)
+{
+   fill_bytes_avx2(dst, w, make_pattern32(color, 1));
+}
+
+static void fill_row16_avx2(void *dst, int w, int color)
+{
+   fill_bytes_avx2(dst, w * 2, make_pattern32(color, 2));
+}
+
+static void fill_row32_avx2(void *dst, int w, int color)
+{
+   fill_bytes_avx2(dst, w * 4, color);
+}
+
+
+
+AL_SIMD_AVX2_FUNC static void fill_row24_avx2(void *dst, int w, int color)
+{
+   unsigned char pat[96];
+   unsigned char *d = dst;
+   unsigned char *end = d + w * 3;
+   __m256i c0, c1, c2;
+
+   if (w < 32) {
+      fill_row24_sse2(dst, w, color);
+      return;
+   }
+
+   make_pattern24(pat, 32, color);
+   c0 = _mm256_loadu_si256((__m256i *)(pat));
+   c1 = _mm256_loadu_si256((__m256i *)(pat + 32));
+   c2 = _mm256_loadu_si256((__m256i *)(pat + 64));
+
+   for (; d + 96 <= end; d += 96) {
+      _mm256_storeu_si256((__m256i *)(d), c0);
+      _mm256_storeu_si256((__m256i *)(d + 32), c1);
+      _mm256_storeu_si256((__m256i *)(d + 64), c2);
+   }
+
+   if (d < end) {
+      d = end - 96;
+      _mm256_storeu_si256((__m256i *)(d), c0);
+      _mm256_storeu_si256((__m256i *)(d + 32), c1);
+      _mm256_storeu_si256((__m256i *)(d + 64), c2);
+   }
+}
+
+
+
+AL_SIMD_AVX2_FUNC static void copy_row_avx2(void *dst, AL_CONST void *src, int bytes)
+{
+   unsigned char *d = dst;
+   AL_CONST unsigned char *s = src;
+
+   if ((bytes >= COPY_ROW_MEMMOVE_SIZE) || (bytes < 32) ||
+       ((d < s + bytes) && (s < d + bytes))) {
+      copy_row_sse2(d, s, bytes);
+      return;
+   }
+
+   for (; bytes >= 32; bytes -= 32, s += 32, d += 32)
+      _mm256_storeu_si256((__m256i *)d, _mm256_loadu_si256((__m256i *)s));
+
+   if (bytes > 0)
+      _mm256_storeu_si256((__m256i *)(d + bytes - 32), _mm256_loadu_si256((__m256i *)(s + bytes - 32)));
+}
+
+
+
+/* AVX2_MASKED_ROW:
+ *  Same as SSE2_MASKED_ROW with twice the width, the remainder goes
+ *  through the SSE2 version.
+ */
+#define AVX2_MASKED_ROW(name, type, per_vec, set1, cmpeq, sse2_version)       \
+AL_SIMD_AVX2_FUNC static void name(void *dst, AL_CONST void *src, int w, int mask) \
+{                                                                             \
+   type *d = dst;                                                             \
+   AL_CONST type *s = src;                                                    \
+   __m256i m = set1(mask);                                                    \
+									      \
+   for (; w >= per_vec; w -= per_vec, s += per_vec, d += per_vec) {           \
+      __m256i c = _mm256_loadu_si256((__m256i *)s);                           \
+      __m256i t = cmpeq(c, m);                                                \
+      int bits = _mm256_movemask_epi8(t);                                     \
+									      \
+      if (bits == 0) {                                                        \
+	 _mm256_storeu_si256((__m256i *)d, c);                                \
+      }                                                                       \
+      else if (bits != -1) {                                                  \
+	 __m256i o = _mm256_loadu_si256((__m256i *)d);                        \
+	 _mm256_storeu_si256((__m256i *)d, _mm256_blendv_epi8(c, o, t));      \
+      }                                                                       \
+   }                                                                          \
+									      \
+   sse2_version(d, s, w, mask);                                               \
+}
+
+AVX2_MASKED_ROW(masked_row8_avx2, unsigned char, 32, _mm256_set1_epi8, _mm256_cmpeq_epi8, masked_row8_sse2)
+AVX2_MASKED_ROW(masked_row16_avx2, uint16_t, 16, _mm256_set1_epi16, _mm256_cmpeq_epi16, masked_row16_sse2)
+AVX2_MASKED_ROW(masked_row32_avx2, uint32_t, 8, _mm256_set1_epi32, _mm256_cmpeq_epi32, masked_row32_sse2)
+
+
+
+/* lerp_row_avx2:
+ *  Same as lerp_row_sse2() with twice the width. The unpacks and the
+ *  final pack both work within 128 bit lanes, so the byte order holds.
+ */
+AL_SIMD_AVX2_FUNC static void lerp_row_avx2(void *dst, AL_CONST void *a, AL_CONST void *b, int bytes, int f)
+{
+   unsigned char *d = dst;
+   AL_CONST unsigned char *pa = a;
+   AL_CONST unsigned char *pb = b;
+   __m256i zero = _mm256_setzero_si256();
+   __m256i fa = _mm256_set1_epi16(256 - f);
+   __m256i fb = _mm256_set1_epi16(f);
+   __m256i half = _mm256_set1_epi16(128);
+
+   for (; bytes >= 32; bytes -= 32, pa += 32, pb += 32, d += 32) {
+      __m256i ca = _mm256_loadu_si256((__m256i *)pa);
+      __m256i cb = _mm256_loadu_si256((__m256i *)pb);
+      __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(ca, zero), fa),
+				    _mm256_mullo_epi16(_mm256_unpacklo_epi8(cb, zero), fb));
+      __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(ca, zero), fa),
+				    _mm256_mullo_epi16(_mm256_unpackhi_epi8(cb, zero), fb));
+      lo = _mm256_srli_epi16(_mm256_add_epi16(lo, half), 8);
+      hi = _mm256_srli_epi16(_mm256_add_epi16(hi, half), 8);
+      _mm256_storeu_si256((__m256i *)d, _mm256_packus_epi16(lo, hi));
+   }
+
+   lerp_row_sse2(d, pa, pb, bytes, f);
+}
+
+
+
+/* AVX2_SPAN_ROW:
+ *  Same as SSE2_SPAN_ROW with twice the width.
+ */
+#define AVX2_SPAN_ROW(name, type, per_vec, set1, cmpeq, keep, tail)           \
+AL_SIMD_AVX2_FUNC static int name(AL_CONST void *src, int w, int mask, int solid) \
+{                                                                             \
+   AL_CONST type *s = src;                                                    \
+   __m256i m = set1(mask);                                                    \
+   __m256i k = _mm256_set1_epi32(keep);                                       \
+   unsigned int want = solid ? 0 : 0xFFFFFFFF;                                \
+   int x;                                                                     \
+									      \
+   for (x = 0; x + per_vec <= w; x += per_vec) {                              \
+      __m256i c = _mm256_and_si256(_mm256_loadu_si256((__m256i *)(s + x)), k); \
+      unsigned int bits = (unsigned int)_mm256_movemask_epi8(cmpeq(c, m)) ^ want; \
+									      \
+      if (bits)                                                               \
+	 return x + span_stop(bits, sizeof(type));                            \
+   }                                                                          \
+									      \
+   return tail(s, x, w, mask, solid);                                         \
+}
+
+AVX2_SPAN_ROW(span_row8_avx2, unsigned char, 32, _mm256_set1_epi8, _mm256_cmpeq_epi8, -1, span_tail8)
+AVX2_SPAN_ROW(span_row16_avx2, uint16_t, 16, _mm256_set1_epi16, _mm256_cmpeq_epi16, -1, span_tail16)
+AVX2_SPAN_ROW(span_row32_avx2, uint32_t, 8, _mm256_set1_epi32, _mm256_cmpeq_epi32, 0xFFFFFF, span_tail32)
+
+#endif /* ALLEGRO_SIMD_AVX2 */
+
+
+
+#ifdef ALLEGRO_SIMD_NEON
+
+static void fill_bytes_neon(unsigned char *d, int bytes, uint32_t pattern)
+{
+   unsigned char *end = d + bytes;
+   uint8x16_t c = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+
+   if (bytes < 16) {
+      unsigned char tmp[16];
+      vst1q_u8(tmp, c);
+      memcpy(d, tmp, bytes);
+      return;
+   }
+
+   for (; d + 16 <= end; d += 16)
+      vst1q_u8(d, c);
+
+   if (d < end)
+      vst1q_u8(end - 16, c);
+}
+
+
+
+static void fill_row8_neon(void *dst, int w, int color)
+{
+   fill_bytes_neon(dst, w, make_pattern32(color, 1));
+}
+
+static void fill_row16_neon(void *dst, int w, int color)
+{
+   fill_bytes_neon(dst, w * 2, make_pattern32(color, 2));
+}
+
+static void fill_row32_neon(void *dst, int w, int color)
+{
+   fill_bytes_neon(dst, w * 4, color);
+}
+
+
+
+/* fill_row24_neon:
+ *  vst3q interleaves three byte planes, which is exactly a 24-bit row.
+ */
+static void fill_row24_neon(void *dst, int w, int color)
+{
+   unsigned char pat[3];
+   unsigned char *d = dst;
+   uint8x16x3_t c;
+
+   make_pattern24(pat, 1, color);
+   c.val[0] = vdupq_n_u8(pat[0]);
+   c.val[1] = vdupq_n_u8(pat[1]);
+   c.val[2] = vdupq_n_u8(pat[2]);
+
+   for (; w >= 16; w -= 16, d += 48)
+      vst3q_u8(d, c);
+
+   for (; w > 0; w--, d += 3)
+      WRITE3BYTES(d, color);
+}
+
+
+
+static void copy_row_neon(void *dst, AL_CONST void *src, int bytes)
+{
+   unsigned char *d = dst;
+   AL_CONST unsigned char *s = src;
+
+   if ((bytes >= COPY_ROW_MEMMOVE_SIZE) || (bytes < 16) ||
+       ((d < s + bytes) && (s < d + bytes))) {
+      memmove(d, s, bytes);
+      return;
+   }
+
+   for (; bytes >= 16; bytes -= 16, s += 16, d += 16)
+      vst1q_u8(d, vld1q_u8(s));
+
+   if (bytes > 0)
+      vst1q_u8(d + bytes - 16, vld1q_u8(s + bytes - 16));
+}
+
+
+
+#define NEON_MASKED_ROW(name, type, per_vec, vtype, ld, st, dup, ceq, bsl, tail) \
+static void name(void *dst, AL_CONST void *src, int w, int mask)              \
+{                                                                             \
+   type *d = dst;                                                             \
+   AL_CONST type *s = src;                                                    \
+   vtype m = dup((type)mask);                                                 \
+									      \
+   for (; w >= per_vec; w -= per_vec, s += per_vec, d += per_vec) {           \
+      vtype c = ld(s);                                                        \
+      st(d, bsl(ceq(c, m), ld(d), c));                                        \
+   }                                                                          \
+									      \
+   tail(d, s, w, mask);                                                       \
+}
+
+NEON_MASKED_ROW(masked_row8_neon, unsigned char, 16, uint8x16_t, vld1q_u8, vst1q_u8, vdupq_n_u8, vceqq_u8, vbslq_u8, masked_tail8)
+NEON_MASKED_ROW(masked_row16_neon, uint16_t, 8, uint16x8_t, vld1q_u16, vst1q_u16, vdupq_n_u16, vceqq_u16, vbslq_u16, masked_tail16)
+NEON_MASKED_ROW(masked_row32_neon, uint32_t, 4, uint32x4_t, vld1q_u32, vst1q_u32, vdupq_n_u32, vceqq_u32, vbslq_u32, masked_tail32)
+
+
+
+/* masked_row24_neon:
+ *  vld3q splits 16 pixels into byte planes, so the mask test is three
+ *  compares and two ands.
+ */
+static void masked_row24_neon(void *dst, AL_CONST void *src, int w, int mask)
+{
+   unsigned char pat[3];
+   unsigned char *d = dst;
+   AL_CONST unsigned char *s = src;
+   uint8x16_t m0, m1, m2;
+
+   make_pattern24(pat, 1, mask);
+   m0 = vdupq_n_u8(pat[0]);
+   m1 = vdupq_n_u8(pat[1]);
+   m2 = vdupq_n_u8(pat[2]);
+
+   for (; w >= 16; w -= 16, s += 48, d += 48) {
+      uint8x16x3_t c = vld3q_u8(s);
+      uint8x16x3_t o = vld3q_u8(d);
+      uint8x16_t t = vandq_u8(vandq_u8(vceqq_u8(c.val[0], m0),
+				       vceqq_u8(c.val[1], m1)),
+			      vceqq_u8(c.val[2], m2));
+
+      o.val[0] = vbslq_u8(t, o.val[0], c.val[0]);
+      o.val[1] = vbslq_u8(t, o.val[1], c.val[1]);
+      o.val[2] = vbslq_u8(t, o.val[2], c.val[2]);
+      vst3q_u8(d, o);
+   }
+
+   masked_tail24(d, s, w, mask);
+}
+
+
+
+/* scale_row16_neon, scale_row32_neon:
+ *  The interleaving stores write each pixel two, three or four times.
+ */
+static void scale_row16_neon(void *dst, AL_CONST void *src, int w, int k)
+{
+   uint16_t *d = dst;
+   AL_CONST uint16_t *s = src;
+
+   for (; w >= 8; w -= 8, s += 8, d += 8 * k) {
+      uint16x8_t c = vld1q_u16(s);
+
+      if (k == 2) {
+	 uint16x8x2_t o = {{ c, c }};
+	 vst2q_u16(d, o);
+      }
+      else if (k == 3) {
+	 uint16x8x3_t o = {{ c, c, c }};
+	 vst3q_u16(d, o);
+      }
+      else {
+	 uint16x8x4_t o = {{ c, c, c, c }};
+	 vst4q_u16(d, o);
+      }
+   }
+
+   scale_tail16(d, s, w, k);
+}
+
+static void scale_row32_neon(void *dst, AL_CONST void *src, int w, int k)
+{
+   uint32_t *d = dst;
+   AL_CONST uint32_t *s = src;
+
+   for (; w >= 4; w -= 4, s += 4, d += 4 * k) {
+      uint32x4_t c = vld1q_u32(s);
+
+      if (k == 2) {
+	 uint32x4x2_t o = {{ c, c }};
+	 vst2q_u32(d, o);
+      }
+      else if (k == 3) {
+	 uint32x4x3_t o = {{ c, c, c }};
+	 vst3q_u32(d, o);
+      }
+      else {
+	 uint32x4x4_t o = {{ c, c, c, c }};
+	 vst4q_u32(d, o);
+      }
+   }
+
+   scale_tail32(d, s, w, k);
+}
+
+
+
+static void lerp_row_neon(void *dst, AL_CONST void *a, AL_CONST void *b, int bytes, int f)
+{
+   unsigned char *d = dst;
+   AL_CONST unsigned char *pa = a;
+   AL_CONST unsigned char *pb = b;
+   uint8x8_t fa, fb;
+
+   /* a weight of 256 does not fit the byte multiplies */
+   if ((f == 0) || (f == 256)) {
+      memcpy(d, (f ? pb : pa), bytes);
+      return;
+   }
+
+   fa = vdup_n_u8(256 - f);
+   fb = vdup_n_u8(f);
+
+   for (; bytes >= 16; bytes -= 16, pa += 16, pb += 16, d += 16) {
+      uint8x16_t ca = vld1q_u8(pa);
+      uint8x16_t cb = vld1q_u8(pb);
+      uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(ca), fa), vget_low_u8(cb), fb);
+      uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(ca), fa), vget_high_u8(cb), fb);
+      vst1q_u8(d, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+   }
+
+   lerp_tail(d, pa, pb, bytes, f);
+}
+
+
+
+/* neon_span_bits:
+ *  NEON has no movemask: the compare result is narrowed to four bits per
+ *  byte instead, and the span ends at the first nibble which is not wanted.
+ */
+static INLINE uint64_t neon_span_bits(uint8x16_t t, int solid)
+{
+   uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(t), 4)), 0);
+
+   return solid ? bits : ~bits;
+}
+
+static INLINE int neon_span_stop(uint64_t bits, int bytes)
+{
+   int n = 0;
+
+   while (!(bits & 15)) {
+      bits >>= 4;
+      n++;
+   }
+
+   return n / bytes;
+}
+
+
+
+static int span_row8_neon(AL_CONST void *src, int w, int mask, int solid)
+{
+   AL_CONST uint8_t *s = src;
+   uint8x16_t m = vdupq_n_u8(mask);
+   uint64_t bits;
+   int x;
+
+   for (x = 0; x + 16 <= w; x += 16) {
+      bits = neon_span_bits(vceqq_u8(vld1q_u8(s + x), m), solid);
+      if (bits)
+	 return x + neon_span_stop(bits, 1);
+   }
+
+   return span_tail8(s, x, w, mask, solid);
+}
+
+static int span_row16_neon(AL_CONST void *src, int w, int mask, int solid)
+{
+   AL_CONST uint16_t *s = src;
+   uint16x8_t m = vdupq_n_u16(mask);
+   uint64_t bits;
+   int x;
+
+   for (x = 0; x + 8 <= w; x += 8) {
+      bits = neon_span_bits(vreinterpretq_u8_u16(vceqq_u16(vld1q_u16(s + x), m)), solid);
+      if (bits)
+	 return x + neon_span_stop(bits, 2);
+   }
+
+   return span_tail16(s, x, w, mask, solid);
+}
+
+static int span_row32_neon(AL_CONST void *src, int w, int mask, int solid)
+{
+   AL_CONST uint32_t *s = src;
+   uint32x4_t m = vdupq_n_u32(mask);
+   uint32x4_t k = vdupq_n_u32(0xFFFFFF);
+   uint64_t bits;
+   int x;
+
+   for (x = 0; x + 4 <= w; x += 4) {
+      bits = neon_span_bits(vreinterpretq_u8_u32(vceqq_u32(vandq_u32(vld1q_u32(s + x), k), m)), solid);
+      if (bits)
+	 return x + neon_span_stop(bits, 4);
+   }
+
+   return span_tail32(s, x, w, mask, solid);
+}
+
+#endif /* ALLEGRO_SIMD_NEON */
+
+
+
+/* replace_blitters:
+ *  Points the blit, masked blit and clear entries of a linear vtable at
+ *  the SIMD versions, leaving alone anything a driver has already
+ *  replaced with its own routine.
+ */
+static void replace_blitters(GFX_VTABLE *vtable,
+			     void (*blit)(BITMAP *, BITMAP *, int, int, int, int, int, int),
+			     void (*simd_blit)(BITMAP *, BITMAP *, int, int, int, int, int, int),
+			     void (*masked_blit)(BITMAP *, BITMAP *, int, int, int, int, int, int),
+			     void (*simd_masked_blit)(BITMAP *, BITMAP *, int, int, int, int, int, int),
+			     void (*clear)(BITMAP *, int),
+			     void (*simd_clear)(BITMAP *, int))
+{
+   #define REPLACE(field, old, new)    if (vtable->field == old) vtable->field = new
+
+   REPLACE(blit_from_memory, blit, simd_blit);
+   REPLACE(blit_to_memory, blit, simd_blit);
+   REPLACE(blit_from_system, blit, simd_blit);
+   REPLACE(blit_to_system, blit, simd_blit);
+   REPLACE(blit_to_self, blit, simd_blit);
+   REPLACE(blit_to_self_forward, blit, simd_blit);
+   REPLACE(masked_blit, masked_blit, simd_masked_blit);
+   REPLACE(clear_to_color, clear, simd_clear);
+
+   #undef REPLACE
+}
+
+#endif /* ALLEGRO_SIMD */
+
+
+
+/* _al_simd_init:
+ *  Selects the row kernels for the CPU found by check_cpu() and installs
+ *  the vectorized blitters into the linear vtables. Without a usable
+ *  vector unit the C versions stay in place.
+ */
+void _al_simd_init(void)
+{
+#ifdef ALLEGRO_SIMD
+
+#ifdef ALLEGRO_SIMD_SSE2
+   /* the compiler only defines ALLEGRO_SIMD_SSE2 when SSE2 is baseline */
+   _al_simd_fill_row8 = fill_row8_sse2;
+   _al_simd_fill_row16 = fill_row16_sse2;
+   _al_simd_fill_row24 = fill_row24_sse2;
+   _al_simd_fill_row32 = fill_row32_sse2;
+   _al_simd_copy_row = copy_row_sse2;
+   _al_simd_masked_row8 = masked_row8_sse2;
+   _al_simd_masked_row16 = masked_row16_sse2;
+   _al_simd_masked_row24 = masked_row24_sse2;
+   _al_simd_masked_row32 = masked_row32_sse2;
+   _al_simd_scale_row16 = scale_row16_sse2;
+   _al_simd_scale_row32 = scale_row32_sse2;
+   _al_simd_lerp_row = lerp_row_sse2;
+   _al_simd_span_row8 = span_row8_sse2;
+   _al_simd_span_row16 = span_row16_sse2;
+   _al_simd_span_row32 = span_row32_sse2;
+
+#ifdef ALLEGRO_SIMD_AVX2
+   if (cpu_capabilities & CPU_AVX2) {
+      _al_simd_fill_row8 = fill_row8_avx2;
+      _al_simd_fill_row16 = fill_row16_avx2;
+      _al_simd_fill_row24 = fill_row24_avx2;
+      _al_simd_fill_row32 = fill_row32_avx2;
+      _al_simd_copy_row = copy_row_avx2;
+      _al_simd_masked_row8 = masked_row8_avx2;
+      _al_simd_masked_row16 = masked_row16_avx2;
+      _al_simd_masked_row32 = masked_row32_avx2;
+      _al_simd_lerp_row = lerp_row_avx2;
+      _al_simd_span_row8 = span_row8_avx2;
+      _al_simd_span_row16 = span_row16_avx2;
+      _al_simd_span_row32 = span_row32_avx2;
+   }
+#endif
+#endif
+
+#ifdef ALLEGRO_SIMD_NEON
+   if (cpu_capabilities & CPU_NEON) {
+      _al_simd_fill_row8 = fill_row8_neon;
+      _al_simd_fill_row16 = fill_row16_neon;
+      _al_simd_fill_row24 = fill_row24_neon;
+      _al_simd_fill_row32 = fill_row32_neon;
+      _al_simd_copy_row = copy_row_neon;
+      _al_simd_masked_row8 = masked_row8_neon;
+      _al_simd_masked_row16 = masked_row16_neon;
+      _al_simd_masked_row24 = masked_row24_neon;
+      _al_simd_masked_row32 = masked_row32_neon;
+      _al_simd_scale_row16 = scale_row16_neon;
+      _al_simd_scale_row32 = scale_row32_neon;
+      _al_simd_lerp_row = lerp_row_neon;
+      _al_simd_span_row8 = span_row8_neon;
+      _al_simd_span_row16 = span_row16_neon;
+      _al_simd_span_row32 = span_row32_neon;
+   }
+#endif
+
+   _al_simd_init_blenders();
+   _update_blender_rows();
+   _al_simd_init_texturers();
+   _al_simd_init_transformers();
+   _al_simd_init_coverers();
+
+#ifdef ALLEGRO_LITTLE_ENDIAN
+   _al_simd_init_converters();
+#endif
+
+   if (!_al_simd_copy_row)
+      return;
+
+#ifdef ALLEGRO_COLOR8
+   replace_blitters(&__linear_vtable8,
+		    _linear_blit8, _linear_blit_simd8,
+		    _linear_masked_blit8, _linear_masked_blit_simd8,
+		    _linear_clear_to_color8, _linear_clear_to_color_simd8);
+#endif
+
+#ifdef ALLEGRO_COLOR16
+   replace_blitters(&__linear_vtable15,
+		    _linear_blit16, _linear_blit_simd16,
+		    _linear_masked_blit16, _linear_masked_blit_simd16,
+		    _linear_clear_to_color16, _linear_clear_to_color_simd16);
+   replace_blitters(&__linear_vtable16,
+		    _linear_blit16, _linear_blit_simd16,
+		    _linear_masked_blit16, _linear_masked_blit_simd16,
+		    _linear_clear_to_color16, _linear_clear_to_color_simd16);
+#endif
+
+#ifdef ALLEGRO_COLOR24
+   replace_blitters(&__linear_vtable24,
+		    _linear_blit24, _linear_blit_simd24,
+		    _linear_masked_blit24, _linear_masked_blit_simd24,
+		    _linear_clear_to_color24, _linear_clear_to_color_simd24);
+#endif
+
+#ifdef ALLEGRO_COLOR32
+   replace_blitters(&__linear_vtable32,
+		    _linear_blit32, _linear_blit_simd32,
+		    _linear_masked_blit32, _linear_masked_blit_simd32,
+		    _linear_clear_to_color32, _linear_clear_to_color_simd32);
+#endif
+
+#endif /* ALLEGRO_SIMD */
+}
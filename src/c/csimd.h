@@ -0,0 +1,239 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Compiler glue and row kernels for the SIMD drawing routines.
+ *
+ *      The kernels are plain function pointers which _al_simd_init()
+ *      points at the best SSE2, AVX2 or NEON version for the running
+ *      CPU. They stay NULL when no vector unit is usable, in which
+ *      case the C routines are used unchanged.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#ifndef __bma_csimd_h
+#define __bma_csimd_h
+
+#include "allegro/internal/aintern.h"
+
+#if (!defined ALLEGRO_NO_SIMD) && (!defined ALLEGRO_DOS)
+
+   #if (defined __x86_64__) || (defined _M_X64) || (defined __SSE2__) || \
+       ((defined _M_IX86_FP) && (_M_IX86_FP >= 2))
+
+      #define ALLEGRO_SIMD
+      #define ALLEGRO_SIMD_SSE2
+
+      #ifndef SCAN_DEPEND
+	 #include <emmintrin.h>
+      #endif
+
+      /* AVX2 code is compiled per function, the rest of the file stays SSE2 */
+      #if (defined __clang__) || \
+	  ((defined __GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))))
+	 #define ALLEGRO_SIMD_AVX2
+	 #define AL_SIMD_AVX2_FUNC   __attribute__((target("avx2")))
+      #elif (defined _MSC_VER) && (_MSC_VER >= 1700)
+	 #define ALLEGRO_SIMD_AVX2
+	 #define AL_SIMD_AVX2_FUNC
+      #endif
+
+      #if (defined ALLEGRO_SIMD_AVX2) && (!defined SCAN_DEPEND)
+	 #include <immintrin.h>
+      #endif
+
+   #elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+
+      #define ALLEGRO_SIMD
+      #define ALLEGRO_SIMD_NEON
+
+      #ifndef SCAN_DEPEND
+	 #include <arm_neon.h>
+      #endif
+
+   #endif
+
+#endif
+
+
+#ifdef ALLEGRO_SIMD
+
+/* fills w pixels at dst with color */
+typedef void (*AL_SIMD_FILL_ROW)(void *dst, int w, int color);
+
+/* copies bytes from src to dst, which may overlap */
+typedef void (*AL_SIMD_COPY_ROW)(void *dst, AL_CONST void *src, int bytes);
+
+/* copies w pixels from src to dst, skipping those equal to mask */
+typedef void (*AL_SIMD_MASKED_ROW)(void *dst, AL_CONST void *src, int w, int mask);
+
+/* writes each of w pixels from src k times to dst, 2 <= k <= 4 */
+typedef void (*AL_SIMD_SCALE_ROW)(void *dst, AL_CONST void *src, int w, int k);
+
+/* mixes the bytes of a and b into dst as (a*(256-f) + b*f + 128) / 256 */
+typedef void (*AL_SIMD_LERP_ROW)(void *dst, AL_CONST void *a, AL_CONST void *b, int bytes, int f);
+
+/* counts the leading pixels of src which differ from mask if solid is set,
+ * or equal it otherwise; 32-bit pixels are compared on their low 24 bits
+ */
+typedef int (*AL_SIMD_SPAN_ROW)(AL_CONST void *src, int w, int mask, int solid);
+
+extern AL_SIMD_FILL_ROW _al_simd_fill_row8;
+extern AL_SIMD_FILL_ROW _al_simd_fill_row16;
+extern AL_SIMD_FILL_ROW _al_simd_fill_row24;
+extern AL_SIMD_FILL_ROW _al_simd_fill_row32;
+
+extern AL_SIMD_COPY_ROW _al_simd_copy_row;
+
+extern AL_SIMD_MASKED_ROW _al_simd_masked_row8;
+extern AL_SIMD_MASKED_ROW _al_simd_masked_row16;
+extern AL_SIMD_MASKED_ROW _al_simd_masked_row24;
+extern AL_SIMD_MASKED_ROW _al_simd_masked_row32;
+
+extern AL_SIMD_SCALE_ROW _al_simd_scale_row16;
+extern AL_SIMD_SCALE_ROW _al_simd_scale_row32;
+
+extern AL_SIMD_LERP_ROW _al_simd_lerp_row;
+
+extern AL_SIMD_SPAN_ROW _al_simd_span_row8;
+extern AL_SIMD_SPAN_ROW _al_simd_span_row16;
+extern AL_SIMD_SPAN_ROW _al_simd_span_row32;
+
+
+/* blends w pixels of src onto dst with alpha n, skipping those equal to mask */
+typedef void (*AL_SIMD_BLEND_ROW)(void *dst, AL_CONST void *src, int w, int n, int mask);
+
+/* scanline blenders, see cblend.c */
+extern AL_SIMD_BLEND_ROW _al_simd_blend_trans15;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_trans16;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_alpha15;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_alpha16;
+
+extern AL_SIMD_BLEND_ROW _al_simd_blend_trans32;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_alpha32;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_add32;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_multiply32;
+extern AL_SIMD_BLEND_ROW _al_simd_blend_screen32;
+
+AL_FUNC(void, _al_simd_init_blenders, (void));
+
+
+/* converts w pixels from src to dst, table is the palette for 8-bit sources */
+typedef void (*AL_SIMD_CONV_ROW)(void *dst, AL_CONST void *src, int w, AL_CONST int *table);
+
+/* row converters between pixel formats, see cconv.c */
+extern AL_SIMD_CONV_ROW _al_simd_conv_8_to_32;
+extern AL_SIMD_CONV_ROW _al_simd_conv_15_to_32;
+extern AL_SIMD_CONV_ROW _al_simd_conv_16_to_32;
+extern AL_SIMD_CONV_ROW _al_simd_conv_32_to_16;
+extern AL_SIMD_CONV_ROW _al_simd_conv_24_to_32;
+extern AL_SIMD_CONV_ROW _al_simd_conv_32_to_24;
+
+AL_FUNC(void, _al_simd_init_converters, (void));
+
+
+/* state of a perspective correct walk through a texture along a scanline */
+typedef struct AL_SIMD_PTEX
+{
+   AL_CONST unsigned char *texture;
+   double fu, fv, fz;               /* u/z, v/z and 1/z at the next span */
+   double dfu, dfv, dfz;            /* their steps across a whole span */
+   int64_t u, v;                    /* 16.16 texture position at the next span */
+   int shift;                       /* log2 of the span length */
+   int umask, vmask, vshift;        /* as used by the C scanline fillers */
+} AL_SIMD_PTEX;
+
+/* the perspective is corrected every 8 or 16 pixels, at most this many */
+#define AL_SIMD_PTEX_SPAN     16
+
+/* fetches the next w texels of a walk to dst; w must be a multiple of
+ * AL_SIMD_PTEX_SPAN except on the last call for a scanline
+ */
+typedef void (*AL_SIMD_PTEX_ROW)(void *dst, int w, AL_SIMD_PTEX *p);
+
+/* texel fetchers, see cptex.c */
+extern AL_SIMD_PTEX_ROW _al_simd_ptex_row16;
+extern AL_SIMD_PTEX_ROW _al_simd_ptex_row32;
+
+AL_FUNC(void, _al_simd_ptex_start, (AL_SIMD_PTEX *p, AL_CONST POLYGON_SEGMENT *info, int w));
+AL_FUNC(void, _al_simd_ptex_skip, (AL_SIMD_PTEX *p, int w));
+AL_FUNC(void, _al_simd_init_texturers, (void));
+
+
+/* transforms and/or projects n vertices, returning how many were done */
+typedef int (*AL_SIMD_XFORM_ROW)(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out, int project);
+
+/* vertex transformer, see cxform.c */
+extern AL_SIMD_XFORM_ROW _al_simd_xform_v3d;
+
+AL_FUNC(void, _al_simd_init_transformers, (void));
+
+
+/* blends color onto dst, weighting each pixel by its coverage value in
+ * cov, returning how many of the w pixels were done
+ */
+typedef int (*AL_SIMD_COVER_ROW)(void *dst, AL_CONST unsigned char *cov, int w, int color);
+
+/* anti-aliased text blenders, see ccover.c */
+extern AL_SIMD_COVER_ROW _al_simd_cover_row15;
+extern AL_SIMD_COVER_ROW _al_simd_cover_row16;
+extern AL_SIMD_COVER_ROW _al_simd_cover_row32;
+
+AL_FUNC(void, _al_simd_init_coverers, (void));
+
+
+/* vectorized perspective correct scanline fillers, see cscan.h and czscan.h */
+AL_FUNC(void, _poly_scanline_ptex_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_mask_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_lit_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_mask_lit_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_mask_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_lit_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_mask_lit_simd15, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+
+AL_FUNC(void, _poly_scanline_ptex_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_mask_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_lit_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_mask_lit_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_mask_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_lit_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_mask_lit_simd16, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+
+AL_FUNC(void, _poly_scanline_ptex_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_mask_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_lit_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_scanline_ptex_mask_lit_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_mask_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_lit_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+AL_FUNC(void, _poly_zbuf_ptex_mask_lit_simd32, (uintptr_t addr, int w, POLYGON_SEGMENT *info));
+
+/* vectorized blitters, see cblit.h */
+AL_FUNC(void, _linear_clear_to_color_simd8, (BITMAP *bitmap, int color));
+AL_FUNC(void, _linear_blit_simd8, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+AL_FUNC(void, _linear_masked_blit_simd8, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+
+AL_FUNC(void, _linear_clear_to_color_simd16, (BITMAP *bitmap, int color));
+AL_FUNC(void, _linear_blit_simd16, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+AL_FUNC(void, _linear_masked_blit_simd16, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+
+AL_FUNC(void, _linear_clear_to_color_simd24, (BITMAP *bitmap, int color));
+AL_FUNC(void, _linear_blit_simd24, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+AL_FUNC(void, _linear_masked_blit_simd24, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+
+AL_FUNC(void, _linear_clear_to_color_simd32, (BITMAP *bitmap, int color));
+AL_FUNC(void, _linear_blit_simd32, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+AL_FUNC(void, _linear_masked_blit_simd32, (BITMAP *source, BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
+
+#endif
+
+#endif /* !__bma_csimd_h */
@@ -659,6 +659,19 @@ void FUNC_LINEAR_DRAW_TRANS_SPRITE(BITMAP *dst, BITMAP *src, int dx, int dy)
 
       bmp_unwrite_line(dst);
    }
+#ifdef MAKE_DTS_ROW_BLENDER
+   else if (MAKE_DTS_ROW_BLENDER()) {
+      /* one of the standard blenders, which can do a whole row at once */
+      BLENDER_ROW_FUNC row_blender = MAKE_DTS_ROW_BLENDER();
+
+      for (y = 0; y < h; y++) {
+	 PIXEL_PTR s = OFFSET_PIXEL_PTR(src->line[sybeg + y], sxbeg);
+	 PIXEL_PTR d = OFFSET_PIXEL_PTR(dst->line[dybeg + y], dxbeg);
+
+	 row_blender(d, s, w, _blender_alpha, src->vtable->mask_color);
+      }
+   }
+#endif
    else {
       for (y = 0; y < h; y++) {
 	 PIXEL_PTR s = OFFSET_PIXEL_PTR(src->line[sybeg + y], sxbeg);
@@ -729,6 +742,22 @@ void FUNC_LINEAR_DRAW_TRANS_RGBA_SPRITE(BITMAP *dst, BITMAP *src, int dx, int dy
 
    blender = MAKE_RGBA_BLENDER();
 
+#ifdef MAKE_RGBA_ROW_BLENDER
+   if ((MAKE_RGBA_ROW_BLENDER()) && (!(dst->id & (BMP_ID_VIDEO | BMP_ID_SYSTEM)))) {
+      /* one of the standard blenders, which can do a whole row at once */
+      BLENDER_ROW_FUNC row_blender = MAKE_RGBA_ROW_BLENDER();
+
+      for (y = 0; y < h; y++) {
+	 uint32_t *s = (uint32_t *)src->line[sybeg + y] + sxbeg;
+	 PIXEL_PTR d = OFFSET_PIXEL_PTR(dst->line[dybeg + y], dxbeg);
+
+	 row_blender(d, s, w, _blender_alpha, MASK_COLOR_32);
+      }
+
+      return;
+   }
+#endif
+
    bmp_select(dst);
 
    for (y = 0; y < h; y++) {
@@ -920,6 +949,39 @@ void FUNC_LINEAR_DRAW_CHARACTER(BITMAP *dst, BITMAP *src, int dx, int dy, int co
 
 
 
+/* RLE_SOLID_RUN:
+ *  Draws a run of n solid pixels from an RLE sprite, advancing both
+ *  pointers. Long runs are copied with the SIMD row kernels.
+ */
+#if (defined SIMD_RLE_RUN) && (defined ALLEGRO_SIMD)
+   #define RLE_SIMD_RUN   8
+
+   #define RLE_SOLID_RUN(d, s, n)                                            \
+   {                                                                         \
+      if (((n) >= RLE_SIMD_RUN) && (SIMD_RLE_RUN_OK)) {                      \
+	 SIMD_RLE_RUN(d, s, n);                                              \
+	 s += (n);                                                           \
+	 d = OFFSET_PIXEL_PTR(d, n);                                         \
+      }                                                                      \
+      else {                                                                 \
+	 for (; (n) > 0; s++, INC_PIXEL_PTR(d), (n)--) {                      \
+	    unsigned long col = *s;                                          \
+	    PUT_PIXEL(d, col);                                               \
+	 }                                                                   \
+      }                                                                      \
+   }
+#else
+   #define RLE_SOLID_RUN(d, s, n)                                            \
+   {                                                                         \
+      for (; (n) > 0; s++, INC_PIXEL_PTR(d), (n)--) {                         \
+	 unsigned long col = *s;                                             \
+	 PUT_PIXEL(d, col);                                                  \
+      }                                                                      \
+   }
+#endif
+
+
+
 /* _linear_draw_rle_sprite:
  *  Draws an RLE sprite onto a linear bitmap at the specified position.
  */
@@ -1027,18 +1089,12 @@ void FUNC_LINEAR_DRAW_RLE_SPRITE(BITMAP *dst, AL_CONST RLE_SPRITE *src, int dx,
 	       if ((x - c) >= 0) {
 	          /* Fully visible.  */
 	          x -= c;
-	          for (c--; c >= 0; s++, INC_PIXEL_PTR(d), c--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_SOLID_RUN(d, s, c);
 	       }
 	       else {
 	          /* Clipped on the right.  */
 	          c -= x;
-	          for (x--; x >= 0; s++, INC_PIXEL_PTR(d), x--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_SOLID_RUN(d, s, x);
 	          break;
 	       }
 	    }
@@ -1075,18 +1131,12 @@ void FUNC_LINEAR_DRAW_RLE_SPRITE(BITMAP *dst, AL_CONST RLE_SPRITE *src, int dx,
 	       if ((x - c) >= 0) {
 	          /* Fully visible.  */
 	          x -= c;
-	          for (c--; c >= 0; s++, INC_PIXEL_PTR(d), c--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_SOLID_RUN(d, s, c);
 	       }
 	       else {
 	          /* Clipped on the right.  */
 	          c -= x;
-	          for (x--; x >= 0; s++, INC_PIXEL_PTR(d), x--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_SOLID_RUN(d, s, x);
 	          break;
 	       }
 	    }
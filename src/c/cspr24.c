@@ -22,6 +22,7 @@
 
 #include "allegro/internal/aintern.h"
 #include "cdefs24.h"
+#include "csimd.h"
 #include "cspr.h"
 
 #endif
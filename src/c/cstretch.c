@@ -17,54 +17,104 @@
  */
 
 
+#include <string.h>
+
 #include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+
+/* the fast paths store whole rows through plain pointers */
+#ifdef ALLEGRO_DOS
+   #define DIRECT_ROWS(bmp)      is_memory_bitmap(bmp)
+#else
+   #define DIRECT_ROWS(bmp)      is_linear_bitmap(bmp)
+#endif
+
+
+static int stretch_filter = STRETCH_NEAREST;
 
 
 
 /* Information for stretching line */
-static struct {
+typedef struct STRETCH_INFO {
    int xcstart; /* x counter start */
    int sxinc; /* amount to increment src x every time */
    int xcdec; /* amount to deccrement counter by, increase sptr when this reaches 0 */
    int xcinc; /* amount to increment counter by when it reaches 0 */
    int linesize; /* size of a whole row of pixels */
-} _al_stretch;
+} STRETCH_INFO;
+
+
+/* Information for stretching a range of rows */
+typedef struct STRETCH_ROWS {
+   BITMAP *src, *dst;
+   void (*stretch_line)(uintptr_t, unsigned char *, AL_CONST STRETCH_INFO *);
+   STRETCH_INFO st;
+   int sxofs, dxofs; /* start offsets */
+   int dy, sy; /* first (unclipped) dst row and its src row */
+   int syinc, ycdec, ycinc; /* src y stepping, see _al_stretch_blit() */
+   int dybeg, dyend; /* rows to draw */
+   int bands; /* number of bands when threaded */
+   int reuse_rows; /* copy the previous dst row when the src row repeats */
+   int filter; /* STRETCH_* filter, see set_stretch_filter() */
+   int scale; /* factor of an integer scale, or 0 */
+   int depth, size; /* color depth and pixel size */
+   int sx, sw, sh, dx, dw, dh; /* unclipped rectangles of the filters */
+   int dxbeg, dxend; /* clipped dst columns */
+} STRETCH_ROWS;
+
+
+/* State of the filtered stretchers for one band of rows */
+typedef struct STRETCH_FILTER {
+   AL_CONST STRETCH_ROWS *sr;
+   int w; /* clipped dst width */
+   int sx0, sn; /* src columns in use */
+   int *pos, *frac; /* first src column and weight (or box width) per dst column */
+   uint32_t *line; /* src row expanded to 8 bits per channel */
+   uint32_t *row[2]; /* horizontally resampled rows, see filter_row() */
+   int key[2]; /* their src rows */
+   uint32_t *out; /* finished row before packing */
+   uint32_t *acc; /* box sums of the area filter, 4 per dst column */
+   uint64_t *recip; /* 2^32 / n rounded up for the box sizes n in use */
+} STRETCH_FILTER;
 
 
 
 /* Stretcher macros */
 #define DECLARE_STRETCHER(type, size, put, get) \
-   int xc = _al_stretch.xcstart; \
-   uintptr_t dend = dptr + _al_stretch.linesize; \
+   int xc = st->xcstart; \
+   uintptr_t dend = dptr + st->linesize; \
    ASSERT(dptr); \
    ASSERT(sptr); \
-   for (; dptr < dend; dptr += size, sptr += _al_stretch.sxinc) { \
+   for (; dptr < dend; dptr += size, sptr += st->sxinc) { \
       put(dptr, get((type*)sptr)); \
       if (xc <= 0) { \
 	 sptr += size; \
-	 xc += _al_stretch.xcinc; \
+	 xc += st->xcinc; \
       } \
       else \
-	 xc -= _al_stretch.xcdec; \
+	 xc -= st->xcdec; \
    }
 
 
 
 #define DECLARE_MASKED_STRETCHER(type, size, put, get, mask) \
-   int xc = _al_stretch.xcstart; \
-   uintptr_t dend = dptr + _al_stretch.linesize; \
+   int xc = st->xcstart; \
+   uintptr_t dend = dptr + st->linesize; \
    ASSERT(dptr); \
    ASSERT(sptr); \
-   for (; dptr < dend; dptr += size, sptr += _al_stretch.sxinc) { \
+   for (; dptr < dend; dptr += size, sptr += st->sxinc) { \
       int color = get((type*)sptr); \
       if (color != mask) \
 	 put(dptr, get((type*)sptr)); \
       if (xc <= 0) { \
 	 sptr += size; \
-	 xc += _al_stretch.xcinc; \
+	 xc += st->xcinc; \
       } \
       else \
-	 xc -= _al_stretch.xcdec; \
+	 xc -= st->xcdec; \
    }
 
 
@@ -73,11 +123,11 @@ static struct {
 /*
  * Mode-X line stretcher.
  */
-static void stretch_linex(uintptr_t dptr, unsigned char *sptr)
+static void stretch_linex(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    int plane;
-   int first_xc = _al_stretch.xcstart;
-   int dw = _al_stretch.linesize;
+   int first_xc = st->xcstart;
+   int dw = st->linesize;
 
    ASSERT(dptr);
    ASSERT(sptr);
@@ -90,28 +140,28 @@ static void stretch_linex(uintptr_t dptr, unsigned char *sptr)
 
       outportw(0x3C4, (0x100 << (dptr & 3)) | 2);
 
-      for (; d < dend; d++, s += 4 * _al_stretch.sxinc) {
+      for (; d < dend; d++, s += 4 * st->sxinc) {
 	 bmp_write8(d, *s);
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
       }
 
       /* Move to the beginning of next plane.  */
       if (first_xc <= 0) {
 	  sptr++;
-	  first_xc += _al_stretch.xcinc;
+	  first_xc += st->xcinc;
       }
       else
-	 first_xc -= _al_stretch.xcdec;
+	 first_xc -= st->xcdec;
 
       dptr++;
-      sptr += _al_stretch.sxinc;
+      sptr += st->sxinc;
       dw--;
    }
 }
@@ -119,11 +169,11 @@ static void stretch_linex(uintptr_t dptr, unsigned char *sptr)
 /*
  * Mode-X masked line stretcher.
  */
-static void stretch_masked_linex(uintptr_t dptr, unsigned char *sptr)
+static void stretch_masked_linex(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    int plane;
-   int dw = _al_stretch.linesize;
-   int first_xc = _al_stretch.xcstart;
+   int dw = st->linesize;
+   int first_xc = st->xcstart;
 
    ASSERT(dptr);
    ASSERT(sptr);
@@ -136,30 +186,30 @@ static void stretch_masked_linex(uintptr_t dptr, unsigned char *sptr)
 
       outportw(0x3C4, (0x100 << (dptr & 3)) | 2);
 
-      for (; d < dend; d++, s += 4 * _al_stretch.sxinc) {
+      for (; d < dend; d++, s += 4 * st->sxinc) {
 	 unsigned long color = *s;
 	 if (color != 0)
 	    bmp_write8(d, color);
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
-	 if (xc <= 0) s++, xc += _al_stretch.xcinc;
-	 else xc -= _al_stretch.xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
+	 if (xc <= 0) s++, xc += st->xcinc;
+	 else xc -= st->xcdec;
       }
 
       /* Move to the beginning of next plane.  */
       if (first_xc <= 0) {
 	 sptr++;
-	 first_xc += _al_stretch.xcinc;
+	 first_xc += st->xcinc;
       }
       else
-	 first_xc -= _al_stretch.xcdec;
+	 first_xc -= st->xcdec;
 
       dptr++;
-      sptr += _al_stretch.sxinc;
+      sptr += st->sxinc;
       dw--;
    }
 }
@@ -168,12 +218,12 @@ static void stretch_masked_linex(uintptr_t dptr, unsigned char *sptr)
 
 
 #ifdef ALLEGRO_COLOR8
-static void stretch_line8(uintptr_t dptr, unsigned char *sptr)
+static void stretch_line8(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_STRETCHER(unsigned char, 1, bmp_write8, *);
 }
 
-static void stretch_masked_line8(uintptr_t dptr, unsigned char *sptr)
+static void stretch_masked_line8(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_MASKED_STRETCHER(unsigned char, 1, bmp_write8, *, 0);
 }
@@ -182,22 +232,22 @@ static void stretch_masked_line8(uintptr_t dptr, unsigned char *sptr)
 
 
 #ifdef ALLEGRO_COLOR16
-static void stretch_line15(uintptr_t dptr, unsigned char* sptr)
+static void stretch_line15(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_STRETCHER(unsigned short, 2, bmp_write15, *);
 }
 
-static void stretch_line16(uintptr_t dptr, unsigned char* sptr)
+static void stretch_line16(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_STRETCHER(unsigned short, 2, bmp_write16, *);
 }
 
-static void stretch_masked_line15(uintptr_t dptr, unsigned char* sptr)
+static void stretch_masked_line15(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_MASKED_STRETCHER(unsigned short, 2, bmp_write15, *, MASK_COLOR_15);
 }
 
-static void stretch_masked_line16(uintptr_t dptr, unsigned char* sptr)
+static void stretch_masked_line16(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_MASKED_STRETCHER(unsigned short, 2, bmp_write16, *, MASK_COLOR_16);
 }
@@ -206,12 +256,12 @@ static void stretch_masked_line16(uintptr_t dptr, unsigned char* sptr)
 
 
 #ifdef ALLEGRO_COLOR24
-static void stretch_line24(uintptr_t dptr, unsigned char* sptr)
+static void stretch_line24(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_STRETCHER(unsigned char, 3, bmp_write24, READ3BYTES);
 }
 
-static void stretch_masked_line24(uintptr_t dptr, unsigned char* sptr)
+static void stretch_masked_line24(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_MASKED_STRETCHER(unsigned char, 3, bmp_write24, READ3BYTES, MASK_COLOR_24);
 }
@@ -220,12 +270,12 @@ static void stretch_masked_line24(uintptr_t dptr, unsigned char* sptr)
 
 
 #ifdef ALLEGRO_COLOR32
-static void stretch_line32(uintptr_t dptr, unsigned char* sptr)
+static void stretch_line32(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_STRETCHER(uint32_t, 4, bmp_write32, *);
 }
 
-static void stretch_masked_line32(uintptr_t dptr, unsigned char* sptr)
+static void stretch_masked_line32(uintptr_t dptr, unsigned char *sptr, AL_CONST STRETCH_INFO *st)
 {
    DECLARE_MASKED_STRETCHER(uint32_t, 4, bmp_write32, *, MASK_COLOR_32);
 }
@@ -233,6 +283,612 @@ static void stretch_masked_line32(uintptr_t dptr, unsigned char* sptr)
 
 
 
+/* set_stretch_filter:
+ *  Selects the filter used by stretch_blit() for truecolor bitmaps,
+ *  returning the previous one.
+ */
+int set_stretch_filter(int filter)
+{
+   int old = stretch_filter;
+
+   ASSERT((filter >= STRETCH_NEAREST) && (filter <= STRETCH_AREA));
+
+   stretch_filter = filter;
+
+   return old;
+}
+
+
+
+/*
+ * Row copy for the cached rows.
+ */
+static INLINE void copy_row(void *dst, AL_CONST void *src, int bytes)
+{
+#ifdef ALLEGRO_SIMD
+   if (_al_simd_copy_row) {
+      _al_simd_copy_row(dst, src, bytes);
+      return;
+   }
+#endif
+
+   memcpy(dst, src, bytes);
+}
+
+
+
+/*
+ * Stretches the dst rows [ybeg, yend).
+ */
+static void stretch_rows(AL_CONST STRETCH_ROWS *sr, int ybeg, int yend)
+{
+   BITMAP *src = sr->src;
+   BITMAP *dst = sr->dst;
+   int y = sr->dy;
+   int sy = sr->sy;
+   int yc = sr->ycinc;
+   int last_sy = -1;
+   uintptr_t last = 0;
+
+   /* skip clipped lines */
+   for (; y < ybeg; y++, sy += sr->syinc) {
+      if (yc <= 0) {
+	 sy++;
+	 yc += sr->ycinc;
+      }
+      else
+	    yc -= sr->ycdec;
+   }
+
+   /* Stretch it */
+
+   bmp_select(dst);
+
+   for (; y < yend; y++, sy += sr->syinc) {
+      uintptr_t d = bmp_write_line(dst, y) + sr->dxofs;
+
+      /* when enlarging, rows repeat: copy instead of stretching again */
+      if ((sr->reuse_rows) && (sy == last_sy))
+	 copy_row((void *)d, (void *)last, sr->st.linesize);
+      else
+	 (*sr->stretch_line)(d, src->line[sy] + sr->sxofs, &sr->st);
+
+      last = d;
+      last_sy = sy;
+
+      if (yc <= 0) {
+	 sy++;
+	 yc += sr->ycinc;
+      }
+      else
+	    yc -= sr->ycdec;
+   }
+   
+   bmp_unwrite_line(dst);
+}
+
+
+
+/*
+ * Writes each of w pixels k times.
+ */
+static void replicate_row(unsigned char *d, AL_CONST unsigned char *s, int w, int k, int size)
+{
+   int i;
+
+#ifdef ALLEGRO_SIMD
+   if ((size == 2) && (_al_simd_scale_row16)) {
+      _al_simd_scale_row16(d, s, w, k);
+      return;
+   }
+   if ((size == 4) && (_al_simd_scale_row32)) {
+      _al_simd_scale_row32(d, s, w, k);
+      return;
+   }
+#endif
+
+   for (; w > 0; w--, s += size)
+      for (i = 0; i < k; i++, d += size)
+	 memcpy(d, s, size);
+}
+
+
+
+/*
+ * Integer scaling of the dst rows [ybeg, yend): each src row is widened
+ * once into a buffer, which is then copied to all k dst rows. The result
+ * is the same as with stretch_rows().
+ */
+static void scale_rows(AL_CONST STRETCH_ROWS *sr, int ybeg, int yend)
+{
+   BITMAP *src = sr->src;
+   BITMAP *dst = sr->dst;
+   int k = sr->scale;
+   int size = sr->size;
+   int first = sr->dxbeg - sr->dx;
+   int sx0 = first / k;
+   int sx1 = (sr->dxend - sr->dx - 1) / k + 1;
+   int skip = (first - sx0 * k) * size;
+   int bytes = (sr->dxend - sr->dxbeg) * size;
+   int last_sy = -1;
+   unsigned char *buf;
+   int y;
+
+   buf = _AL_MALLOC_ATOMIC((sx1 - sx0) * k * size);
+   if (!buf) {
+      stretch_rows(sr, ybeg, yend);
+      return;
+   }
+
+   bmp_select(dst);
+
+   for (y = ybeg; y < yend; y++) {
+      int sy = sr->sy + (y - sr->dy) / k;
+
+      if (sy != last_sy) {
+	 replicate_row(buf, src->line[sy] + (sr->sx + sx0) * size, sx1 - sx0, k, size);
+	 last_sy = sy;
+      }
+
+      copy_row((void *)(bmp_write_line(dst, y) + sr->dxbeg * size), buf + skip, bytes);
+   }
+
+   bmp_unwrite_line(dst);
+
+   _AL_FREE(buf);
+}
+
+
+
+/* Mixes two 8888 pixels, the same as lerp_row() does per byte */
+#define LERP_PIXEL(a, b, f)                                                   \
+   ((((((a) & 0xFF00FF) * (256 - (f)) + ((b) & 0xFF00FF) * (f) + 0x800080) >> 8) & 0xFF00FF) | \
+    (((((a) >> 8) & 0xFF00FF) * (256 - (f)) + (((b) >> 8) & 0xFF00FF) * (f) + 0x800080) & 0xFF00FF00))
+
+
+
+/*
+ * Mixes two 8888 rows with the weight f (0-256) of the second one.
+ */
+static void lerp_row(uint32_t *d, AL_CONST uint32_t *a, AL_CONST uint32_t *b, int w, int f)
+{
+#ifdef ALLEGRO_SIMD
+   if (_al_simd_lerp_row) {
+      _al_simd_lerp_row(d, a, b, w * 4, f);
+      return;
+   }
+#endif
+
+   for (; w > 0; w--, a++, b++)
+      *d++ = LERP_PIXEL(*a, *b, f);
+}
+
+
+
+/*
+ * Expands w pixels of a 15, 16 or 24-bit row to 8 bits per channel.
+ * The channels keep the order of the fields, which is all the filters
+ * need.
+ */
+static void unpack_row(uint32_t *d, AL_CONST unsigned char *s, int w, int depth)
+{
+   AL_CONST uint16_t *s16 = (AL_CONST uint16_t *)s;
+   int c;
+
+#if (defined ALLEGRO_SIMD) && (defined ALLEGRO_LITTLE_ENDIAN)
+   AL_SIMD_CONV_ROW conv = NULL;
+
+   if (depth == 15)
+      conv = _al_simd_conv_15_to_32;
+   else if (depth == 16)
+      conv = _al_simd_conv_16_to_32;
+   else if (depth == 24)
+      conv = _al_simd_conv_24_to_32;
+
+   if (conv) {
+      conv(d, s, w, NULL);
+      return;
+   }
+#endif
+
+   switch (depth) {
+
+      case 15:
+	 for (; w > 0; w--) {
+	    c = *s16++;
+	    *d++ = _rgb_scale_5[c & 0x1F] | (_rgb_scale_5[(c >> 5) & 0x1F] << 8) |
+		   (_rgb_scale_5[(c >> 10) & 0x1F] << 16);
+	 }
+	 break;
+
+      case 16:
+	 for (; w > 0; w--) {
+	    c = *s16++;
+	    *d++ = _rgb_scale_5[c & 0x1F] | (_rgb_scale_6[(c >> 5) & 0x3F] << 8) |
+		   (_rgb_scale_5[(c >> 11) & 0x1F] << 16);
+	 }
+	 break;
+
+      case 24:
+	 for (; w > 0; w--, s += 3)
+	    *d++ = READ3BYTES(s);
+	 break;
+   }
+}
+
+
+
+/*
+ * Packs w pixels of 8 bits per channel back into the dst format.
+ */
+static void pack_row(unsigned char *d, AL_CONST uint32_t *s, int w, int depth)
+{
+   uint16_t *d16 = (uint16_t *)d;
+   uint32_t c;
+
+#if (defined ALLEGRO_SIMD) && (defined ALLEGRO_LITTLE_ENDIAN)
+   if ((depth == 16) && (_al_simd_conv_32_to_16)) {
+      _al_simd_conv_32_to_16(d, s, w, NULL);
+      return;
+   }
+   if ((depth == 24) && (_al_simd_conv_32_to_24)) {
+      _al_simd_conv_32_to_24(d, s, w, NULL);
+      return;
+   }
+#endif
+
+   switch (depth) {
+
+      case 15:
+	 for (; w > 0; w--) {
+	    c = *s++;
+	    *d16++ = ((c >> 3) & 0x001F) | ((c >> 6) & 0x03E0) | ((c >> 9) & 0x7C00);
+	 }
+	 break;
+
+      case 16:
+	 for (; w > 0; w--) {
+	    c = *s++;
+	    *d16++ = ((c >> 3) & 0x001F) | ((c >> 5) & 0x07E0) | ((c >> 8) & 0xF800);
+	 }
+	 break;
+
+      case 24:
+	 for (; w > 0; w--, d += 3) {
+	    c = *s++;
+	    WRITE3BYTES(d, c);
+	 }
+	 break;
+
+      case 32:
+	 copy_row(d, s, w * 4);
+	 break;
+   }
+}
+
+
+
+/*
+ * Maps n dst pixels, starting at first of dn, onto sn src pixels with
+ * the pixel centres lined up. pos gets the src pixel to the left and frac
+ * the weight (0-255) of the one to the right of it.
+ */
+static void bilinear_coords(int *pos, int *frac, int first, int n, int sn, int dn)
+{
+   int64_t p;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      p = ((int64_t)(2 * (first + i) + 1) * sn * 256) / (2 * dn) - 128;
+
+      if (p <= 0) {
+	 pos[i] = 0;
+	 frac[i] = 0;
+      }
+      else if (p >= (int64_t)(sn - 1) * 256) {
+	 pos[i] = sn - 1;
+	 frac[i] = 0;
+      }
+      else {
+	 pos[i] = (int)(p >> 8);
+	 frac[i] = (int)(p & 255);
+      }
+   }
+}
+
+
+
+/*
+ * Maps n dst pixels, starting at first of dn, onto boxes of the sn src
+ * pixels. pos gets the first src pixel of each box and len its size,
+ * which is at least one.
+ */
+static void area_coords(int *pos, int *len, int first, int n, int sn, int dn)
+{
+   int x0, x1;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      x0 = (int)((int64_t)(first + i) * sn / dn);
+      x1 = (int)((int64_t)(first + i + 1) * sn / dn);
+
+      pos[i] = x0;
+      len[i] = MAX(x1 - x0, 1);
+   }
+}
+
+
+
+/*
+ * Returns row y of the src rectangle with 8 bits per channel, starting at
+ * src column sx0.
+ */
+static AL_CONST uint32_t *fetch_row(STRETCH_FILTER *sf, int y)
+{
+   AL_CONST STRETCH_ROWS *sr = sf->sr;
+   AL_CONST unsigned char *s = sr->src->line[sr->sy + y] + (sr->sx + sf->sx0) * sr->size;
+
+   if (sr->depth == 32)
+      return (AL_CONST uint32_t *)s;
+
+   unpack_row(sf->line, s, sf->sn, sr->depth);
+
+   return sf->line;
+}
+
+
+
+/*
+ * Returns src row y resampled horizontally to the dst width. The last two
+ * are cached, and when enlarging most dst rows only need those. The slot
+ * holding src row keep is not replaced.
+ */
+static AL_CONST uint32_t *filter_row(STRETCH_FILTER *sf, int y, int keep)
+{
+   AL_CONST uint32_t *s;
+   uint32_t *d;
+   int i, f;
+
+   if (sf->key[0] == y)
+      return sf->row[0];
+
+   if (sf->key[1] == y)
+      return sf->row[1];
+
+   i = (sf->key[0] == keep) ? 1 : 0;
+   sf->key[i] = y;
+   d = sf->row[i];
+
+   s = fetch_row(sf, y);
+
+   for (i = 0; i < sf->w; i++) {
+      f = sf->frac[i];
+      if (f)
+	 d[i] = LERP_PIXEL(s[sf->pos[i]], s[sf->pos[i] + 1], f);
+      else
+	 d[i] = s[sf->pos[i]];
+   }
+
+   return d;
+}
+
+
+
+/*
+ * Adds the box sums of one src row to the accumulators. Boxes up to 257
+ * pixels wide are summed two channels at a time in 16 bit halves.
+ */
+static void area_add_row(uint32_t *acc, AL_CONST uint32_t *s, AL_CONST int *pos, AL_CONST int *len, int w)
+{
+   AL_CONST uint32_t *p;
+   uint32_t c, rb, ga;
+   int i, j;
+
+   for (i = 0; i < w; i++, acc += 4) {
+      p = s + pos[i];
+
+      if (len[i] == 1) {
+	 c = *p;
+	 acc[0] += c & 0xFF;
+	 acc[1] += (c >> 8) & 0xFF;
+	 acc[2] += (c >> 16) & 0xFF;
+	 acc[3] += c >> 24;
+      }
+      else if (len[i] <= 257) {
+	 rb = ga = 0;
+	 for (j = 0; j < len[i]; j++) {
+	    rb += p[j] & 0xFF00FF;
+	    ga += (p[j] >> 8) & 0xFF00FF;
+	 }
+	 acc[0] += rb & 0xFFFF;
+	 acc[1] += ga & 0xFFFF;
+	 acc[2] += rb >> 16;
+	 acc[3] += ga >> 16;
+      }
+      else {
+	 for (j = 0; j < len[i]; j++) {
+	    c = p[j];
+	    acc[0] += c & 0xFF;
+	    acc[1] += (c >> 8) & 0xFF;
+	    acc[2] += (c >> 16) & 0xFF;
+	    acc[3] += c >> 24;
+	 }
+      }
+   }
+}
+
+
+
+/*
+ * Divides the box sums by the box sizes, rounding to nearest. Sizes below
+ * AREA_RECIPROCALS use the reciprocal table, which is exact for them since
+ * a sum is never more than 255 times its size.
+ */
+#define AREA_RECIPROCALS   4096
+
+static void area_average(uint32_t *d, AL_CONST uint32_t *acc, AL_CONST int *len, int rows, int w, AL_CONST uint64_t *recip)
+{
+   uint64_t m;
+   int i, n;
+
+   for (i = 0; i < w; i++, acc += 4) {
+      n = len[i] * rows;
+
+      if (n == 1) {
+	 d[i] = acc[0] | (acc[1] << 8) | (acc[2] << 16) | (acc[3] << 24);
+      }
+      else if (n < AREA_RECIPROCALS) {
+	 m = recip[n];
+	 d[i] = (uint32_t)(((acc[0] + n/2) * m) >> 32) |
+		((uint32_t)(((acc[1] + n/2) * m) >> 32) << 8) |
+		((uint32_t)(((acc[2] + n/2) * m) >> 32) << 16) |
+		((uint32_t)(((acc[3] + n/2) * m) >> 32) << 24);
+      }
+      else {
+	 d[i] = ((acc[0] + n/2) / n) | (((acc[1] + n/2) / n) << 8) |
+		(((acc[2] + n/2) / n) << 16) | (((acc[3] + n/2) / n) << 24);
+      }
+   }
+}
+
+
+
+/*
+ * Filtered stretching of the dst rows [ybeg, yend), see set_stretch_filter().
+ */
+static void filter_rows(AL_CONST STRETCH_ROWS *sr, int ybeg, int yend)
+{
+   BITMAP *dst = sr->dst;
+   STRETCH_FILTER sf;
+   int first = sr->dxbeg - sr->dx;
+   int w = sr->dxend - sr->dxbeg;
+   int last_y0 = -1;
+   int y0, yn, n, x, y;
+   void *mem;
+
+   /* room for AREA_RECIPROCALS first, which keeps them aligned */
+   mem = _AL_MALLOC_ATOMIC(AREA_RECIPROCALS * sizeof(uint64_t) + w * 2 * sizeof(int) +
+			   (sr->sw + w * 7) * sizeof(uint32_t));
+   if (!mem) {
+      stretch_rows(sr, ybeg, yend);
+      return;
+   }
+
+   sf.sr = sr;
+   sf.w = w;
+   sf.recip = mem;
+   sf.pos = (int *)(sf.recip + AREA_RECIPROCALS);
+   sf.frac = sf.pos + w;
+   sf.line = (uint32_t *)(sf.frac + w);
+   sf.row[0] = sf.line + sr->sw;
+   sf.row[1] = sf.row[0] + w;
+   sf.out = sf.row[1] + w;
+   sf.acc = sf.out + w;
+   sf.key[0] = sf.key[1] = -1;
+
+   if (sr->filter == STRETCH_AREA) {
+      area_coords(sf.pos, sf.frac, first, w, sr->sw, sr->dw);
+      sf.sx0 = sf.pos[0];
+      sf.sn = sf.pos[w-1] + sf.frac[w-1] - sf.sx0;
+
+      /* boxes are at most this big */
+      n = MIN((sr->sw / sr->dw + 1) * (sr->sh / sr->dh + 1), AREA_RECIPROCALS - 1);
+      for (x = 1; x <= n; x++)
+	 sf.recip[x] = (((uint64_t)1 << 32) + x - 1) / x;
+   }
+   else {
+      bilinear_coords(sf.pos, sf.frac, first, w, sr->sw, sr->dw);
+      sf.sx0 = sf.pos[0];
+      sf.sn = MIN(sf.pos[w-1] + 2, sr->sw) - sf.sx0;
+   }
+
+   for (x = 0; x < w; x++)
+      sf.pos[x] -= sf.sx0;
+
+   bmp_select(dst);
+
+   for (y = ybeg; y < yend; y++) {
+      unsigned char *d = (unsigned char *)bmp_write_line(dst, y) + sr->dxbeg * sr->size;
+
+      if (sr->filter == STRETCH_AREA) {
+	 area_coords(&y0, &yn, y - sr->dy, 1, sr->sh, sr->dh);
+
+	 /* boxes repeat when enlarging */
+	 if (y0 != last_y0) {
+	    memset(sf.acc, 0, w * 4 * sizeof(uint32_t));
+
+	    for (n = 0; n < yn; n++)
+	       area_add_row(sf.acc, fetch_row(&sf, y0 + n), sf.pos, sf.frac, w);
+
+	    area_average(sf.out, sf.acc, sf.frac, yn, w, sf.recip);
+
+	    last_y0 = y0;
+	 }
+
+	 pack_row(d, sf.out, w, sr->depth);
+      }
+      else {
+	 AL_CONST uint32_t *a, *b;
+	 int f;
+
+	 bilinear_coords(&y0, &f, y - sr->dy, 1, sr->sh, sr->dh);
+
+	 a = filter_row(&sf, y0, -1);
+
+	 if (f) {
+	    b = filter_row(&sf, y0 + 1, y0);
+
+	    if (sr->depth == 32) {
+	       lerp_row((uint32_t *)d, a, b, w, f);
+	       continue;
+	    }
+
+	    lerp_row(sf.out, a, b, w, f);
+	    a = sf.out;
+	 }
+
+	 pack_row(d, a, w, sr->depth);
+      }
+   }
+
+   bmp_unwrite_line(dst);
+
+   _AL_FREE(mem);
+}
+
+
+
+/*
+ * Draws the dst rows [ybeg, yend) with the method chosen by _al_stretch_blit().
+ */
+static void draw_rows(AL_CONST STRETCH_ROWS *sr, int ybeg, int yend)
+{
+   if (sr->scale)
+      scale_rows(sr, ybeg, yend);
+   else if (sr->filter != STRETCH_NEAREST)
+      filter_rows(sr, ybeg, yend);
+   else
+      stretch_rows(sr, ybeg, yend);
+}
+
+
+
+#ifdef ALLEGRO_WORKER_THREADS
+/*
+ * Worker callback stretching one band of rows.
+ */
+static void stretch_band(void *data, int band)
+{
+   STRETCH_ROWS *sr = (STRETCH_ROWS *)data;
+   int rows = sr->dyend - sr->dybeg;
+
+   draw_rows(sr, sr->dybeg + rows * band / sr->bands,
+	     sr->dybeg + rows * (band + 1) / sr->bands);
+}
+#endif
+
+
+
 /*
  * Stretch blit work-horse.
  */
@@ -240,8 +896,7 @@ static void _al_stretch_blit(BITMAP *src, BITMAP *dst,
     int sx, int sy, int sw, int sh, int dx, int dy, int dw, int dh,
    int masked)
 {
-   int y; /* current dst y */
-   int yc; /* y counter */
+   STRETCH_ROWS sr;
    int sxofs, dxofs; /* start offsets */
    int syinc; /* amount to increment src y each time */
    int ycdec; /* amount to deccrement counter by, increase sy when this reaches 0 */
@@ -251,7 +906,7 @@ static void _al_stretch_blit(BITMAP *src, BITMAP *dst,
    int dybeg, dyend;
    int i;
 
-   void (*stretch_line)(uintptr_t, unsigned char*) = 0;
+   void (*stretch_line)(uintptr_t, unsigned char *, AL_CONST STRETCH_INFO *) = 0;
 
    ASSERT(src);
    ASSERT(dst);
@@ -364,59 +1019,79 @@ static void _al_stretch_blit(BITMAP *src, BITMAP *dst,
    syinc = sh / dh;
    ycdec = sh - (syinc*dh);
    ycinc = dh - ycdec;
-   yc = ycinc;
    sxofs = sx * size;
    dxofs = dx * size;
 
-   _al_stretch.sxinc = sw / dw * size;
-   _al_stretch.xcdec = sw - ((sw/dw)*dw);
-   _al_stretch.xcinc = dw - _al_stretch.xcdec;
-   _al_stretch.linesize = (dxend-dxbeg)*size;
+   sr.st.sxinc = sw / dw * size;
+   sr.st.xcdec = sw - ((sw/dw)*dw);
+   sr.st.xcinc = dw - sr.st.xcdec;
+   sr.st.linesize = (dxend-dxbeg)*size;
 
    /* get start state (clip) */
-   _al_stretch.xcstart = _al_stretch.xcinc;
-   for (i = 0; i < dxbeg-dx; i++, sxofs += _al_stretch.sxinc) {
-      if (_al_stretch.xcstart <= 0) {
-	 _al_stretch.xcstart += _al_stretch.xcinc;
+   sr.st.xcstart = sr.st.xcinc;
+   for (i = 0; i < dxbeg-dx; i++, sxofs += sr.st.sxinc) {
+      if (sr.st.xcstart <= 0) {
+	 sr.st.xcstart += sr.st.xcinc;
 	 sxofs += size;
       }
       else
-	 _al_stretch.xcstart -= _al_stretch.xcdec;
+	 sr.st.xcstart -= sr.st.xcdec;
    }
 
    dxofs += i * size;
 
-   /* skip clipped lines */
-   for (y = dy; y < dybeg; y++, sy += syinc) {
-      if (yc <= 0) {
-	 sy++;
-	 yc += ycinc;
-      }
-      else
-	    yc -= ycdec;
+   sr.src = src;
+   sr.dst = dst;
+   sr.stretch_line = stretch_line;
+   sr.sxofs = sxofs;
+   sr.dxofs = dxofs;
+   sr.dy = dy;
+   sr.sy = sy;
+   sr.syinc = syinc;
+   sr.ycdec = ycdec;
+   sr.ycinc = ycinc;
+   sr.dybeg = dybeg;
+   sr.dyend = dyend;
+   sr.reuse_rows = ((!masked) && (syinc == 0) && (is_memory_bitmap(dst)));
+   sr.filter = STRETCH_NEAREST;
+   sr.scale = 0;
+   sr.depth = bitmap_color_depth(dst);
+   sr.size = size;
+   sr.sx = sx;
+   sr.sw = sw;
+   sr.sh = sh;
+   sr.dx = dx;
+   sr.dw = dw;
+   sr.dh = dh;
+   sr.dxbeg = dxbeg;
+   sr.dxend = dxend;
+
+   if ((!masked) && (DIRECT_ROWS(dst))) {
+      if ((size > 1) && (stretch_filter != STRETCH_NEAREST))
+	 sr.filter = stretch_filter;
+
+      /* 2x, 3x and 4x are plain pixel replication, also for the area filter */
+      if ((sr.filter != STRETCH_BILINEAR) && (dw == (dw / sw) * sw) &&
+	  (dw / sw >= 2) && (dw / sw <= 4) && (dh == (dw / sw) * sh))
+	 sr.scale = dw / sw;
    }
 
-   /* Stretch it */
-
-   bmp_select(dst);
-
-   for (; y < dyend; y++, sy += syinc) {
-      (*stretch_line)(bmp_write_line(dst, y) + dxofs, src->line[sy] + sxofs);
-      if (yc <= 0) {
-	 sy++;
-	 yc += ycinc;
-      }
-      else
-	    yc -= ycdec;
+#ifdef ALLEGRO_WORKER_THREADS
+   /* split big stretches onto memory bitmaps over the drawing threads */
+   sr.bands = _drawing_bands(dst, dxend - dxbeg, dyend - dybeg);
+   if (sr.bands) {
+      _al_run_workers(stretch_band, &sr, sr.bands);
+      return;
    }
-   
-   bmp_unwrite_line(dst);
+#endif
+
+   draw_rows(&sr, dybeg, dyend);
 }
 
 
 
 /* stretch_blit:
- *  Opaque bitmap scaling function.
+ *  Opaque bitmap scaling function, filtered as set by set_stretch_filter().
  */
 void stretch_blit(BITMAP *src, BITMAP *dst, int sx, int sy, int sw, int sh,
 		  int dx, int dy, int dw, int dh)
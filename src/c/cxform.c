@@ -0,0 +1,343 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      SSE2, AVX2 and NEON vertex transformers for the floating point
+ *      batch versions of apply_matrix_f() and persp_project_f().
+ *
+ *      The x, y, z and u fields of four vertices are loaded as they lie
+ *      in memory and transposed in registers, so each lane of a vector
+ *      holds one vertex and the maths is done in the same order as the
+ *      C versions, giving the same results. The perspective divide is a
+ *      true division rather than a reciprocal estimate for that reason.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "csimd.h"
+
+
+
+#ifdef ALLEGRO_SIMD
+
+AL_SIMD_XFORM_ROW _al_simd_xform_v3d = NULL;
+
+
+
+/* xform_copy_uvc:
+ *  Copies the texture coordinates and colour of the vertices that the
+ *  vector stores do not cover.
+ */
+static INLINE void xform_copy_uvc(AL_CONST V3D_f *in, V3D_f *out, int n)
+{
+   int i;
+
+   if (in == out)
+      return;
+
+   for (i = 0; i < n; i++) {
+      out[i].v = in[i].v;
+      out[i].c = in[i].c;
+   }
+}
+
+
+
+#ifdef ALLEGRO_SIMD_SSE2
+
+/* xform_v3d_sse2:
+ *  Transforms and/or projects four vertices at a time.
+ */
+static int xform_v3d_sse2(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out, int project)
+{
+   __m128 m00, m01, m02, m10, m11, m12, m20, m21, m22, t0, t1, t2;
+   __m128 one = _mm_set1_ps(1.0f);
+   __m128 xs = _mm_set1_ps(_persp_xscale_f);
+   __m128 ys = _mm_set1_ps(_persp_yscale_f);
+   __m128 xo = _mm_set1_ps(_persp_xoffset_f);
+   __m128 yo = _mm_set1_ps(_persp_yoffset_f);
+   __m128 x, y, z, u, tx, ty, z1;
+   int i;
+
+   m00 = m01 = m02 = m10 = m11 = m12 = m20 = m21 = m22 = t0 = t1 = t2 = one;
+
+   if (m) {
+      m00 = _mm_set1_ps(m->v[0][0]);  m01 = _mm_set1_ps(m->v[0][1]);
+      m02 = _mm_set1_ps(m->v[0][2]);  t0 = _mm_set1_ps(m->t[0]);
+      m10 = _mm_set1_ps(m->v[1][0]);  m11 = _mm_set1_ps(m->v[1][1]);
+      m12 = _mm_set1_ps(m->v[1][2]);  t1 = _mm_set1_ps(m->t[1]);
+      m20 = _mm_set1_ps(m->v[2][0]);  m21 = _mm_set1_ps(m->v[2][1]);
+      m22 = _mm_set1_ps(m->v[2][2]);  t2 = _mm_set1_ps(m->t[2]);
+   }
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      x = _mm_loadu_ps(&in[i].x);
+      y = _mm_loadu_ps(&in[i+1].x);
+      z = _mm_loadu_ps(&in[i+2].x);
+      u = _mm_loadu_ps(&in[i+3].x);
+      _MM_TRANSPOSE4_PS(x, y, z, u);
+
+      if (m) {
+	 tx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m01)), _mm_mul_ps(z, m02)), t0);
+	 ty = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m10), _mm_mul_ps(y, m11)), _mm_mul_ps(z, m12)), t1);
+	 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m20), _mm_mul_ps(y, m21)), _mm_mul_ps(z, m22)), t2);
+	 x = tx;
+	 y = ty;
+      }
+
+      if (project) {
+	 z1 = _mm_div_ps(one, z);
+	 x = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(x, z1), xs), xo);
+	 y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, z1), ys), yo);
+      }
+
+      _MM_TRANSPOSE4_PS(x, y, z, u);
+      xform_copy_uvc(in + i, out + i, 4);
+      _mm_storeu_ps(&out[i].x, x);
+      _mm_storeu_ps(&out[i+1].x, y);
+      _mm_storeu_ps(&out[i+2].x, z);
+      _mm_storeu_ps(&out[i+3].x, u);
+   }
+
+   return i;
+}
+
+#endif /* ALLEGRO_SIMD_SSE2 */
+
+
+
+#ifdef ALLEGRO_SIMD_AVX2
+
+/* XFORM_TRANSPOSE_AVX2:
+ *  Transposes the two 4x4 blocks held in the halves of four registers.
+ */
+#define XFORM_TRANSPOSE_AVX2(r0, r1, r2, r3)                                  \
+{                                                                             \
+   __m256 _t0 = _mm256_unpacklo_ps(r0, r1);                                   \
+   __m256 _t1 = _mm256_unpacklo_ps(r2, r3);                                   \
+   __m256 _t2 = _mm256_unpackhi_ps(r0, r1);                                   \
+   __m256 _t3 = _mm256_unpackhi_ps(r2, r3);                                   \
+   r0 = _mm256_shuffle_ps(_t0, _t1, 0x44);                                    \
+   r1 = _mm256_shuffle_ps(_t0, _t1, 0xEE);                                    \
+   r2 = _mm256_shuffle_ps(_t2, _t3, 0x44);                                    \
+   r3 = _mm256_shuffle_ps(_t2, _t3, 0xEE);                                    \
+}
+
+
+
+/* xform_load_avx2:
+ *  Loads vertices k and k+4 into the halves of a register.
+ */
+AL_SIMD_AVX2_FUNC static INLINE __m256 xform_load_avx2(AL_CONST V3D_f *in, int k)
+{
+   return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&in[k].x)),
+			       _mm_loadu_ps(&in[k+4].x), 1);
+}
+
+
+
+/* xform_store_avx2:
+ *  Stores the halves of a register to vertices k and k+4.
+ */
+AL_SIMD_AVX2_FUNC static INLINE void xform_store_avx2(V3D_f *out, int k, __m256 r)
+{
+   _mm_storeu_ps(&out[k].x, _mm256_castps256_ps128(r));
+   _mm_storeu_ps(&out[k+4].x, _mm256_extractf128_ps(r, 1));
+}
+
+
+
+/* xform_v3d_avx2:
+ *  Transforms and/or projects eight vertices at a time.
+ */
+AL_SIMD_AVX2_FUNC static int xform_v3d_avx2(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out, int project)
+{
+   __m256 m00, m01, m02, m10, m11, m12, m20, m21, m22, t0, t1, t2;
+   __m256 one = _mm256_set1_ps(1.0f);
+   __m256 xs = _mm256_set1_ps(_persp_xscale_f);
+   __m256 ys = _mm256_set1_ps(_persp_yscale_f);
+   __m256 xo = _mm256_set1_ps(_persp_xoffset_f);
+   __m256 yo = _mm256_set1_ps(_persp_yoffset_f);
+   __m256 x, y, z, u, tx, ty, z1;
+   int i;
+
+   m00 = m01 = m02 = m10 = m11 = m12 = m20 = m21 = m22 = t0 = t1 = t2 = one;
+
+   if (m) {
+      m00 = _mm256_set1_ps(m->v[0][0]);  m01 = _mm256_set1_ps(m->v[0][1]);
+      m02 = _mm256_set1_ps(m->v[0][2]);  t0 = _mm256_set1_ps(m->t[0]);
+      m10 = _mm256_set1_ps(m->v[1][0]);  m11 = _mm256_set1_ps(m->v[1][1]);
+      m12 = _mm256_set1_ps(m->v[1][2]);  t1 = _mm256_set1_ps(m->t[1]);
+      m20 = _mm256_set1_ps(m->v[2][0]);  m21 = _mm256_set1_ps(m->v[2][1]);
+      m22 = _mm256_set1_ps(m->v[2][2]);  t2 = _mm256_set1_ps(m->t[2]);
+   }
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      x = xform_load_avx2(in + i, 0);
+      y = xform_load_avx2(in + i, 1);
+      z = xform_load_avx2(in + i, 2);
+      u = xform_load_avx2(in + i, 3);
+      XFORM_TRANSPOSE_AVX2(x, y, z, u);
+
+      if (m) {
+	 tx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m00), _mm256_mul_ps(y, m01)), _mm256_mul_ps(z, m02)), t0);
+	 ty = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m10), _mm256_mul_ps(y, m11)), _mm256_mul_ps(z, m12)), t1);
+	 z = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, m20), _mm256_mul_ps(y, m21)), _mm256_mul_ps(z, m22)), t2);
+	 x = tx;
+	 y = ty;
+      }
+
+      if (project) {
+	 z1 = _mm256_div_ps(one, z);
+	 x = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(x, z1), xs), xo);
+	 y = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(y, z1), ys), yo);
+      }
+
+      XFORM_TRANSPOSE_AVX2(x, y, z, u);
+      xform_copy_uvc(in + i, out + i, 8);
+      xform_store_avx2(out + i, 0, x);
+      xform_store_avx2(out + i, 1, y);
+      xform_store_avx2(out + i, 2, z);
+      xform_store_avx2(out + i, 3, u);
+   }
+
+   /* one block of four may be left over */
+   if (i + 4 <= n)
+      i += xform_v3d_sse2(m, n - i, in + i, out + i, project);
+
+   return i;
+}
+
+#endif /* ALLEGRO_SIMD_AVX2 */
+
+
+
+#ifdef ALLEGRO_SIMD_NEON
+
+/* XFORM_TRANSPOSE_NEON:
+ *  Transposes a 4x4 block held in four registers.
+ */
+#define XFORM_TRANSPOSE_NEON(r0, r1, r2, r3)                                  \
+{                                                                             \
+   float32x4x2_t _t01 = vtrnq_f32(r0, r1);                                    \
+   float32x4x2_t _t23 = vtrnq_f32(r2, r3);                                    \
+   r0 = vcombine_f32(vget_low_f32(_t01.val[0]), vget_low_f32(_t23.val[0]));   \
+   r1 = vcombine_f32(vget_low_f32(_t01.val[1]), vget_low_f32(_t23.val[1]));   \
+   r2 = vcombine_f32(vget_high_f32(_t01.val[0]), vget_high_f32(_t23.val[0])); \
+   r3 = vcombine_f32(vget_high_f32(_t01.val[1]), vget_high_f32(_t23.val[1])); \
+}
+
+
+
+/* xform_recip_neon:
+ *  Returns 1/z. Only AArch64 has a vector divide, 32 bit NEON divides
+ *  lane by lane so the result still matches the C code.
+ */
+static INLINE float32x4_t xform_recip_neon(float32x4_t z)
+{
+#ifdef __aarch64__
+   return vdivq_f32(vdupq_n_f32(1.0f), z);
+#else
+   float t[4];
+
+   vst1q_f32(t, z);
+   t[0] = 1.0f / t[0];
+   t[1] = 1.0f / t[1];
+   t[2] = 1.0f / t[2];
+   t[3] = 1.0f / t[3];
+
+   return vld1q_f32(t);
+#endif
+}
+
+
+
+/* xform_row_neon:
+ *  Works out one coordinate of four vertices as (x*a + y*b + z*c) + t.
+ */
+static INLINE float32x4_t xform_row_neon(float32x4_t x, float32x4_t y, float32x4_t z, AL_CONST float *row, float t)
+{
+   return vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(x, row[0]), vmulq_n_f32(y, row[1])),
+			      vmulq_n_f32(z, row[2])), vdupq_n_f32(t));
+}
+
+
+
+/* xform_v3d_neon:
+ *  Transforms and/or projects four vertices at a time.
+ */
+static int xform_v3d_neon(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out, int project)
+{
+   float32x4_t xs = vdupq_n_f32(_persp_xscale_f);
+   float32x4_t ys = vdupq_n_f32(_persp_yscale_f);
+   float32x4_t xo = vdupq_n_f32(_persp_xoffset_f);
+   float32x4_t yo = vdupq_n_f32(_persp_yoffset_f);
+   float32x4_t x, y, z, u, tx, ty, z1;
+   int i;
+
+   for (i = 0; i + 4 <= n; i += 4) {
+      x = vld1q_f32(&in[i].x);
+      y = vld1q_f32(&in[i+1].x);
+      z = vld1q_f32(&in[i+2].x);
+      u = vld1q_f32(&in[i+3].x);
+      XFORM_TRANSPOSE_NEON(x, y, z, u);
+
+      if (m) {
+	 tx = xform_row_neon(x, y, z, m->v[0], m->t[0]);
+	 ty = xform_row_neon(x, y, z, m->v[1], m->t[1]);
+	 z = xform_row_neon(x, y, z, m->v[2], m->t[2]);
+	 x = tx;
+	 y = ty;
+      }
+
+      if (project) {
+	 z1 = xform_recip_neon(z);
+	 x = vaddq_f32(vmulq_f32(vmulq_f32(x, z1), xs), xo);
+	 y = vaddq_f32(vmulq_f32(vmulq_f32(y, z1), ys), yo);
+      }
+
+      XFORM_TRANSPOSE_NEON(x, y, z, u);
+      xform_copy_uvc(in + i, out + i, 4);
+      vst1q_f32(&out[i].x, x);
+      vst1q_f32(&out[i+1].x, y);
+      vst1q_f32(&out[i+2].x, z);
+      vst1q_f32(&out[i+3].x, u);
+   }
+
+   return i;
+}
+
+#endif /* ALLEGRO_SIMD_NEON */
+
+
+
+/* _al_simd_init_transformers:
+ *  Picks the vertex transformer for the running CPU.
+ */
+void _al_simd_init_transformers(void)
+{
+#ifdef ALLEGRO_SIMD_SSE2
+   _al_simd_xform_v3d = xform_v3d_sse2;
+
+#ifdef ALLEGRO_SIMD_AVX2
+   if (cpu_capabilities & CPU_AVX2)
+      _al_simd_xform_v3d = xform_v3d_avx2;
+#endif
+#endif
+
+#ifdef ALLEGRO_SIMD_NEON
+   if (cpu_capabilities & CPU_NEON)
+      _al_simd_xform_v3d = xform_v3d_neon;
+#endif
+}
+
+#endif /* ALLEGRO_SIMD */
@@ -734,5 +734,252 @@ void FUNC_POLY_ZBUF_PTEX_MASK_TRANS(uintptr_t addr, int w, POLYGON_SEGMENT *info
    }
 }
 
+#if (defined ALLEGRO_SIMD) && (defined FUNC_POLY_ZBUF_PTEX_SIMD)
+
+/* Texels are fetched into a buffer this many pixels at a time, which
+ * must be a multiple of the span.
+ */
+#define PTEX_SIMD_CHUNK   (AL_SIMD_PTEX_SPAN * 4)
+
+
+
+/* _poly_zbuf_ptex_simd:
+ *  Version of _poly_zbuf_ptex using the SIMD texel fetchers.
+ */
+void FUNC_POLY_ZBUF_PTEX_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   double fz, dfz, z;
+   PIXEL_PTR d;
+   ZBUF_PTR zb;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   fz = info->z;
+   dfz = info->dz;
+   d = (PIXEL_PTR) addr;
+   zb = (ZBUF_PTR) info->zbuf_addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+
+      /* skip the texels of chunks which are hidden completely */
+      for (i = 0, z = fz; (i < n) && (zb[i] >= z); i++)
+	 z += dfz;
+
+      if (i == n) {
+	 _al_simd_ptex_skip(&p, n);
+	 INC_PIXEL_PTR_N(d, n);
+	 zb += n;
+	 fz = z;
+	 continue;
+      }
+
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 if (*zb < fz) {
+	    unsigned long color = GET_MEMORY_PIXEL(s);
+	    PUT_PIXEL(d, color);
+	    *zb = (float) fz;
+	 }
+	 fz += dfz;
+	 zb++;
+      }
+   }
+}
+
+
+
+/* _poly_zbuf_ptex_mask_simd:
+ *  Version of _poly_zbuf_ptex_mask using the SIMD texel fetchers.
+ */
+void FUNC_POLY_ZBUF_PTEX_MASK_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   double fz, dfz, z;
+   PIXEL_PTR d;
+   ZBUF_PTR zb;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   fz = info->z;
+   dfz = info->dz;
+   d = (PIXEL_PTR) addr;
+   zb = (ZBUF_PTR) info->zbuf_addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+
+      /* skip the texels of chunks which are hidden completely */
+      for (i = 0, z = fz; (i < n) && (zb[i] >= z); i++)
+	 z += dfz;
+
+      if (i == n) {
+	 _al_simd_ptex_skip(&p, n);
+	 INC_PIXEL_PTR_N(d, n);
+	 zb += n;
+	 fz = z;
+	 continue;
+      }
+
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 if (*zb < fz) {
+	    unsigned long color = GET_MEMORY_PIXEL(s);
+
+	    if (!IS_MASK(color)) {
+	       PUT_PIXEL(d, color);
+	       *zb = (float) fz;
+	    }
+	 }
+	 fz += dfz;
+	 zb++;
+      }
+   }
+}
+
+
+
+/* _poly_zbuf_ptex_lit_simd:
+ *  Version of _poly_zbuf_ptex_lit using the SIMD texel fetchers.
+ */
+void FUNC_POLY_ZBUF_PTEX_LIT_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   double fz, dfz, z;
+   fixed c, dc;
+   PS_BLENDER blender;
+   PIXEL_PTR d;
+   ZBUF_PTR zb;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   fz = info->z;
+   dfz = info->dz;
+   c = info->c;
+   dc = info->dc;
+   blender = MAKE_PS_BLENDER();
+   d = (PIXEL_PTR) addr;
+   zb = (ZBUF_PTR) info->zbuf_addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+
+      /* skip the texels of chunks which are hidden completely */
+      for (i = 0, z = fz; (i < n) && (zb[i] >= z); i++)
+	 z += dfz;
+
+      if (i == n) {
+	 _al_simd_ptex_skip(&p, n);
+	 INC_PIXEL_PTR_N(d, n);
+	 zb += n;
+	 fz = z;
+	 c += dc * n;
+	 continue;
+      }
+
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 if (*zb < fz) {
+	    unsigned long color = GET_MEMORY_PIXEL(s);
+	    color = PS_BLEND(blender, (c >> 16), color);
+	    PUT_PIXEL(d, color);
+	    *zb = (float) fz;
+	 }
+	 fz += dfz;
+	 c += dc;
+	 zb++;
+      }
+   }
+}
+
+
+
+/* _poly_zbuf_ptex_mask_lit_simd:
+ *  Version of _poly_zbuf_ptex_mask_lit using the SIMD texel fetchers.
+ */
+void FUNC_POLY_ZBUF_PTEX_MASK_LIT_SIMD(uintptr_t addr, int w, POLYGON_SEGMENT *info)
+{
+   uint32_t buf[PTEX_SIMD_CHUNK];
+   AL_SIMD_PTEX p;
+   double fz, dfz, z;
+   fixed c, dc;
+   PS_BLENDER blender;
+   PIXEL_PTR d;
+   ZBUF_PTR zb;
+   int i, n;
+
+   ASSERT(addr);
+   ASSERT(info);
+
+   _al_simd_ptex_start(&p, info, w);
+   fz = info->z;
+   dfz = info->dz;
+   c = info->c;
+   dc = info->dc;
+   blender = MAKE_PS_BLENDER();
+   d = (PIXEL_PTR) addr;
+   zb = (ZBUF_PTR) info->zbuf_addr;
+
+   for (; w > 0; w -= n) {
+      PIXEL_PTR s = (PIXEL_PTR) buf;
+
+      n = MIN(w, PTEX_SIMD_CHUNK);
+
+      /* skip the texels of chunks which are hidden completely */
+      for (i = 0, z = fz; (i < n) && (zb[i] >= z); i++)
+	 z += dfz;
+
+      if (i == n) {
+	 _al_simd_ptex_skip(&p, n);
+	 INC_PIXEL_PTR_N(d, n);
+	 zb += n;
+	 fz = z;
+	 c += dc * n;
+	 continue;
+      }
+
+      SIMD_PTEX_ROW(buf, n, &p);
+
+      for (i = n; i > 0; i--, INC_PIXEL_PTR(s), INC_PIXEL_PTR(d)) {
+	 if (*zb < fz) {
+	    unsigned long color = GET_MEMORY_PIXEL(s);
+
+	    if (!IS_MASK(color)) {
+	       color = PS_BLEND(blender, (c >> 16), color);
+	       PUT_PIXEL(d, color);
+	       *zb = (float) fz;
+	    }
+	 }
+	 fz += dfz;
+	 c += dc;
+	 zb++;
+      }
+   }
+}
+
+#endif /* ALLEGRO_SIMD && FUNC_POLY_ZBUF_PTEX_SIMD */
+
 #endif /* !__bma_czscan_h */
 
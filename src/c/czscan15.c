@@ -22,6 +22,7 @@
 
 #include "allegro/internal/aintern.h"
 #include "cdefs15.h"
+#include "csimd.h"
 
 #define FUNC_POLY_ZBUF_FLAT			_poly_zbuf_flat15
 #define FUNC_POLY_ZBUF_GRGB			_poly_zbuf_grgb15
@@ -38,6 +39,11 @@
 #define FUNC_POLY_ZBUF_PTEX_TRANS		_poly_zbuf_ptex_trans15
 #define FUNC_POLY_ZBUF_PTEX_MASK_TRANS		_poly_zbuf_ptex_mask_trans15
 
+#define FUNC_POLY_ZBUF_PTEX_SIMD		_poly_zbuf_ptex_simd15
+#define FUNC_POLY_ZBUF_PTEX_MASK_SIMD		_poly_zbuf_ptex_mask_simd15
+#define FUNC_POLY_ZBUF_PTEX_LIT_SIMD		_poly_zbuf_ptex_lit_simd15
+#define FUNC_POLY_ZBUF_PTEX_MASK_LIT_SIMD	_poly_zbuf_ptex_mask_lit_simd15
+
 #undef _bma_zbuf_gcol
 
 #include "czscan.h"
@@ -20,6 +20,7 @@
 
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
+#include "c/csimd.h"
 
 
 
@@ -1061,3 +1062,125 @@ void set_write_alpha_blender(void)
 		       0, 0, 0, 0);
 }
 
+
+
+
+/* BLENDER_ROW:
+ *  Generates a plain C scanline version of a blender, which at least
+ *  saves the indirect call per pixel when there is no SIMD version.
+ */
+#define BLENDER_ROW(name, blender, stype, dtype)                              \
+   static void name(void *dst, AL_CONST void *src, int w, int n, int mask)   \
+   {                                                                          \
+      dtype *d = dst;                                                         \
+      AL_CONST stype *s = src;                                                \
+									      \
+      for (; w > 0; w--, s++, d++) {                                          \
+	 if (*s != (stype)mask)                                               \
+	    *d = blender(*s, *d, n);                                          \
+      }                                                                       \
+   }
+
+
+#ifdef ALLEGRO_COLOR16
+   BLENDER_ROW(trans15_row, _blender_trans15, uint16_t, uint16_t)
+   BLENDER_ROW(trans16_row, _blender_trans16, uint16_t, uint16_t)
+   BLENDER_ROW(alpha15_row, _blender_alpha15_rgb, uint32_t, uint16_t)
+   BLENDER_ROW(alpha16_row, _blender_alpha16_rgb, uint32_t, uint16_t)
+#endif
+
+#ifdef ALLEGRO_COLOR32
+   BLENDER_ROW(trans32_row, _blender_trans24, uint32_t, uint32_t)
+   BLENDER_ROW(alpha32_row, _blender_alpha32, uint32_t, uint32_t)
+   BLENDER_ROW(add32_row, _blender_add24, uint32_t, uint32_t)
+   BLENDER_ROW(multiply32_row, _blender_multiply24, uint32_t, uint32_t)
+   BLENDER_ROW(screen32_row, _blender_screen24, uint32_t, uint32_t)
+#endif
+
+
+/* prefer the SIMD version of a scanline blender when there is one */
+#ifdef ALLEGRO_SIMD
+   #define PICK_ROW(simd, c)     ((simd) ? (BLENDER_ROW_FUNC)(simd) : (c))
+#else
+   #define PICK_ROW(simd, c)     (c)
+#endif
+
+
+
+#ifdef ALLEGRO_COLOR32
+
+/* get_blender_row32:
+ *  Recognises the standard 32 bit blenders. The SIMD versions of the
+ *  per channel ones need the colors to sit in whole bytes, and the add
+ *  one needs the alpha to fit its 16 bit multiply.
+ */
+static BLENDER_ROW_FUNC get_blender_row32(BLENDER_FUNC func)
+{
+   int bytes = (((1 << _rgb_r_shift_24) | (1 << _rgb_g_shift_24) | (1 << _rgb_b_shift_24)) == 0x10101);
+
+   if (func == _blender_trans24)
+      return PICK_ROW(_al_simd_blend_trans32, trans32_row);
+
+   if (func == _blender_alpha32) {
+      if (_rgb_a_shift_32 == 24)
+	 return PICK_ROW(_al_simd_blend_alpha32, alpha32_row);
+      return alpha32_row;
+   }
+
+   if (func == _blender_add24) {
+      if ((bytes) && (_blender_alpha >= 0) && (_blender_alpha <= 256))
+	 return PICK_ROW(_al_simd_blend_add32, add32_row);
+      return add32_row;
+   }
+
+   if (func == _blender_multiply24) {
+      if (bytes)
+	 return PICK_ROW(_al_simd_blend_multiply32, multiply32_row);
+      return multiply32_row;
+   }
+
+   if (func == _blender_screen24) {
+      if (bytes)
+	 return PICK_ROW(_al_simd_blend_screen32, screen32_row);
+      return screen32_row;
+   }
+
+   return NULL;
+}
+
+#endif
+
+
+
+/* _update_blender_rows:
+ *  Looks for scanline versions of the current blenders, so the sprite
+ *  routines can blend whole rows at a time. Anything unknown, such as a
+ *  custom blender passed to set_blender_mode(), is left NULL and drawn
+ *  one pixel at a time.
+ */
+void _update_blender_rows(void)
+{
+   _blender_row15 = NULL;
+   _blender_row16 = NULL;
+   _blender_row32 = NULL;
+   _blender_row15x = NULL;
+   _blender_row16x = NULL;
+
+   #ifdef ALLEGRO_COLOR16
+      if (_blender_func15 == _blender_trans15)
+	 _blender_row15 = PICK_ROW(_al_simd_blend_trans15, trans15_row);
+
+      if (_blender_func16 == _blender_trans16)
+	 _blender_row16 = PICK_ROW(_al_simd_blend_trans16, trans16_row);
+
+      if (_blender_func15x == _blender_alpha15_rgb)
+	 _blender_row15x = PICK_ROW(_al_simd_blend_alpha15, alpha15_row);
+
+      if (_blender_func16x == _blender_alpha16_rgb)
+	 _blender_row16x = PICK_ROW(_al_simd_blend_alpha16, alpha16_row);
+   #endif
+
+   #ifdef ALLEGRO_COLOR32
+      _blender_row32 = get_blender_row32(_blender_func32);
+   #endif
+}
@@ -18,6 +18,7 @@
  */
 
 
+#include <limits.h>
 #include <string.h>
 
 #include "allegro.h"
@@ -44,6 +45,39 @@ static void (*datafile_callback)(DATAFILE *) = NULL;
 
 
 
+/* files mapped by load_datafile_mapped(), some of whose objects point
+ * straight into the mapping rather than owning their memory
+ */
+typedef struct DATAFILE_MAP
+{
+   DATAFILE *dat;
+   unsigned char *base;
+   uint64_t size;
+   struct DATAFILE_MAP *next;
+} DATAFILE_MAP;
+
+static DATAFILE_MAP *datafile_maps = NULL;
+
+
+
+/* datafile_mapped:
+ *  Returns TRUE if p points into a mapped datafile, so isn't to be freed.
+ */
+static int datafile_mapped(AL_CONST void *p)
+{
+   DATAFILE_MAP *m;
+
+   for (m = datafile_maps; m; m = m->next) {
+      if (((AL_CONST unsigned char *)p >= m->base) &&
+	  ((AL_CONST unsigned char *)p < m->base + m->size))
+	 return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+
 /* load_st_data:
  *  I'm not using this format any more, but files created with the old
  *  version of Allegro might have some bitmaps stored like this. It is 
@@ -458,6 +492,64 @@ static FONT_COLOR_DATA *read_font_color(PACKFILE *pack, int *hmax, int depth)
 
 
 
+/* read_font_aa:
+ *  Helper for read_font, below.
+ */
+static FONT_AA_DATA *read_font_aa(PACKFILE *pack, int *hmax)
+{
+   FONT_AA_DATA *af = NULL;
+   int max = 0, i = 0;
+   FONT_AA_GLYPH **gl = NULL;
+
+   af = _AL_MALLOC(sizeof(FONT_AA_DATA));
+   if (!af) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   af->begin = pack_mgetl(pack);
+   af->end = pack_mgetl(pack) + 1;
+   af->next = NULL;
+   max = af->end - af->begin;
+
+   af->glyphs = gl = _AL_MALLOC(sizeof(FONT_AA_GLYPH *) * MAX(max, 1));
+   if (!gl) {
+      _AL_FREE(af);
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   for (i = 0; i < max; i++) {
+      int w, h;
+
+      w = pack_mgetw(pack);
+      h = pack_mgetw(pack);
+
+      if (h > *hmax) *hmax = h;
+
+      gl[i] = _AL_MALLOC(sizeof(FONT_AA_GLYPH) + w * h);
+      if (!gl[i]) {
+	 while (i) {
+	    i--;
+	    _AL_FREE(gl[i]);
+	 }
+	 _AL_FREE(gl);
+	 _AL_FREE(af);
+	 *allegro_errno = ENOMEM;
+	 return NULL;
+      }
+
+      gl[i]->w = w;
+      gl[i]->h = h;
+      gl[i]->advance = pack_mgetl(pack);
+      pack_fread(gl[i]->dat, w * h, pack);
+   }
+
+   return af;
+}
+
+
+
 /* read_font:
  *  Reads a new style, Unicode format font from a file.
  */
@@ -497,6 +589,25 @@ static FONT *read_font(PACKFILE *pack)
 	    iter->next = mf;
 	 }
       } 
+      else if (depth == 248) {
+	 /* -8: anti-aliased, a byte of coverage per pixel */
+	 FONT_AA_DATA *af = NULL, *iter = (FONT_AA_DATA *)f->data;
+
+	 f->vtable = font_vtable_aa;
+
+	 af = read_font_aa(pack, &height);
+	 if (!af) {
+	    destroy_font(f);
+	    return NULL;
+	 }
+
+	 if (!iter)
+	    f->data = af;
+	 else {
+	    while (iter->next) iter = iter->next;
+	    iter->next = af;
+	 }
+      }
       else {
 	 FONT_COLOR_DATA *cf = NULL, *iter = (FONT_COLOR_DATA *)f->data;
          
@@ -1116,7 +1227,8 @@ static void unload_sample(SAMPLE *s)
    if (s) {
       if (s->data) {
 	 UNLOCK_DATA(s->data, s->len * ((s->bits==8) ? 1 : sizeof(short)) * ((s->stereo) ? 2 : 1));
-	 _AL_FREE(s->data);
+	 if (!datafile_mapped(s->data))
+	    _AL_FREE(s->data);
       }
 
       UNLOCK_DATA(s, sizeof(SAMPLE));
@@ -1190,6 +1302,17 @@ static int load_object(DATAFILE *obj, PACKFILE *f, int type)
 
 
 
+/* _load_datafile_object:
+ *  Loads the object whose chunk f is at into 'obj', for the lazy datafile
+ *  code. Returns 0 on success and -1 on failure.
+ */
+int _load_datafile_object(DATAFILE *obj, PACKFILE *f, int type)
+{
+   return load_object(obj, f, type);
+}
+
+
+
 /* _load_property:
  *  Helper to load a property from a datafile and store it in 'prop'.
  *  Returns 0 on success and -1 on failure.
@@ -1385,7 +1508,7 @@ DATAFILE *load_datafile_callback(AL_CONST char *filename, void (*callback)(DATAF
       return NULL;
 
    if ((f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
-      type = (_packfile_type == DAT_FILE) ? DAT_MAGIC : 0;
+      type = (f->normal.type == DAT_FILE) ? DAT_MAGIC : 0;
    else
       type = pack_mgetl(f);
 
@@ -1406,209 +1529,1184 @@ DATAFILE *load_datafile_callback(AL_CONST char *filename, void (*callback)(DATAF
 
 
 
-/* create_datafile_index
- *  Reads offsets of all objects inside datafile.
- *  On error, sets errno and returns NULL.
+/* the reading position in a mapped datafile, for map_vtable */
+typedef struct MAP_READER
+{
+   unsigned char *base;
+   long pos;
+   long end;                  /* end of the object being read */
+} MAP_READER;
+
+
+
+/* map_fclose, map_getc, map_ungetc, map_fread, map_putc, map_fwrite,
+ * map_fseek, map_feof, map_ferror:
+ *  A read only packfile on a mapped datafile, so that objects which can't
+ *  be used in place can still be parsed by the usual loaders.
  */
-DATAFILE_INDEX *create_datafile_index(AL_CONST char *filename)
+static int map_fclose(void *userdata)
 {
-   PACKFILE *f;
-   DATAFILE_INDEX *index;
-   long pos = 4;
-   int type, count, skip, i;
+   return 0;
+}
 
-   ASSERT(filename);
 
-   f = pack_fopen(filename, F_READ_PACKED);
-   if (!f)
-      return NULL;
 
-   if ((f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
-      type = (_packfile_type == DAT_FILE) ? DAT_MAGIC : 0;
-   else {
-      type = pack_mgetl(f);   pos += 4;
-   }
+static int map_getc(void *userdata)
+{
+   MAP_READER *r = userdata;
 
-   /* only support V2 datafile format */
-   if (type != DAT_MAGIC)
-      return NULL;
+   if (r->pos >= r->end)
+      return EOF;
 
-   count = pack_mgetl(f);     pos += 4;
+   return r->base[r->pos++];
+}
 
-   index = _AL_MALLOC(sizeof(DATAFILE_INDEX));
-   if (!index) {
-      pack_fclose(f);
-      *allegro_errno = ENOMEM;
-      return NULL;
-   }
 
-   index->filename = _al_ustrdup(filename);
-   if (!index->filename) {
-      pack_fclose(f);
-      _AL_FREE(index);
-      *allegro_errno = ENOMEM;
-      return NULL;
-   }
 
-   index->offset = _AL_MALLOC(sizeof(long) * count);
-   if (!index->offset) {
-      pack_fclose(f);
-      _AL_FREE(index->filename);
-      _AL_FREE(index);
-      *allegro_errno = ENOMEM;
-      return NULL;
-   }
+static int map_ungetc(int c, void *userdata)
+{
+   MAP_READER *r = userdata;
 
-   for (i = 0; i < count; ++i) {
-      index->offset[i] = pos;
+   if (r->pos <= 0)
+      return EOF;
 
-      /* Skip properties */
-      while (pos += 4, pack_mgetl(f) == DAT_PROPERTY) {
+   /* the byte is always the one just read, so leave the page clean */
+   r->pos--;
+   return c;
+}
 
-         /* Skip property name */
-         pack_fseek(f, 4);       pos += 4;
 
-         /* Skip rest of property */
-         skip = pack_mgetl(f);   pos += 4;      /* Get property size */
-         pack_fseek(f, skip);    pos += skip;
-      }
 
-      /* Skip rest of object */
-      skip = pack_mgetl(f) + 4;  pos += 4;
-      pack_fseek(f, skip);       pos += skip;
+static long map_fread(void *p, long n, void *userdata)
+{
+   MAP_READER *r = userdata;
 
-   }
-   pack_fclose(f);
-   return index;
+   n = MIN(n, r->end - r->pos);
+   if (n <= 0)
+      return 0;
+
+   memcpy(p, r->base + r->pos, n);
+   r->pos += n;
+
+   return n;
 }
 
 
 
-/* load_datafile_object:
- *  Loads a single object from a datafile.
- */
-DATAFILE *load_datafile_object(AL_CONST char *filename, AL_CONST char *objectname)
+static int map_putc(int c, void *userdata)
 {
-   PACKFILE *f;
-   DATAFILE *dat;
-   DATAFILE_PROPERTY prop, *list;
-   char parent[1024], child[1024], tmp[8];
-   char *bufptr, *prevptr, *separator;
-   int count, c, type, size, found;
+   return EOF;
+}
 
-   ASSERT(filename);
-   ASSERT(objectname);
-  
-   /* concatenate to filename#objectname */
-   ustrzcpy(parent, sizeof(parent), filename);
 
-   if (ustrcmp(parent, uconvert_ascii("#", tmp)) != 0)
-      ustrzcat(parent, sizeof(parent), uconvert_ascii("#", tmp));
 
-   ustrzcat(parent, sizeof(parent), objectname);
-   
-   /* split into path and actual objectname (for nested files) */
-   prevptr = bufptr = parent;
-   separator = NULL;
-   while ((c = ugetx(&bufptr)) != 0) {
-      if ((c == '#') || (c == '/') || (c == OTHER_PATH_SEPARATOR))
-	 separator = prevptr;
+static long map_fwrite(AL_CONST void *p, long n, void *userdata)
+{
+   return 0;
+}
 
-      prevptr = bufptr;
-   }
-   
-   ustrzcpy(child, sizeof(child), separator + uwidth (separator));
 
-   if (separator == parent)
-      usetc(separator + uwidth (separator), 0);
-   else
-      usetc(separator, 0);
 
-   /* open the parent datafile */
-   f = pack_fopen(parent, F_READ_PACKED);
-   if (!f)
-      return NULL;
+static int map_fseek(void *userdata, int offset)
+{
+   MAP_READER *r = userdata;
 
-   if ((f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
-      type = (_packfile_type == DAT_FILE) ? DAT_MAGIC : 0;
-   else
-      type = pack_mgetl(f);
+   if ((offset < 0) || (offset > r->end - r->pos))
+      return -1;
 
-   /* only support V2 datafile format */
-   if (type != DAT_MAGIC) {
-      pack_fclose(f);
-      return NULL;
-   }
+   r->pos += offset;
+   return 0;
+}
 
-   count = pack_mgetl(f);
 
-   dat = NULL;
-   list = NULL;
-   found = FALSE;
 
-   /* search the packfile for properties or objects */
-   for (c=0; c<count;) {
-      type = pack_mgetl(f);
+static int map_feof(void *userdata)
+{
+   MAP_READER *r = userdata;
 
-      if (type == DAT_PROPERTY) {
-	 if ((_load_property(&prop, f) != 0) || (_add_property(&list, &prop) != 0))
-	    break;
+   return (r->pos >= r->end);
+}
 
-	 if ((prop.type == DAT_NAME) && (ustricmp(prop.dat, child) == 0))
-	    found = TRUE;
-      }
-      else {
-	 if (found) {
-	    /* we have found the object, load it */
-	    dat = _AL_MALLOC(sizeof(DATAFILE));
-	    if (!dat) {
-	       *allegro_errno = ENOMEM;
-	       break;
-	    }
 
-	    if (load_object(dat, f, type) != 0) {
-	       _AL_FREE(dat);
-	       dat = NULL;
-	       break;
-	    }
 
-	    /* attach the property list to the object */
-	    dat->prop = list;
-	    list = NULL;
+static int map_ferror(void *userdata)
+{
+   return 0;
+}
 
-	    break;
-	 }
-	 else {
-	    /* skip an unwanted object */
-	    size = pack_mgetl(f);
-	    pack_fseek(f, size+4);  /* '4' for the chunk size */
 
-	    /* destroy the property list */
-	    if (list) {
-	       _destroy_property_list(list);
-	       list = NULL;
-	    }
 
-	    c++;
-	 }
-      }
-   }
+static PACKFILE_VTABLE map_vtable =
+{
+   map_fclose,
+   map_getc,
+   map_ungetc,
+   map_fread,
+   map_putc,
+   map_fwrite,
+   map_fseek,
+   map_feof,
+   map_ferror
+};
 
-   /* destroy the property list if not assigned to an object */
-   if (list)
-      _destroy_property_list(list);
 
-   pack_fclose(f);
-   return dat;
+
+/* map_mgetl:
+ *  Reads a big endian long from a mapped datafile, without moving.
+ */
+static long map_mgetl(AL_CONST unsigned char *p)
+{
+   return (long)(int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+			  ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
 }
 
 
 
-/* load_datafile_object_indexed
- *  Loads a single object from a datafile using its offset.
- *  On error, returns NULL.
+/* map_check:
+ *  Walks the objects of a mapped datafile between pos and end, making
+ *  sure they are all stored uncompressed and fit in the file.
  */
-DATAFILE *load_datafile_object_indexed(AL_CONST DATAFILE_INDEX *index, int item)
+static int map_check(AL_CONST unsigned char *base, long pos, long end)
+{
+   long count, type, size;
+
+   if (end - pos < 4)
+      return FALSE;
+
+   count = map_mgetl(base + pos);
+   pos += 4;
+
+   while (count > 0) {
+      if (end - pos < 12)
+	 return FALSE;
+
+      type = map_mgetl(base + pos);
+
+      if (type == DAT_PROPERTY) {
+	 size = map_mgetl(base + pos + 8);
+	 pos += 12;
+      }
+      else {
+	 /* chunk header: stored size, then unpacked size or minus that */
+	 size = map_mgetl(base + pos + 8);
+	 pos += 12;
+
+	 if (size < 0)
+	    return FALSE;
+
+	 if ((type == DAT_FILE) && (size <= end - pos)) {
+	    if (!map_check(base, pos, pos + size))
+	       return FALSE;
+	 }
+
+	 count--;
+      }
+
+      if ((size < 0) || (size > end - pos))
+	 return FALSE;
+
+      pos += size;
+   }
+
+   return TRUE;
+}
+
+
+
+/* map_bitmap:
+ *  Makes a bitmap whose lines point at pixels in a mapped datafile,
+ *  without owning them, so destroy_bitmap() leaves them alone.
+ */
+static BITMAP *map_bitmap(int depth, int w, int h, unsigned char *pixels)
+{
+   GFX_VTABLE *vtable;
+   BITMAP *bmp;
+   int i;
+
+   if (system_driver->create_bitmap)
+      return NULL;
+
+   vtable = _get_vtable(depth);
+   if (!vtable)
+      return NULL;
+
+   bmp = _AL_MALLOC(sizeof(BITMAP) + (sizeof(char *) * MAX(2, h)));
+   if (!bmp)
+      return NULL;
+
+   bmp->w = bmp->cr = w;
+   bmp->h = bmp->cb = h;
+   bmp->clip = TRUE;
+   bmp->cl = bmp->ct = 0;
+   bmp->vtable = vtable;
+   bmp->write_bank = bmp->read_bank = _stub_bank_switch;
+   bmp->dat = NULL;
+   bmp->id = 0;
+   bmp->extra = NULL;
+   bmp->x_ofs = 0;
+   bmp->y_ofs = 0;
+   bmp->seg = _default_ds();
+
+   for (i=0; i<h; i++)
+      bmp->line[i] = pixels + i * w * BYTES_PER_PIXEL(depth);
+
+   if (system_driver->created_bitmap)
+      system_driver->created_bitmap(bmp);
+
+   return bmp;
+}
+
+
+
+/* map_bitmap_object:
+ *  Uses a bitmap in place if its pixels are stored the way they are kept
+ *  in memory, which is the case for 256 color bitmaps and, on little
+ *  endian machines, 16 bit ones. Returns NULL if it has to be read.
+ */
+static BITMAP *map_bitmap_object(MAP_READER *r, long size)
+{
+   unsigned char *p = r->base + r->pos;
+   int bits, w, h;
+
+   if (size < 6)
+      return NULL;
+
+   bits = (short)((p[0] << 8) | p[1]);
+   w = (p[2] << 8) | p[3];
+   h = (p[4] << 8) | p[5];
+   p += 6;
+
+   /* only these can be mapped, and _color_load_depth() knows no others */
+   if ((w <= 0) || (h <= 0) || ((bits != 8) && (bits != 16)))
+      return NULL;
+
+   if (_color_load_depth(bits, FALSE) != bits)
+      return NULL;
+
+   if (bits == 8) {
+      if ((long)w * h > size - 6)
+	 return NULL;
+   }
+#ifdef ALLEGRO_LITTLE_ENDIAN
+   else if (bits == 16) {
+      if (((long)w * h * 2 > size - 6) || ((uintptr_t)p & 1))
+	 return NULL;
+
+      /* the file has 5.6.5 pixels, which may not be how we keep them */
+      if ((_rgb_r_shift_16 != 11) || (_rgb_g_shift_16 != 5) || (_rgb_b_shift_16 != 0))
+	 return NULL;
+   }
+#endif
+   else
+      return NULL;
+
+   return map_bitmap(bits, w, h, p);
+}
+
+
+
+/* map_sample_object:
+ *  Uses the data of a sample in place if possible. Returns NULL if it
+ *  has to be read.
+ */
+static SAMPLE *map_sample_object(MAP_READER *r, long size)
+{
+   unsigned char *p = r->base + r->pos;
+   int bits, stereo;
+   long len;
+   SAMPLE *s;
+
+   if (size < 8)
+      return NULL;
+
+   bits = (short)((p[0] << 8) | p[1]);
+   len = map_mgetl(p + 4);
+
+   if (bits < 0) {
+      bits = -bits;
+      stereo = TRUE;
+   }
+   else
+      stereo = FALSE;
+
+   if ((len <= 0) || (len > (size - 8) / ((bits == 8) ? 1 : 2) / ((stereo) ? 2 : 1)))
+      return NULL;
+
+#ifdef ALLEGRO_LITTLE_ENDIAN
+   if ((bits != 8) && ((bits != 16) || ((uintptr_t)(p + 8) & 1)))
+      return NULL;
+#else
+   if (bits != 8)
+      return NULL;
+#endif
+
+   s = _AL_MALLOC(sizeof(SAMPLE));
+   if (!s)
+      return NULL;
+
+   s->bits = bits;
+   s->stereo = stereo;
+   s->freq = (p[2] << 8) | p[3];
+   s->len = len;
+   s->priority = 128;
+   s->loop_start = 0;
+   s->loop_end = s->len;
+   s->param = 0;
+   s->data = p + 8;
+
+   LOCK_DATA(s, sizeof(SAMPLE));
+   LOCK_DATA(s->data, s->len * ((s->bits==8) ? 1 : sizeof(short)) * ((s->stereo) ? 2 : 1));
+
+   return s;
+}
+
+
+
+static void *map_file_object(PACKFILE *f, MAP_READER *r);
+
+
+
+/* map_object:
+ *  Like load_object(), for a mapped datafile. Objects are used in place
+ *  where possible, and otherwise handed to their loader.
+ */
+static int map_object(DATAFILE *obj, PACKFILE *f, MAP_READER *r, int type)
+{
+   long d, start, end;
+   void *(*load)(PACKFILE *f, long size) = NULL;
+   int i;
+
+   pack_mgetl(f);
+   d = pack_mgetl(f);
+
+   start = r->pos;
+   end = r->end;
+   r->end = start + d;
+
+   for (i=0; i<MAX_DATAFILE_TYPES; i++) {
+      if (_datafile_type[i].type == type) {
+	 load = _datafile_type[i].load;
+	 break;
+      }
+   }
+
+   obj->dat = NULL;
+
+   if (load == load_file_object)
+      obj->dat = map_file_object(f, r);
+   else if (load == load_bitmap_object)
+      obj->dat = map_bitmap_object(r, d);
+   else if (load == load_sample_object)
+      obj->dat = map_sample_object(r, d);
+   else if ((!load) && (d > 0))
+      obj->dat = r->base + start;
+
+   if ((!obj->dat) && (load != load_file_object)) {
+      r->pos = start;
+      obj->dat = (load) ? load(f, d) : load_data_object(f, d);
+   }
+
+   r->pos = start + d;
+   r->end = end;
+
+   if (!obj->dat)
+      return -1;
+
+   obj->type = type;
+   obj->size = d;
+   return 0;
+}
+
+
+
+/* map_file_object:
+ *  Like load_file_object(), for a mapped datafile.
+ */
+static void *map_file_object(PACKFILE *f, MAP_READER *r)
+{
+   DATAFILE *dat;
+   DATAFILE_PROPERTY prop, *list;
+   int count, c, type, failed;
+
+   count = pack_mgetl(f);
+
+   dat = _AL_MALLOC(sizeof(DATAFILE)*(count+1));
+   if (!dat) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   list = NULL;
+   failed = FALSE;
+
+   for (c=0; c<count;) {
+      type = pack_mgetl(f);
+
+      if (type == DAT_PROPERTY) {
+	 if ((_load_property(&prop, f) != 0) || (_add_property(&list, &prop) != 0)) {
+	    failed = TRUE;
+	    break;
+	 }
+      }
+      else {
+	 if (map_object(&dat[c], f, r, type) != 0) {
+	    failed = TRUE;
+	    break;
+	 }
+
+	 dat[c].prop = list;
+	 list = NULL;
+
+	 if (datafile_callback)
+	    datafile_callback(dat+c);
+
+	 c++;
+      }
+   }
+
+   dat[c].type = DAT_END;
+   dat[c].dat = NULL;
+
+   if (list)
+      _destroy_property_list(list);
+
+   if (failed) {
+      unload_datafile(dat);
+      dat = NULL;
+   }
+
+   return dat;
+}
+
+
+
+/* load_datafile_mapped:
+ *  Loads a datafile by mapping it into memory. Bitmaps, samples and
+ *  binary objects that are stored the way they are kept in memory point
+ *  straight into the mapping instead of being copied, so large files
+ *  load quickly and their pages can be shared between processes. Pages
+ *  are only copied if an object is written to. Files that can't be
+ *  mapped, such as compressed ones, are loaded as usual.
+ */
+DATAFILE *load_datafile_mapped(AL_CONST char *filename, void (*callback)(DATAFILE *))
+{
+   DATAFILE_MAP *m;
+   MAP_READER r;
+   PACKFILE *f;
+   DATAFILE *dat;
+   uint64_t size;
+   unsigned char *base;
+   ASSERT(filename);
+
+   /* objects inside other files have to be read */
+   if (ustrchr(filename, '#'))
+      return load_datafile_callback(filename, callback);
+
+   base = _al_file_map(filename, &size);
+   if (!base)
+      return load_datafile_callback(filename, callback);
+
+   if ((size > LONG_MAX) || (size < 8) ||
+       (map_mgetl(base) != F_NOPACK_MAGIC) || (map_mgetl(base + 4) != DAT_MAGIC) ||
+       (!map_check(base, 8, (long)size))) {
+      _al_file_unmap(base, size);
+      return load_datafile_callback(filename, callback);
+   }
+
+   m = _AL_MALLOC(sizeof(DATAFILE_MAP));
+   if (!m) {
+      _al_file_unmap(base, size);
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   m->dat = NULL;
+   m->base = base;
+   m->size = size;
+   m->next = datafile_maps;
+   datafile_maps = m;
+
+   r.base = base;
+   r.pos = 8;
+   r.end = (long)size;
+
+   f = pack_fopen_vtable(&map_vtable, &r);
+   if (f) {
+      datafile_callback = callback;
+      dat = map_file_object(f, &r);
+      datafile_callback = NULL;
+      pack_fclose(f);
+   }
+   else
+      dat = NULL;
+
+   if (!dat) {
+      datafile_maps = m->next;
+      _al_file_unmap(base, size);
+      _AL_FREE(m);
+      return NULL;
+   }
+
+   m->dat = dat;
+   return dat;
+}
+
+
+
+/* objects read by load_datafile_parallel() but not decoded yet */
+typedef struct PAR_JOB
+{
+   DATAFILE *obj;
+   void *(*load)(PACKFILE *f, long size);    /* NULL for nested datafiles */
+   int parallel;              /* can it be decoded on a worker thread? */
+   AL_CONST PACKFILE_CODEC *codec;     /* NULL if not compressed */
+   unsigned char *raw;        /* the chunk as stored in the file */
+   long rawsize;
+} PAR_JOB;
+
+
+typedef struct PAR_BATCH
+{
+   PAR_JOB *job;
+   int jobs;
+   int max;
+   long bytes;                /* total raw size of the jobs */
+   int threads;
+   int failed;
+   void (*callback)(DATAFILE *);
+} PAR_BATCH;
+
+
+/* decode a batch once it holds this many objects or bytes */
+#define PAR_BATCH_JOBS     1024
+#define PAR_BATCH_BYTES    (16*1024*1024)
+
+
+
+/* par_unpack:
+ *  Unpacks a compressed chunk into a new block of size bytes, storing how
+ *  many of them there were data for in got; like a chunk read with
+ *  pack_fopen_chunk(), a truncated one just comes up short. Returns NULL
+ *  on error.
+ */
+static unsigned char *par_unpack(AL_CONST PACKFILE_CODEC *codec, unsigned char *raw, long rawsize, long size, long *got)
+{
+   void *unpack;
+   unsigned char *data;
+   MAP_READER r;
+   PACKFILE *f;
+   long n = -1;
+
+   data = _AL_MALLOC_ATOMIC(MAX(size, 1));
+   if (!data) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   r.base = raw;
+   r.pos = 0;
+   r.end = rawsize;
+
+   f = pack_fopen_vtable(&map_vtable, &r);
+   unpack = codec->create_unpacker();
+
+   if ((f) && (unpack)) {
+      n = codec->unpack(f, unpack, size, data);
+      if (pack_ferror(f))
+	 n = -1;
+   }
+
+   if (n < 0) {
+      _AL_FREE(data);
+      data = NULL;
+   }
+   else
+      *got = n;
+
+   if (unpack)
+      codec->destroy_unpacker(unpack);
+
+   if (f)
+      pack_fclose(f);
+
+   return data;
+}
+
+
+
+/* par_decode:
+ *  Unpacks the chunk of an object if it is compressed, and hands it to
+ *  the loader for its type. Leaves obj->dat NULL on failure.
+ */
+static void par_decode(PAR_JOB *j)
+{
+   MAP_READER r;
+   PACKFILE *f;
+   unsigned char *data = j->raw;
+   long size = j->obj->size;
+   long got = j->rawsize;
+
+   if (j->codec) {
+      data = par_unpack(j->codec, j->raw, j->rawsize, size, &got);
+      if (!data)
+	 return;
+   }
+
+   r.base = data;
+   r.pos = 0;
+   r.end = MIN(size, got);
+
+   f = pack_fopen_vtable(&map_vtable, &r);
+   if (f) {
+      j->obj->dat = j->load(f, size);
+      pack_fclose(f);
+   }
+
+   if (data != j->raw)
+      _AL_FREE(data);
+}
+
+
+
+/* par_job:
+ *  Worker thread function, decoding one object of a batch.
+ */
+static void par_job(void *data, int job)
+{
+   PAR_JOB *j = ((PAR_BATCH *)data)->job + job;
+
+   if ((j->load) && (j->parallel))
+      par_decode(j);
+}
+
+
+
+/* par_flush:
+ *  Decodes the objects of a batch, spreading those which are safe to
+ *  decode concurrently over the worker threads, then decodes the rest and
+ *  calls the callback for each object in the order they were read.
+ */
+static void par_flush(PAR_BATCH *b)
+{
+   PAR_JOB *j;
+   int i;
+
+   if (!b->failed) {
+#ifdef ALLEGRO_WORKER_THREADS
+      if (b->threads > 1)
+	 _al_run_workers(par_job, b, b->jobs);
+      else
+#endif
+      {
+	 for (i=0; i<b->jobs; i++)
+	    par_job(b, i);
+      }
+   }
+
+   for (i=0; i<b->jobs; i++) {
+      j = b->job+i;
+
+      if (!b->failed) {
+	 if ((j->load) && (!j->parallel))
+	    par_decode(j);
+
+	 if (!j->obj->dat)
+	    b->failed = TRUE;
+	 else if (b->callback)
+	    b->callback(j->obj);
+      }
+
+      if (j->raw)
+	 _AL_FREE(j->raw);
+   }
+
+   b->jobs = 0;
+   b->bytes = 0;
+}
+
+
+
+/* par_add:
+ *  Adds an object to the batch, decoding the batch if it is full. Returns
+ *  FALSE if there is no memory, in which case it frees raw.
+ */
+static int par_add(PAR_BATCH *b, DATAFILE *obj, int type, unsigned char *raw, long rawsize, AL_CONST PACKFILE_CODEC *codec)
+{
+   PAR_JOB *j;
+   int i;
+
+   if (b->jobs == b->max) {
+      j = _AL_REALLOC(b->job, sizeof(PAR_JOB) * (b->max + 64));
+      if (!j) {
+	 if (raw)
+	    _AL_FREE(raw);
+	 *allegro_errno = ENOMEM;
+	 return FALSE;
+      }
+      b->job = j;
+      b->max += 64;
+   }
+
+   j = b->job + b->jobs++;
+   j->obj = obj;
+   j->raw = raw;
+   j->rawsize = rawsize;
+   j->codec = codec;
+   j->load = NULL;
+   j->parallel = FALSE;
+
+   if (raw) {
+      j->load = load_data_object;
+
+      for (i=0; i<MAX_DATAFILE_TYPES; i++) {
+	 if (_datafile_type[i].type == type) {
+	    j->load = _datafile_type[i].load;
+	    break;
+	 }
+      }
+
+      /* only our own loaders are known to be thread safe, and compiled
+       * sprites and platform bitmaps have to be made on this thread
+       */
+      if ((j->load == load_data_object) || (j->load == load_sample_object) ||
+	  (j->load == load_midi_object) || (j->load == load_rle_sprite_object))
+	 j->parallel = TRUE;
+      else if ((j->load == load_bitmap_object) || (j->load == load_font_object))
+	 j->parallel = ((!system_driver->create_bitmap) && (!system_driver->created_bitmap));
+
+      b->bytes += rawsize;
+   }
+
+   if ((b->jobs >= PAR_BATCH_JOBS) || (b->bytes >= PAR_BATCH_BYTES))
+      par_flush(b);
+
+   return TRUE;
+}
+
+
+
+/* par_scan:
+ *  Reads the objects of a datafile into a batch, reading nested datafiles
+ *  in turn. Sets b->failed if anything goes wrong, but always returns the
+ *  array, or NULL if it couldn't be allocated, so that it can be freed.
+ */
+static DATAFILE *par_scan(PACKFILE *f, PAR_BATCH *b)
+{
+   AL_CONST PACKFILE_CODEC *codec;
+   DATAFILE *dat;
+   DATAFILE_PROPERTY prop, *list = NULL;
+   MAP_READER r;
+   PACKFILE *ff;
+   unsigned char *raw;
+   int filesize, datasize;
+   int count, type, c;
+   long got;
+
+   count = pack_mgetl(f);
+   if ((count < 0) || (count >= INT_MAX / (int)sizeof(DATAFILE)) || (pack_ferror(f))) {
+      b->failed = TRUE;
+      return NULL;
+   }
+
+   dat = _AL_MALLOC(sizeof(DATAFILE)*(count+1));
+   if (!dat) {
+      *allegro_errno = ENOMEM;
+      b->failed = TRUE;
+      return NULL;
+   }
+
+   for (c=0; (c<count) && (!b->failed);) {
+      type = pack_mgetl(f);
+
+      if (type == DAT_PROPERTY) {
+	 if ((_load_property(&prop, f) != 0) || (_add_property(&list, &prop) != 0))
+	    b->failed = TRUE;
+	 continue;
+      }
+
+      filesize = pack_mgetl(f);
+      datasize = pack_mgetl(f);
+      codec = (datasize < 0) ? &_al_lzss_codec : NULL;
+
+      if ((filesize < 0) && (filesize > INT_MIN)) {
+	 /* packed with another codec, whose magic number comes next */
+	 codec = _al_find_packfile_codec(pack_mgetl(f));
+	 filesize = -(filesize + 4);
+      }
+
+      if ((filesize < 0) || (pack_ferror(f)) || ((datasize < 0) != (codec != NULL))) {
+	 b->failed = TRUE;
+	 break;
+      }
+
+      dat[c].type = type;
+      dat[c].dat = NULL;
+      dat[c].size = ABS(datasize);
+      dat[c].prop = list;
+      list = NULL;
+      c++;
+
+      if ((type == DAT_FILE) && (datasize >= 0)) {
+	 /* nested datafiles are read in place, through a chunk so that they
+	  * stop at its end just like with load_datafile()
+	  */
+	 ff = _al_pack_fopen_read_chunk(f, datasize, NULL);
+	 if (ff) {
+	    dat[c-1].dat = par_scan(ff, b);
+	    pack_fclose_chunk(ff);
+	 }
+      }
+      else {
+	 raw = _AL_MALLOC_ATOMIC(MAX(filesize, 1));
+	 if (!raw) {
+	    *allegro_errno = ENOMEM;
+	    b->failed = TRUE;
+	    break;
+	 }
+
+	 /* a truncated chunk is loaded from what there is, as a chunk
+	  * opened with pack_fopen_chunk() would be
+	  */
+	 got = pack_fread(raw, filesize, f);
+	 if (pack_ferror(f)) {
+	    _AL_FREE(raw);
+	    b->failed = TRUE;
+	    break;
+	 }
+
+	 if (type != DAT_FILE) {
+	    if (!par_add(b, dat+c-1, type, raw, got, codec))
+	       b->failed = TRUE;
+	    continue;
+	 }
+
+	 /* a compressed nested datafile is unpacked on this thread */
+	 r.base = par_unpack(codec, raw, got, -datasize, &got);
+	 _AL_FREE(raw);
+
+	 if (r.base) {
+	    r.pos = 0;
+	    r.end = got;
+
+	    ff = pack_fopen_vtable(&map_vtable, &r);
+	    if (ff) {
+	       dat[c-1].dat = par_scan(ff, b);
+	       pack_fclose(ff);
+	    }
+
+	    _AL_FREE(r.base);
+	 }
+      }
+
+      /* the datafile itself is passed to the callback after its objects */
+      if ((!dat[c-1].dat) || (!par_add(b, dat+c-1, type, NULL, 0, NULL)))
+	 b->failed = TRUE;
+   }
+
+   dat[c].type = DAT_END;
+   dat[c].dat = NULL;
+
+   if (list)
+      _destroy_property_list(list);
+
+   if (c < count)
+      b->failed = TRUE;
+
+   return dat;
+}
+
+
+
+#ifdef ALLEGRO_WORKER_THREADS
+
+/* par_workers_exit:
+ *  Stops the workers load_datafile_parallel() added to the pool.
+ */
+static void par_workers_exit(void)
+{
+   _al_stop_workers();
+}
+
+#endif
+
+
+
+/* load_datafile_parallel:
+ *  Loads an entire data file into memory like load_datafile_callback(),
+ *  but decodes the objects on several threads, or one per processor if
+ *  threads is zero. On error, sets errno and returns NULL.
+ */
+DATAFILE *load_datafile_parallel(AL_CONST char *filename, void (*callback)(DATAFILE *), int threads)
+{
+   PAR_BATCH b;
+   PACKFILE *f;
+   DATAFILE *dat;
+   int type;
+   ASSERT(filename);
+
+#ifdef ALLEGRO_WORKER_THREADS
+   if (threads <= 0)
+      threads = _al_cpu_count();
+#else
+   threads = 1;
+#endif
+
+   /* with a single thread, buffering the objects would only cost time */
+   if (threads <= 1)
+      return load_datafile_callback(filename, callback);
+
+   f = pack_fopen(filename, F_READ_PACKED);
+   if (!f)
+      return NULL;
+
+   if ((f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
+      type = (f->normal.type == DAT_FILE) ? DAT_MAGIC : 0;
+   else
+      type = pack_mgetl(f);
+
+   /* old datafiles and old style encryption are read the usual way */
+   if ((type != DAT_MAGIC) || (f->normal.flags & PACKFILE_FLAG_OLD_CRYPT)) {
+      pack_fclose(f);
+      return load_datafile_callback(filename, callback);
+   }
+
+   b.job = NULL;
+   b.jobs = b.max = 0;
+   b.bytes = 0;
+   b.failed = FALSE;
+   b.callback = callback;
+   b.threads = threads;
+
+#ifdef ALLEGRO_WORKER_THREADS
+   /* share the drawing thread pool, adding workers if it is too small but
+    * never restarting it, since other threads may be drawing with it
+    */
+   b.threads = _al_grow_workers(threads);
+   if (b.threads > _drawing_threads)
+      _add_exit_func(par_workers_exit, "par_workers_exit");
+#endif
+
+   dat = par_scan(f, &b);
+   par_flush(&b);
+
+   pack_fclose(f);
+
+   if (b.job)
+      _AL_FREE(b.job);
+
+   if (b.failed) {
+      unload_datafile(dat);
+      return NULL;
+   }
+
+   return dat;
+}
+
+
+
+/* create_datafile_index
+ *  Reads offsets of all objects inside datafile.
+ *  On error, sets errno and returns NULL.
+ */
+DATAFILE_INDEX *create_datafile_index(AL_CONST char *filename)
+{
+   PACKFILE *f;
+   DATAFILE_INDEX *index;
+   long pos = 4;
+   int type, count, skip, i;
+
+   ASSERT(filename);
+
+   f = pack_fopen(filename, F_READ_PACKED);
+   if (!f)
+      return NULL;
+
+   if ((f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
+      type = (f->normal.type == DAT_FILE) ? DAT_MAGIC : 0;
+   else {
+      type = pack_mgetl(f);   pos += 4;
+   }
+
+   /* only support V2 datafile format */
+   if (type != DAT_MAGIC)
+      return NULL;
+
+   count = pack_mgetl(f);     pos += 4;
+
+   index = _AL_MALLOC(sizeof(DATAFILE_INDEX));
+   if (!index) {
+      pack_fclose(f);
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   index->filename = _al_ustrdup(filename);
+   if (!index->filename) {
+      pack_fclose(f);
+      _AL_FREE(index);
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   index->offset = _AL_MALLOC(sizeof(long) * count);
+   if (!index->offset) {
+      pack_fclose(f);
+      _AL_FREE(index->filename);
+      _AL_FREE(index);
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   for (i = 0; i < count; ++i) {
+      index->offset[i] = pos;
+
+      /* Skip properties */
+      while (pos += 4, pack_mgetl(f) == DAT_PROPERTY) {
+
+         /* Skip property name */
+         pack_fseek(f, 4);       pos += 4;
+
+         /* Skip rest of property */
+         skip = pack_mgetl(f);   pos += 4;      /* Get property size */
+         pack_fseek(f, skip);    pos += skip;
+      }
+
+      /* Skip rest of object */
+      skip = pack_mgetl(f) + 4;  pos += 4;
+      pack_fseek(f, skip);       pos += skip;
+
+   }
+   pack_fclose(f);
+   return index;
+}
+
+
+
+/* load_datafile_object:
+ *  Loads a single object from a datafile.
+ */
+DATAFILE *load_datafile_object(AL_CONST char *filename, AL_CONST char *objectname)
+{
+   PACKFILE *f;
+   DATAFILE *dat;
+   DATAFILE_PROPERTY prop, *list;
+   char parent[1024], child[1024], tmp[8];
+   char *bufptr, *prevptr, *separator;
+   int count, c, type, size, found;
+
+   ASSERT(filename);
+   ASSERT(objectname);
+  
+   /* concatenate to filename#objectname */
+   ustrzcpy(parent, sizeof(parent), filename);
+
+   if (ustrcmp(parent, uconvert_ascii("#", tmp)) != 0)
+      ustrzcat(parent, sizeof(parent), uconvert_ascii("#", tmp));
+
+   ustrzcat(parent, sizeof(parent), objectname);
+   
+   /* split into path and actual objectname (for nested files) */
+   prevptr = bufptr = parent;
+   separator = NULL;
+   while ((c = ugetx(&bufptr)) != 0) {
+      if ((c == '#') || (c == '/') || (c == OTHER_PATH_SEPARATOR))
+	 separator = prevptr;
+
+      prevptr = bufptr;
+   }
+   
+   ustrzcpy(child, sizeof(child), separator + uwidth (separator));
+
+   if (separator == parent)
+      usetc(separator + uwidth (separator), 0);
+   else
+      usetc(separator, 0);
+
+   /* open the parent datafile */
+   f = pack_fopen(parent, F_READ_PACKED);
+   if (!f)
+      return NULL;
+
+   if ((f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(f->normal.flags & PACKFILE_FLAG_EXEDAT)))
+      type = (f->normal.type == DAT_FILE) ? DAT_MAGIC : 0;
+   else
+      type = pack_mgetl(f);
+
+   /* only support V2 datafile format */
+   if (type != DAT_MAGIC) {
+      pack_fclose(f);
+      return NULL;
+   }
+
+   count = pack_mgetl(f);
+
+   dat = NULL;
+   list = NULL;
+   found = FALSE;
+
+   /* search the packfile for properties or objects */
+   for (c=0; c<count;) {
+      type = pack_mgetl(f);
+
+      if (type == DAT_PROPERTY) {
+	 if ((_load_property(&prop, f) != 0) || (_add_property(&list, &prop) != 0))
+	    break;
+
+	 if ((prop.type == DAT_NAME) && (ustricmp(prop.dat, child) == 0))
+	    found = TRUE;
+      }
+      else {
+	 if (found) {
+	    /* we have found the object, load it */
+	    dat = _AL_MALLOC(sizeof(DATAFILE));
+	    if (!dat) {
+	       *allegro_errno = ENOMEM;
+	       break;
+	    }
+
+	    if (load_object(dat, f, type) != 0) {
+	       _AL_FREE(dat);
+	       dat = NULL;
+	       break;
+	    }
+
+	    /* attach the property list to the object */
+	    dat->prop = list;
+	    list = NULL;
+
+	    break;
+	 }
+	 else {
+	    /* skip an unwanted object */
+	    size = pack_mgetl(f);
+	    pack_fseek(f, size+4);  /* '4' for the chunk size */
+
+	    /* destroy the property list */
+	    if (list) {
+	       _destroy_property_list(list);
+	       list = NULL;
+	    }
+
+	    c++;
+	 }
+      }
+   }
+
+   /* destroy the property list if not assigned to an object */
+   if (list)
+      _destroy_property_list(list);
+
+   pack_fclose(f);
+   return dat;
+}
+
+
+
+/* load_datafile_object_indexed
+ *  Loads a single object from a datafile using its offset.
+ *  On error, returns NULL.
+ */
+DATAFILE *load_datafile_object_indexed(AL_CONST DATAFILE_INDEX *index, int item)
 {
    int type;
    PACKFILE *f;
@@ -1670,7 +2768,7 @@ void _unload_datafile_object(DATAFILE *dat)
 	 if (dat->dat) {
 	    if (_datafile_type[i].destroy)
 	       _datafile_type[i].destroy(dat->dat);
-	    else
+	    else if (!datafile_mapped(dat->dat))
 	       _AL_FREE(dat->dat);
 	 }
 	 return;
@@ -1678,7 +2776,7 @@ void _unload_datafile_object(DATAFILE *dat)
    }
 
    /* if not found, just free the data */
-   if (dat->dat)
+   if ((dat->dat) && (!datafile_mapped(dat->dat)))
       _AL_FREE(dat->dat);
 }
 
@@ -1689,13 +2787,26 @@ void _unload_datafile_object(DATAFILE *dat)
  */
 void unload_datafile(DATAFILE *dat)
 {
+   DATAFILE_MAP **p, *m;
    int i;
 
    if (dat) {
       for (i=0; dat[i].type != DAT_END; i++)
 	 _unload_datafile_object(dat+i);
 
+      _lazy_datafile_unload(dat);
       _AL_FREE(dat);
+
+      /* let go of the file if it was loaded by load_datafile_mapped() */
+      for (p = &datafile_maps; *p; p = &(*p)->next) {
+	 if ((*p)->dat == dat) {
+	    m = *p;
+	    *p = m->next;
+	    _al_file_unmap(m->base, m->size);
+	    _AL_FREE(m);
+	    break;
+	 }
+      }
    }
 }
 
@@ -1756,7 +2867,7 @@ DATAFILE *find_datafile_object(AL_CONST DATAFILE *dat, AL_CONST char *objectname
    for (pos=0; dat[pos].type != DAT_END; pos++) {
       if (ustricmp(name, get_datafile_property(dat+pos, DAT_NAME)) == 0) {
 	 if (recurse) {
-	    if (dat[pos].type == DAT_FILE)
+	    if ((dat[pos].type == DAT_FILE) && (get_datafile_object((DATAFILE *)dat+pos)))
 	       return find_datafile_object(dat[pos].dat, objectname);
 	    else
 	       return NULL;
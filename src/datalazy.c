@@ -0,0 +1,584 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Lazily loaded datafiles.
+ *
+ *      load_datafile_lazy() only reads the types and properties of the
+ *      objects in a datafile, remembering where each one is stored.
+ *      The objects themselves are read by get_datafile_object() the first
+ *      time they are asked for, and the least recently used ones are
+ *      unloaded again whenever the datafile holds more than its budget.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <limits.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* an object of a lazy datafile */
+typedef struct LAZY_OBJECT
+{
+   DATAFILE *dat;                      /* the object itself */
+   long pos;                           /* where its chunk starts */
+   long end;                           /* and where it ends */
+   int packed;                         /* is the chunk compressed? */
+   int resident;                       /* is it in the recently used list? */
+   struct LAZY_OBJECT *prev;           /* towards the most recently used */
+   struct LAZY_OBJECT *next;           /* towards the least recently used */
+} LAZY_OBJECT;
+
+
+/* the file and memory budget shared by a datafile and all its children */
+typedef struct LAZY_ROOT
+{
+   char *filename;
+   PACKFILE *f;                        /* kept open between reads */
+   long pos;                           /* how far into the datafile f is */
+   long budget;                        /* 0 means no limit */
+   long resident;                      /* bytes of objects in memory */
+   LAZY_OBJECT *head;                  /* most recently used */
+   LAZY_OBJECT *tail;                  /* least recently used */
+} LAZY_ROOT;
+
+
+/* the index of a lazy datafile or nested datafile */
+typedef struct LAZY_FILE
+{
+   DATAFILE *dat;
+   int count;
+   LAZY_OBJECT *obj;
+   LAZY_ROOT *root;                    /* NULL unless this is a child */
+   struct LAZY_FILE *parent;
+   struct LAZY_FILE *next;
+} LAZY_FILE;
+
+
+static LAZY_FILE *lazy_files = NULL;
+static LAZY_FILE *lazy_last = NULL;    /* where the last lookup ended */
+
+
+
+/* lazy_find:
+ *  Returns the lazy datafile containing an object, or NULL.
+ */
+static LAZY_FILE *lazy_find(AL_CONST DATAFILE *dat)
+{
+   LAZY_FILE *lf;
+
+   if ((lazy_last) && (dat >= lazy_last->dat) && (dat < lazy_last->dat + lazy_last->count))
+      return lazy_last;
+
+   for (lf = lazy_files; lf; lf = lf->next) {
+      if ((dat >= lf->dat) && (dat < lf->dat + lf->count)) {
+	 lazy_last = lf;
+	 return lf;
+      }
+   }
+
+   return NULL;
+}
+
+
+
+/* lazy_open:
+ *  Opens the datafile, leaving it just after the magic number. Positions
+ *  in the file are counted from there, since packfiles can't tell where
+ *  they are once they have been decompressed.
+ */
+static PACKFILE *lazy_open(LAZY_ROOT *r, int *type)
+{
+   r->f = pack_fopen(r->filename, F_READ_PACKED);
+   if (!r->f)
+      return NULL;
+
+   r->pos = 0;
+
+   if ((r->f->normal.flags & PACKFILE_FLAG_CHUNK) && (!(r->f->normal.flags & PACKFILE_FLAG_EXEDAT)))
+      *type = (r->f->normal.type == DAT_FILE) ? DAT_MAGIC : 0;
+   else
+      *type = pack_mgetl(r->f);
+
+   return r->f;
+}
+
+
+
+/* lazy_close:
+ *  Closes the datafile until it is needed again.
+ */
+static void lazy_close(LAZY_ROOT *r)
+{
+   if (r->f) {
+      pack_fclose(r->f);
+      r->f = NULL;
+   }
+}
+
+
+
+/* lazy_seek:
+ *  Moves to a position in the datafile, opening it again if the position
+ *  is behind the current one, because packfiles only seek forwards.
+ */
+static PACKFILE *lazy_seek(LAZY_ROOT *r, long pos)
+{
+   int type;
+
+   if ((r->f) && (r->pos > pos))
+      lazy_close(r);
+
+   if (!r->f) {
+      if (!lazy_open(r, &type))
+	 return NULL;
+   }
+
+   if ((pos > r->pos) && (pack_fseek(r->f, pos - r->pos) != 0)) {
+      lazy_close(r);
+      return NULL;
+   }
+
+   r->pos = pos;
+   return r->f;
+}
+
+
+
+/* lazy_root:
+ *  Returns the budget a lazy datafile counts towards.
+ */
+static LAZY_ROOT *lazy_root(LAZY_FILE *lf)
+{
+   while (lf->parent)
+      lf = lf->parent;
+
+   return lf->root;
+}
+
+
+
+/* lazy_property:
+ *  Reads a property the way _load_property() does, keeping count of the
+ *  position in the file. Returns 0 on success and -1 on failure.
+ */
+static int lazy_property(LAZY_ROOT *r, DATAFILE_PROPERTY *prop)
+{
+   char *p;
+   int size;
+
+   prop->type = pack_mgetl(r->f);
+   size = pack_mgetl(r->f);
+   r->pos += 8;
+
+   if ((size < 0) || (pack_ferror(r->f))) {
+      *allegro_errno = EINVAL;
+      return -1;
+   }
+
+   prop->dat = _AL_MALLOC_ATOMIC(size+1);
+   if (!prop->dat) {
+      *allegro_errno = ENOMEM;
+      return -1;
+   }
+
+   r->pos += pack_fread(prop->dat, size, r->f);
+   prop->dat[size] = 0;
+
+   if (need_uconvert(prop->dat, U_UTF8, U_CURRENT)) {
+      int length = uconvert_size(prop->dat, U_UTF8, U_CURRENT);
+      p = _AL_MALLOC_ATOMIC(length);
+      if (!p) {
+	 _AL_FREE(prop->dat);
+	 *allegro_errno = ENOMEM;
+	 return -1;
+      }
+
+      do_uconvert(prop->dat, U_UTF8, p, U_CURRENT, length);
+      _AL_FREE(prop->dat);
+      prop->dat = p;
+   }
+
+   return 0;
+}
+
+
+
+/* lazy_index:
+ *  Reads the object types and properties of a datafile, which starts at
+ *  the current position, skipping over the objects themselves. On error,
+ *  sets errno and returns NULL.
+ */
+static LAZY_FILE *lazy_index(LAZY_ROOT *r, LAZY_FILE *parent)
+{
+   LAZY_FILE *lf;
+   DATAFILE_PROPERTY prop, *list = NULL;
+   int filesize, datasize;
+   int count, type, c;
+
+   count = pack_mgetl(r->f);
+   r->pos += 4;
+
+   if ((count < 0) || (count >= INT_MAX / (int)sizeof(LAZY_OBJECT)) || (pack_ferror(r->f))) {
+      *allegro_errno = EINVAL;
+      return NULL;
+   }
+
+   lf = _AL_MALLOC(sizeof(LAZY_FILE));
+   if (!lf) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   lf->dat = _AL_MALLOC(sizeof(DATAFILE)*(count+1));
+   lf->obj = _AL_MALLOC(sizeof(LAZY_OBJECT)*(count+1));
+   c = 0;
+
+   if ((!lf->dat) || (!lf->obj)) {
+      *allegro_errno = ENOMEM;
+      goto Error;
+   }
+
+   while (c < count) {
+      type = pack_mgetl(r->f);
+      r->pos += 4;
+
+      if (pack_feof(r->f)) {
+	 *allegro_errno = EINVAL;
+	 goto Error;
+      }
+
+      if (type == DAT_PROPERTY) {
+	 if ((lazy_property(r, &prop) != 0) || (_add_property(&list, &prop) != 0))
+	    goto Error;
+      }
+      else {
+	 lf->obj[c].dat = lf->dat+c;
+	 lf->obj[c].pos = r->pos;
+	 lf->obj[c].resident = FALSE;
+
+	 filesize = pack_mgetl(r->f);
+	 datasize = pack_mgetl(r->f);
+	 r->pos += 8;
+
+	 /* codecs other than LZSS store minus the size, magic included */
+	 if ((filesize < 0) && (filesize > INT_MIN))
+	    filesize = -filesize;
+
+	 if ((filesize < 0) || (pack_ferror(r->f)) || (pack_fseek(r->f, filesize) != 0)) {
+	    *allegro_errno = EINVAL;
+	    goto Error;
+	 }
+
+	 r->pos += filesize;
+	 lf->obj[c].end = r->pos;
+	 lf->obj[c].packed = (datasize < 0);
+
+	 lf->dat[c].dat = NULL;
+	 lf->dat[c].type = type;
+	 lf->dat[c].size = ABS(datasize);
+	 lf->dat[c].prop = list;
+	 list = NULL;
+
+	 c++;
+      }
+   }
+
+   lf->dat[c].type = DAT_END;
+   lf->dat[c].dat = NULL;
+   lf->dat[c].size = 0;
+   lf->dat[c].prop = NULL;
+
+   lf->count = count;
+   lf->root = NULL;
+   lf->parent = parent;
+   lf->next = lazy_files;
+   lazy_files = lf;
+
+   return lf;
+
+ Error:
+   if (list)
+      _destroy_property_list(list);
+
+   if (lf->dat) {
+      while (c > 0) {
+	 c--;
+	 if (lf->dat[c].prop)
+	    _destroy_property_list(lf->dat[c].prop);
+      }
+      _AL_FREE(lf->dat);
+   }
+
+   if (lf->obj)
+      _AL_FREE(lf->obj);
+
+   _AL_FREE(lf);
+   return NULL;
+}
+
+
+
+/* lazy_unlink:
+ *  Takes an object out of the recently used list.
+ */
+static void lazy_unlink(LAZY_ROOT *r, LAZY_OBJECT *o)
+{
+   if (o->prev)
+      o->prev->next = o->next;
+   else
+      r->head = o->next;
+
+   if (o->next)
+      o->next->prev = o->prev;
+   else
+      r->tail = o->prev;
+
+   o->resident = FALSE;
+   r->resident -= o->dat->size;
+}
+
+
+
+/* lazy_push:
+ *  Puts an object at the front of the recently used list.
+ */
+static void lazy_push(LAZY_ROOT *r, LAZY_OBJECT *o)
+{
+   o->prev = NULL;
+   o->next = r->head;
+
+   if (r->head)
+      r->head->prev = o;
+   else
+      r->tail = o;
+
+   r->head = o;
+   o->resident = TRUE;
+   r->resident += o->dat->size;
+}
+
+
+
+/* lazy_evict:
+ *  Unloads the least recently used objects until the datafile fits in its
+ *  budget again, leaving keep alone.
+ */
+static void lazy_evict(LAZY_ROOT *r, LAZY_OBJECT *keep)
+{
+   DATAFILE_PROPERTY *prop;
+   LAZY_OBJECT *o, *prev;
+
+   if (r->budget <= 0)
+      return;
+
+   for (o = r->tail; (o) && (r->resident > r->budget); o = prev) {
+      prev = o->prev;
+
+      if (o != keep) {
+	 lazy_unlink(r, o);
+
+	 prop = o->dat->prop;
+	 o->dat->prop = NULL;
+	 _unload_datafile_object(o->dat);
+	 o->dat->prop = prop;
+	 o->dat->dat = NULL;
+      }
+   }
+}
+
+
+
+/* get_datafile_object:
+ *  Returns the data of a datafile object, reading it from the disk first
+ *  if it belongs to a lazy datafile and isn't in memory. On error, sets
+ *  errno and returns NULL.
+ */
+void *get_datafile_object(DATAFILE *dat)
+{
+   LAZY_FILE *lf, *child;
+   LAZY_OBJECT *o;
+   LAZY_ROOT *r;
+   PACKFILE *f;
+   ASSERT(dat);
+
+   lf = lazy_find(dat);
+   if (!lf)
+      return dat->dat;
+
+   o = lf->obj + (dat - lf->dat);
+   r = lazy_root(lf);
+
+   if (dat->dat) {
+      if ((o->resident) && (o != r->head)) {
+	 lazy_unlink(r, o);
+	 lazy_push(r, o);
+      }
+      return dat->dat;
+   }
+
+   if ((dat->type == DAT_FILE) && (!o->packed)) {
+      /* nested datafiles are indexed in turn, and never unloaded */
+      if (!lazy_seek(r, o->pos + 8))
+	 return NULL;
+
+      child = lazy_index(r, lf);
+      if (!child) {
+	 lazy_close(r);
+	 return NULL;
+      }
+
+      dat->dat = child->dat;
+      return dat->dat;
+   }
+
+   f = lazy_seek(r, o->pos);
+   if (!f)
+      return NULL;
+
+   if (_load_datafile_object(dat, f, dat->type) != 0) {
+      lazy_close(r);
+      return NULL;
+   }
+
+   /* reading a chunk always leaves the file at the end of it */
+   r->pos = o->end;
+
+   if (dat->type != DAT_FILE) {
+      lazy_push(r, o);
+      lazy_evict(r, o);
+   }
+
+   return dat->dat;
+}
+
+
+
+/* load_datafile_lazy:
+ *  Reads the index of a datafile, leaving its objects on the disk until
+ *  they are asked for by get_datafile_object(). On error, sets errno and
+ *  returns NULL.
+ */
+DATAFILE *load_datafile_lazy(AL_CONST char *filename)
+{
+   LAZY_ROOT *r;
+   LAZY_FILE *lf;
+   int type;
+   ASSERT(filename);
+
+   r = _AL_MALLOC(sizeof(LAZY_ROOT));
+   if (!r) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   r->filename = _al_ustrdup(filename);
+   if (!r->filename) {
+      _AL_FREE(r);
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   r->budget = 0;
+   r->resident = 0;
+   r->head = r->tail = NULL;
+
+   if (!lazy_open(r, &type)) {
+      _AL_FREE(r->filename);
+      _AL_FREE(r);
+      return NULL;
+   }
+
+   if (type == DAT_MAGIC)
+      lf = lazy_index(r, NULL);
+   else
+      lf = NULL;
+
+   if (!lf) {
+      pack_fclose(r->f);
+      _AL_FREE(r->filename);
+      _AL_FREE(r);
+
+      /* old format datafiles can't be indexed, so just load them */
+      if (type == V1_DAT_MAGIC)
+	 return load_datafile(filename);
+
+      return NULL;
+   }
+
+   lf->root = r;
+   return lf->dat;
+}
+
+
+
+/* set_datafile_budget:
+ *  Sets how many bytes of objects a lazy datafile may keep in memory.
+ */
+void set_datafile_budget(DATAFILE *dat, long budget)
+{
+   LAZY_FILE *lf;
+   LAZY_ROOT *r;
+   ASSERT(dat);
+
+   lf = lazy_find(dat);
+   if (!lf)
+      return;
+
+   r = lazy_root(lf);
+   r->budget = MAX(budget, 0);
+   lazy_evict(r, NULL);
+}
+
+
+
+/* _lazy_datafile_unload:
+ *  Forgets the index of a lazy datafile when unload_datafile() has freed
+ *  its objects, closing the file if it is the outermost one.
+ */
+void _lazy_datafile_unload(DATAFILE *dat)
+{
+   LAZY_FILE **p, *lf;
+   LAZY_ROOT *r;
+   int i;
+
+   for (p = &lazy_files; *p; p = &(*p)->next) {
+      if ((*p)->dat == dat)
+	 break;
+   }
+
+   lf = *p;
+   if (!lf)
+      return;
+
+   *p = lf->next;
+
+   if (lazy_last == lf)
+      lazy_last = NULL;
+
+   r = lazy_root(lf);
+
+   for (i=0; i<lf->count; i++) {
+      if (lf->obj[i].resident)
+	 lazy_unlink(r, lf->obj+i);
+   }
+
+   if (lf->root) {
+      lazy_close(r);
+      _AL_FREE(r->filename);
+      _AL_FREE(r);
+   }
+
+   _AL_FREE(lf->obj);
+   _AL_FREE(lf);
+}
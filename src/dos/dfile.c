@@ -75,6 +75,26 @@ uint64_t _al_file_size_ex(AL_CONST char *filename)
 
 
 
+/* _al_file_map:
+ *  Maps a whole file into memory. There's no way to do that here, so
+ *  callers fall back to reading the file.
+ */
+void *_al_file_map(AL_CONST char *filename, uint64_t *size)
+{
+   return NULL;
+}
+
+
+
+/* _al_file_unmap:
+ *  Releases a mapping made by _al_file_map().
+ */
+void _al_file_unmap(void *p, uint64_t size)
+{
+}
+
+
+
 /* _al_file_time:
  *  Returns the timestamp of the specified file.
  */
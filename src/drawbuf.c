@@ -0,0 +1,832 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Deferred drawing buffers.
+ *
+ *      Drawing operations are recorded along with the clipping rectangle
+ *      and blender state they were issued under. When the buffer is
+ *      flushed, operations hidden by later opaque ones are dropped, the
+ *      rest are grouped by source bitmap and drawing state wherever that
+ *      can't change the result, and the groups are replayed through the
+ *      normal drawing functions with the target acquired once.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* how far back to look for a batch to join, and for occluding draws */
+#define MAX_LOOKBACK       64
+#define MAX_OCCLUDERS      16
+
+
+/* types of recorded operation */
+enum { DB_CLEAR, DB_RECTFILL, DB_BLIT, DB_MASKED_BLIT, DB_SPRITE,
+       DB_TRANS_SPRITE, DB_TEXT };
+
+
+/* drawing state captured for blended and patterned operations */
+typedef struct DRAW_STATE
+{
+   BLENDER_FUNC func15, func16, func24, func32;
+   BLENDER_FUNC func15x, func16x, func24x;
+   int col15, col16, col24, col32;
+   int alpha;
+   COLOR_MAP *color_map;
+   int mode;
+   BITMAP *pattern;
+   int x_anchor, y_anchor;
+} DRAW_STATE;
+
+
+/* one recorded operation */
+typedef struct DRAW_CMD
+{
+   int type;
+   void *source;              /* bitmap or font, used for grouping */
+   int state;                 /* index into the state list, or -1 */
+   int clip, cl, ct, cr, cb;  /* clipping of the target when recorded */
+   int sx, sy, x, y, w, h;    /* arguments, rectfill uses x, y, w, h as x2, y2 */
+   int color, bg;
+   char *text;
+   int x1, y1, x2, y2;        /* area touched on the target */
+   int next;                  /* next command in the same batch */
+} DRAW_CMD;
+
+
+/* a group of commands which are replayed together */
+typedef struct DRAW_BATCH
+{
+   void *source;
+   int state;
+   int first, last;
+   int x1, y1, x2, y2;        /* bounding box of the whole batch */
+} DRAW_BATCH;
+
+
+struct DRAW_BUFFER
+{
+   BITMAP *bmp;
+   DRAW_CMD *cmds;
+   int num_cmds, max_cmds;
+   DRAW_STATE *states;
+   int num_states, max_states;
+   DRAW_BATCH *batches;
+   int max_batches;
+};
+
+
+
+/* create_draw_buffer:
+ *  Creates a buffer for recording drawing operations onto a bitmap.
+ */
+DRAW_BUFFER *create_draw_buffer(BITMAP *bmp)
+{
+   DRAW_BUFFER *buf;
+   ASSERT(bmp);
+
+   buf = _AL_MALLOC(sizeof(DRAW_BUFFER));
+   if (!buf) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   memset(buf, 0, sizeof(DRAW_BUFFER));
+   buf->bmp = bmp;
+
+   return buf;
+}
+
+
+
+/* discard_draw_buffer:
+ *  Throws away everything recorded since the last flush.
+ */
+void discard_draw_buffer(DRAW_BUFFER *buf)
+{
+   int i;
+   ASSERT(buf);
+
+   for (i = 0; i < buf->num_cmds; i++) {
+      if (buf->cmds[i].text)
+	 _AL_FREE(buf->cmds[i].text);
+   }
+
+   buf->num_cmds = 0;
+   buf->num_states = 0;
+}
+
+
+
+/* destroy_draw_buffer:
+ *  Destroys a draw buffer, without drawing anything still recorded in it.
+ */
+void destroy_draw_buffer(DRAW_BUFFER *buf)
+{
+   if (!buf)
+      return;
+
+   discard_draw_buffer(buf);
+
+   if (buf->cmds)
+      _AL_FREE(buf->cmds);
+
+   if (buf->states)
+      _AL_FREE(buf->states);
+
+   if (buf->batches)
+      _AL_FREE(buf->batches);
+
+   _AL_FREE(buf);
+}
+
+
+
+/* get_state:
+ *  Captures the current drawing state into s.
+ */
+static void get_state(DRAW_STATE *s)
+{
+   memset(s, 0, sizeof(DRAW_STATE));
+
+   s->func15 = _blender_func15;
+   s->func16 = _blender_func16;
+   s->func24 = _blender_func24;
+   s->func32 = _blender_func32;
+   s->func15x = _blender_func15x;
+   s->func16x = _blender_func16x;
+   s->func24x = _blender_func24x;
+   s->col15 = _blender_col_15;
+   s->col16 = _blender_col_16;
+   s->col24 = _blender_col_24;
+   s->col32 = _blender_col_32;
+   s->alpha = _blender_alpha;
+   s->color_map = color_map;
+   s->mode = _drawing_mode;
+   s->pattern = _drawing_pattern;
+   s->x_anchor = _drawing_x_anchor;
+   s->y_anchor = _drawing_y_anchor;
+}
+
+
+
+/* set_state:
+ *  Makes a captured drawing state current again.
+ */
+static void set_state(AL_CONST DRAW_STATE *s)
+{
+   _blender_func15 = s->func15;
+   _blender_func16 = s->func16;
+   _blender_func24 = s->func24;
+   _blender_func32 = s->func32;
+   _blender_func15x = s->func15x;
+   _blender_func16x = s->func16x;
+   _blender_func24x = s->func24x;
+   _blender_col_15 = s->col15;
+   _blender_col_16 = s->col16;
+   _blender_col_24 = s->col24;
+   _blender_col_32 = s->col32;
+   _blender_alpha = s->alpha;
+   color_map = s->color_map;
+
+   _update_blender_rows();
+
+   drawing_mode(s->mode, s->pattern, s->x_anchor, s->y_anchor);
+}
+
+
+
+/* add_state:
+ *  Returns the index of the current drawing state in the buffer's list,
+ *  adding it if needed, or -1 on error.
+ */
+static int add_state(DRAW_BUFFER *buf)
+{
+   DRAW_STATE s;
+   int i;
+
+   get_state(&s);
+
+   /* most calls use the same state as the one before */
+   for (i = buf->num_states - 1; i >= 0; i--) {
+      if (memcmp(&buf->states[i], &s, sizeof(DRAW_STATE)) == 0)
+	 return i;
+   }
+
+   if (buf->num_states >= buf->max_states) {
+      int size = (buf->max_states) ? buf->max_states * 2 : 8;
+      DRAW_STATE *states = _AL_REALLOC(buf->states, size * sizeof(DRAW_STATE));
+      if (!states)
+	 return -1;
+      buf->states = states;
+      buf->max_states = size;
+   }
+
+   buf->states[buf->num_states] = s;
+
+   return buf->num_states++;
+}
+
+
+
+/* add_cmd:
+ *  Appends a new command to the buffer, or returns NULL if it should be
+ *  drawn straight away instead.
+ */
+static DRAW_CMD *add_cmd(DRAW_BUFFER *buf, int type, void *source, int stateful)
+{
+   BITMAP *bmp = buf->bmp;
+   DRAW_CMD *cmd;
+   int state = -1;
+
+   if (stateful) {
+      state = add_state(buf);
+      if (state < 0)
+	 return NULL;
+   }
+
+   if (buf->num_cmds >= buf->max_cmds) {
+      int size = (buf->max_cmds) ? buf->max_cmds * 2 : 64;
+      DRAW_CMD *cmds = _AL_REALLOC(buf->cmds, size * sizeof(DRAW_CMD));
+      if (!cmds)
+	 return NULL;
+      buf->cmds = cmds;
+      buf->max_cmds = size;
+   }
+
+   cmd = &buf->cmds[buf->num_cmds++];
+   memset(cmd, 0, sizeof(DRAW_CMD));
+
+   cmd->type = type;
+   cmd->source = source;
+   cmd->state = state;
+   cmd->clip = bmp->clip;
+   cmd->cl = bmp->cl;
+   cmd->ct = bmp->ct;
+   cmd->cr = bmp->cr;
+   cmd->cb = bmp->cb;
+
+   return cmd;
+}
+
+
+
+/* set_area:
+ *  Sets the area of the target touched by a command, from an unclipped
+ *  inclusive-exclusive rectangle. Blits and clears use the clipping
+ *  rectangle even when clipping is turned off.
+ */
+static void set_area(DRAW_BUFFER *buf, DRAW_CMD *cmd, int x1, int y1, int x2, int y2, int always_clip)
+{
+   if ((cmd->clip) || (always_clip)) {
+      cmd->x1 = MAX(x1, cmd->cl);
+      cmd->y1 = MAX(y1, cmd->ct);
+      cmd->x2 = MIN(x2, cmd->cr);
+      cmd->y2 = MIN(y2, cmd->cb);
+   }
+   else {
+      cmd->x1 = MAX(x1, 0);
+      cmd->y1 = MAX(y1, 0);
+      cmd->x2 = MIN(x2, buf->bmp->w);
+      cmd->y2 = MIN(y2, buf->bmp->h);
+   }
+}
+
+
+
+/* set_blit_area:
+ *  Works out the area touched by a blit, clipping against the source
+ *  bitmap the same way blit() does.
+ */
+static void set_blit_area(DRAW_BUFFER *buf, DRAW_CMD *cmd, BITMAP *src, int sx, int sy, int dx, int dy, int w, int h)
+{
+   if (sx < 0) {
+      w += sx;
+      dx -= sx;
+      sx = 0;
+   }
+
+   if (sy < 0) {
+      h += sy;
+      dy -= sy;
+      sy = 0;
+   }
+
+   if (sx + w > src->w)
+      w = src->w - sx;
+
+   if (sy + h > src->h)
+      h = src->h - sy;
+
+   set_area(buf, cmd, dx, dy, dx + w, dy + h, TRUE);
+}
+
+
+
+/* buffer_clear_to_color:
+ *  Records a clear_to_color() call.
+ */
+void buffer_clear_to_color(DRAW_BUFFER *buf, int color)
+{
+   DRAW_CMD *cmd;
+   ASSERT(buf);
+
+   cmd = add_cmd(buf, DB_CLEAR, NULL, FALSE);
+   if (!cmd) {
+      flush_draw_buffer(buf);
+      clear_to_color(buf->bmp, color);
+      return;
+   }
+
+   cmd->color = color;
+   set_area(buf, cmd, cmd->cl, cmd->ct, cmd->cr, cmd->cb, TRUE);
+}
+
+
+
+/* buffer_rectfill:
+ *  Records a rectfill() call.
+ */
+void buffer_rectfill(DRAW_BUFFER *buf, int x1, int y1, int x2, int y2, int color)
+{
+   DRAW_CMD *cmd;
+   int t;
+   ASSERT(buf);
+
+   cmd = add_cmd(buf, DB_RECTFILL, NULL, TRUE);
+   if (!cmd) {
+      flush_draw_buffer(buf);
+      rectfill(buf->bmp, x1, y1, x2, y2, color);
+      return;
+   }
+
+   if (x2 < x1) {
+      t = x1;
+      x1 = x2;
+      x2 = t;
+   }
+
+   if (y2 < y1) {
+      t = y1;
+      y1 = y2;
+      y2 = t;
+   }
+
+   cmd->x = x1;
+   cmd->y = y1;
+   cmd->w = x2;
+   cmd->h = y2;
+   cmd->color = color;
+   set_area(buf, cmd, x1, y1, x2 + 1, y2 + 1, FALSE);
+}
+
+
+
+/* record_blit:
+ *  Helper for buffer_blit() and buffer_masked_blit().
+ */
+static void record_blit(DRAW_BUFFER *buf, int type, BITMAP *src, int sx, int sy, int dx, int dy, int w, int h)
+{
+   DRAW_CMD *cmd;
+
+   ASSERT(buf);
+   ASSERT(src);
+
+   /* blits reading from the target can't be moved around */
+   if (is_same_bitmap(src, buf->bmp))
+      cmd = NULL;
+   else
+      cmd = add_cmd(buf, type, src, FALSE);
+
+   if (!cmd) {
+      flush_draw_buffer(buf);
+      if (type == DB_BLIT)
+	 blit(src, buf->bmp, sx, sy, dx, dy, w, h);
+      else
+	 masked_blit(src, buf->bmp, sx, sy, dx, dy, w, h);
+      return;
+   }
+
+   cmd->sx = sx;
+   cmd->sy = sy;
+   cmd->x = dx;
+   cmd->y = dy;
+   cmd->w = w;
+   cmd->h = h;
+   set_blit_area(buf, cmd, src, sx, sy, dx, dy, w, h);
+}
+
+
+
+/* buffer_blit:
+ *  Records a blit() call.
+ */
+void buffer_blit(DRAW_BUFFER *buf, BITMAP *source, int source_x, int source_y, int dest_x, int dest_y, int width, int height)
+{
+   record_blit(buf, DB_BLIT, source, source_x, source_y, dest_x, dest_y, width, height);
+}
+
+
+
+/* buffer_masked_blit:
+ *  Records a masked_blit() call.
+ */
+void buffer_masked_blit(DRAW_BUFFER *buf, BITMAP *source, int source_x, int source_y, int dest_x, int dest_y, int width, int height)
+{
+   record_blit(buf, DB_MASKED_BLIT, source, source_x, source_y, dest_x, dest_y, width, height);
+}
+
+
+
+/* record_sprite:
+ *  Helper for buffer_draw_sprite() and buffer_draw_trans_sprite().
+ */
+static void record_sprite(DRAW_BUFFER *buf, int type, BITMAP *sprite, int x, int y)
+{
+   DRAW_CMD *cmd;
+
+   ASSERT(buf);
+   ASSERT(sprite);
+
+   if (is_same_bitmap(sprite, buf->bmp))
+      cmd = NULL;
+   else
+      cmd = add_cmd(buf, type, sprite, (type == DB_TRANS_SPRITE));
+
+   if (!cmd) {
+      flush_draw_buffer(buf);
+      if (type == DB_SPRITE)
+	 draw_sprite(buf->bmp, sprite, x, y);
+      else
+	 draw_trans_sprite(buf->bmp, sprite, x, y);
+      return;
+   }
+
+   cmd->x = x;
+   cmd->y = y;
+   set_area(buf, cmd, x, y, x + sprite->w, y + sprite->h, FALSE);
+}
+
+
+
+/* buffer_draw_sprite:
+ *  Records a draw_sprite() call.
+ */
+void buffer_draw_sprite(DRAW_BUFFER *buf, BITMAP *sprite, int x, int y)
+{
+   record_sprite(buf, DB_SPRITE, sprite, x, y);
+}
+
+
+
+/* buffer_draw_trans_sprite:
+ *  Records a draw_trans_sprite() call, along with the current blender.
+ */
+void buffer_draw_trans_sprite(DRAW_BUFFER *buf, BITMAP *sprite, int x, int y)
+{
+   record_sprite(buf, DB_TRANS_SPRITE, sprite, x, y);
+}
+
+
+
+/* buffer_textout_ex:
+ *  Records a textout_ex() call. The string is copied.
+ */
+void buffer_textout_ex(DRAW_BUFFER *buf, AL_CONST FONT *f, AL_CONST char *str, int x, int y, int color, int bg)
+{
+   DRAW_CMD *cmd;
+   char *text;
+
+   ASSERT(buf);
+   ASSERT(f);
+   ASSERT(str);
+
+   text = _al_ustrdup(str);
+   cmd = (text) ? add_cmd(buf, DB_TEXT, (void *)f, FALSE) : NULL;
+
+   if (!cmd) {
+      if (text)
+	 _AL_FREE(text);
+      flush_draw_buffer(buf);
+      textout_ex(buf->bmp, f, str, x, y, color, bg);
+      return;
+   }
+
+   cmd->text = text;
+   cmd->x = x;
+   cmd->y = y;
+   cmd->color = color;
+   cmd->bg = bg;
+   set_area(buf, cmd, x, y, x + text_length(f, str), y + text_height(f), FALSE);
+}
+
+
+
+/* is_opaque:
+ *  Returns TRUE if a command overwrites every pixel of its area without
+ *  looking at what was there before.
+ */
+static int is_opaque(DRAW_BUFFER *buf, AL_CONST DRAW_CMD *cmd)
+{
+   switch (cmd->type) {
+
+      case DB_CLEAR:
+      case DB_BLIT:
+	 return TRUE;
+
+      case DB_RECTFILL:
+	 return (buf->states[cmd->state].mode == DRAW_MODE_SOLID);
+   }
+
+   return FALSE;
+}
+
+
+
+/* cull_commands:
+ *  Marks commands which are completely covered by later opaque ones, or
+ *  which don't touch the target at all, by giving them an empty area.
+ */
+static void cull_commands(DRAW_BUFFER *buf)
+{
+   DRAW_CMD *occluders[MAX_OCCLUDERS];
+   int num_occluders = 0;
+   int i, j;
+
+   for (i = buf->num_cmds - 1; i >= 0; i--) {
+      DRAW_CMD *cmd = &buf->cmds[i];
+
+      if ((cmd->x1 >= cmd->x2) || (cmd->y1 >= cmd->y2)) {
+	 cmd->x2 = cmd->x1;
+	 continue;
+      }
+
+      for (j = 0; j < num_occluders; j++) {
+	 DRAW_CMD *o = occluders[j];
+
+	 if ((cmd->x1 >= o->x1) && (cmd->x2 <= o->x2) &&
+	     (cmd->y1 >= o->y1) && (cmd->y2 <= o->y2)) {
+	    cmd->x2 = cmd->x1;
+	    break;
+	 }
+      }
+
+      if ((j == num_occluders) && (is_opaque(buf, cmd))) {
+	 /* keep the most recent ones, they are the most likely to matter */
+	 if (num_occluders == MAX_OCCLUDERS)
+	    memmove(occluders, occluders + 1, (MAX_OCCLUDERS - 1) * sizeof(DRAW_CMD *));
+	 else
+	    num_occluders++;
+	 occluders[num_occluders - 1] = cmd;
+      }
+   }
+}
+
+
+
+/* merge_rectfill:
+ *  Tries to extend the rectfill command last to also cover cmd, which is
+ *  only possible if the union of the two is a rectangle. Overlapping
+ *  fills are only merged when drawing solid.
+ */
+static int merge_rectfill(DRAW_BUFFER *buf, DRAW_CMD *last, AL_CONST DRAW_CMD *cmd)
+{
+   int overlap_ok;
+
+   if ((last->type != DB_RECTFILL) || (cmd->type != DB_RECTFILL) ||
+       (last->color != cmd->color) || (last->state != cmd->state) ||
+       (last->clip != cmd->clip) || (last->cl != cmd->cl) ||
+       (last->ct != cmd->ct) || (last->cr != cmd->cr) || (last->cb != cmd->cb))
+      return FALSE;
+
+   overlap_ok = (buf->states[cmd->state].mode == DRAW_MODE_SOLID);
+
+   if ((last->x == cmd->x) && (last->w == cmd->w)) {
+      if ((cmd->y == last->h + 1) || ((overlap_ok) && (cmd->y >= last->y) && (cmd->y <= last->h + 1))) {
+	 last->h = MAX(last->h, cmd->h);
+      }
+      else if ((cmd->h + 1 == last->y) || ((overlap_ok) && (cmd->h + 1 >= last->y) && (cmd->h <= last->h))) {
+	 last->y = MIN(last->y, cmd->y);
+      }
+      else
+	 return FALSE;
+   }
+   else if ((last->y == cmd->y) && (last->h == cmd->h)) {
+      if ((cmd->x == last->w + 1) || ((overlap_ok) && (cmd->x >= last->x) && (cmd->x <= last->w + 1))) {
+	 last->w = MAX(last->w, cmd->w);
+      }
+      else if ((cmd->w + 1 == last->x) || ((overlap_ok) && (cmd->w + 1 >= last->x) && (cmd->w <= last->w))) {
+	 last->x = MIN(last->x, cmd->x);
+      }
+      else
+	 return FALSE;
+   }
+   else
+      return FALSE;
+
+   last->x1 = MIN(last->x1, cmd->x1);
+   last->y1 = MIN(last->y1, cmd->y1);
+   last->x2 = MAX(last->x2, cmd->x2);
+   last->y2 = MAX(last->y2, cmd->y2);
+
+   return TRUE;
+}
+
+
+
+/* batch_commands:
+ *  Groups the surviving commands into batches sharing a source and drawing
+ *  state. A command may only join an earlier batch if it doesn't overlap
+ *  anything in the batches it is moved in front of, so the result is the
+ *  same as drawing in the original order. Returns the number of batches,
+ *  or -1 on error.
+ */
+static int batch_commands(DRAW_BUFFER *buf)
+{
+   int num_batches = 0;
+   int i, b;
+
+   if (buf->max_batches < buf->num_cmds) {
+      DRAW_BATCH *batches = _AL_REALLOC(buf->batches, buf->num_cmds * sizeof(DRAW_BATCH));
+      if (!batches)
+	 return -1;
+      buf->batches = batches;
+      buf->max_batches = buf->num_cmds;
+   }
+
+   for (i = 0; i < buf->num_cmds; i++) {
+      DRAW_CMD *cmd = &buf->cmds[i];
+      DRAW_BATCH *batch = NULL;
+
+      if (cmd->x1 >= cmd->x2)
+	 continue;
+
+      cmd->next = -1;
+
+      for (b = num_batches - 1; (b >= 0) && (b >= num_batches - MAX_LOOKBACK); b--) {
+	 DRAW_BATCH *prev = &buf->batches[b];
+
+	 if ((prev->source == cmd->source) && (prev->state == cmd->state)) {
+	    batch = prev;
+	    break;
+	 }
+
+	 if ((cmd->x1 < prev->x2) && (cmd->x2 > prev->x1) &&
+	     (cmd->y1 < prev->y2) && (cmd->y2 > prev->y1))
+	    break;
+      }
+
+      if (batch) {
+	 if (!merge_rectfill(buf, &buf->cmds[batch->last], cmd)) {
+	    buf->cmds[batch->last].next = i;
+	    batch->last = i;
+	 }
+
+	 batch->x1 = MIN(batch->x1, cmd->x1);
+	 batch->y1 = MIN(batch->y1, cmd->y1);
+	 batch->x2 = MAX(batch->x2, cmd->x2);
+	 batch->y2 = MAX(batch->y2, cmd->y2);
+      }
+      else {
+	 batch = &buf->batches[num_batches++];
+	 batch->source = cmd->source;
+	 batch->state = cmd->state;
+	 batch->first = batch->last = i;
+	 batch->x1 = cmd->x1;
+	 batch->y1 = cmd->y1;
+	 batch->x2 = cmd->x2;
+	 batch->y2 = cmd->y2;
+      }
+   }
+
+   return num_batches;
+}
+
+
+
+/* replay_command:
+ *  Draws a single recorded command, switching to its clipping rectangle
+ *  and drawing state first.
+ */
+static void replay_command(DRAW_BUFFER *buf, AL_CONST DRAW_CMD *cmd, int *state)
+{
+   BITMAP *bmp = buf->bmp;
+
+   if ((cmd->clip != bmp->clip) || (cmd->cl != bmp->cl) || (cmd->ct != bmp->ct) ||
+       (cmd->cr != bmp->cr) || (cmd->cb != bmp->cb)) {
+      set_clip_rect(bmp, cmd->cl, cmd->ct, cmd->cr - 1, cmd->cb - 1);
+      set_clip_state(bmp, cmd->clip);
+   }
+
+   if ((cmd->state >= 0) && (cmd->state != *state)) {
+      set_state(&buf->states[cmd->state]);
+      *state = cmd->state;
+   }
+
+   switch (cmd->type) {
+
+      case DB_CLEAR:
+	 clear_to_color(bmp, cmd->color);
+	 break;
+
+      case DB_RECTFILL:
+	 rectfill(bmp, cmd->x, cmd->y, cmd->w, cmd->h, cmd->color);
+	 break;
+
+      case DB_BLIT:
+	 blit(cmd->source, bmp, cmd->sx, cmd->sy, cmd->x, cmd->y, cmd->w, cmd->h);
+	 break;
+
+      case DB_MASKED_BLIT:
+	 masked_blit(cmd->source, bmp, cmd->sx, cmd->sy, cmd->x, cmd->y, cmd->w, cmd->h);
+	 break;
+
+      case DB_SPRITE:
+	 draw_sprite(bmp, cmd->source, cmd->x, cmd->y);
+	 break;
+
+      case DB_TRANS_SPRITE:
+	 draw_trans_sprite(bmp, cmd->source, cmd->x, cmd->y);
+	 break;
+
+      case DB_TEXT:
+	 textout_ex(bmp, cmd->source, cmd->text, cmd->x, cmd->y, cmd->color, cmd->bg);
+	 break;
+   }
+}
+
+
+
+/* flush_draw_buffer:
+ *  Draws everything recorded so far onto the target bitmap and empties
+ *  the buffer. The clipping rectangle and drawing state are left the way
+ *  they were.
+ */
+void flush_draw_buffer(DRAW_BUFFER *buf)
+{
+   BITMAP *bmp;
+   DRAW_STATE old_state;
+   int old_clip, old_cl, old_ct, old_cr, old_cb;
+   int num_batches, state;
+   int b, i;
+
+   ASSERT(buf);
+
+   if (!buf->num_cmds)
+      return;
+
+   bmp = buf->bmp;
+
+   get_state(&old_state);
+   old_clip = bmp->clip;
+   old_cl = bmp->cl;
+   old_ct = bmp->ct;
+   old_cr = bmp->cr;
+   old_cb = bmp->cb;
+   state = -1;
+
+   cull_commands(buf);
+   num_batches = batch_commands(buf);
+
+   acquire_bitmap(bmp);
+
+   if (num_batches >= 0) {
+      for (b = 0; b < num_batches; b++) {
+	 for (i = buf->batches[b].first; i >= 0; i = buf->cmds[i].next)
+	    replay_command(buf, &buf->cmds[i], &state);
+      }
+   }
+   else {
+      /* out of memory, just draw everything in order */
+      for (i = 0; i < buf->num_cmds; i++) {
+	 if (buf->cmds[i].x1 < buf->cmds[i].x2)
+	    replay_command(buf, &buf->cmds[i], &state);
+      }
+   }
+
+   release_bitmap(bmp);
+
+   if ((bmp->clip != old_clip) || (bmp->cl != old_cl) || (bmp->ct != old_ct) ||
+       (bmp->cr != old_cr) || (bmp->cb != old_cb)) {
+      set_clip_rect(bmp, old_cl, old_ct, old_cr - 1, old_cb - 1);
+      set_clip_state(bmp, old_clip);
+   }
+
+   if (state >= 0)
+      set_state(&old_state);
+
+   discard_draw_buffer(buf);
+}
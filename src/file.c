@@ -71,11 +71,32 @@ static char the_password[256] = EMPTY_STRING;
 int _packfile_filesize = 0;
 int _packfile_datasize = 0;
 
-int _packfile_type = 0;
+int _packfile_type = 0;    /* obsolete, no longer set */
 
 static PACKFILE_VTABLE normal_vtable;
 
+
+#define MAX_PACKFILE_CODECS   16
+
+typedef struct PACKFILE_CODEC_INFO
+{
+   int magic;
+   AL_CONST PACKFILE_CODEC *codec;
+} PACKFILE_CODEC_INFO;
+
+static PACKFILE_CODEC_INFO packfile_codec[MAX_PACKFILE_CODECS] =
+{
+   { F_PACK_MAGIC, &_al_lzss_codec },
+   { F_LZ4_MAGIC,  &_al_lz4_codec  },
+   { F_LZ4I_MAGIC, &_al_lz4i_codec }
+};
+
+static int packfile_codec_count = 3;
+static int packfile_codec_current = 0;
+
 static PACKFILE *pack_fopen_special_file(AL_CONST char *filename, AL_CONST char *mode);
+static int normal_flush_buffer(PACKFILE *f, int last);
+static PACKFILE *pack_fdopen_codec(int fd, AL_CONST char *mode, int codec);
 
 static int filename_encoding = U_ASCII;
 
@@ -1394,8 +1415,10 @@ static PACKFILE *pack_fopen_datafile_object(PACKFILE *f, AL_CONST char *objname)
 		  break;
 	    }
 	    else {
-	       _packfile_type = type;
-	       return pack_fopen_chunk(f, FALSE);
+	       f = pack_fopen_chunk(f, FALSE);
+	       if (f)
+		  f->normal.type = type;
+	       return f;
 	    }
 	 }
 	 else {
@@ -1545,6 +1568,103 @@ static int clone_password(PACKFILE *f)
 
 
 
+/* find_packfile_codec:
+ *  Looks up a codec by its magic number, returning its index in the
+ *  table or -1 if it isn't known.
+ */
+static int find_packfile_codec(int magic)
+{
+   int i;
+
+   for (i=0; i<packfile_codec_count; i++)
+      if (packfile_codec[i].magic == magic)
+	 return i;
+
+   return -1;
+}
+
+
+
+/* find_packfile_header:
+ *  Like find_packfile_codec(), but for a header read back from a file,
+ *  where the magic number has been encrypted with the password.
+ */
+static int find_packfile_header(long header)
+{
+   int i;
+
+   for (i=0; i<packfile_codec_count; i++)
+      if (header == encrypt_id(packfile_codec[i].magic, TRUE))
+	 return i;
+
+   return -1;
+}
+
+
+
+/* _al_find_packfile_codec:
+ *  Returns the codec registered for a magic number, or NULL.
+ */
+AL_CONST PACKFILE_CODEC *_al_find_packfile_codec(int magic)
+{
+   int i = find_packfile_codec(magic);
+
+   return (i >= 0) ? packfile_codec[i].codec : NULL;
+}
+
+
+
+/* register_packfile_codec:
+ *  Adds a compressor for packed files, identified in the file by magic,
+ *  or replaces the one already using that magic number. Returns zero on
+ *  success, or -1 if the magic number is reserved or the table is full.
+ */
+int register_packfile_codec(int magic, AL_CONST PACKFILE_CODEC *codec)
+{
+   int i;
+   ASSERT(codec);
+
+   if ((magic == 0) || (magic == TRUE) ||
+       (magic == F_NOPACK_MAGIC) || (magic == F_EXE_MAGIC))
+      return -1;
+
+   i = find_packfile_codec(magic);
+
+   if (i < 0) {
+      if (packfile_codec_count >= MAX_PACKFILE_CODECS)
+	 return -1;
+
+      i = packfile_codec_count++;
+      packfile_codec[i].magic = magic;
+   }
+
+   packfile_codec[i].codec = codec;
+
+   return 0;
+}
+
+
+
+/* set_packfile_codec:
+ *  Selects the codec used by files and chunks written in packed mode from
+ *  now on. Returns the magic number of the codec used until now, or zero
+ *  if magic isn't registered, in which case nothing changes.
+ */
+int set_packfile_codec(int magic)
+{
+   int i = find_packfile_codec(magic);
+   int old = packfile_codec[packfile_codec_current].magic;
+
+   if (i < 0)
+      return 0;
+
+   packfile_codec_current = i;
+
+   return old;
+}
+
+
+
 /* create_packfile:
  *  Helper function for creating a PACKFILE structure.
  */
@@ -1572,7 +1692,9 @@ static PACKFILE *create_packfile(int is_normal_packfile)
       f->userdata = f;
       f->is_normal_packfile = TRUE;
 
-      f->normal.buf_pos = f->normal.buf;
+      f->normal.buf_base = f->normal.buf;
+      f->normal.buf_max = F_BUF_SIZE;
+      f->normal.buf_pos = f->normal.buf_base;
       f->normal.flags = 0;
       f->normal.buf_size = 0;
       f->normal.filename = NULL;
@@ -1581,7 +1703,9 @@ static PACKFILE *create_packfile(int is_normal_packfile)
       f->normal.parent = NULL;
       f->normal.pack_data = NULL;
       f->normal.unpack_data = NULL;
+      f->normal.codec = NULL;
       f->normal.todo = 0;
+      f->normal.type = 0;
    }
 
    return f;
@@ -1604,6 +1728,9 @@ static void free_packfile(PACKFILE *f)
 	 ASSERT(!f->normal.unpack_data);
 	 ASSERT(!f->normal.passdata);
 	 ASSERT(!f->normal.passpos);
+
+	 if (f->normal.buf_base != f->normal.buf)
+	    _AL_FREE(f->normal.buf_base);
       }
 
       _AL_FREE(f);
@@ -1623,6 +1750,17 @@ static void free_packfile(PACKFILE *f)
  *  a normal file in packed mode will cause errno to be set to EDOM.
  */
 PACKFILE *_pack_fdopen(int fd, AL_CONST char *mode)
+{
+   return pack_fdopen_codec(fd, mode, packfile_codec_current);
+}
+
+
+
+/* pack_fdopen_codec:
+ *  Does the work of _pack_fdopen(), compressing files written in packed
+ *  mode with the given entry of the codec table.
+ */
+static PACKFILE *pack_fdopen_codec(int fd, AL_CONST char *mode, int codec)
 {
    PACKFILE *f, *f2;
    long header = FALSE;
@@ -1645,7 +1783,8 @@ PACKFILE *_pack_fdopen(int fd, AL_CONST char *mode)
    if (f->normal.flags & PACKFILE_FLAG_WRITE) {
       if (f->normal.flags & PACKFILE_FLAG_PACK) {
 	 /* write a packed file */
-	 f->normal.pack_data = create_lzss_pack_data();
+	 f->normal.codec = packfile_codec[codec].codec;
+	 f->normal.pack_data = f->normal.codec->create_packer();
 	 ASSERT(!f->normal.unpack_data);
 
 	 if (!f->normal.pack_data) {
@@ -1654,13 +1793,13 @@ PACKFILE *_pack_fdopen(int fd, AL_CONST char *mode)
 	 }
 
 	 if ((f->normal.parent = _pack_fdopen(fd, F_WRITE)) == NULL) {
-	    free_lzss_pack_data(f->normal.pack_data);
+	    f->normal.codec->destroy_packer(f->normal.pack_data);
 	    f->normal.pack_data = NULL;
 	    free_packfile(f);
 	    return NULL;
 	 }
 
-	 pack_mputl(encrypt_id(F_PACK_MAGIC, TRUE), f->normal.parent);
+	 pack_mputl(encrypt_id(packfile_codec[codec].magic, TRUE), f->normal.parent);
 
 	 f->normal.todo = 4;
       }
@@ -1683,17 +1822,7 @@ PACKFILE *_pack_fdopen(int fd, AL_CONST char *mode)
    else { 
       if (f->normal.flags & PACKFILE_FLAG_PACK) {
 	 /* read a packed file */
-         f->normal.unpack_data = create_lzss_unpack_data();
-	 ASSERT(!f->normal.pack_data);
-
-         if (!f->normal.unpack_data) {
-	    free_packfile(f);
-	    return NULL;
-	 }
-
          if ((f->normal.parent = _pack_fdopen(fd, F_READ)) == NULL) {
-	    free_lzss_unpack_data(f->normal.unpack_data);
-	    f->normal.unpack_data = NULL;
 	    free_packfile(f);
 	    return NULL;
 	 }
@@ -1743,24 +1872,31 @@ PACKFILE *_pack_fdopen(int fd, AL_CONST char *mode)
 	       header = encrypt_id(F_NOPACK_MAGIC, TRUE);
 	 }
 
-	 if (header == encrypt_id(F_PACK_MAGIC, TRUE)) {
-	    f->normal.todo = LONG_MAX;
-	 }
-	 else if (header == encrypt_id(F_NOPACK_MAGIC, TRUE)) {
+	 if (header == encrypt_id(F_NOPACK_MAGIC, TRUE)) {
 	    f2 = f->normal.parent;
-	    free_lzss_unpack_data(f->normal.unpack_data);
-	    f->normal.unpack_data = NULL;
  	    free_packfile(f);
 	    return f2;
 	 }
-	 else {
+
+	 c = find_packfile_header(header);
+	 if (c < 0) {
 	    pack_fclose(f->normal.parent);
-	    free_lzss_unpack_data(f->normal.unpack_data);
-	    f->normal.unpack_data = NULL;
 	    free_packfile(f);
 	    *allegro_errno = EDOM;
 	    return NULL;
 	 }
+
+	 f->normal.codec = packfile_codec[c].codec;
+	 f->normal.unpack_data = f->normal.codec->create_unpacker();
+	 ASSERT(!f->normal.pack_data);
+
+	 if (!f->normal.unpack_data) {
+	    pack_fclose(f->normal.parent);
+	    free_packfile(f);
+	    return NULL;
+	 }
+
+	 f->normal.todo = LONG_MAX;
       }
       else {
 	 /* read a 'real' file */
@@ -1814,8 +1950,6 @@ PACKFILE *__old_pack_fopen(AL_CONST char *filename, AL_CONST char *mode)
    int fd;
    ASSERT(filename);
 
-   _packfile_type = 0;
-
    if (ustrchr(filename, '#')) {
       PACKFILE *special = pack_fopen_special_file(filename, mode);
       if (special)
@@ -1915,6 +2049,63 @@ int pack_fclose(PACKFILE *f)
 
 
 
+/* _al_pack_fopen_read_chunk:
+ *  Opens a sub-chunk for reading like pack_fopen_chunk(), for callers which
+ *  have already read its header themselves. Datasize is as stored in the
+ *  header, and codec only matters if it is negative.
+ */
+PACKFILE *_al_pack_fopen_read_chunk(PACKFILE *f, int datasize, AL_CONST PACKFILE_CODEC *codec)
+{
+   PACKFILE *chunk;
+   ASSERT(f);
+   ASSERT(f->is_normal_packfile);
+   ASSERT((datasize >= 0) || (codec));
+
+   if ((chunk = create_packfile(TRUE)) == NULL)
+      return NULL;
+
+   chunk->normal.flags = PACKFILE_FLAG_CHUNK;
+   chunk->normal.parent = f;
+
+   if (f->normal.flags & PACKFILE_FLAG_OLD_CRYPT) {
+      /* backward compatibility mode */
+      if (f->normal.passdata) {
+	 if ((chunk->normal.passdata = _AL_MALLOC_ATOMIC(strlen(f->normal.passdata)+1)) == NULL) {
+	    *allegro_errno = ENOMEM;
+	    _AL_FREE(chunk);
+	    return NULL;
+	 }
+	 _al_sane_strncpy(chunk->normal.passdata, f->normal.passdata, strlen(f->normal.passdata)+1);
+	 chunk->normal.passpos = chunk->normal.passdata + (long)f->normal.passpos - (long)f->normal.passdata;
+	 f->normal.passpos = f->normal.passdata;
+      }
+      chunk->normal.flags |= PACKFILE_FLAG_OLD_CRYPT;
+   }
+
+   if (datasize < 0) {
+      /* read a packed chunk */
+      chunk->normal.codec = codec;
+      chunk->normal.unpack_data = codec->create_unpacker();
+      ASSERT(!chunk->normal.pack_data);
+
+      if (!chunk->normal.unpack_data) {
+	 free_packfile(chunk);
+	 return NULL;
+      }
+
+      chunk->normal.todo = -datasize;
+      chunk->normal.flags |= PACKFILE_FLAG_PACK;
+   }
+   else {
+      /* read an uncompressed chunk */
+      chunk->normal.todo = datasize;
+   }
+
+   return chunk;
+}
+
+
+
 /* pack_fopen_chunk: 
  *  Opens a sub-chunk of the specified file, for reading or writing depending
  *  on the type of the file. The returned file pointer describes the sub
@@ -1924,20 +2115,26 @@ int pack_fclose(PACKFILE *f)
  *  chunks these will both be set to the length of the data in the chunk.
  *  For compressed chunks, created by setting the pack flag, the first will
  *  contain the raw size of the chunk, and the second will be the negative
- *  size of the uncompressed data. When reading chunks, the pack flag is
- *  ignored, and the compression type is detected from the sign of the
- *  second size value. The file structure used to read chunks checks the
- *  chunk size, and will return EOF if you try to read past the end of
- *  the chunk. If you don't read all of the chunk data, when you call
+ *  size of the uncompressed data. The pack flag may also be the magic
+ *  number of the codec to use instead of the current one. Chunks packed
+ *  with anything but LZSS store the raw size plus four as a negative value
+ *  too, and are followed by the magic number of their codec. When reading
+ *  chunks, the pack flag is ignored, and the compression type is detected
+ *  from the signs of the size values. The file structure used to read
+ *  chunks checks the chunk size, and will return EOF if you try to read
+ *  past the end of the chunk. If you don't read all of the chunk data, when you call
  *  pack_fclose_chunk(), the parent file will advance past the unused data.
  *  When you have finished reading or writing a chunk, you should call
  *  pack_fclose_chunk() to return to your original file.
  */
 PACKFILE *pack_fopen_chunk(PACKFILE *f, int pack)
 {
+   AL_CONST PACKFILE_CODEC *codec;
    PACKFILE *chunk;
    char tmp[1024];
    char *name;
+   int filesize, datasize;
+   int c;
    ASSERT(f);
 
    /* unsupported */
@@ -2028,8 +2225,16 @@ PACKFILE *pack_fopen_chunk(PACKFILE *f, int pack)
          return NULL;
       }
 
+      c = packfile_codec_current;
+      if ((pack) && (find_packfile_codec(pack) >= 0))
+	 c = find_packfile_codec(pack);
+
+      /* a chunk can't seek through its index, so don't write one */
+      if (packfile_codec[c].magic == F_LZ4I_MAGIC)
+	 c = find_packfile_codec(F_LZ4_MAGIC);
+
       name = uconvert_ascii(tmp_name, tmp);
-      chunk = _pack_fdopen(tmp_fd, (pack ? F_WRITE_PACKED : F_WRITE_NOPACK));
+      chunk = pack_fdopen_codec(tmp_fd, (pack ? F_WRITE_PACKED : F_WRITE_NOPACK), c);
 
       if (chunk) {
          chunk->normal.filename = _al_ustrdup(name);
@@ -2046,49 +2251,26 @@ PACKFILE *pack_fopen_chunk(PACKFILE *f, int pack)
       _AL_FREE(tmp_name);
    }
    else {
-      /* read a sub-chunk */
-      _packfile_filesize = pack_mgetl(f);
-      _packfile_datasize = pack_mgetl(f);
+      /* read a sub-chunk, leaving the globals alone for other threads */
+      filesize = pack_mgetl(f);
+      datasize = pack_mgetl(f);
+      codec = &_al_lzss_codec;
 
-      if ((chunk = create_packfile(TRUE)) == NULL)
-         return NULL;
+      if (filesize < 0) {
+	 /* packed with some other codec */
+	 codec = _al_find_packfile_codec(pack_mgetl(f));
 
-      chunk->normal.flags = PACKFILE_FLAG_CHUNK;
-      chunk->normal.parent = f;
-
-      if (f->normal.flags & PACKFILE_FLAG_OLD_CRYPT) {
-	 /* backward compatibility mode */
-	 if (f->normal.passdata) {
-	    if ((chunk->normal.passdata = _AL_MALLOC_ATOMIC(strlen(f->normal.passdata)+1)) == NULL) {
-	       *allegro_errno = ENOMEM;
-	       _AL_FREE(chunk);
-	       return NULL;
-	    }
-	    _al_sane_strncpy(chunk->normal.passdata, f->normal.passdata, strlen(f->normal.passdata)+1);
-	    chunk->normal.passpos = chunk->normal.passdata + (long)f->normal.passpos - (long)f->normal.passdata;
-	    f->normal.passpos = f->normal.passdata;
-	 }
-	 chunk->normal.flags |= PACKFILE_FLAG_OLD_CRYPT;
-      }
-
-      if (_packfile_datasize < 0) {
-	 /* read a packed chunk */
-         chunk->normal.unpack_data = create_lzss_unpack_data();
-	 ASSERT(!chunk->normal.pack_data);
-
-	 if (!chunk->normal.unpack_data) {
-            free_packfile(chunk);
+	 if ((!codec) || (datasize >= 0)) {
+	    *allegro_errno = EDOM;
 	    return NULL;
 	 }
 
-	 _packfile_datasize = -_packfile_datasize;
-	 chunk->normal.todo = _packfile_datasize;
-	 chunk->normal.flags |= PACKFILE_FLAG_PACK;
-      }
-      else {
-	 /* read an uncompressed chunk */
-	 chunk->normal.todo = _packfile_datasize;
+	 /* the blocks are the same, only the index can't be reached */
+	 if (codec == &_al_lz4i_codec)
+	    codec = &_al_lz4_codec;
       }
+
+      chunk = _al_pack_fopen_read_chunk(f, datasize, codec);
    }
 
    return chunk;
@@ -2107,6 +2289,7 @@ PACKFILE *pack_fclose_chunk(PACKFILE *f)
    PACKFILE *parent;
    PACKFILE *tmp;
    char *name;
+   unsigned char copy[F_BUF_SIZE];
    int header, c;
    ASSERT(f);
 
@@ -2161,16 +2344,24 @@ PACKFILE *pack_fclose_chunk(PACKFILE *f)
       _packfile_filesize = tmp->normal.todo - 4;
 
       header = pack_mgetl(tmp);
+      c = find_packfile_header(header);
 
-      pack_mputl(_packfile_filesize, parent);
-
-      if (header == encrypt_id(F_PACK_MAGIC, TRUE))
-	 pack_mputl(-_packfile_datasize, parent);
-      else
+      if (c < 0) {
+	 pack_mputl(_packfile_filesize, parent);
 	 pack_mputl(_packfile_datasize, parent);
+      }
+      else if (packfile_codec[c].magic == F_PACK_MAGIC) {
+	 pack_mputl(_packfile_filesize, parent);
+	 pack_mputl(-_packfile_datasize, parent);
+      }
+      else {
+	 pack_mputl(-(_packfile_filesize + 4), parent);
+	 pack_mputl(-_packfile_datasize, parent);
+	 pack_mputl(packfile_codec[c].magic, parent);
+      }
 
-      while ((c = pack_getc(tmp)) != EOF)
-	 pack_putc(c, parent);
+      while ((c = pack_fread(copy, sizeof(copy), tmp)) > 0)
+	 pack_fwrite(copy, c, parent);
 
       pack_fclose(tmp);
 
@@ -2178,12 +2369,15 @@ PACKFILE *pack_fclose_chunk(PACKFILE *f)
       _AL_FREE(name);
    }
    else {
-      /* finish reading a chunk */
+      /* finish reading a chunk, seeking over the rest where we can */
+      if (f->normal.todo > 0)
+	 pack_fseek(f, MIN(f->normal.todo + MAX(f->normal.buf_size, 0), INT_MAX));
+
       while (f->normal.todo > 0)
 	 pack_getc(f);
 
       if (f->normal.unpack_data) {
-	 free_lzss_unpack_data(f->normal.unpack_data);
+	 f->normal.codec->destroy_unpacker(f->normal.unpack_data);
 	 f->normal.unpack_data = NULL;
       }
 
@@ -2212,6 +2406,61 @@ int pack_fseek(PACKFILE *f, int offset)
 
 
 
+/* pack_setbuf:
+ *  Changes the size of the buffer used by a normal packfile. Sizes up to
+ *  F_BUF_SIZE use the buffer built into the PACKFILE structure. Any data
+ *  already buffered is kept. Returns zero on success, or -1 on failure.
+ */
+int pack_setbuf(PACKFILE *f, int size)
+{
+   unsigned char *buf;
+   int keep;
+   ASSERT(f);
+
+   if (!f->is_normal_packfile)
+      return -1;
+
+   if (f->normal.flags & PACKFILE_FLAG_WRITE) {
+      if (normal_flush_buffer(f, FALSE))
+	 return -1;
+   }
+
+   keep = MAX(f->normal.buf_size, 0);
+
+   if (size <= F_BUF_SIZE) {
+      if (f->normal.buf_base == f->normal.buf)
+	 return 0;
+      if (keep > F_BUF_SIZE)
+	 return -1;
+      size = F_BUF_SIZE;
+      buf = f->normal.buf;
+   }
+   else {
+      if (size == f->normal.buf_max)
+	 return 0;
+      if (keep > size)
+	 return -1;
+      buf = _AL_MALLOC_ATOMIC(size);
+      if (!buf) {
+	 *allegro_errno = ENOMEM;
+	 return -1;
+      }
+   }
+
+   memmove(buf, f->normal.buf_pos, keep);
+
+   if (f->normal.buf_base != f->normal.buf)
+      _AL_FREE(f->normal.buf_base);
+
+   f->normal.buf_base = buf;
+   f->normal.buf_max = size;
+   f->normal.buf_pos = buf;
+
+   return 0;
+}
+
+
+
 /* pack_getc:
  *  Returns the next character from the stream f, or EOF if the end of the
  *  file has been reached.
@@ -2625,6 +2874,8 @@ static int normal_ferror(void *_f);
 
 static int normal_refill_buffer(PACKFILE *f);
 static int normal_flush_buffer(PACKFILE *f, int last);
+static long normal_read_direct(PACKFILE *f, unsigned char *p, long n);
+static int normal_write_fd(PACKFILE *f, AL_CONST unsigned char *p, long n);
 
 
 
@@ -2670,12 +2921,12 @@ static int normal_fclose(void *_f)
    }
 
    if (f->normal.pack_data) {
-      free_lzss_pack_data(f->normal.pack_data);
+      f->normal.codec->destroy_packer(f->normal.pack_data);
       f->normal.pack_data = NULL;
    }
 
    if (f->normal.unpack_data) {
-      free_lzss_unpack_data(f->normal.unpack_data);
+      f->normal.codec->destroy_unpacker(f->normal.unpack_data);
       f->normal.unpack_data = NULL;
    }
 
@@ -2690,21 +2941,32 @@ static int normal_fclose(void *_f)
 
 
 
+/* normal_unpack_pending:
+ *  Return non-zero if the unpacker of a compressed file is holding output
+ *  that hasn't been read yet, even if all its input has been used up.
+ */
+static INLINE int normal_unpack_pending(PACKFILE *f)
+{
+   return ((f->normal.parent) && (f->normal.flags & PACKFILE_FLAG_PACK) &&
+	   (f->normal.codec->unpack_pending(f->normal.unpack_data)));
+}
+
+
+
 /* normal_no_more_input:
  *  Return non-zero if the number of bytes remaining in the file (todo) is
  *  less than or equal to zero.
  *
- *  However, there is a special case.  If we are reading from a LZSS
- *  compressed file, the latest call to lzss_read() may have suspended while
- *  writing out a sequence of bytes due to the output buffer being too small.
+ *  However, there is a special case.  If we are reading from a compressed
+ *  file, the latest call to the unpacker may have suspended while writing
+ *  out a sequence of bytes due to the output buffer being too small.
  *  In that case the `todo' count would be decremented (possibly to zero),
  *  but the output isn't yet completely written out.
  */
 static INLINE int normal_no_more_input(PACKFILE *f)
 {
-   /* see normal_refill_buffer() to see when lzss_read() is called */
-   if (f->normal.parent && (f->normal.flags & PACKFILE_FLAG_PACK) &&
-       _al_lzss_incomplete_state(f->normal.unpack_data))
+   /* see normal_read_block() to see when the unpacker is called */
+   if (normal_unpack_pending(f))
       return 0;
 
    return (f->normal.todo <= 0);
@@ -2735,7 +2997,7 @@ static int normal_ungetc(int c, void *_f)
 {
    PACKFILE *f = _f;
 
-   if (f->normal.buf_pos == f->normal.buf) {
+   if (f->normal.buf_pos == f->normal.buf_base) {
       return EOF;
    }
    else {
@@ -2752,17 +3014,40 @@ static long normal_fread(void *p, long n, void *_f)
 {
    PACKFILE *f = _f;
    unsigned char *cp = (unsigned char *)p;
-   long i;
+   long i, done = 0;
    int c;
 
-   for (i=0; i<n; i++) {
-      if ((c = normal_getc(f)) == EOF)
+   while (done < n) {
+      /* take what we can from the buffer */
+      if (f->normal.buf_size > 0) {
+	 i = MIN(n - done, f->normal.buf_size);
+	 memcpy(cp + done, f->normal.buf_pos, i);
+	 f->normal.buf_pos += i;
+	 f->normal.buf_size -= i;
+	 done += i;
+
+	 if ((f->normal.buf_size == 0) && (normal_no_more_input(f)))
+	    f->normal.flags |= PACKFILE_FLAG_EOF;
+	 continue;
+      }
+
+      /* big reads skip the buffer */
+      if ((n - done >= f->normal.buf_max) && (!(f->normal.flags & PACKFILE_FLAG_EOF)) &&
+	  (f->normal.todo > 0)) {
+	 i = normal_read_direct(f, cp + done, n - done);
+	 if (i <= 0)
+	    break;
+	 done += i;
+	 continue;
+      }
+
+      if ((c = normal_refill_buffer(f)) == EOF)
 	 break;
 
-      *(cp++) = c;
+      cp[done++] = c;
    }
 
-   return i;
+   return done;
 }
 
 
@@ -2771,7 +3056,7 @@ static int normal_putc(int c, void *_f)
 {
    PACKFILE *f = _f;
 
-   if (f->normal.buf_size + 1 >= F_BUF_SIZE) {
+   if (f->normal.buf_size + 1 >= f->normal.buf_max) {
       if (normal_flush_buffer(f, FALSE))
 	 return EOF;
    }
@@ -2786,14 +3071,56 @@ static long normal_fwrite(AL_CONST void *p, long n, void *_f)
 {
    PACKFILE *f = _f;
    AL_CONST unsigned char *cp = (AL_CONST unsigned char *)p;
-   long i;
+   long i, done = 0;
 
-   for (i=0; i<n; i++) {
-      if (normal_putc(*cp++, f) == EOF)
+   while (done < n) {
+      /* big writes to plain files skip the buffer */
+      if ((n - done >= f->normal.buf_max) && (!f->normal.parent) && (!f->normal.passpos)) {
+	 if (normal_flush_buffer(f, FALSE))
+	    break;
+
+	 if (normal_write_fd(f, cp + done, n - done) != 0)
+	    break;
+
+	 f->normal.todo += n - done;
+	 done = n;
 	 break;
+      }
+
+      /* keep the same one byte of slack that normal_putc() leaves */
+      i = MIN(n - done, f->normal.buf_max - 1 - f->normal.buf_size);
+
+      if (i <= 0) {
+	 if (normal_flush_buffer(f, FALSE))
+	    break;
+	 continue;
+      }
+
+      memcpy(f->normal.buf_pos, cp + done, i);
+      f->normal.buf_pos += i;
+      f->normal.buf_size += i;
+      done += i;
    }
 
-   return i;
+   return done;
+}
+
+
+
+/* normal_skip:
+ *  Skips n bytes by reading through them, for files that can't seek.
+ */
+static void normal_skip(PACKFILE *f, long n)
+{
+   unsigned char tmp[F_BUF_SIZE];
+   long got;
+
+   while (n > 0) {
+      got = pack_fread(tmp, MIN(n, F_BUF_SIZE), f);
+      if (got <= 0)
+	 break;
+      n -= got;
+   }
 }
 
 
@@ -2801,12 +3128,16 @@ static long normal_fwrite(AL_CONST void *p, long n, void *_f)
 static int normal_fseek(void *_f, int offset)
 {
    PACKFILE *f = _f;
+   int was_error = (f->normal.flags & PACKFILE_FLAG_ERROR);
+   int ret = 0;
    int i;
 
    if (f->normal.flags & PACKFILE_FLAG_WRITE)
       return -1;
 
-   *allegro_errno = 0;
+   /* Errors are told apart by the flag rather than by clearing errno,
+    * which may belong to another thread when this runs on the I/O one.
+    */
 
    /* skip forward through the buffer */
    if (f->normal.buf_size > 0) {
@@ -2822,32 +3153,45 @@ static int normal_fseek(void *_f, int offset)
    if (offset > 0) {
       i = MIN(offset, f->normal.todo);
 
-      if ((f->normal.flags & PACKFILE_FLAG_PACK) || (f->normal.passpos)) {
-	 /* for compressed or encrypted files, we just have to read through the data */
-	 while (i > 0) {
-	    pack_getc(f);
-	    i--;
+      if (f->normal.flags & PACKFILE_FLAG_PACK) {
+	 if (f->normal.codec->unpack_seek) {
+	    /* the codec can skip over whole blocks of packed data */
+	    f->normal.todo -= f->normal.codec->unpack_seek(f->normal.parent, f->normal.unpack_data, i);
+	    if ((f->normal.parent->normal.flags & PACKFILE_FLAG_EOF) &&
+		(!normal_unpack_pending(f)))
+	       f->normal.todo = 0;
+	    if (f->normal.parent->normal.flags & PACKFILE_FLAG_ERROR)
+	       f->normal.flags |= PACKFILE_FLAG_ERROR;
+	 }
+	 else {
+	    /* otherwise we just have to read through the data */
+	    normal_skip(f, i);
 	 }
       }
-      else {
-	 if (f->normal.parent) {
-	    /* pass the seek request on to the parent file */
-	    pack_fseek(f->normal.parent, i);
+      else if (f->normal.parent) {
+	 if (f->normal.passpos) {
+	    /* old style encryption restarts the password in each chunk */
+	    normal_skip(f, i);
 	 }
 	 else {
-	    /* do a real seek */
-	    lseek(f->normal.hndl, i, SEEK_CUR);
+	    /* pass the seek request on to the parent file */
+	    if (pack_fseek(f->normal.parent, i) != 0)
+	       ret = -1;
+	    f->normal.todo -= i;
 	 }
-	 f->normal.todo -= i;
-	 if (normal_no_more_input(f))
-	    f->normal.flags |= PACKFILE_FLAG_EOF;
       }
+      else if (_al_normal_seek(f, i) != 0) {
+	 normal_skip(f, i);
+      }
+
+      if ((f->normal.buf_size <= 0) && normal_no_more_input(f))
+	 f->normal.flags |= PACKFILE_FLAG_EOF;
    }
 
-   if (*allegro_errno)
-      return -1;
-   else
-      return 0;
+   if ((f->normal.flags & PACKFILE_FLAG_ERROR) && (!was_error))
+      ret = -1;
+
+   return ret;
 }
 
 
@@ -2870,66 +3214,213 @@ static int normal_ferror(void *_f)
 
 
 
-/* normal_refill_buffer:
- *  Refills the read buffer. The file must have been opened in read mode,
- *  and the buffer must be empty.
+/* normal_read_fd:
+ *  Reads up to n bytes from the file handle, retrying after interrupted
+ *  or partial reads. read() leaves the handle just past the data, so
+ *  there is no need to seek. Returns the number of bytes read, which is
+ *  only short at the real end of the file, or -1 on error.
  */
-static int normal_refill_buffer(PACKFILE *f)
+static long normal_read_fd(PACKFILE *f, unsigned char *p, long n)
 {
-   int i, sz, done, offset;
+   long done = 0;
+   int sz;
 
-   if (f->normal.flags & PACKFILE_FLAG_EOF)
-      return EOF;
+   while (done < n) {
+      errno = 0;
+      sz = read(f->normal.hndl, p+done, n-done);
 
-   if (normal_no_more_input(f)) {
-      f->normal.flags |= PACKFILE_FLAG_EOF;
-      return EOF;
+      if (sz > 0)
+	 done += sz;
+      else if (sz == 0)
+	 break;
+      else if ((errno != EINTR) && (errno != EAGAIN))
+	 return -1;
    }
 
+   return done;
+}
+
+
+
+/* normal_write_fd:
+ *  Writes n bytes to the file handle, retrying after interrupted or
+ *  partial writes. Returns zero on success.
+ */
+static int normal_write_fd(PACKFILE *f, AL_CONST unsigned char *p, long n)
+{
+   long done = 0;
+   int sz;
+
+   while (done < n) {
+      errno = 0;
+      sz = write(f->normal.hndl, p+done, n-done);
+
+      if (sz > 0)
+	 done += sz;
+      else if ((sz == 0) || ((errno != EINTR) && (errno != EAGAIN)))
+	 return -1;
+   }
+
+   return 0;
+}
+
+
+
+/* normal_crypt:
+ *  Applies the password of a file to a block of data.
+ */
+static void normal_crypt(PACKFILE *f, unsigned char *p, long n)
+{
+   long i;
+
+   if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT))) {
+      for (i=0; i<n; i++) {
+	 p[i] ^= *(f->normal.passpos++);
+	 if (!*f->normal.passpos)
+	    f->normal.passpos = f->normal.passdata;
+      }
+   }
+}
+
+
+
+/* _al_normal_seek:
+ *  Moves a file open for reading by offset bytes, backwards if offset is
+ *  negative, as long as the file reads straight from the disk. Used by
+ *  codecs which keep an index of their data. Returns zero on success, or
+ *  -1 if the file can't be moved like that.
+ */
+int _al_normal_seek(PACKFILE *f, long offset)
+{
+   long len, pos;
+   ASSERT(f);
+
+   if ((!f->is_normal_packfile) || (f->normal.parent) ||
+       (f->normal.flags & (PACKFILE_FLAG_WRITE | PACKFILE_FLAG_OLD_CRYPT)))
+      return -1;
+
+   if ((offset >= 0) && (offset <= f->normal.buf_size)) {
+      /* still inside the buffer */
+      f->normal.buf_pos += offset;
+      f->normal.buf_size -= offset;
+   }
+   else {
+      /* move the handle, which is past the buffered data */
+      offset -= f->normal.buf_size;
+
+      if ((offset > f->normal.todo) || (lseek(f->normal.hndl, offset, SEEK_CUR) < 0))
+	 return -1;
+
+      f->normal.todo -= offset;
+      f->normal.buf_pos = f->normal.buf_base;
+      f->normal.buf_size = 0;
+
+      /* keep the password in step with the data */
+      if (f->normal.passpos) {
+	 len = strlen(f->normal.passdata);
+	 pos = (f->normal.passpos - f->normal.passdata + offset % len + len) % len;
+	 f->normal.passpos = f->normal.passdata + pos;
+      }
+   }
+
+   if ((f->normal.buf_size <= 0) && (f->normal.todo <= 0))
+      f->normal.flags |= PACKFILE_FLAG_EOF;
+   else
+      f->normal.flags &= ~PACKFILE_FLAG_EOF;
+
+   return 0;
+}
+
+
+
+/* normal_read_block:
+ *  Reads up to n bytes of the file into p, from the parent file or from
+ *  the disk, and updates the count of bytes left. Used both to refill the
+ *  buffer and to read large blocks straight into the caller's memory.
+ *  Returns the number of bytes read, or -1 on error.
+ */
+static long normal_read_block(PACKFILE *f, unsigned char *p, long n)
+{
+   long got;
+
    if (f->normal.parent) {
       if (f->normal.flags & PACKFILE_FLAG_PACK) {
-	 f->normal.buf_size = lzss_read(f->normal.parent, f->normal.unpack_data, MIN(F_BUF_SIZE, f->normal.todo), f->normal.buf);
+	 got = f->normal.codec->unpack(f->normal.parent, f->normal.unpack_data, MIN(n, f->normal.todo), p);
       }
       else {
-	 f->normal.buf_size = pack_fread(f->normal.buf, MIN(F_BUF_SIZE, f->normal.todo), f->normal.parent);
-      } 
-      if (f->normal.parent->normal.flags & PACKFILE_FLAG_EOF)
+	 got = pack_fread(p, MIN(n, f->normal.todo), f->normal.parent);
+      }
+      f->normal.todo -= got;
+      if ((f->normal.parent->normal.flags & PACKFILE_FLAG_EOF) &&
+	  (!normal_unpack_pending(f)))
 	 f->normal.todo = 0;
       if (f->normal.parent->normal.flags & PACKFILE_FLAG_ERROR)
-	 goto Error;
+	 return -1;
    }
    else {
-      f->normal.buf_size = MIN(F_BUF_SIZE, f->normal.todo);
+      n = MIN(n, f->normal.todo);
+      got = normal_read_fd(f, p, n);
+      if (got < 0)
+	 return -1;
 
-      offset = lseek(f->normal.hndl, 0, SEEK_CUR);
-      done = 0;
+      normal_crypt(f, p, got);
 
-      errno = 0;
-      sz = read(f->normal.hndl, f->normal.buf, f->normal.buf_size);
+      /* the file is shorter than it was when we opened it */
+      if (got < n)
+	 f->normal.todo = got;
 
-      while (sz+done < f->normal.buf_size) {
-	 if ((sz < 0) && ((errno != EINTR) && (errno != EAGAIN)))
-	    goto Error;
+      f->normal.todo -= got;
+   }
 
-	 if (sz > 0)
-	    done += sz;
+   return got;
+}
 
-	 lseek(f->normal.hndl, offset+done, SEEK_SET);
-         errno = 0;
-	 sz = read(f->normal.hndl, f->normal.buf+done, f->normal.buf_size-done);
-      }
 
-      if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT))) {
-	 for (i=0; i<f->normal.buf_size; i++) {
-	    f->normal.buf[i] ^= *(f->normal.passpos++);
-	    if (!*f->normal.passpos)
-	       f->normal.passpos = f->normal.passdata;
-	 }
-      }
+
+/* normal_read_direct:
+ *  Reads a large block straight into the caller's memory, skipping the
+ *  buffer, which must be empty. Returns the number of bytes read.
+ */
+static long normal_read_direct(PACKFILE *f, unsigned char *p, long n)
+{
+   long got = normal_read_block(f, p, n);
+
+   if (got < 0) {
+      *allegro_errno = EFAULT;
+      f->normal.flags |= PACKFILE_FLAG_ERROR;
+      return 0;
+   }
+
+   if (normal_no_more_input(f))
+      f->normal.flags |= PACKFILE_FLAG_EOF;
+
+   return got;
+}
+
+
+
+/* normal_refill_buffer:
+ *  Refills the read buffer. The file must have been opened in read mode,
+ *  and the buffer must be empty.
+ */
+static int normal_refill_buffer(PACKFILE *f)
+{
+   long got;
+
+   if (f->normal.flags & PACKFILE_FLAG_EOF)
+      return EOF;
+
+   if (normal_no_more_input(f)) {
+      f->normal.flags |= PACKFILE_FLAG_EOF;
+      return EOF;
    }
 
-   f->normal.todo -= f->normal.buf_size;
-   f->normal.buf_pos = f->normal.buf;
+   got = normal_read_block(f, f->normal.buf_base, f->normal.buf_max);
+   if (got < 0)
+      goto Error;
+
+   f->normal.buf_size = got;
+   f->normal.buf_pos = f->normal.buf_base;
    f->normal.buf_size--;
    if (f->normal.buf_size <= 0)
       if (normal_no_more_input(f))
@@ -2953,44 +3444,22 @@ static int normal_refill_buffer(PACKFILE *f)
  */
 static int normal_flush_buffer(PACKFILE *f, int last)
 {
-   int i, sz, done, offset;
-
-   if (f->normal.buf_size > 0) {
+   /* the compressor always needs to hear about the end of the data */
+   if ((f->normal.buf_size > 0) || ((last) && (f->normal.flags & PACKFILE_FLAG_PACK))) {
       if (f->normal.flags & PACKFILE_FLAG_PACK) {
-	 if (lzss_write(f->normal.parent, f->normal.pack_data, f->normal.buf_size, f->normal.buf, last))
+	 if (f->normal.codec->pack(f->normal.parent, f->normal.pack_data, f->normal.buf_size, f->normal.buf_base, last))
 	    goto Error;
       }
       else {
-	 if ((f->normal.passpos) && (!(f->normal.flags & PACKFILE_FLAG_OLD_CRYPT))) {
-	    for (i=0; i<f->normal.buf_size; i++) {
-	       f->normal.buf[i] ^= *(f->normal.passpos++);
-	       if (!*f->normal.passpos)
-		  f->normal.passpos = f->normal.passdata;
-	    }
-	 }
-
-	 offset = lseek(f->normal.hndl, 0, SEEK_CUR);
-	 done = 0;
-
-	 errno = 0;
-	 sz = write(f->normal.hndl, f->normal.buf, f->normal.buf_size);
-
-	 while (sz+done < f->normal.buf_size) {
-	    if ((sz < 0) && ((errno != EINTR) && (errno != EAGAIN)))
-	       goto Error;
-
-	    if (sz > 0)
-	       done += sz;
+	 normal_crypt(f, f->normal.buf_base, f->normal.buf_size);
 
-	    lseek(f->normal.hndl, offset+done, SEEK_SET);
-	    errno = 0;
-	    sz = write(f->normal.hndl, f->normal.buf+done, f->normal.buf_size-done);
-	 }
+	 if (normal_write_fd(f, f->normal.buf_base, f->normal.buf_size))
+	    goto Error;
       }
       f->normal.todo += f->normal.buf_size;
    }
 
-   f->normal.buf_pos = f->normal.buf;
+   f->normal.buf_pos = f->normal.buf_base;
    f->normal.buf_size = 0;
    return 0;
 
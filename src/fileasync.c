@@ -0,0 +1,742 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Asynchronous file reads.
+ *
+ *      Requests to read from a packfile or to load a datafile object
+ *      are queued for a thread of their own, started the first time
+ *      one is made, and carried out one at a time in the order they
+ *      were made. The program can poll for them or wait, and can have
+ *      a callback run as soon as each is done. Read-ahead streams use
+ *      the same thread to fill one buffer while the program reads the
+ *      other; their refills have a queue of their own which goes
+ *      first, so they don't wait behind whole objects. Without threads,
+ *      every request is carried out straight away by the function that
+ *      makes it.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+#define REQUEST_READ       0
+#define REQUEST_OBJECT     1
+
+#define QUEUE_REFILL       0           /* read-ahead refills go first */
+#define QUEUE_OTHER        1
+#define QUEUES             2
+
+#define READAHEAD_SIZE     65536
+
+
+struct PACKFILE_REQUEST
+{
+   int type;                              /* REQUEST_* constant */
+   int queue;                             /* QUEUE_* constant */
+   PACKFILE *f;                           /* for reads */
+   void *p;
+   long n;
+   AL_CONST DATAFILE_INDEX *index;        /* for object loads */
+   int item;
+   DATAFILE **dat;
+   AL_METHOD(void, callback, (PACKFILE_REQUEST *req, void *arg));
+   void *arg;
+   long result;                           /* bytes read, or 0 or -1 */
+   int started;                           /* taken off the queue */
+   int done;                              /* set once the callback returns */
+   struct PACKFILE_REQUEST *next;         /* in the queue */
+};
+
+
+typedef struct READAHEAD_DATA             /* a read-ahead stream */
+{
+   PACKFILE *parent;
+   unsigned char *buf[2];                 /* one read, the other filled */
+   long size;                             /* of each buffer */
+   int cur;                               /* the buffer being read */
+   long pos, len;                         /* read position and data in it */
+   PACKFILE_REQUEST *next;                /* the other buffer being filled */
+   int eof;                               /* the parent has run out */
+   int error;
+} READAHEAD_DATA;
+
+
+
+/* do_request:
+ *  Carries out a request, then calls its callback.
+ */
+static void do_request(PACKFILE_REQUEST *req)
+{
+   switch (req->type) {
+
+      case REQUEST_READ:
+	 req->result = pack_fread(req->p, req->n, req->f);
+	 break;
+
+      case REQUEST_OBJECT:
+	 *req->dat = load_datafile_object_indexed(req->index, req->item);
+	 req->result = (*req->dat) ? 0 : -1;
+	 break;
+   }
+
+   if (req->callback)
+      req->callback(req, req->arg);
+}
+
+
+
+#ifdef ALLEGRO_WORKER_THREADS
+
+
+/* the queues of requests, and whether the thread is running; all of it
+ * is protected by _al_lock_io()
+ */
+static PACKFILE_REQUEST *io_first[QUEUES] = { NULL, NULL };
+static PACKFILE_REQUEST *io_last[QUEUES] = { NULL, NULL };
+static int io_quit;
+static int io_started = FALSE;
+
+
+
+/* take_request:
+ *  Called with the lock held, takes the next request off the queues,
+ *  refills first. Returns NULL if they are empty.
+ */
+static PACKFILE_REQUEST *take_request(void)
+{
+   PACKFILE_REQUEST *req;
+   int q;
+
+   for (q=0; q<QUEUES; q++) {
+      req = io_first[q];
+      if (req) {
+	 io_first[q] = req->next;
+	 if (!io_first[q])
+	    io_last[q] = NULL;
+	 req->started = TRUE;
+	 return req;
+      }
+   }
+
+   return NULL;
+}
+
+
+
+/* unqueue_request:
+ *  Called with the lock held, takes a request off its queue if the I/O
+ *  thread hasn't got to it yet. Returns TRUE if it did.
+ */
+static int unqueue_request(PACKFILE_REQUEST *req)
+{
+   PACKFILE_REQUEST *prev = NULL;
+   PACKFILE_REQUEST *p;
+
+   if (req->started)
+      return FALSE;
+
+   for (p = io_first[req->queue]; p != req; p = p->next)
+      prev = p;
+
+   if (prev)
+      prev->next = req->next;
+   else
+      io_first[req->queue] = req->next;
+
+   if (io_last[req->queue] == req)
+      io_last[req->queue] = prev;
+
+   req->started = TRUE;
+   return TRUE;
+}
+
+
+
+/* run_request:
+ *  Called with the lock held, carries out a request taken off the queue,
+ *  letting go of the lock meanwhile, and tells anyone waiting for it.
+ */
+static void run_request(PACKFILE_REQUEST *req)
+{
+   _al_unlock_io();
+   do_request(req);
+   _al_lock_io();
+
+   req->done = TRUE;
+   _al_wake_io();
+}
+
+
+
+/* io_thread_proc:
+ *  Runs on the I/O thread, taking requests off the queues until told to
+ *  quit. Anything still queued at that point is carried out first, so
+ *  nobody is left waiting.
+ */
+static void io_thread_proc(void)
+{
+   PACKFILE_REQUEST *req;
+
+   _al_lock_io();
+
+   for (;;) {
+      req = take_request();
+
+      if (req) {
+	 run_request(req);
+      }
+      else {
+	 if (io_quit)
+	    break;
+
+	 _al_wait_io();
+      }
+   }
+
+   _al_unlock_io();
+}
+
+
+
+/* io_thread_exit:
+ *  Stops the I/O thread when Allegro exits.
+ */
+static void io_thread_exit(void)
+{
+   _al_lock_io();
+   io_quit = TRUE;
+   _al_wake_io();
+   _al_unlock_io();
+
+   _al_stop_io_thread();
+
+   _al_lock_io();
+   io_started = FALSE;
+   _al_unlock_io();
+
+   _remove_exit_func(io_thread_exit);
+}
+
+
+
+/* start_io_thread:
+ *  Called with the lock held, starts the I/O thread if it isn't running
+ *  yet. Returns TRUE if it is.
+ */
+static int start_io_thread(void)
+{
+   if (io_started)
+      return TRUE;
+
+   io_quit = FALSE;
+
+   if (!_al_start_io_thread(io_thread_proc))
+      return FALSE;
+
+   io_started = TRUE;
+   _add_exit_func(io_thread_exit, "io_thread_exit");
+
+   return TRUE;
+}
+
+
+#endif /* ALLEGRO_WORKER_THREADS */
+
+
+
+/* submit_request:
+ *  Queues a request for the I/O thread, or carries it out straight away
+ *  when there is no such thread.
+ */
+static PACKFILE_REQUEST *submit_request(PACKFILE_REQUEST *req)
+{
+   req->result = 0;
+   req->started = FALSE;
+   req->done = FALSE;
+   req->next = NULL;
+
+#ifdef ALLEGRO_WORKER_THREADS
+   _al_lock_io();
+
+   if (start_io_thread()) {
+      if (io_last[req->queue])
+	 io_last[req->queue]->next = req;
+      else
+	 io_first[req->queue] = req;
+      io_last[req->queue] = req;
+
+      _al_wake_io();
+      _al_unlock_io();
+
+      return req;
+   }
+
+   _al_unlock_io();
+#endif
+
+   req->started = TRUE;
+   do_request(req);
+   req->done = TRUE;
+
+   return req;
+}
+
+
+
+/* create_request:
+ *  Helper for making a request of the given type.
+ */
+static PACKFILE_REQUEST *create_request(int type, AL_METHOD(void, callback, (PACKFILE_REQUEST *req, void *arg)), void *arg)
+{
+   PACKFILE_REQUEST *req = _AL_MALLOC(sizeof(PACKFILE_REQUEST));
+
+   if (!req) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   memset(req, 0, sizeof(PACKFILE_REQUEST));
+   req->type = type;
+   req->queue = QUEUE_OTHER;
+   req->callback = callback;
+   req->arg = arg;
+
+   return req;
+}
+
+
+
+/* read_async:
+ *  Helper for pack_fread_async() and read-ahead refills, which use their
+ *  own queue.
+ */
+static PACKFILE_REQUEST *read_async(void *p, long n, PACKFILE *f, AL_METHOD(void, callback, (PACKFILE_REQUEST *req, void *arg)), void *arg, int queue)
+{
+   PACKFILE_REQUEST *req;
+
+   req = create_request(REQUEST_READ, callback, arg);
+   if (!req)
+      return NULL;
+
+   req->queue = queue;
+   req->f = f;
+   req->p = p;
+   req->n = n;
+
+   return submit_request(req);
+}
+
+
+
+/* pack_fread_async:
+ *  Starts reading n bytes from f into p in the background, returning at
+ *  once. Neither the file nor the memory may be touched until the request
+ *  is done, but more requests may be made for the same file; they are
+ *  carried out in order. If callback isn't NULL, it is called from the
+ *  I/O thread when the data has been read. Returns NULL on error.
+ */
+PACKFILE_REQUEST *pack_fread_async(void *p, long n, PACKFILE *f, void (*callback)(PACKFILE_REQUEST *req, void *arg), void *arg)
+{
+   ASSERT(f);
+   ASSERT(p);
+   ASSERT(n >= 0);
+
+   return read_async(p, n, f, callback, arg, QUEUE_OTHER);
+}
+
+
+
+/* load_datafile_object_async:
+ *  Starts loading an object like load_datafile_object_indexed(), in the
+ *  background, storing it in *dat when it is done, or NULL on failure.
+ *  The index must stay valid until then. Returns NULL on error.
+ */
+PACKFILE_REQUEST *load_datafile_object_async(AL_CONST DATAFILE_INDEX *index, int item, DATAFILE **dat, void (*callback)(PACKFILE_REQUEST *req, void *arg), void *arg)
+{
+   PACKFILE_REQUEST *req;
+   ASSERT(index);
+   ASSERT(dat);
+
+   req = create_request(REQUEST_OBJECT, callback, arg);
+   if (!req)
+      return NULL;
+
+   req->index = index;
+   req->item = item;
+   req->dat = dat;
+   *dat = NULL;
+
+   return submit_request(req);
+}
+
+
+
+/* pack_async_done:
+ *  Tells whether a request has been carried out, without waiting.
+ */
+int pack_async_done(PACKFILE_REQUEST *req)
+{
+   int done;
+   ASSERT(req);
+
+#ifdef ALLEGRO_WORKER_THREADS
+   _al_lock_io();
+   done = req->done;
+   _al_unlock_io();
+#else
+   done = req->done;
+#endif
+
+   return done;
+}
+
+
+
+/* pack_async_wait:
+ *  Waits for a request to be carried out, then frees it. Returns the
+ *  number of bytes read, or for an object load zero on success and -1
+ *  on failure. Must be called once for every request.
+ *
+ *  A callback which waits would hold up the only thread that could do
+ *  the work, so there the queued requests are carried out straight away
+ *  instead, in order, until the one waited for is done. A callback can't
+ *  wait for its own request, though; that fails with EDEADLK and leaves
+ *  the request to be waited for again later.
+ */
+long pack_async_wait(PACKFILE_REQUEST *req)
+{
+   PACKFILE_REQUEST *next;
+   long result;
+   ASSERT(req);
+
+#ifdef ALLEGRO_WORKER_THREADS
+   _al_lock_io();
+
+   if (_al_in_io_thread()) {
+      while ((!req->done) && ((next = take_request()) != NULL))
+	 run_request(next);
+
+      if (!req->done) {
+	 _al_unlock_io();
+	 *allegro_errno = EDEADLK;
+	 return -1;
+      }
+   }
+   else {
+      while (!req->done)
+	 _al_wait_io();
+   }
+
+   _al_unlock_io();
+#endif
+
+   ASSERT(req->done);
+   result = req->result;
+   _AL_FREE(req);
+
+   return result;
+}
+
+
+
+/* readahead_start:
+ *  Starts filling the buffer which isn't being read.
+ */
+static void readahead_start(READAHEAD_DATA *r)
+{
+   if ((!r->eof) && (!r->error))
+      r->next = read_async(r->buf[!r->cur], r->size, r->parent, NULL, NULL, QUEUE_REFILL);
+}
+
+
+
+/* readahead_finish:
+ *  Finishes with the refill under way, returning how much it read. If the
+ *  I/O thread hasn't got to it yet it is busy with something else, maybe
+ *  a whole object, so rather than wait the refill is done here, or just
+ *  dropped if its data isn't wanted.
+ */
+static long readahead_finish(READAHEAD_DATA *r, int want)
+{
+   PACKFILE_REQUEST *req = r->next;
+
+   r->next = NULL;
+
+#ifdef ALLEGRO_WORKER_THREADS
+   _al_lock_io();
+
+   if (unqueue_request(req)) {
+      if (!want) {
+	 _al_unlock_io();
+	 _AL_FREE(req);
+	 return 0;
+      }
+
+      run_request(req);
+   }
+
+   _al_unlock_io();
+#endif
+
+   return pack_async_wait(req);
+}
+
+
+
+/* readahead_next:
+ *  Moves on to the other buffer once it has been filled, and starts
+ *  filling the one just used. Returns FALSE if there is nothing left.
+ */
+static int readahead_next(READAHEAD_DATA *r)
+{
+   long got;
+
+   if (r->next) {
+      got = readahead_finish(r, TRUE);
+   }
+   else if ((!r->eof) && (!r->error)) {
+      /* the request couldn't be made, so read it ourselves */
+      got = pack_fread(r->buf[!r->cur], r->size, r->parent);
+   }
+   else
+      return FALSE;
+
+   if (pack_ferror(r->parent))
+      r->error = TRUE;
+
+   if (got < r->size)
+      r->eof = TRUE;
+
+   r->cur = !r->cur;
+   r->pos = 0;
+   r->len = MAX(got, 0);
+
+   readahead_start(r);
+
+   return (r->len > 0);
+}
+
+
+
+static int readahead_fclose(void *_r)
+{
+   READAHEAD_DATA *r = _r;
+   int ret;
+
+   if (r->next)
+      readahead_finish(r, FALSE);
+
+   ret = pack_fclose(r->parent);
+
+   _AL_FREE(r->buf[0]);
+   _AL_FREE(r);
+
+   return ret;
+}
+
+
+
+static int readahead_getc(void *_r)
+{
+   READAHEAD_DATA *r = _r;
+
+   if ((r->pos >= r->len) && (!readahead_next(r)))
+      return EOF;
+
+   return r->buf[r->cur][r->pos++];
+}
+
+
+
+static int readahead_ungetc(int c, void *_r)
+{
+   READAHEAD_DATA *r = _r;
+
+   if (r->pos <= 0)
+      return EOF;
+
+   r->buf[r->cur][--r->pos] = c;
+
+   return c;
+}
+
+
+
+static long readahead_fread(void *p, long n, void *_r)
+{
+   READAHEAD_DATA *r = _r;
+   long done = 0;
+   long i;
+
+   while (done < n) {
+      if ((r->pos >= r->len) && (!readahead_next(r)))
+	 break;
+
+      i = MIN(n - done, r->len - r->pos);
+      memcpy((unsigned char *)p + done, r->buf[r->cur] + r->pos, i);
+      r->pos += i;
+      done += i;
+   }
+
+   return done;
+}
+
+
+
+static int readahead_putc(int c, void *_r)
+{
+   return EOF;
+}
+
+
+
+static long readahead_fwrite(AL_CONST void *p, long n, void *_r)
+{
+   return 0;
+}
+
+
+
+static int readahead_fseek(void *_r, int offset)
+{
+   READAHEAD_DATA *r = _r;
+   long i;
+
+   if (offset < 0)
+      return -1;
+
+   while (offset > 0) {
+      if (r->pos < r->len) {
+	 /* skip through the buffer */
+	 i = MIN(offset, r->len - r->pos);
+	 r->pos += i;
+	 offset -= i;
+      }
+      else if (offset < r->size) {
+	 /* the new position is in the next buffer */
+	 if (!readahead_next(r))
+	    break;
+      }
+      else {
+	 /* drop the next buffer, and have the parent skip the rest */
+	 if (r->next) {
+	    i = readahead_finish(r, FALSE);
+	    offset -= i;
+	    if ((i > 0) && (i < r->size))
+	       r->eof = TRUE;
+	 }
+
+	 if ((r->eof) || (r->error))
+	    break;
+
+	 if (pack_fseek(r->parent, offset) != 0)
+	    r->error = TRUE;
+	 if (pack_feof(r->parent))
+	    r->eof = TRUE;
+
+	 r->pos = r->len = 0;
+	 readahead_start(r);
+	 break;
+      }
+   }
+
+   return (r->error) ? -1 : 0;
+}
+
+
+
+static int readahead_feof(void *_r)
+{
+   READAHEAD_DATA *r = _r;
+
+   return (r->pos >= r->len) && (!r->next) && (r->eof);
+}
+
+
+
+static int readahead_ferror(void *_r)
+{
+   READAHEAD_DATA *r = _r;
+
+   return r->error;
+}
+
+
+
+static PACKFILE_VTABLE readahead_vtable =
+{
+   readahead_fclose,
+   readahead_getc,
+   readahead_ungetc,
+   readahead_fread,
+   readahead_putc,
+   readahead_fwrite,
+   readahead_fseek,
+   readahead_feof,
+   readahead_ferror
+};
+
+
+
+/* pack_fopen_readahead:
+ *  Opens a stream which reads f in the background, size bytes ahead of
+ *  the program, or 64k if size is zero. f must be open for reading, and
+ *  is closed along with the new stream. Returns NULL on error, in which
+ *  case f is left as it was.
+ */
+PACKFILE *pack_fopen_readahead(PACKFILE *f, long size)
+{
+   READAHEAD_DATA *r;
+   PACKFILE *ahead;
+   ASSERT(f);
+   ASSERT(size >= 0);
+
+   if (size <= 0)
+      size = READAHEAD_SIZE;
+
+   r = _AL_MALLOC(sizeof(READAHEAD_DATA));
+   if (!r) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   r->buf[0] = _AL_MALLOC_ATOMIC(size * 2);
+   if (!r->buf[0]) {
+      *allegro_errno = ENOMEM;
+      _AL_FREE(r);
+      return NULL;
+   }
+
+   r->parent = f;
+   r->buf[1] = r->buf[0] + size;
+   r->size = size;
+   r->cur = 0;
+   r->pos = r->len = 0;
+   r->next = NULL;
+   r->eof = FALSE;
+   r->error = FALSE;
+
+   ahead = pack_fopen_vtable(&readahead_vtable, r);
+   if (!ahead) {
+      _AL_FREE(r->buf[0]);
+      _AL_FREE(r);
+      return NULL;
+   }
+
+   readahead_start(r);
+
+   return ahead;
+}
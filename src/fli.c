@@ -146,6 +146,27 @@ static void *fli_read(void *buf, int size)
 
 
 
+/* fli_open:
+ *  Helper function to open the FLI file. The frames are read in order,
+ *  so they are fetched ahead of time in the background.
+ */
+static PACKFILE *fli_open(void)
+{
+   PACKFILE *f, *ahead;
+
+   f = pack_fopen(fli_filename, F_READ);
+   if (!f)
+      return NULL;
+
+   ahead = pack_fopen_readahead(f, 0);
+   if (!ahead)
+      return f;
+
+   return ahead;
+}
+
+
+
 /* fli_rewind:
  *  Helper function to rewind to the beginning of the FLI file data.
  *  Pass offset from the beginning of the data in bytes.
@@ -157,7 +178,7 @@ static void fli_rewind(int offset)
    }
    else {
       pack_fclose(fli_file);
-      fli_file = pack_fopen(fli_filename, F_READ);
+      fli_file = fli_open();
       if (fli_file)
 	 pack_fseek(fli_file, offset);
       else
@@ -1001,7 +1022,7 @@ int open_fli(AL_CONST char *filename)
    if (!fli_filename)
       return FLI_ERROR;
 
-   fli_file = pack_fopen(fli_filename, F_READ);
+   fli_file = fli_open();
    if (!fli_file)
       return FLI_ERROR;
 
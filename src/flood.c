@@ -1,6 +1,6 @@
-/*         ______   ___    ___ 
- *        /\  _  \ /\_ \  /\_ \ 
- *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___ 
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
  *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
  *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
  *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
@@ -12,100 +12,176 @@
  *
  *      By Shawn Hargreaves.
  *
+ *      Rewritten as a span stack fill with tolerance and mask output.
+ *
  *      See readme.txt for copyright information.
  */
 
 
-#include <limits.h>
+#include <errno.h>
+#include <string.h>
 
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
 
 
 
-typedef struct FLOODED_LINE      /* store segments which have been flooded */
+typedef struct FLOOD_SPAN        /* a stretch of line still to be looked at */
+{
+   int x1, x2;                   /* left and right ends */
+   int y;                        /* the line */
+   int dy;                       /* direction we were heading in */
+} FLOOD_SPAN;
+
+
+typedef struct FLOOD             /* state of one floodfill */
+{
+   BITMAP *bmp;                  /* bitmap being read */
+   BITMAP *dest;                 /* bitmap being drawn onto */
+   int color;                    /* color to draw with */
+   int depth;                    /* color depth of bmp */
+   int src_color;                /* color being replaced */
+   int tolerance;                /* allowed difference per channel */
+   int sr, sg, sb;               /* components of src_color */
+   unsigned char match8[256];    /* which palette entries match */
+   unsigned char *done;          /* one bit per pixel already drawn */
+   int done_pitch;               /* bytes per line of done */
+   int check_done;               /* whether scans have to look at done */
+   FLOOD_SPAN *stack;            /* spans still to be looked at */
+   int stack_count;
+   int stack_size;
+   int stack_max;                /* the stack never grows beyond this */
+   int overflow;                 /* spans were dropped for lack of room */
+} FLOOD;
+
+
+#define FLOOD_STACK_START        256
+#define FLOOD_STACK_MAX          4096
+
+
+/* flood_match:
+ *  Checks whether a pixel is close enough to the color being replaced.
+ */
+static INLINE int flood_match(FLOOD *f, int c)
 {
-   short flags;                  /* status of the segment */
-   short lpos, rpos;             /* left and right ends of segment */
-   short y;                      /* y coordinate of the segment */
-   int next;                     /* linked list if several per line */
-} FLOODED_LINE;
+   int r, g, b;
+
+   if (!f->tolerance)
+      return (c == f->src_color);
+
+   switch (f->depth) {
+
+      case 8:
+	 return f->match8[c & 0xFF];
+
+      case 15:
+	 r = getr15(c);
+	 g = getg15(c);
+	 b = getb15(c);
+	 break;
+
+      case 16:
+	 r = getr16(c);
+	 g = getg16(c);
+	 b = getb16(c);
+	 break;
+
+      case 24:
+	 r = getr24(c);
+	 g = getg24(c);
+	 b = getb24(c);
+	 break;
+
+      default:
+	 r = getr32(c);
+	 g = getg32(c);
+	 b = getb32(c);
+	 break;
+   }
+
+   return ((ABS(r - f->sr) <= f->tolerance) &&
+	   (ABS(g - f->sg) <= f->tolerance) &&
+	   (ABS(b - f->sb) <= f->tolerance));
+}
 
-/* Note: a 'short' is not sufficient for 'next' above in some corner cases. */
 
 
-static int flood_count;          /* number of flooded segments */
+/* flood_inside:
+ *  Checks whether a pixel of color c is to be filled, given its bit in
+ *  the done array if there is one. Returns 1 or 0 so the result can be
+ *  compared with the want flag of flood_scan.
+ */
+static INLINE int flood_inside(FLOOD *f, int c, AL_CONST unsigned char *done, int i)
+{
+   if (!flood_match(f, c))
+      return 0;
 
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
+   if ((done) && (done[i >> 3] & (1 << (i & 7))))
+      return 0;
 
-#define FLOOD_LINE(c)            (((FLOODED_LINE *)_scratch_mem) + c)
+   return 1;
+}
 
 
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after 
- *  the part of the line which it has dealt with.
+/* flood_scan:
+ *  Walks along line y from x in steps of dir, for as long as the pixels
+ *  are (want = 1) or are not (want = 0) to be filled, stopping at end at
+ *  the latest. Returns the position it stopped at.
  */
-static int flooder(BITMAP *bmp, int x, int y, int src_color, int dest_color)
+static int flood_scan(FLOOD *f, int y, int x, int end, int dir, int want)
 {
-   FLOODED_LINE *p;
-   int left = 0, right = 0;
-   unsigned long addr;
-   int c;
+   BITMAP *bmp = f->bmp;
+   int src_color = f->src_color;
+   unsigned char *done = NULL;
+   uintptr_t addr;
 
-   /* helper for doing checks in each color depth */
-   #define FLOODER(bits, size)                                               \
+   /* helper for reading a line in each color depth */
+   #define FLOOD_SCAN(bits, size)                                            \
    {                                                                         \
-      /* check start pixel */                                                \
-      if ((int)bmp_read##bits(addr+x*size) != src_color)                     \
-	 return x+1;                                                         \
-									     \
-      /* work left from starting point */                                    \
-      for (left=x-1; left>=bmp->cl; left--) {                                \
-	 if ((int)bmp_read##bits(addr+left*size) != src_color)               \
-	    break;                                                           \
+      if (!done) {                                                           \
+	 while ((x != end) &&                                                \
+		(((int)bmp_read##bits(addr+x*size) == src_color) == want))   \
+	    x += dir;                                                        \
       }                                                                      \
-									     \
-      /* work right from starting point */                                   \
-      for (right=x+1; right<bmp->cr; right++) {                              \
-	 if ((int)bmp_read##bits(addr+right*size) != src_color)              \
-	    break;                                                           \
+      else {                                                                 \
+	 while ((x != end) &&                                                \
+		(flood_inside(f, bmp_read##bits(addr+x*size), done, x-bmp->cl) == want)) \
+	    x += dir;                                                        \
       }                                                                      \
    }
 
-   ASSERT(bmp);
-   
+   if (f->check_done)
+      done = f->done + (y - bmp->ct) * f->done_pitch;
+
    if (is_linear_bitmap(bmp)) {     /* use direct access for linear bitmaps */
       addr = bmp_read_line(bmp, y);
       bmp_select(bmp);
 
-      switch (bitmap_color_depth(bmp)) {
+      switch (f->depth) {
 
 	 #ifdef ALLEGRO_COLOR8
 	    case 8:
-	       FLOODER(8, 1);
+	       FLOOD_SCAN(8, 1);
 	       break;
 	 #endif
 
 	 #ifdef ALLEGRO_COLOR16
 	    case 15:
 	    case 16:
-	       FLOODER(16, sizeof(short));
+	       FLOOD_SCAN(16, sizeof(short));
 	       break;
 	 #endif
 
 	 #ifdef ALLEGRO_COLOR24
 	    case 24:
-	       FLOODER(24, 3);
+	       FLOOD_SCAN(24, 3);
 	       break;
 	 #endif
 
 	 #ifdef ALLEGRO_COLOR32
 	    case 32:
-	       FLOODER(32, sizeof(int32_t));
+	       FLOOD_SCAN(32, sizeof(int32_t));
 	       break;
 	 #endif
       }
@@ -113,166 +189,291 @@ static int flooder(BITMAP *bmp, int x, int y, int src_color, int dest_color)
       bmp_unwrite_line(bmp);
    }
    else {                           /* have to use getpixel() for mode-X */
-      /* check start pixel */
-      if (getpixel(bmp, x, y) != src_color)
-	 return x+1;
-
-      /* work left from starting point */ 
-      for (left=x-1; left>=bmp->cl; left--)
-	 if (getpixel(bmp, left, y) != src_color)
-	    break;
-
-      /* work right from starting point */ 
-      for (right=x+1; right<bmp->cr; right++)
-	 if (getpixel(bmp, right, y) != src_color)
-	    break;
-   } 
-
-   left++;
-   right--;
-
-   /* draw the line */
-   bmp->vtable->hfill(bmp, left, y, right, dest_color);
-
-   /* store it in the list of flooded segments */
-   c = y;
-   p = FLOOD_LINE(c);
-
-   if (p->flags) {
-      while (p->next) {
-	 c = p->next;
-	 p = FLOOD_LINE(c);
-      }
-
-      p->next = c = flood_count++;
-      _grow_scratch_mem(sizeof(FLOODED_LINE) * flood_count);
-      p = FLOOD_LINE(c);
+      while ((x != end) && (flood_inside(f, getpixel(bmp, x, y), done, x-bmp->cl) == want))
+	 x += dir;
    }
 
-   p->flags = FLOOD_IN_USE;
-   p->lpos = left;
-   p->rpos = right;
-   p->y = y;
-   p->next = 0;
+   return x;
+}
 
-   if (y > bmp->ct)
-      p->flags |= FLOOD_TODO_ABOVE;
 
-   if (y+1 < bmp->cb)
-      p->flags |= FLOOD_TODO_BELOW;
 
-   return right+2;
+/* flood_fill:
+ *  Draws the run from x1 to x2 on line y, and marks it as done.
+ */
+static void flood_fill(FLOOD *f, int x1, int x2, int y)
+{
+   unsigned char *p;
+   int a, b;
+
+   a = x1 - f->bmp->cl;
+   b = x2 - f->bmp->cl;
+   p = f->done + (y - f->bmp->ct) * f->done_pitch;
+
+   if ((a >> 3) == (b >> 3)) {
+      p[a >> 3] |= (0xFF << (a & 7)) & (0xFF >> (7 - (b & 7)));
+   }
+   else {
+      p[a >> 3] |= 0xFF << (a & 7);
+      memset(p + (a >> 3) + 1, 0xFF, (b >> 3) - (a >> 3) - 1);
+      p[b >> 3] |= 0xFF >> (7 - (b & 7));
+   }
+
+   if (f->dest == f->bmp)
+      f->bmp->vtable->hfill(f->bmp, x1, y, x2, f->color);
+   else
+      hline(f->dest, x1, y, x2, f->color);
 }
 
 
 
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of 
- *  segments which have already been drawn in order to minimise the required 
- *  number of tests.
+/* flood_push:
+ *  Adds a span to the stack, unless its line is outside the clipping
+ *  rectangle. When the stack is as big as it may get, the span is dropped
+ *  and flood_reseed() finds it again later. Returns FALSE if out of
+ *  memory.
  */
-static int check_flood_line(BITMAP *bmp, int y, int left, int right, int src_color, int dest_color)
+static int flood_push(FLOOD *f, int x1, int x2, int y, int dy)
 {
-   int c;
-   FLOODED_LINE *p;
-   int ret = FALSE;
+   FLOOD_SPAN *s;
+   int size;
 
-   while (left <= right) {
-      c = y;
+   if ((y < f->bmp->ct) || (y >= f->bmp->cb))
+      return TRUE;
 
-      for (;;) {
-	 p = FLOOD_LINE(c);
+   if (f->stack_count >= f->stack_size) {
+      if (f->stack_size >= f->stack_max) {
+	 f->overflow = TRUE;
+	 return TRUE;
+      }
 
-	 if ((left >= p->lpos) && (left <= p->rpos)) {
-	    left = p->rpos+2;
-	    break;
-	 }
+      size = MIN(f->stack_size * 2, f->stack_max);
+      s = _AL_REALLOC(f->stack, sizeof(FLOOD_SPAN) * size);
+      if (!s) {
+	 *allegro_errno = ENOMEM;
+	 return FALSE;
+      }
+      f->stack = s;
+      f->stack_size = size;
+   }
 
-	 c = p->next;
+   s = f->stack + f->stack_count++;
+   s->x1 = x1;
+   s->x2 = x2;
+   s->y = y;
+   s->dy = dy;
 
-	 if (!c) {
-	    left = flooder(bmp, left, y, src_color, dest_color);
-	    ret = TRUE;
-	    break; 
+   return TRUE;
+}
+
+
+
+/* flood_drain:
+ *  Works through the stack until it is empty. Each span popped off it is
+ *  widened to the left, then its runs of matching pixels are drawn and
+ *  the lines next to them queued, so every pixel is read only a handful
+ *  of times and the stack stays small. Returns FALSE if out of memory.
+ */
+static int flood_drain(FLOOD *f)
+{
+   BITMAP *bmp = f->bmp;
+   FLOOD_SPAN s;
+   int x, x1, x2, y, dy;
+   int ok = TRUE;
+
+   while ((ok) && (f->stack_count > 0)) {
+      s = f->stack[--f->stack_count];
+      x1 = s.x1;
+      x2 = s.x2;
+      y = s.y;
+      dy = s.dy;
+
+      /* widen the span to the left, if its first pixel is to be filled */
+      x = flood_scan(f, y, x1, bmp->cl-1, -1, 1) + 1;
+      if (x > x1)
+	 x = x1;
+      else if (x < x1)
+	 ok = flood_push(f, x, x1-1, y-dy, -dy);
+
+      /* fill the runs of matching pixels along it */
+      while ((ok) && (x1 <= x2)) {
+	 x1 = flood_scan(f, y, x1, bmp->cr, 1, 1);
+
+	 if (x1 > x) {
+	    flood_fill(f, x, x1-1, y);
+	    ok = flood_push(f, x, x1-1, y+dy, dy);
 	 }
+
+	 /* overhangs going back the way we came */
+	 if ((ok) && (x1-1 > x2))
+	    ok = flood_push(f, x2+1, x1-1, y-dy, -dy);
+
+	 x1++;
+	 if (x1 < x2)
+	    x1 = flood_scan(f, y, x1, x2, 1, 0);
+	 x = x1;
       }
    }
 
-   return ret;
+   return ok;
 }
 
 
 
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
+/* flood_reseed:
+ *  Queues the lines above and below every run drawn on line y, to pick up
+ *  spans which flood_push() had to drop. The stack is empty when this is
+ *  called and big enough for a whole line of them, so none are lost.
  */
-void _soft_floodfill(BITMAP *bmp, int x, int y, int color)
+static int flood_reseed(FLOOD *f, int y)
 {
-   int src_color;
-   int c, done;
-   FLOODED_LINE *p;
-   ASSERT(bmp);
+   unsigned char *p = f->done + (y - f->bmp->ct) * f->done_pitch;
+   int w = f->bmp->cr - f->bmp->cl;
+   int a, b;
 
-   /* make sure we have a valid starting point */ 
-   if ((x < bmp->cl) || (x >= bmp->cr) || (y < bmp->ct) || (y >= bmp->cb))
-      return;
+   for (a=0; a<w; a++) {
+      if (!(p[a >> 3] & (1 << (a & 7))))
+	 continue;
 
-   acquire_bitmap(bmp);
+      for (b=a+1; (b<w) && (p[b >> 3] & (1 << (b & 7))); b++)
+	 ;
 
-   /* what color to replace? */
-   src_color = getpixel(bmp, x, y);
-   if (src_color == color) {
-      release_bitmap(bmp);
-      return;
-   }
+      if ((!flood_push(f, f->bmp->cl+a, f->bmp->cl+b-1, y+1, 1)) ||
+	  (!flood_push(f, f->bmp->cl+a, f->bmp->cl+b-1, y-1, -1)))
+	 return FALSE;
 
-   /* set up the list of flooded segments */
-   _grow_scratch_mem(sizeof(FLOODED_LINE) * bmp->cb);
-   flood_count = bmp->cb;
-   p = _scratch_mem;
-   for (c=0; c<flood_count; c++) {
-      p[c].flags = 0;
-      p[c].lpos = SHRT_MAX;
-      p[c].rpos = SHRT_MIN;
-      p[c].y = y;
-      p[c].next = 0;
+      a = b;
    }
 
-   /* start up the flood algorithm */
-   flooder(bmp, x, y, src_color, color);
+   return TRUE;
+}
 
-   /* continue as long as there are some segments still to test */
-   do {
-      done = TRUE;
 
-      /* for each line on the screen */
-      for (c=0; c<flood_count; c++) {
 
-	 p = FLOOD_LINE(c);
+/* do_floodfill:
+ *  Fills the area connected to x, y with color. The stack of spans is
+ *  limited in size; if it fills up, the spans it couldn't take are found
+ *  again from the pixels already drawn, until there are none left.
+ */
+static void do_floodfill(BITMAP *bmp, int x, int y, int color, int tolerance, BITMAP *mask)
+{
+   FLOOD f;
+   int i, ok;
+
+   f.bmp = bmp;
+   f.dest = (mask) ? mask : bmp;
+   f.color = color;
+   f.depth = bitmap_color_depth(bmp);
+   f.src_color = getpixel(bmp, x, y);
+   f.tolerance = MAX(tolerance, 0);
+
+   /* A solid fill of an exact color changes every pixel it draws, so those
+    * pixels stop matching, unless it is drawn in the color being replaced,
+    * which leaves nothing to do. Otherwise scans have to look at what was
+    * already drawn.
+    */
+   f.check_done = ((mask) || (f.tolerance) || (_drawing_mode != DRAW_MODE_SOLID));
+
+   if (!f.check_done) {
+      switch (f.depth) {
+	 case 8:  color &= 0xFF;      break;
+	 case 15:
+	 case 16: color &= 0xFFFF;    break;
+	 case 24: color &= 0xFFFFFF;  break;
+      }
 
-	 /* check below the segment? */
-	 if (p->flags & FLOOD_TODO_BELOW) {
-	    p->flags &= ~FLOOD_TODO_BELOW;
-	    if (check_flood_line(bmp, p->y+1, p->lpos, p->rpos, src_color, color)) {
-	       done = FALSE;
-	       p = FLOOD_LINE(c);
-	    }
-	 }
+      if (color == f.src_color)
+	 return;
+   }
 
-	 /* check above the segment? */
-	 if (p->flags & FLOOD_TODO_ABOVE) {
-	    p->flags &= ~FLOOD_TODO_ABOVE;
-	    if (check_flood_line(bmp, p->y-1, p->lpos, p->rpos, src_color, color)) {
-	       done = FALSE;
-	       /* special case shortcut for going backwards */
-	       if ((c < bmp->cb) && (c > 0))
-		  c -= 2;
-	    }
+   if (f.tolerance) {
+      f.sr = getr_depth(f.depth, f.src_color);
+      f.sg = getg_depth(f.depth, f.src_color);
+      f.sb = getb_depth(f.depth, f.src_color);
+
+      if (f.depth == 8) {
+	 for (i=0; i<256; i++) {
+	    f.match8[i] = ((ABS(getr8(i) - f.sr) <= f.tolerance) &&
+			   (ABS(getg8(i) - f.sg) <= f.tolerance) &&
+			   (ABS(getb8(i) - f.sb) <= f.tolerance));
 	 }
       }
+   }
+
+   f.done_pitch = (bmp->cr - bmp->cl + 7) / 8;
+   f.done = _AL_MALLOC_ATOMIC(f.done_pitch * (bmp->cb - bmp->ct));
+   if (!f.done) {
+      *allegro_errno = ENOMEM;
+      return;
+   }
+   memset(f.done, 0, f.done_pitch * (bmp->cb - bmp->ct));
+
+   /* room for reseeding a whole line at once */
+   f.stack_max = MAX(FLOOD_STACK_MAX, (bmp->cr - bmp->cl) + 2);
+   f.stack_size = FLOOD_STACK_START;
+   f.stack_count = 0;
+   f.overflow = FALSE;
+   f.stack = _AL_MALLOC(sizeof(FLOOD_SPAN) * f.stack_size);
+   if (!f.stack) {
+      *allegro_errno = ENOMEM;
+      _AL_FREE(f.done);
+      return;
+   }
+
+   acquire_bitmap(f.dest);
+
+   ok = flood_push(&f, x, x, y, 1) && flood_push(&f, x, x, y-1, -1) &&
+	flood_drain(&f);
+
+   /* Only filling new pixels pushes spans, so each pass that drops some
+    * also draws more, and the passes come to an end.
+    */
+   while ((ok) && (f.overflow)) {
+      f.overflow = FALSE;
+      for (y=bmp->ct; (ok) && (y<bmp->cb); y++)
+	 ok = flood_reseed(&f, y) && flood_drain(&f);
+   }
+
+   release_bitmap(f.dest);
+
+   _AL_FREE(f.stack);
+   _AL_FREE(f.done);
+}
+
+
 
-   } while (!done);
+/* floodfill:
+ *  Fills an enclosed area (starting at point x, y) with the specified color.
+ */
+void _soft_floodfill(BITMAP *bmp, int x, int y, int color)
+{
+   ASSERT(bmp);
 
+   /* make sure we have a valid starting point */
+   if ((x < bmp->cl) || (x >= bmp->cr) || (y < bmp->ct) || (y >= bmp->cb))
+      return;
+
+   /* filling with the color being replaced is caught by do_floodfill() */
+   acquire_bitmap(bmp);
+   do_floodfill(bmp, x, y, color, 0, NULL);
    release_bitmap(bmp);
 }
 
+
+
+/* floodfill_ex:
+ *  Floodfill which also takes in pixels within a tolerance of the start
+ *  color, and can draw the area onto a separate mask bitmap instead.
+ */
+void floodfill_ex(BITMAP *bmp, int x, int y, int color, int tolerance, BITMAP *mask)
+{
+   ASSERT(bmp);
+   ASSERT(tolerance >= 0);
+
+   if ((x < bmp->cl) || (x >= bmp->cr) || (y < bmp->ct) || (y >= bmp->cb))
+      return;
+
+   acquire_bitmap(bmp);
+   do_floodfill(bmp, x, y, color, tolerance, mask);
+   release_bitmap(bmp);
+}
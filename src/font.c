@@ -472,10 +472,10 @@ static int length(AL_CONST FONT* f, AL_CONST char* text)
 
 
 
-/* _mono_find_glyph:
- *  Helper for mono vtable, below.
+/* mono_walk_glyph:
+ *  Looks a character up in the ranges of a monochrome font.
  */
-FONT_GLYPH* _mono_find_glyph(AL_CONST FONT* f, int ch)
+static FONT_GLYPH* mono_walk_glyph(AL_CONST FONT* f, int ch)
 {
     FONT_MONO_DATA* mf = (FONT_MONO_DATA*)(f->data);
 
@@ -486,12 +486,35 @@ FONT_GLYPH* _mono_find_glyph(AL_CONST FONT* f, int ch)
 
     /* if we don't find the character, then search for the missing
        glyph, but don't get stuck in a loop. */
-    if(ch != allegro_404_char) return _mono_find_glyph(f, allegro_404_char);
+    if(ch != allegro_404_char) return mono_walk_glyph(f, allegro_404_char);
     return 0;
 }
 
 
 
+/* _mono_find_glyph:
+ *  Helper for mono vtable, below. Goes through the glyph cache.
+ */
+FONT_GLYPH* _mono_find_glyph(AL_CONST FONT* f, int ch)
+{
+    FONT_CACHE_SLOT* s = _font_cache_slot(f, ch);
+    FONT_GLYPH* g;
+
+    if(s && s->ch == ch) return s->glyph;
+
+    g = mono_walk_glyph(f, ch);
+
+    if(s) {
+        s->ch = ch;
+        s->glyph = g;
+        s->ax = s->ay = -1;
+    }
+
+    return g;
+}
+
+
+
 /* mono_char_length:
  *  (mono vtable entry)
  *  Returns the length, in pixels, of a character as rendered in a
@@ -540,6 +563,8 @@ static void mono_render(AL_CONST FONT* f, AL_CONST char* text, int fg, int bg, B
     int ch = 0;
     AL_CONST char* p = text;
 
+    if(_font_cache_render(f, text, fg, bg, bmp, x, y)) return;
+
     acquire_bitmap(bmp);
 
     while( (ch = ugetxc(&p)) ) {
@@ -561,6 +586,8 @@ static void mono_destroy(FONT* f)
 
     if(!f) return;
 
+    flush_font_cache(f);
+
     mf = (FONT_MONO_DATA*)(f->data);
     while(mf) {
         FONT_MONO_DATA* next = mf->next;
@@ -842,6 +869,8 @@ static int mono_transpose_font(FONT* f, int drange)
    if (!f) 
       return -1;
 
+   flush_font_cache(f);
+
    mf = (FONT_MONO_DATA*)(f->data);
 
    while(mf) {
@@ -857,10 +886,10 @@ static int mono_transpose_font(FONT* f, int drange)
 
 
 
-/* _color_find_glyph:
- *  Helper for color vtable entries, below.
+/* color_walk_glyph:
+ *  Looks a character up in the ranges of a color font.
  */
-BITMAP* _color_find_glyph(AL_CONST FONT* f, int ch)
+static BITMAP* color_walk_glyph(AL_CONST FONT* f, int ch)
 {
     FONT_COLOR_DATA* cf = (FONT_COLOR_DATA*)(f->data);
 
@@ -871,12 +900,35 @@ BITMAP* _color_find_glyph(AL_CONST FONT* f, int ch)
 
     /* if we don't find the character, then search for the missing
        glyph, but don't get stuck in a loop. */
-    if(ch != allegro_404_char) return _color_find_glyph(f, allegro_404_char);
+    if(ch != allegro_404_char) return color_walk_glyph(f, allegro_404_char);
     return 0;
 }
 
 
 
+/* _color_find_glyph:
+ *  Helper for color vtable entries, below. Goes through the glyph cache.
+ */
+BITMAP* _color_find_glyph(AL_CONST FONT* f, int ch)
+{
+    FONT_CACHE_SLOT* s = _font_cache_slot(f, ch);
+    BITMAP* g;
+
+    if(s && s->ch == ch) return s->glyph;
+
+    g = color_walk_glyph(f, ch);
+
+    if(s) {
+        s->ch = ch;
+        s->glyph = g;
+        s->ax = s->ay = -1;
+    }
+
+    return g;
+}
+
+
+
 /* color_char_length:
  *  (color vtable entry)
  *  Returns the length of a character, in pixels, as it would be rendered
@@ -1002,8 +1054,10 @@ static void color_render(AL_CONST FONT* f, AL_CONST char* text, int fg, int bg,
 	bg = -1; /* to avoid filling rectangles for each character */
     }
 
-    while( (ch = ugetxc(&p)) ) {
-        x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+    if(!_font_cache_render(f, text, fg, bg, bmp, x, y)) {
+        while( (ch = ugetxc(&p)) ) {
+            x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+        }
     }
 
     release_bitmap(bmp);
@@ -1021,6 +1075,8 @@ static void color_destroy(FONT* f)
 
     if(!f) return;
 
+    flush_font_cache(f);
+
     cf = (FONT_COLOR_DATA*)(f->data);
 
     while(cf) {
@@ -1370,6 +1426,8 @@ static int color_transpose_font(FONT* f, int drange)
    if (!f) 
       return -1;
 
+   flush_font_cache(f);
+
    cf = (FONT_COLOR_DATA*)(f->data);
 
    while(cf) {
@@ -1522,6 +1580,18 @@ int is_mono_font(FONT *f)
 
 
 
+/* is_aa_font:
+ *  returns non-zero if the font passed is an anti-aliased font
+ */
+int is_aa_font(FONT *f)
+{
+   ASSERT(f);
+
+   return f->vtable == font_vtable_aa;
+}
+
+
+
 /* is_compatibe_font:
  *  returns non-zero if the two fonts are of similar type
  */
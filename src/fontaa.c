@@ -0,0 +1,1028 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Anti-aliased fonts.
+ *
+ *      Each glyph is an 8 bit coverage map, and the text colour is mixed
+ *      into the destination in proportion to it. Advances are kept in
+ *      64ths of a pixel, so strings are laid out with subpixel accuracy
+ *      and glyphs that land between pixels have their coverage shifted
+ *      to match.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "c/csimd.h"
+
+
+
+/* widest run of coverage values shifted for subpixel placement at once */
+#define AA_SPAN      256
+
+
+typedef void (*AA_ROW)(uintptr_t dd, uintptr_t ds, AL_CONST unsigned char *cov, int w, int color);
+
+
+
+/* aa_find_glyph:
+ *  Looks a character up in the ranges of an anti-aliased font.
+ */
+static FONT_AA_GLYPH *aa_find_glyph(AL_CONST FONT *f, int ch)
+{
+   FONT_AA_DATA *af = f->data;
+
+   while (af) {
+      if ((ch >= af->begin) && (ch < af->end))
+	 return af->glyphs[ch - af->begin];
+
+      af = af->next;
+   }
+
+   /* if we don't find the character, then search for the missing
+    * glyph, but don't get stuck in a loop.
+    */
+   if (ch != allegro_404_char)
+      return aa_find_glyph(f, allegro_404_char);
+
+   return NULL;
+}
+
+
+
+/* aa_mix:
+ *  Mixes channel f into d by the coverage a, rounding to nearest. The
+ *  kernels in ccover.c use exactly the same arithmetic.
+ */
+static INLINE int aa_mix(int f, int d, int a)
+{
+   int v = f * a + d * (255 - a) + 128;
+
+   return (v + (v >> 8)) >> 8;
+}
+
+
+
+/* aa_row8, aa_row15, aa_row16, aa_row24, aa_row32:
+ *  Blend a run of pixels, reading through ds and writing through dd. A
+ *  palette can't be blended, so 8 bit pixels are set where the glyph
+ *  covers more than half of them.
+ */
+static void aa_row8(uintptr_t dd, uintptr_t ds, AL_CONST unsigned char *cov, int w, int color)
+{
+   int x;
+
+   for (x = 0; x < w; x++) {
+      if (cov[x] >= 128)
+	 bmp_write8(dd + x, color);
+   }
+}
+
+
+
+static void aa_row15(uintptr_t dd, uintptr_t ds, AL_CONST unsigned char *cov, int w, int color)
+{
+   int fr = (color >> 10) & 0x1F;
+   int fg = (color >> 5) & 0x1F;
+   int fb = color & 0x1F;
+   int x, a, d;
+
+   for (x = 0; x < w; x++) {
+      a = cov[x];
+      if (!a)
+	 continue;
+
+      d = bmp_read16(ds + x * 2);
+      bmp_write16(dd + x * 2, (aa_mix(fr, (d >> 10) & 0x1F, a) << 10) |
+			      (aa_mix(fg, (d >> 5) & 0x1F, a) << 5) |
+			      aa_mix(fb, d & 0x1F, a));
+   }
+}
+
+
+
+static void aa_row16(uintptr_t dd, uintptr_t ds, AL_CONST unsigned char *cov, int w, int color)
+{
+   int fr = (color >> 11) & 0x1F;
+   int fg = (color >> 5) & 0x3F;
+   int fb = color & 0x1F;
+   int x, a, d;
+
+   for (x = 0; x < w; x++) {
+      a = cov[x];
+      if (!a)
+	 continue;
+
+      d = bmp_read16(ds + x * 2);
+      bmp_write16(dd + x * 2, (aa_mix(fr, (d >> 11) & 0x1F, a) << 11) |
+			      (aa_mix(fg, (d >> 5) & 0x3F, a) << 5) |
+			      aa_mix(fb, d & 0x1F, a));
+   }
+}
+
+
+
+static void aa_row24(uintptr_t dd, uintptr_t ds, AL_CONST unsigned char *cov, int w, int color)
+{
+   int x, a, d;
+
+   for (x = 0; x < w; x++) {
+      a = cov[x];
+      if (!a)
+	 continue;
+
+      d = bmp_read24(ds + x * 3);
+      bmp_write24(dd + x * 3, (aa_mix((color >> 16) & 0xFF, (d >> 16) & 0xFF, a) << 16) |
+			      (aa_mix((color >> 8) & 0xFF, (d >> 8) & 0xFF, a) << 8) |
+			      aa_mix(color & 0xFF, d & 0xFF, a));
+   }
+}
+
+
+
+static void aa_row32(uintptr_t dd, uintptr_t ds, AL_CONST unsigned char *cov, int w, int color)
+{
+   unsigned long c = (unsigned long)color & 0xFFFFFFFF;
+   unsigned long d;
+   int x, a;
+
+   for (x = 0; x < w; x++) {
+      a = cov[x];
+      if (!a)
+	 continue;
+
+      d = bmp_read32(ds + x * 4);
+      bmp_write32(dd + x * 4, ((unsigned long)aa_mix((c >> 24) & 0xFF, (d >> 24) & 0xFF, a) << 24) |
+			      (aa_mix((c >> 16) & 0xFF, (d >> 16) & 0xFF, a) << 16) |
+			      (aa_mix((c >> 8) & 0xFF, (d >> 8) & 0xFF, a) << 8) |
+			      aa_mix(c & 0xFF, d & 0xFF, a));
+   }
+}
+
+
+
+/* aa_draw_glyph:
+ *  Blends a glyph into bmp with its top left corner at px/64, y. When px
+ *  falls between pixels the coverage is resampled one row at a time,
+ *  which makes the glyph a pixel wider.
+ */
+static void aa_draw_glyph(BITMAP *bmp, AL_CONST FONT_AA_GLYPH *g, int px, int y, int color)
+{
+   unsigned char buf[AA_SPAN];
+   AL_CONST unsigned char *src, *cov;
+   int x = px >> 6;
+   int frac = px & 63;
+   int w = g->w + ((frac) ? 1 : 0);
+   int h = g->h;
+   int sx = 0, sy = 0;
+   int depth = bitmap_color_depth(bmp);
+   int bpp = BYTES_PER_PIXEL(depth);
+   int memory = is_memory_bitmap(bmp);
+   int i, j, k, n, l, r, done;
+   uintptr_t ds, dd;
+#ifdef ALLEGRO_SIMD
+   AL_SIMD_COVER_ROW kernel = NULL;
+#endif
+   AA_ROW row;
+
+   if ((g->w <= 0) || (h <= 0))
+      return;
+
+   if (bmp->clip) {
+      if (x < bmp->cl)
+	 sx = bmp->cl - x;
+      if (y < bmp->ct)
+	 sy = bmp->ct - y;
+      if (x + w > bmp->cr)
+	 w = bmp->cr - x;
+      if (y + h > bmp->cb)
+	 h = bmp->cb - y;
+
+      if ((sx >= w) || (sy >= h))
+	 return;
+   }
+
+   switch (depth) {
+
+      case 8:
+	 row = aa_row8;
+	 break;
+
+      case 15:
+	 row = aa_row15;
+#ifdef ALLEGRO_SIMD
+	 kernel = _al_simd_cover_row15;
+#endif
+	 break;
+
+      case 16:
+	 row = aa_row16;
+#ifdef ALLEGRO_SIMD
+	 kernel = _al_simd_cover_row16;
+#endif
+	 break;
+
+      case 24:
+	 row = aa_row24;
+	 break;
+
+      case 32:
+	 row = aa_row32;
+#ifdef ALLEGRO_SIMD
+	 kernel = _al_simd_cover_row32;
+#endif
+	 break;
+
+      default:
+	 return;
+   }
+
+   bmp_select(bmp);
+
+   for (j = sy; j < h; j++) {
+      src = g->dat + j * g->w;
+
+      if (memory) {
+	 ds = dd = (uintptr_t)bmp->line[y + j];
+      }
+      else {
+	 ds = bmp_read_line(bmp, y + j);
+	 dd = bmp_write_line(bmp, y + j);
+      }
+
+      for (i = sx; i < w; i += n) {
+	 n = MIN(w - i, AA_SPAN);
+
+	 if (frac) {
+	    /* column c takes the right part of glyph pixel c - 1 and the
+	     * left part of glyph pixel c
+	     */
+	    for (k = 0; k < n; k++) {
+	       l = (i + k > 0) ? src[i + k - 1] : 0;
+	       r = (i + k < g->w) ? src[i + k] : 0;
+	       buf[k] = (r * (64 - frac) + l * frac + 32) >> 6;
+	    }
+	    cov = buf;
+	 }
+	 else
+	    cov = src + i;
+
+	 done = 0;
+
+#ifdef ALLEGRO_SIMD
+	 if ((kernel) && (memory))
+	    done = kernel((void *)(dd + (x + i) * bpp), cov, n, color);
+#endif
+
+	 if (done < n)
+	    row(dd + (x + i + done) * bpp, ds + (x + i + done) * bpp, cov + done, n - done, color);
+      }
+   }
+
+   if (!memory)
+      bmp_unwrite_line(bmp);
+}
+
+
+
+/* aa_color:
+ *  Anti-aliased glyphs have no colours of their own, so -1 means white.
+ */
+static int aa_color(BITMAP *bmp, int fg)
+{
+   if (fg < 0)
+      return makecol_depth(bitmap_color_depth(bmp), 255, 255, 255);
+
+   return fg;
+}
+
+
+
+/* aa_font_height:
+ *  (aa vtable entry)
+ *  Returns the height, in pixels of the font.
+ */
+static int aa_font_height(AL_CONST FONT *f)
+{
+   ASSERT(f);
+   return f->height;
+}
+
+
+
+/* aa_char_length:
+ *  (aa vtable entry)
+ *  Returns the advance of a character, rounded to whole pixels.
+ */
+static int aa_char_length(AL_CONST FONT *f, int ch)
+{
+   FONT_AA_GLYPH *g = aa_find_glyph(f, ch);
+
+   return (g) ? (g->advance + 32) >> 6 : 0;
+}
+
+
+
+/* aa_text_length:
+ *  (aa vtable entry)
+ *  Adds up the advances before rounding, as aa_render() places glyphs.
+ */
+static int aa_text_length(AL_CONST FONT *f, AL_CONST char *text)
+{
+   AL_CONST char *p = text;
+   FONT_AA_GLYPH *g;
+   int ch, len = 0;
+
+   while ((ch = ugetxc(&p))) {
+      g = aa_find_glyph(f, ch);
+      if (g)
+	 len += g->advance;
+   }
+
+   return (len + 32) >> 6;
+}
+
+
+
+/* aa_render_char:
+ *  (aa vtable entry)
+ *  Renders a character at a whole pixel position. Returns its advance.
+ */
+static int aa_render_char(AL_CONST FONT *f, int ch, int fg, int bg, BITMAP *bmp, int x, int y)
+{
+   FONT_AA_GLYPH *g;
+   int w = 0;
+
+   acquire_bitmap(bmp);
+
+   g = aa_find_glyph(f, ch);
+   if (g) {
+      w = (g->advance + 32) >> 6;
+
+      if ((bg >= 0) && (w > 0))
+	 rectfill(bmp, x, y, x + w - 1, y + f->height - 1, bg);
+
+      aa_draw_glyph(bmp, g, x * 64, y + (f->height - g->h) / 2, aa_color(bmp, fg));
+   }
+
+   release_bitmap(bmp);
+
+   return w;
+}
+
+
+
+/* aa_render:
+ *  (aa vtable entry)
+ *  Renders a string, keeping the pen position in 64ths of a pixel.
+ */
+static void aa_render(AL_CONST FONT *f, AL_CONST char *text, int fg, int bg, BITMAP *bmp, int x, int y)
+{
+   AL_CONST char *p = text;
+   FONT_AA_GLYPH *g;
+   int ch, w, px = x * 64;
+
+   acquire_bitmap(bmp);
+
+   if (bg >= 0) {
+      w = aa_text_length(f, text);
+      if (w > 0)
+	 rectfill(bmp, x, y, x + w - 1, y + f->height - 1, bg);
+   }
+
+   fg = aa_color(bmp, fg);
+
+   while ((ch = ugetxc(&p))) {
+      g = aa_find_glyph(f, ch);
+      if (g) {
+	 aa_draw_glyph(bmp, g, px, y + (f->height - g->h) / 2, fg);
+	 px += g->advance;
+      }
+   }
+
+   release_bitmap(bmp);
+}
+
+
+
+/* aa_destroy:
+ *  (aa vtable entry)
+ *  Destroys an anti-aliased font.
+ */
+static void aa_destroy(FONT *f)
+{
+   FONT_AA_DATA *af, *next;
+   int i;
+
+   if (!f)
+      return;
+
+   af = f->data;
+
+   while (af) {
+      next = af->next;
+
+      if (af->glyphs) {
+	 for (i = af->begin; i < af->end; i++)
+	    _AL_FREE(af->glyphs[i - af->begin]);
+
+	 _AL_FREE(af->glyphs);
+      }
+
+      _AL_FREE(af);
+      af = next;
+   }
+
+   _AL_FREE(f);
+}
+
+
+
+/* aa_get_font_ranges:
+ *  (aa vtable entry)
+ *  Returns the number of character ranges in a font, or -1 if that
+ *  information is not available.
+ */
+static int aa_get_font_ranges(FONT *f)
+{
+   FONT_AA_DATA *af;
+   int ranges = 0;
+
+   if ((!f) || (!f->data))
+      return -1;
+
+   for (af = f->data; af; af = af->next)
+      ranges++;
+
+   return ranges;
+}
+
+
+
+/* aa_get_font_range_begin:
+ *  (aa vtable entry)
+ *  Get first character for a font range, or for the whole font if range
+ *  is -1.
+ */
+static int aa_get_font_range_begin(FONT *f, int range)
+{
+   FONT_AA_DATA *af;
+   int n = 0;
+
+   if ((!f) || (!f->data))
+      return -1;
+
+   if (range < 0)
+      range = 0;
+
+   for (af = f->data; af; af = af->next, n++) {
+      if ((!af->next) || (n == range))
+	 return af->begin;
+   }
+
+   return -1;
+}
+
+
+
+/* aa_get_font_range_end:
+ *  (aa vtable entry)
+ *  Get last character for a font range, or for the whole font if range
+ *  is -1.
+ */
+static int aa_get_font_range_end(FONT *f, int range)
+{
+   FONT_AA_DATA *af;
+   int n = 0;
+
+   if ((!f) || (!f->data))
+      return -1;
+
+   for (af = f->data; af; af = af->next, n++) {
+      if ((!af->next) || (n == range))
+	 return af->end - 1;
+   }
+
+   return -1;
+}
+
+
+
+/* aa_copy_glyph:
+ *  Duplicates a glyph.
+ */
+static FONT_AA_GLYPH *aa_copy_glyph(AL_CONST FONT_AA_GLYPH *g)
+{
+   int sz = sizeof(FONT_AA_GLYPH) + g->w * g->h;
+   FONT_AA_GLYPH *copy = _AL_MALLOC(sz);
+
+   if (copy)
+      memcpy(copy, g, sz);
+
+   return copy;
+}
+
+
+
+/* aa_new_range:
+ *  Allocates a range with room for the glyphs of begin to end - 1.
+ */
+static FONT_AA_DATA *aa_new_range(int begin, int end)
+{
+   FONT_AA_DATA *af;
+   int i;
+
+   af = _AL_MALLOC(sizeof *af);
+   if (!af)
+      return NULL;
+
+   af->begin = begin;
+   af->end = end;
+   af->next = NULL;
+   af->glyphs = _AL_MALLOC(MAX(end - begin, 1) * sizeof *af->glyphs);
+
+   if (!af->glyphs) {
+      _AL_FREE(af);
+      return NULL;
+   }
+
+   for (i = 0; i < end - begin; i++)
+      af->glyphs[i] = NULL;
+
+   return af;
+}
+
+
+
+/* aa_copy_glyph_range:
+ *  Copies (part of) a glyph range.
+ */
+static FONT_AA_DATA *aa_copy_glyph_range(FONT_AA_DATA *af, int begin, int end)
+{
+   FONT_AA_DATA *newaf;
+   int c;
+
+   if ((begin < af->begin) || (end > af->end))
+      return NULL;
+
+   newaf = aa_new_range(begin, end);
+   if (!newaf)
+      return NULL;
+
+   for (c = begin; c < end; c++) {
+      newaf->glyphs[c - begin] = aa_copy_glyph(af->glyphs[c - af->begin]);
+      if (!newaf->glyphs[c - begin]) {
+	 while (c-- > begin)
+	    _AL_FREE(newaf->glyphs[c - begin]);
+	 _AL_FREE(newaf->glyphs);
+	 _AL_FREE(newaf);
+	 return NULL;
+      }
+   }
+
+   return newaf;
+}
+
+
+
+/* aa_new_font:
+ *  Allocates an empty anti-aliased font.
+ */
+static FONT *aa_new_font(int height)
+{
+   FONT *f = _AL_MALLOC(sizeof *f);
+
+   if (!f) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   f->data = NULL;
+   f->height = height;
+   f->vtable = font_vtable_aa;
+
+   return f;
+}
+
+
+
+/* aa_extract_font_range:
+ *  (aa vtable entry)
+ *  Extracts a range of characters from an anti-aliased font.
+ */
+static FONT *aa_extract_font_range(FONT *f, int begin, int end)
+{
+   FONT *fontout;
+   FONT_AA_DATA *af = NULL, *afin, *copy;
+   int first, last;
+
+   if (!f)
+      return NULL;
+
+   if ((begin == -1) && (end == -1)) {
+      /* copy the entire font */
+   }
+   else if ((begin == -1) && (end > aa_get_font_range_begin(f, -1))) {
+      /* copy from the beginning */
+   }
+   else if ((end == -1) && (begin <= aa_get_font_range_end(f, -1))) {
+      /* copy to the end */
+   }
+   else if ((begin > end) || (begin == -1) || (end == -1)) {
+      return NULL;
+   }
+
+   fontout = aa_new_font(f->height);
+   if (!fontout)
+      return NULL;
+
+   first = MAX(begin, aa_get_font_range_begin(f, -1));
+   last = (end > -1) ? MIN(end, aa_get_font_range_end(f, -1)) : aa_get_font_range_end(f, -1);
+   last++;
+
+   for (afin = f->data; afin; afin = afin->next) {
+      if ((afin->end <= first) || (afin->begin >= last))
+	 continue;
+
+      copy = aa_copy_glyph_range(afin, MAX(afin->begin, first), MIN(afin->end, last));
+      if (!copy) {
+	 aa_destroy(fontout);
+	 return NULL;
+      }
+
+      if (af)
+	 af->next = copy;
+      else
+	 fontout->data = copy;
+
+      af = copy;
+   }
+
+   return fontout;
+}
+
+
+
+/* aa_merge_fonts:
+ *  (aa vtable entry)
+ *  Merges font2 with font1 and returns a new font, converting font2 to
+ *  an anti-aliased font first if need be.
+ */
+static FONT *aa_merge_fonts(FONT *font1, FONT *font2)
+{
+   FONT *fontout, *font2_aa;
+   FONT_AA_DATA *af = NULL, *af1, *af2, *copy;
+
+   if ((!font1) || (!font2) || (!is_aa_font(font1)))
+      return NULL;
+
+   if (is_aa_font(font2))
+      font2_aa = font2;
+   else {
+      font2_aa = create_aa_font(font2, 0);
+      if (!font2_aa)
+	 return NULL;
+   }
+
+   fontout = aa_new_font(MAX(font1->height, font2_aa->height));
+
+   af1 = font1->data;
+   af2 = font2_aa->data;
+
+   while ((fontout) && ((af1) || (af2))) {
+      if ((af1) && ((!af2) || (af1->begin < af2->begin))) {
+	 copy = aa_copy_glyph_range(af1, af1->begin, af1->end);
+	 af1 = af1->next;
+      }
+      else {
+	 copy = aa_copy_glyph_range(af2, af2->begin, af2->end);
+	 af2 = af2->next;
+      }
+
+      if (!copy) {
+	 aa_destroy(fontout);
+	 fontout = NULL;
+	 break;
+      }
+
+      if (af)
+	 af->next = copy;
+      else
+	 fontout->data = copy;
+
+      af = copy;
+   }
+
+   if (font2_aa != font2)
+      destroy_font(font2_aa);
+
+   return fontout;
+}
+
+
+
+/* aa_transpose_font:
+ *  (aa vtable entry)
+ *  Transposes all glyphs in a font.
+ */
+static int aa_transpose_font(FONT *f, int drange)
+{
+   FONT_AA_DATA *af;
+
+   if (!f)
+      return -1;
+
+   for (af = f->data; af; af = af->next) {
+      af->begin += drange;
+      af->end += drange;
+   }
+
+   flush_font_cache(f);
+
+   return 0;
+}
+
+
+
+FONT_VTABLE _font_vtable_aa = {
+   aa_font_height,
+   aa_char_length,
+   aa_text_length,
+   aa_render_char,
+   aa_render,
+   aa_destroy,
+
+   aa_get_font_ranges,
+   aa_get_font_range_begin,
+   aa_get_font_range_end,
+   aa_extract_font_range,
+   aa_merge_fonts,
+   aa_transpose_font
+};
+
+FONT_VTABLE *font_vtable_aa = &_font_vtable_aa;
+
+
+
+/* aa_source_coverage:
+ *  Reads the glyph of ch in any kind of font as coverage values, in a
+ *  buffer which the caller must free. Mono pixels and 8 bit colour
+ *  pixels are either fully covered or not at all, alpha channels are
+ *  used as they are, and other truecolor pixels give their brightest
+ *  component unless they are the mask colour. A missing glyph comes
+ *  back empty, so NULL means there was no memory.
+ */
+static unsigned char *aa_source_coverage(FONT *f, int ch, int *w, int *h, int *advance)
+{
+   unsigned char *cov = NULL;
+   int x, y, c;
+
+   *w = *h = *advance = 0;
+
+   if (is_aa_font(f)) {
+      FONT_AA_GLYPH *g = aa_find_glyph(f, ch);
+
+      if (!g)
+	 goto empty;
+
+      *w = g->w;
+      *h = g->h;
+      *advance = g->advance;
+
+      cov = _AL_MALLOC_ATOMIC(MAX(g->w * g->h, 1));
+      if (cov)
+	 memcpy(cov, g->dat, g->w * g->h);
+   }
+   else if (is_mono_font(f)) {
+      FONT_GLYPH *g = _mono_find_glyph(f, ch);
+      int stride;
+
+      if (!g)
+	 goto empty;
+
+      *w = g->w;
+      *h = g->h;
+      *advance = g->w * 64;
+      stride = (g->w + 7) / 8;
+
+      cov = _AL_MALLOC_ATOMIC(MAX(g->w * g->h, 1));
+      if (cov) {
+	 for (y = 0; y < g->h; y++)
+	    for (x = 0; x < g->w; x++)
+	       cov[y * g->w + x] = (g->dat[y * stride + x / 8] & (0x80 >> (x & 7))) ? 255 : 0;
+      }
+   }
+   else if (is_color_font(f)) {
+      BITMAP *g = _color_find_glyph(f, ch);
+      int depth, mask, alpha;
+
+      if (!g)
+	 goto empty;
+
+      *w = g->w;
+      *h = g->h;
+      *advance = g->w * 64;
+      depth = bitmap_color_depth(g);
+      mask = bitmap_mask_color(g);
+      alpha = _bitmap_has_alpha(g);
+
+      cov = _AL_MALLOC_ATOMIC(MAX(g->w * g->h, 1));
+      if (cov) {
+	 for (y = 0; y < g->h; y++) {
+	    for (x = 0; x < g->w; x++) {
+	       c = getpixel(g, x, y);
+
+	       if (depth == 8)
+		  c = (c != mask) ? 255 : 0;
+	       else if (alpha)
+		  c = geta32(c);
+	       else if (c == mask)
+		  c = 0;
+	       else
+		  c = MAX(MAX(getr_depth(depth, c), getg_depth(depth, c)), getb_depth(depth, c));
+
+	       cov[y * g->w + x] = c;
+	    }
+	 }
+      }
+   }
+   else {
+    empty:
+      cov = _AL_MALLOC_ATOMIC(1);
+   }
+
+   if (!cov)
+      *allegro_errno = ENOMEM;
+
+   return cov;
+}
+
+
+
+/* aa_box_filter:
+ *  Resamples n_in values spaced in_step apart into n_out values spaced
+ *  out_step apart, each output covering 1/scale of the input.
+ */
+static void aa_box_filter(AL_CONST float *in, int n_in, int in_step, float *out, int n_out, int out_step, float scale)
+{
+   float span = 1.0f / scale;
+   float a, b, lo, hi, sum;
+   int i, j;
+
+   for (i = 0; i < n_out; i++) {
+      a = i * span;
+      b = a + span;
+      sum = 0;
+
+      for (j = (int)a; (j < n_in) && (j < b); j++) {
+	 lo = MAX(a, (float)j);
+	 hi = MIN(b, (float)(j + 1));
+	 if (hi > lo)
+	    sum += (hi - lo) * in[j * in_step];
+      }
+
+      out[i * out_step] = sum * scale;
+   }
+}
+
+
+
+/* aa_scale_glyph:
+ *  Builds a glyph from a coverage map, scaling it by height / font_h with
+ *  each new pixel averaging the area of the old ones it covers.
+ */
+static FONT_AA_GLYPH *aa_scale_glyph(AL_CONST unsigned char *cov, int w, int h, int advance, int height, int font_h)
+{
+   FONT_AA_GLYPH *g;
+   float *in, *tmp, *out;
+   float scale;
+   int dw, dh, i;
+
+   if ((height == font_h) || (font_h <= 0)) {
+      g = _AL_MALLOC(sizeof(FONT_AA_GLYPH) + w * h);
+      if (!g)
+	 return NULL;
+
+      g->w = w;
+      g->h = h;
+      g->advance = advance;
+      memcpy(g->dat, cov, w * h);
+      return g;
+   }
+
+   scale = (float)height / font_h;
+   dw = (w * height + font_h - 1) / font_h;
+   dh = (h * height + font_h - 1) / font_h;
+
+   g = _AL_MALLOC(sizeof(FONT_AA_GLYPH) + dw * dh);
+   if (!g)
+      return NULL;
+
+   g->w = dw;
+   g->h = dh;
+   g->advance = (int)floor(advance * scale + 0.5);
+
+   if ((dw <= 0) || (dh <= 0))
+      return g;
+
+   in = _AL_MALLOC_ATOMIC(sizeof(float) * (w * h + dw * h + dw * dh));
+   if (!in) {
+      _AL_FREE(g);
+      return NULL;
+   }
+
+   tmp = in + w * h;
+   out = tmp + dw * h;
+
+   for (i = 0; i < w * h; i++)
+      in[i] = cov[i];
+
+   /* rows first, then columns */
+   for (i = 0; i < h; i++)
+      aa_box_filter(in + i * w, w, 1, tmp + i * dw, dw, 1, scale);
+
+   for (i = 0; i < dw; i++)
+      aa_box_filter(tmp + i, h, dw, out + i, dh, dw, scale);
+
+   for (i = 0; i < dw * dh; i++)
+      g->dat[i] = MID(0, (int)(out[i] + 0.5f), 255);
+
+   _AL_FREE(in);
+
+   return g;
+}
+
+
+
+/* create_aa_font:
+ *  Makes an anti-aliased copy of a font of any kind, resampled to the
+ *  given height if that is positive.
+ */
+FONT *create_aa_font(FONT *f, int height)
+{
+   FONT *fontout;
+   FONT_AA_DATA *af, *last = NULL;
+   unsigned char *cov;
+   int ranges, range, begin, end, ch;
+   int w, h, advance;
+
+   ASSERT(f);
+
+   if (height <= 0)
+      height = f->height;
+
+   ranges = get_font_ranges(f);
+   if (ranges <= 0)
+      return NULL;
+
+   fontout = aa_new_font(height);
+   if (!fontout)
+      return NULL;
+
+   for (range = 0; range < ranges; range++) {
+      begin = get_font_range_begin(f, range);
+      end = get_font_range_end(f, range) + 1;
+
+      af = aa_new_range(begin, end);
+      if (!af)
+	 goto nomem;
+
+      if (last)
+	 last->next = af;
+      else
+	 fontout->data = af;
+
+      last = af;
+
+      for (ch = begin; ch < end; ch++) {
+	 cov = aa_source_coverage(f, ch, &w, &h, &advance);
+	 if (!cov)
+	    goto nomem;
+
+	 af->glyphs[ch - begin] = aa_scale_glyph(cov, w, h, advance, height, f->height);
+	 _AL_FREE(cov);
+
+	 if (!af->glyphs[ch - begin])
+	    goto nomem;
+      }
+   }
+
+   return fontout;
+
+ nomem:
+   aa_destroy(fontout);
+   *allegro_errno = ENOMEM;
+   return NULL;
+}
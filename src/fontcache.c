@@ -0,0 +1,568 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Glyph cache for the mono and color font vtables.
+ *
+ *      Each font that gets drawn has a small direct mapped table from
+ *      characters to glyphs, which saves walking the list of ranges for
+ *      every character, and an atlas bitmap that the glyphs are unpacked
+ *      into. Strings are drawn by copying their glyphs from the atlas
+ *      into one line bitmap, which is then put on the screen with a
+ *      single draw_character(), draw_256_sprite() or masked_blit() call.
+ *
+ *      The caches live in a table of their own rather than in the FONT,
+ *      so fonts built by hand or by add-ons keep working unchanged.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+#define FONT_CACHE_SLOTS      256      /* direct mapped, a power of two */
+#define FONT_CACHE_BUCKETS    16       /* fonts are looked up by address */
+#define FONT_CACHE_BATCH      128      /* glyphs copied to the line at once */
+
+#define FONT_ATLAS_W          256
+#define FONT_ATLAS_MIN_H      64
+#define FONT_ATLAS_MAX_H      2048
+
+
+typedef struct FONT_CACHE
+{
+   AL_CONST FONT *font;                /* the font this is for */
+   void *data;                         /* its data and vtable when cached, */
+   FONT_VTABLE *vtable;                /* to spot it changing under us */
+   int char_404;                       /* allegro_404_char when cached */
+   FONT_CACHE_SLOT slot[FONT_CACHE_SLOTS];
+   BITMAP *atlas;                      /* unpacked or converted glyphs */
+   int shelf_x, shelf_y, shelf_h;      /* where the next glyph goes */
+   int resets;                         /* times the atlas was emptied */
+   struct FONT_CACHE *next;
+} FONT_CACHE;
+
+
+typedef struct FONT_CACHE_ITEM         /* a glyph of the string being drawn */
+{
+   int ch;
+   int w, h;
+   int ax, ay;
+} FONT_CACHE_ITEM;
+
+
+static FONT_CACHE *font_caches[FONT_CACHE_BUCKETS];
+static int font_cache_count = 0;
+
+static BITMAP *line_bmp = NULL;        /* the line glyphs are copied into */
+static BITMAP *line_view = NULL;       /* sub-bitmap sized to each batch */
+
+#define FONT_CACHE_HASH(f)    ((((uintptr_t)(f)) >> 4) & (FONT_CACHE_BUCKETS - 1))
+
+
+
+/* font_cache_reset:
+ *  Empties a cache, keeping its memory.
+ */
+static void font_cache_reset(FONT_CACHE *c)
+{
+   int i;
+
+   c->data = c->font->data;
+   c->vtable = c->font->vtable;
+   c->char_404 = allegro_404_char;
+
+   for (i=0; i<FONT_CACHE_SLOTS; i++)
+      c->slot[i].ch = -1;
+
+   if (c->atlas) {
+      destroy_bitmap(c->atlas);
+      c->atlas = NULL;
+      c->resets++;
+   }
+}
+
+
+
+/* font_cache_destroy:
+ *  Frees a cache.
+ */
+static void font_cache_destroy(FONT_CACHE *c)
+{
+   if (c->atlas)
+      destroy_bitmap(c->atlas);
+
+   _AL_FREE(c);
+   font_cache_count--;
+}
+
+
+
+/* font_cache_exit:
+ *  Frees all the caches when Allegro exits.
+ */
+static void font_cache_exit(void)
+{
+   flush_font_cache(NULL);
+}
+
+
+
+/* font_cache_get:
+ *  Finds or makes the cache of a font. Returns NULL if there is no memory.
+ */
+static FONT_CACHE *font_cache_get(AL_CONST FONT *f)
+{
+   FONT_CACHE **bucket = &font_caches[FONT_CACHE_HASH(f)];
+   FONT_CACHE *c;
+
+   for (c = *bucket; c; c = c->next) {
+      if (c->font == f) {
+	 if ((c->data != f->data) || (c->vtable != f->vtable) ||
+	     (c->char_404 != allegro_404_char))
+	    font_cache_reset(c);
+	 return c;
+      }
+   }
+
+   c = _AL_MALLOC(sizeof(FONT_CACHE));
+   if (!c)
+      return NULL;
+
+   c->font = f;
+   c->atlas = NULL;
+   c->resets = 0;
+   font_cache_reset(c);
+
+   c->next = *bucket;
+   *bucket = c;
+
+   if (!font_cache_count++)
+      _add_exit_func(font_cache_exit, "font_cache_exit");
+
+   return c;
+}
+
+
+
+/* _font_cache_slot:
+ *  Returns the slot of the glyph cache of a font that ch belongs in, or
+ *  NULL if the font can't be cached. The glyph is cached if slot->ch is
+ *  ch; if not, the caller looks it up and stores it with slot->ax = -1.
+ */
+FONT_CACHE_SLOT *_font_cache_slot(AL_CONST FONT *f, int ch)
+{
+   FONT_CACHE *c;
+
+   if (ch < 0)
+      return NULL;
+
+   c = font_cache_get(f);
+   if (!c)
+      return NULL;
+
+   return &c->slot[ch & (FONT_CACHE_SLOTS - 1)];
+}
+
+
+
+/* flush_font_cache:
+ *  Throws away the cached glyphs of a font, or of all fonts if f is NULL,
+ *  along with the strings measured with it.
+ */
+void flush_font_cache(FONT *f)
+{
+   FONT_CACHE **p, *c;
+   int i;
+
+   _text_layout_flush(f);
+
+   for (i=0; i<FONT_CACHE_BUCKETS; i++) {
+      p = &font_caches[i];
+
+      while (*p) {
+	 c = *p;
+	 if ((!f) || (c->font == f)) {
+	    *p = c->next;
+	    font_cache_destroy(c);
+	 }
+	 else
+	    p = &c->next;
+      }
+   }
+
+   if (!font_cache_count) {
+      _remove_exit_func(font_cache_exit);
+
+      if (line_view) {
+	 destroy_bitmap(line_view);
+	 line_view = NULL;
+      }
+
+      if (line_bmp) {
+	 destroy_bitmap(line_bmp);
+	 line_bmp = NULL;
+      }
+   }
+}
+
+
+
+/* font_cache_glyph:
+ *  Looks up a character, returning its slot.
+ */
+static FONT_CACHE_SLOT *font_cache_glyph(FONT_CACHE *c, int ch)
+{
+   FONT_CACHE_SLOT *s = &c->slot[ch & (FONT_CACHE_SLOTS - 1)];
+
+   if (s->ch != ch) {
+      /* the find functions fill the slot in */
+      if (c->vtable == font_vtable_mono)
+	 _mono_find_glyph(c->font, ch);
+      else
+	 _color_find_glyph(c->font, ch);
+   }
+
+   return s;
+}
+
+
+
+/* font_atlas_depth:
+ *  Returns the color depth a glyph is kept at in the atlas, when drawing
+ *  onto a bitmap of the given depth, or zero if it can't go in.
+ */
+static int font_atlas_depth(FONT_CACHE *c, FONT_CACHE_SLOT *s, int dest_depth)
+{
+   int depth;
+
+   if (c->vtable == font_vtable_mono)
+      return 8;
+
+   depth = bitmap_color_depth((BITMAP *)s->glyph);
+   if (depth == 8)
+      return 8;
+
+   /* conversions to 256 colors depend on the palette of the moment */
+   if (dest_depth == 8)
+      return 0;
+
+   return dest_depth;
+}
+
+
+
+/* font_atlas_add:
+ *  Puts a glyph in the atlas, making or growing it as needed. Returns
+ *  FALSE if it doesn't fit. Growing keeps the other glyphs where they
+ *  are, but when the atlas has to be emptied c->resets goes up.
+ */
+static int font_atlas_add(FONT_CACHE *c, FONT_CACHE_SLOT *s, int w, int h, int depth)
+{
+   BITMAP *atlas;
+   int i, j, ah;
+
+   if ((w > FONT_ATLAS_W) || (h > FONT_ATLAS_MAX_H))
+      return FALSE;
+
+   /* a font draws from one atlas at a time */
+   if ((c->atlas) && (bitmap_color_depth(c->atlas) != depth)) {
+      for (i=0; i<FONT_CACHE_SLOTS; i++)
+	 c->slot[i].ax = -1;
+      destroy_bitmap(c->atlas);
+      c->atlas = NULL;
+      c->resets++;
+   }
+
+   if (!c->atlas) {
+      c->atlas = create_bitmap_ex(depth, FONT_ATLAS_W, MAX(FONT_ATLAS_MIN_H, h));
+      if (!c->atlas)
+	 return FALSE;
+      c->shelf_x = c->shelf_y = c->shelf_h = 0;
+   }
+
+   /* start a new shelf if this one is full */
+   if (c->shelf_x + w > FONT_ATLAS_W) {
+      c->shelf_y += c->shelf_h;
+      c->shelf_x = c->shelf_h = 0;
+   }
+
+   if (c->shelf_y + h > c->atlas->h) {
+      ah = c->atlas->h;
+      while ((ah < c->shelf_y + h) && (ah < FONT_ATLAS_MAX_H))
+	 ah *= 2;
+
+      if (c->shelf_y + h > MIN(ah, FONT_ATLAS_MAX_H)) {
+	 /* full up: start again from an empty atlas */
+	 for (i=0; i<FONT_CACHE_SLOTS; i++)
+	    c->slot[i].ax = -1;
+	 c->shelf_x = c->shelf_y = c->shelf_h = 0;
+	 c->resets++;
+      }
+      else {
+	 atlas = create_bitmap_ex(depth, FONT_ATLAS_W, MIN(ah, FONT_ATLAS_MAX_H));
+	 if (!atlas)
+	    return FALSE;
+	 blit(c->atlas, atlas, 0, 0, 0, 0, FONT_ATLAS_W, c->shelf_y + c->shelf_h);
+	 destroy_bitmap(c->atlas);
+	 c->atlas = atlas;
+      }
+   }
+
+   s->ax = c->shelf_x;
+   s->ay = c->shelf_y;
+   c->shelf_x += w;
+   c->shelf_h = MAX(c->shelf_h, h);
+
+   if (c->vtable == font_vtable_mono) {
+      FONT_GLYPH *g = s->glyph;
+      int stride = (w + 7) / 8;
+
+      for (j=0; j<h; j++) {
+	 unsigned char *d = c->atlas->line[s->ay + j] + s->ax;
+	 AL_CONST unsigned char *p = g->dat + j * stride;
+
+	 for (i=0; i<w; i++)
+	    d[i] = (p[i >> 3] >> (7 - (i & 7))) & 1;
+      }
+   }
+   else {
+      BITMAP *g = s->glyph;
+      int mode = get_color_conversion();
+
+      /* same conversion as color_render_char() */
+      set_color_conversion(COLORCONV_MOST | COLORCONV_KEEP_TRANS);
+      blit(g, c->atlas, 0, 0, s->ax, s->ay, w, h);
+      set_color_conversion(mode);
+   }
+
+   return TRUE;
+}
+
+
+
+/* font_cache_line:
+ *  Makes sure the line bitmap can hold w by h pixels at the given color
+ *  depth, and sizes the view onto it to match.
+ */
+static BITMAP *font_cache_line(int w, int h, int depth)
+{
+   BITMAP *bmp;
+
+   if ((!line_bmp) || (bitmap_color_depth(line_bmp) != depth) ||
+       (line_bmp->w < w) || (line_bmp->h < h)) {
+
+      if (line_bmp) {
+	 w = MAX(w, line_bmp->w);
+	 h = MAX(h, line_bmp->h);
+      }
+
+      bmp = create_bitmap_ex(depth, w, h);
+      if (!bmp)
+	 return NULL;
+
+      if (line_view)
+	 destroy_bitmap(line_view);
+      if (line_bmp)
+	 destroy_bitmap(line_bmp);
+
+      line_bmp = bmp;
+      line_view = create_sub_bitmap(line_bmp, 0, 0, line_bmp->w, line_bmp->h);
+      if (!line_view)
+	 return NULL;
+   }
+
+   /* the view shares the rows of line_bmp, so shrinking it is safe */
+   line_view->w = line_view->cr = w;
+   line_view->h = line_view->cb = h;
+
+   return line_view;
+}
+
+
+
+/* font_cache_draw:
+ *  Draws a batch of glyphs whose top left corner is at x, y, all of which
+ *  are in the atlas. Returns FALSE if it can't be done in one go.
+ */
+static int font_cache_draw(FONT_CACHE *c, FONT_CACHE_ITEM *item, int n, int w, int fg, int bg, BITMAP *bmp, int x, int y)
+{
+   BITMAP *line;
+   int top = INT_MAX, bottom = INT_MIN;
+   int depth = bitmap_color_depth(c->atlas);
+   int bpp = BYTES_PER_PIXEL(depth);
+   int first = 0, last = n;
+   int i, j, oy, lx;
+
+   for (i=0; i<n; i++) {
+      if ((item[i].w <= 0) || (item[i].h <= 0))
+	 continue;
+
+      oy = (c->font->height - item[i].h) / 2;
+      top = MIN(top, oy);
+      bottom = MAX(bottom, oy + item[i].h);
+
+      /* opaque glyphs only fill in their own box */
+      if ((bg >= 0) && (item[i].h != item[0].h))
+	 return FALSE;
+   }
+
+   if (bottom <= top)
+      return TRUE;
+
+   if ((bmp->clip) && ((x >= bmp->cr) || (x + w <= bmp->cl) ||
+		       (y + top >= bmp->cb) || (y + bottom <= bmp->ct)))
+      return TRUE;
+
+   /* only compose the glyphs that overlap the clipping rectangle */
+   if (bmp->clip) {
+      while ((first < n-1) && (x + item[first].w <= bmp->cl)) {
+	 x += item[first].w;
+	 w -= item[first].w;
+	 first++;
+      }
+
+      for (i=first, lx=0; (i < n) && (x + lx < bmp->cr); i++)
+	 lx += item[i].w;
+
+      last = i;
+      w = lx;
+   }
+
+   line = font_cache_line(w, bottom - top, depth);
+   if (!line)
+      return FALSE;
+
+   if (depth == 8) {
+      for (j=0; j<bottom-top; j++)
+	 memset(line->line[j], 0, w);
+   }
+   else
+      clear_to_color(line, bitmap_mask_color(line));
+
+   for (i=first, lx=0; i<last; lx+=item[i].w, i++) {
+      if ((item[i].w <= 0) || (item[i].h <= 0))
+	 continue;
+
+      oy = (c->font->height - item[i].h) / 2 - top;
+
+      for (j=0; j<item[i].h; j++) {
+	 memcpy(line->line[oy + j] + lx * bpp,
+		c->atlas->line[item[i].ay + j] + item[i].ax * bpp,
+		item[i].w * bpp);
+      }
+   }
+
+   if (depth > 8)
+      masked_blit(line, bmp, 0, 0, x, y + top, w, bottom - top);
+   else if ((c->vtable != font_vtable_mono) && (fg < 0))
+      bmp->vtable->draw_256_sprite(bmp, line, x, y + top);
+   else
+      bmp->vtable->draw_character(bmp, line, x, y + top, fg, bg);
+
+   return TRUE;
+}
+
+
+
+/* _font_cache_render:
+ *  Draws a string in a mono or color font through the glyph cache. The
+ *  color vtable must already have dealt with filling the background
+ *  behind color glyphs. Returns FALSE if the font can't be cached, in
+ *  which case nothing has been drawn.
+ */
+int _font_cache_render(AL_CONST FONT *f, AL_CONST char *text, int fg, int bg, BITMAP *bmp, int x, int y)
+{
+   FONT_CACHE_ITEM item[FONT_CACHE_BATCH];
+   FONT_CACHE_SLOT *s;
+   FONT_CACHE *c;
+   AL_CONST char *p = text;
+   int dest_depth = bitmap_color_depth(bmp);
+   int ch, n, w, i, depth, batched, resets;
+
+   if ((f->vtable != font_vtable_mono) && (f->vtable != font_vtable_color))
+      return FALSE;
+
+   c = font_cache_get(f);
+   if (!c)
+      return FALSE;
+
+   acquire_bitmap(bmp);
+
+   ch = ugetxc(&p);
+
+   while (ch) {
+      /* gather a batch of glyphs */
+      batched = TRUE;
+      resets = c->resets;
+      n = w = 0;
+
+      for (; (ch) && (n < FONT_CACHE_BATCH); ch = ugetxc(&p), n++) {
+	 s = font_cache_glyph(c, ch);
+
+	 item[n].ch = ch;
+	 item[n].w = item[n].h = 0;
+	 item[n].ax = item[n].ay = -1;
+
+	 if (!s->glyph)
+	    continue;
+
+	 if (c->vtable == font_vtable_mono) {
+	    item[n].w = ((FONT_GLYPH *)s->glyph)->w;
+	    item[n].h = ((FONT_GLYPH *)s->glyph)->h;
+	 }
+	 else {
+	    item[n].w = ((BITMAP *)s->glyph)->w;
+	    item[n].h = ((BITMAP *)s->glyph)->h;
+	 }
+
+	 w += item[n].w;
+
+	 if ((!batched) || (item[n].w <= 0) || (item[n].h <= 0))
+	    continue;
+
+	 depth = font_atlas_depth(c, s, dest_depth);
+	 if (!depth) {
+	    batched = FALSE;
+	    continue;
+	 }
+
+	 if ((s->ax < 0) || (bitmap_color_depth(c->atlas) != depth)) {
+	    if (!font_atlas_add(c, s, item[n].w, item[n].h, depth))
+	       batched = FALSE;
+	 }
+
+	 item[n].ax = s->ax;
+	 item[n].ay = s->ay;
+      }
+
+      /* glyphs gathered before the atlas was emptied are gone from it */
+      if (c->resets != resets)
+	 batched = FALSE;
+
+      /* draw it, a character at a time if it won't go in one */
+      if ((batched) && (w > 0) && (font_cache_draw(c, item, n, w, fg, bg, bmp, x, y))) {
+	 x += w;
+      }
+      else {
+	 for (i=0; i<n; i++)
+	    x += f->vtable->render_char(f, item[i].ch, fg, bg, bmp, x, y);
+      }
+   }
+
+   release_bitmap(bmp);
+
+   return TRUE;
+}
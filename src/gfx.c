@@ -102,6 +102,8 @@ void set_blender_mode(BLENDER_FUNC b15, BLENDER_FUNC b16, BLENDER_FUNC b24, int
    _blender_col_32 = makecol32(r, g, b);
 
    _blender_alpha = a;
+
+   _update_blender_rows();
 }
 
 
@@ -129,6 +131,8 @@ void set_blender_mode_ex(BLENDER_FUNC b15, BLENDER_FUNC b16, BLENDER_FUNC b24, B
    _blender_col_32 = makecol32(r, g, b);
 
    _blender_alpha = a;
+
+   _update_blender_rows();
 }
 
 
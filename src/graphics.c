@@ -80,6 +80,13 @@ int _blender_col_32 = 0;
 
 int _blender_alpha = 0;                /* for truecolor translucent drawing */
 
+BLENDER_ROW_FUNC _blender_row15 = NULL;  /* scanline versions of the above */
+BLENDER_ROW_FUNC _blender_row16 = NULL;
+BLENDER_ROW_FUNC _blender_row32 = NULL;
+
+BLENDER_ROW_FUNC _blender_row15x = NULL;
+BLENDER_ROW_FUNC _blender_row16x = NULL;
+
 int _rgb_r_shift_15 = DEFAULT_RGB_R_SHIFT_15;     /* truecolor pixel format */
 int _rgb_g_shift_15 = DEFAULT_RGB_G_SHIFT_15;
 int _rgb_b_shift_15 = DEFAULT_RGB_B_SHIFT_15;
@@ -0,0 +1,848 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      LZ4 block compression for packfiles.
+ *
+ *      A byte oriented codec that unpacks several times faster than
+ *      LZSS, at the cost of slightly bigger files. The data is split
+ *      into blocks of up to 64k, each written as its packed size and
+ *      its unpacked size (32 bit, big-endian) followed by the block in
+ *      the LZ4 block format. A block that doesn't get any smaller is
+ *      stored as it is, with both sizes the same. Blocks don't refer to
+ *      each other, so any one of them can be unpacked on its own.
+ *
+ *      The indexed variant makes every block but the last exactly 64k,
+ *      and ends the stream with a zero packed size and the number of
+ *      blocks, the offset of each block from the first one, and the
+ *      size of this whole index, so a reader can find any block from
+ *      the end of the file without unpacking the ones before it.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+#define MINMATCH        4           /* shortest match worth encoding */
+#define LASTLITERALS    5           /* the last bytes are always literals */
+#define MFLIMIT         12          /* no match may start after this */
+#define MAX_OFFSET      65535
+#define LZ4_MAX_BLOCKS  (INT_MAX / 4 - 4)
+
+#define HASH_BITS       12
+#define HASH_SIZE       (1 << HASH_BITS)
+
+#define READ32(p)       ((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8) | \
+			 ((unsigned int)(p)[2] << 16) | ((unsigned int)(p)[3] << 24))
+
+#define LZ4_HASH(p)     ((READ32(p) * 2654435761U) >> (32 - HASH_BITS))
+
+
+typedef struct LZ4_PACK_DATA        /* for writing LZ4 packed files */
+{
+   int size;                        /* bytes waiting in buf */
+   int indexed;                     /* write a block index at the end */
+   long at;                         /* bytes written so far */
+   long *index;                     /* offset of each block */
+   int count, max;                  /* blocks in the index, and room */
+   int hash[HASH_SIZE];             /* recent positions by hash */
+   unsigned char buf[LZ4_BLOCK_SIZE];
+   unsigned char out[LZ4_BLOCK_BOUND(LZ4_BLOCK_SIZE)];
+} LZ4_PACK_DATA;
+
+
+typedef struct LZ4_UNPACK_DATA      /* for reading LZ4 packed files */
+{
+   int pos, size;                   /* unread part of out */
+   int failed;                      /* the data was bad, so stop */
+   int ended;                       /* read the end of an indexed stream */
+   int indexed;                     /* look for a block index to seek */
+   long at;                         /* bytes read from the file so far */
+   long next;                       /* number of the next block */
+   long *index;                     /* offset of each block, once read */
+   long count;                      /* blocks in the index, -1 if not read */
+   int in_max, out_max;             /* sizes of the buffers so far */
+   unsigned char *in;
+   unsigned char *out;
+} LZ4_UNPACK_DATA;
+
+
+
+/* lz4_put_length:
+ *  Writes the remainder of a length that didn't fit in a token.
+ */
+static unsigned char *lz4_put_length(unsigned char *op, int len)
+{
+   while (len >= 255) {
+      *(op++) = 255;
+      len -= 255;
+   }
+
+   *(op++) = len;
+   return op;
+}
+
+
+
+/* _al_lz4_pack_block:
+ *  Packs size bytes from src into dst, which must have room for
+ *  LZ4_BLOCK_BOUND(size) bytes. hash is scratch space for HASH_SIZE
+ *  ints. Returns the packed size.
+ */
+int _al_lz4_pack_block(AL_CONST unsigned char *src, int size, unsigned char *dst, int *hash)
+{
+   AL_CONST unsigned char *ip = src;
+   AL_CONST unsigned char *anchor = src;
+   AL_CONST unsigned char *iend = src + size;
+   AL_CONST unsigned char *mflimit = iend - MFLIMIT;
+   AL_CONST unsigned char *matchlimit = iend - LASTLITERALS;
+   AL_CONST unsigned char *ref;
+   unsigned char *op = dst;
+   unsigned char *token;
+   int misses = 0;
+   int h, lit, len;
+
+   if (size > MFLIMIT) {
+      memset(hash, 0, HASH_SIZE * sizeof(int));
+
+      while (ip < mflimit) {
+	 h = LZ4_HASH(ip);
+	 ref = src + hash[h];
+	 hash[h] = (int)(ip - src);
+
+	 if ((ref >= ip) || (ip - ref > MAX_OFFSET) || (READ32(ref) != READ32(ip))) {
+	    /* skip faster through data that doesn't compress */
+	    ip += 1 + (misses++ >> 6);
+	    continue;
+	 }
+
+	 misses = 0;
+
+	 /* take in any matching bytes just before it */
+	 while ((ip > anchor) && (ref > src) && (ip[-1] == ref[-1])) {
+	    ip--;
+	    ref--;
+	 }
+
+	 len = MINMATCH;
+	 while ((ip + len < matchlimit) && (ip[len] == ref[len]))
+	    len++;
+
+	 lit = (int)(ip - anchor);
+	 token = op++;
+
+	 if (lit >= 15) {
+	    *token = 15 << 4;
+	    op = lz4_put_length(op, lit - 15);
+	 }
+	 else
+	    *token = lit << 4;
+
+	 memcpy(op, anchor, lit);
+	 op += lit;
+
+	 *(op++) = (ip - ref) & 0xFF;
+	 *(op++) = (ip - ref) >> 8;
+
+	 if (len - MINMATCH >= 15) {
+	    *token |= 15;
+	    op = lz4_put_length(op, len - MINMATCH - 15);
+	 }
+	 else
+	    *token |= len - MINMATCH;
+
+	 ip += len;
+	 anchor = ip;
+
+	 if (ip < mflimit)
+	    hash[LZ4_HASH(ip-2)] = (int)(ip - 2 - src);
+      }
+   }
+
+   /* the rest goes out as literals */
+   lit = (int)(iend - anchor);
+
+   if (lit >= 15) {
+      *(op++) = 15 << 4;
+      op = lz4_put_length(op, lit - 15);
+   }
+   else
+      *(op++) = lit << 4;
+
+   memcpy(op, anchor, lit);
+   op += lit;
+
+   return (int)(op - dst);
+}
+
+
+
+/* _al_lz4_unpack_block:
+ *  Unpacks a block of size bytes from src into dst, which has room for
+ *  max bytes. Every length and offset is checked, so bad data can't
+ *  write outside dst. Returns the unpacked size, or -1 if the data is
+ *  not valid.
+ */
+int _al_lz4_unpack_block(AL_CONST unsigned char *src, int size, unsigned char *dst, int max)
+{
+   AL_CONST unsigned char *ip = src;
+   AL_CONST unsigned char *iend = src + size;
+   unsigned char *op = dst;
+   unsigned char *oend = dst + max;
+   unsigned char *ref, *end;
+   int token, lit, len, off, s;
+
+   while (ip < iend) {
+      token = *(ip++);
+
+      lit = token >> 4;
+      if (lit == 15) {
+	 do {
+	    if (ip >= iend)
+	       return -1;
+	    s = *(ip++);
+	    lit += s;
+	 } while (s == 255);
+      }
+
+      if ((lit <= 16) && (iend - ip >= 16) && (oend - op >= 16)) {
+	 /* short runs are copied in one go, there is room to spare */
+	 memcpy(op, ip, 16);
+      }
+      else {
+	 if ((lit > iend - ip) || (lit > oend - op))
+	    return -1;
+
+	 memcpy(op, ip, lit);
+      }
+
+      op += lit;
+      ip += lit;
+
+      /* the last sequence has no match */
+      if (ip >= iend)
+	 break;
+
+      if (iend - ip < 2)
+	 return -1;
+
+      off = ip[0] | (ip[1] << 8);
+      ip += 2;
+
+      if ((off == 0) || (off > op - dst))
+	 return -1;
+
+      len = token & 15;
+      if (len == 15) {
+	 do {
+	    if (ip >= iend)
+	       return -1;
+	    s = *(ip++);
+	    len += s;
+	 } while (s == 255);
+      }
+      len += MINMATCH;
+
+      if (len > oend - op)
+	 return -1;
+
+      ref = op - off;
+
+      if ((off >= 8) && (oend - op >= len + 8)) {
+	 /* copy in steps of 8, which may run a little past the match */
+	 end = op + len;
+	 do {
+	    memcpy(op, ref, 8);
+	    op += 8;
+	    ref += 8;
+	 } while (op < end);
+	 op = end;
+      }
+      else if (off >= len) {
+	 memcpy(op, ref, len);
+	 op += len;
+      }
+      else {
+	 /* the match overlaps itself */
+	 while (len--)
+	    *(op++) = *(ref++);
+      }
+   }
+
+   return (int)(op - dst);
+}
+
+
+
+/* lz4_create_packer:
+ *  Creates the state for packing a stream.
+ */
+static void *lz4_create_packer(void)
+{
+   LZ4_PACK_DATA *dat;
+
+   if ((dat = _AL_MALLOC(sizeof(LZ4_PACK_DATA))) == NULL) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   dat->size = 0;
+   dat->indexed = FALSE;
+   dat->at = 0;
+   dat->index = NULL;
+   dat->count = dat->max = 0;
+
+   return dat;
+}
+
+
+
+/* lz4i_create_packer:
+ *  Creates the state for packing a stream with a block index.
+ */
+static void *lz4i_create_packer(void)
+{
+   LZ4_PACK_DATA *dat = lz4_create_packer();
+
+   if (dat)
+      dat->indexed = TRUE;
+
+   return dat;
+}
+
+
+
+/* lz4_destroy_packer:
+ *  Frees the state for packing a stream.
+ */
+static void lz4_destroy_packer(void *_dat)
+{
+   LZ4_PACK_DATA *dat = _dat;
+   ASSERT(dat);
+
+   if (dat->index)
+      _AL_FREE(dat->index);
+
+   _AL_FREE(dat);
+}
+
+
+
+/* lz4_flush_block:
+ *  Packs the data waiting in the buffer and writes it out as a block.
+ */
+static int lz4_flush_block(PACKFILE *file, LZ4_PACK_DATA *dat)
+{
+   int size = _al_lz4_pack_block(dat->buf, dat->size, dat->out, dat->hash);
+   long *p;
+
+   if (dat->indexed) {
+      if (dat->count >= dat->max) {
+	 p = _AL_REALLOC(dat->index, (dat->max + 64) * sizeof(long));
+	 if (!p) {
+	    *allegro_errno = ENOMEM;
+	    return EOF;
+	 }
+	 dat->index = p;
+	 dat->max += 64;
+      }
+
+      dat->index[dat->count++] = dat->at;
+   }
+
+   if (size < dat->size) {
+      pack_mputl(size, file);
+      pack_mputl(dat->size, file);
+      pack_fwrite(dat->out, size, file);
+   }
+   else {
+      size = dat->size;
+      pack_mputl(size, file);
+      pack_mputl(size, file);
+      pack_fwrite(dat->buf, size, file);
+   }
+
+   dat->at += 8 + size;
+   dat->size = 0;
+
+   return pack_ferror(file) ? EOF : 0;
+}
+
+
+
+/* lz4_write_index:
+ *  Ends an indexed stream with the offsets of all its blocks.
+ */
+static int lz4_write_index(PACKFILE *file, LZ4_PACK_DATA *dat)
+{
+   int i;
+
+   pack_mputl(0, file);
+   pack_mputl(dat->count, file);
+
+   for (i=0; i<dat->count; i++)
+      pack_mputl(dat->index[i], file);
+
+   pack_mputl(12 + dat->count * 4, file);
+
+   return pack_ferror(file) ? EOF : 0;
+}
+
+
+
+/* lz4_pack:
+ *  Packs size bytes from buf. Whole blocks are written as soon as they
+ *  fill up, and the rest when last is set. Returns 0 on success.
+ */
+static int lz4_pack(PACKFILE *file, void *_dat, int size, unsigned char *buf, int last)
+{
+   LZ4_PACK_DATA *dat = _dat;
+   int n;
+
+   while (size > 0) {
+      n = MIN(size, LZ4_BLOCK_SIZE - dat->size);
+      memcpy(dat->buf + dat->size, buf, n);
+      dat->size += n;
+      buf += n;
+      size -= n;
+
+      if (dat->size == LZ4_BLOCK_SIZE) {
+	 if (lz4_flush_block(file, dat))
+	    return EOF;
+      }
+   }
+
+   if (last) {
+      if ((dat->size > 0) && (lz4_flush_block(file, dat)))
+	 return EOF;
+
+      if (dat->indexed)
+	 return lz4_write_index(file, dat);
+   }
+
+   return 0;
+}
+
+
+
+/* lz4_create_unpacker:
+ *  Creates the state for unpacking a stream. The buffers are allocated
+ *  when the first block is read, at the size it needs, so small chunks
+ *  don't cost a full block of memory.
+ */
+static void *lz4_create_unpacker(void)
+{
+   LZ4_UNPACK_DATA *dat;
+
+   if ((dat = _AL_MALLOC(sizeof(LZ4_UNPACK_DATA))) == NULL) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   dat->pos = dat->size = 0;
+   dat->failed = FALSE;
+   dat->ended = FALSE;
+   dat->indexed = FALSE;
+   dat->at = 0;
+   dat->next = 0;
+   dat->index = NULL;
+   dat->count = -1;
+   dat->in_max = dat->out_max = 0;
+   dat->in = dat->out = NULL;
+
+   return dat;
+}
+
+
+
+/* lz4i_create_unpacker:
+ *  Creates the state for unpacking a stream with a block index.
+ */
+static void *lz4i_create_unpacker(void)
+{
+   LZ4_UNPACK_DATA *dat = lz4_create_unpacker();
+
+   if (dat)
+      dat->indexed = TRUE;
+
+   return dat;
+}
+
+
+
+/* lz4_destroy_unpacker:
+ *  Frees the state for unpacking a stream.
+ */
+static void lz4_destroy_unpacker(void *_dat)
+{
+   LZ4_UNPACK_DATA *dat = _dat;
+   ASSERT(dat);
+
+   if (dat->in)
+      _AL_FREE(dat->in);
+
+   if (dat->out)
+      _AL_FREE(dat->out);
+
+   if (dat->index)
+      _AL_FREE(dat->index);
+
+   _AL_FREE(dat);
+}
+
+
+
+/* lz4_grow:
+ *  Makes sure one of the buffers can hold size bytes.
+ */
+static int lz4_grow(unsigned char **buf, int *max, int size)
+{
+   unsigned char *p;
+
+   if (size <= *max)
+      return TRUE;
+
+   p = _AL_REALLOC(*buf, size);
+   if (!p) {
+      *allegro_errno = ENOMEM;
+      return FALSE;
+   }
+
+   *buf = p;
+   *max = size;
+   return TRUE;
+}
+
+
+
+/* lz4_fail:
+ *  Stops unpacking a stream that turned out to be bad.
+ */
+static void lz4_fail(PACKFILE *file, LZ4_UNPACK_DATA *dat)
+{
+   dat->failed = TRUE;
+   *allegro_errno = EFAULT;
+
+   if (file->is_normal_packfile)
+      file->normal.flags |= PACKFILE_FLAG_ERROR;
+}
+
+
+
+/* lz4_read:
+ *  Reads from the packed file, keeping count of where we are in it.
+ */
+static int lz4_read(PACKFILE *file, LZ4_UNPACK_DATA *dat, unsigned char *p, int n)
+{
+   n = pack_fread(p, n, file);
+   dat->at += n;
+
+   return n;
+}
+
+
+
+/* lz4_next_block:
+ *  Reads the header of the next block. Returns FALSE at the end of the
+ *  data, or if the header is bad.
+ */
+static int lz4_next_block(PACKFILE *file, LZ4_UNPACK_DATA *dat, int *packed, int *size)
+{
+   unsigned char header[8];
+   int n;
+
+   if ((dat->failed) || (dat->ended))
+      return FALSE;
+
+   n = lz4_read(file, dat, header, 8);
+   if (n != 8) {
+      /* a clean end of the data, unless a header was cut short */
+      if (n != 0)
+	 lz4_fail(file, dat);
+      return FALSE;
+   }
+
+   *packed = (int)(((unsigned int)header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3]);
+   *size = (int)(((unsigned int)header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7]);
+
+   if ((*packed == 0) && (*size >= 0) && (*size < LZ4_MAX_BLOCKS)) {
+      /* the index of an indexed stream, which sequential reads skip */
+      pack_fseek(file, *size * 4 + 4);
+      dat->ended = TRUE;
+      return FALSE;
+   }
+
+   if ((*size <= 0) || (*size > LZ4_BLOCK_SIZE) ||
+       (*packed <= 0) || (*packed > LZ4_BLOCK_BOUND(*size))) {
+      lz4_fail(file, dat);
+      return FALSE;
+   }
+
+   /* seeking by the index relies on the blocks being full */
+   if ((dat->next < dat->count - 1) && (*size != LZ4_BLOCK_SIZE)) {
+      lz4_fail(file, dat);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+
+/* lz4_read_block:
+ *  Reads the block whose header has just been read and unpacks it into
+ *  dest, which has room for size bytes. Returns FALSE on error.
+ */
+static int lz4_read_block(PACKFILE *file, LZ4_UNPACK_DATA *dat, int packed, int size, unsigned char *dest)
+{
+   if (packed == size) {
+      /* stored as it is */
+      if (lz4_read(file, dat, dest, size) != size) {
+	 lz4_fail(file, dat);
+	 return FALSE;
+      }
+   }
+   else {
+      if ((!lz4_grow(&dat->in, &dat->in_max, packed)) ||
+	  (lz4_read(file, dat, dat->in, packed) != packed) ||
+	  (_al_lz4_unpack_block(dat->in, packed, dest, size) != size)) {
+	 lz4_fail(file, dat);
+	 return FALSE;
+      }
+   }
+
+   dat->next++;
+   return TRUE;
+}
+
+
+
+/* lz4_unpack:
+ *  Unpacks up to s bytes into buf, reading blocks as they are needed.
+ *  Blocks that fit are unpacked straight into buf. Returns the number
+ *  of bytes added to buf.
+ */
+static int lz4_unpack(PACKFILE *file, void *_dat, int s, unsigned char *buf)
+{
+   LZ4_UNPACK_DATA *dat = _dat;
+   unsigned char *dest;
+   int done = 0;
+   int n, packed, size;
+
+   while (done < s) {
+      if (dat->pos < dat->size) {
+	 n = MIN(s - done, dat->size - dat->pos);
+	 memcpy(buf + done, dat->out + dat->pos, n);
+	 dat->pos += n;
+	 done += n;
+	 continue;
+      }
+
+      if (!lz4_next_block(file, dat, &packed, &size))
+	 break;
+
+      if (s - done >= size)
+	 dest = buf + done;
+      else {
+	 if (!lz4_grow(&dat->out, &dat->out_max, size)) {
+	    lz4_fail(file, dat);
+	    break;
+	 }
+	 dest = dat->out;
+      }
+
+      if (!lz4_read_block(file, dat, packed, size, dest))
+	 break;
+
+      if (dest == dat->out) {
+	 dat->pos = 0;
+	 dat->size = size;
+      }
+      else
+	 done += size;
+   }
+
+   return done;
+}
+
+
+
+/* lz4_unpack_pending:
+ *  Tells whether an unpacked block still has bytes that haven't been
+ *  read, even if the packed data has all been consumed.
+ */
+static int lz4_unpack_pending(void *_dat)
+{
+   LZ4_UNPACK_DATA *dat = _dat;
+
+   return (dat->pos < dat->size);
+}
+
+
+
+/* lz4_load_index:
+ *  Reads the block index from the end of an indexed stream, the first
+ *  time it is needed, and goes back to where we were. This only works
+ *  when the stream is a whole file on the disk. Returns TRUE if there
+ *  is an index to use.
+ */
+static int lz4_load_index(PACKFILE *file, LZ4_UNPACK_DATA *dat)
+{
+   long from = dat->at;
+   long end, size, marker, count, n, i;
+
+   if (dat->count >= 0)
+      return (dat->count > 0);
+
+   dat->count = 0;
+
+   if ((!file->is_normal_packfile) || (file->normal.parent))
+      return FALSE;
+
+   end = dat->at + file->normal.todo + file->normal.buf_size;
+
+   if (_al_normal_seek(file, end - 4 - dat->at) != 0)
+      return FALSE;
+
+   size = pack_mgetl(file);
+   dat->at = end;
+   n = (size - 12) / 4;
+
+   if ((size > 12) && (size <= end) && ((size - 12) % 4 == 0) &&
+       (_al_normal_seek(file, -size) == 0)) {
+      dat->at = end - size;
+      marker = pack_mgetl(file);
+      count = pack_mgetl(file);
+      dat->at += 8;
+
+      if ((marker == 0) && (count == n) &&
+	  ((dat->index = _AL_MALLOC_ATOMIC(n * sizeof(long))) != NULL)) {
+	 for (i=0; i<n; i++) {
+	    dat->index[i] = pack_mgetl(file);
+	    dat->at += 4;
+
+	    /* the blocks must follow each other, before the index */
+	    if (((i == 0) ? (dat->index[i] != 0) : (dat->index[i] < dat->index[i-1] + 9)) ||
+		(dat->index[i] > end - size - 9))
+	       break;
+	 }
+
+	 if ((i == n) && (!pack_ferror(file)))
+	    dat->count = n;
+	 else {
+	    _AL_FREE(dat->index);
+	    dat->index = NULL;
+	 }
+      }
+   }
+
+   if (_al_normal_seek(file, from - dat->at) != 0) {
+      lz4_fail(file, dat);
+      return FALSE;
+   }
+
+   dat->at = from;
+
+   return (dat->count > 0);
+}
+
+
+
+/* lz4_unpack_seek:
+ *  Skips up to offset bytes of unpacked data. Whole blocks are skipped
+ *  by their headers without unpacking them, or found straight away in
+ *  the index of an indexed stream. Returns the number of bytes skipped.
+ */
+static long lz4_unpack_seek(PACKFILE *file, void *_dat, long offset)
+{
+   LZ4_UNPACK_DATA *dat = _dat;
+   long done = 0;
+   long n, target;
+   int packed, size;
+
+   while (done < offset) {
+      if (dat->pos < dat->size) {
+	 n = MIN(offset - done, dat->size - dat->pos);
+	 dat->pos += n;
+	 done += n;
+	 continue;
+      }
+
+      if ((dat->failed) || (dat->ended))
+	 break;
+
+      /* jump over whole blocks by the index, up to the last one */
+      if ((dat->indexed) && (offset - done >= LZ4_BLOCK_SIZE) && (lz4_load_index(file, dat))) {
+	 target = MIN(dat->next + (offset - done) / LZ4_BLOCK_SIZE, dat->count - 1);
+
+	 if ((target > dat->next) && (_al_normal_seek(file, dat->index[target] - dat->at) == 0)) {
+	    done += (target - dat->next) * LZ4_BLOCK_SIZE;
+	    dat->at = dat->index[target];
+	    dat->next = target;
+	 }
+      }
+
+      if (!lz4_next_block(file, dat, &packed, &size))
+	 break;
+
+      if (offset - done >= size) {
+	 /* skip the block without unpacking it */
+	 pack_fseek(file, packed);
+	 dat->at += packed;
+	 dat->next++;
+	 done += size;
+      }
+      else {
+	 if ((!lz4_grow(&dat->out, &dat->out_max, size)) ||
+	     (!lz4_read_block(file, dat, packed, size, dat->out))) {
+	    lz4_fail(file, dat);
+	    break;
+	 }
+
+	 dat->pos = 0;
+	 dat->size = size;
+      }
+   }
+
+   return done;
+}
+
+
+
+PACKFILE_CODEC _al_lz4_codec =
+{
+   lz4_create_packer,
+   lz4_destroy_packer,
+   lz4_pack,
+   lz4_create_unpacker,
+   lz4_destroy_unpacker,
+   lz4_unpack,
+   lz4_unpack_pending,
+   lz4_unpack_seek
+};
+
+
+
+PACKFILE_CODEC _al_lz4i_codec =
+{
+   lz4i_create_packer,
+   lz4_destroy_packer,
+   lz4_pack,
+   lz4i_create_unpacker,
+   lz4_destroy_unpacker,
+   lz4_unpack,
+   lz4_unpack_pending,
+   lz4_unpack_seek
+};
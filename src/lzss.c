@@ -1,6 +1,6 @@
-/*         ______   ___    ___ 
- *        /\  _  \ /\_ \  /\_ \ 
- *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___ 
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
  *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
  *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
  *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
@@ -18,16 +18,18 @@
  */
 
 
+#include <string.h>
+
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
 
 
 /*
    This compression algorithm is based on the ideas of Lempel and Ziv,
-   with the modifications suggested by Storer and Szymanski. The algorithm 
-   is based on the use of a ring buffer, which initially contains zeros. 
-   We read several characters from the file into the buffer, and then 
-   search the buffer for the longest string that matches the characters 
+   with the modifications suggested by Storer and Szymanski. The algorithm
+   is based on the use of a ring buffer, which initially contains zeros.
+   We read several characters from the file into the buffer, and then
+   search the buffer for the longest string that matches the characters
    just read, and output the length and position of the match in the buffer.
 
    With a buffer size of 4096 bytes, the position can be encoded in 12
@@ -39,15 +41,20 @@
    length> pair or an unencoded character, and these flags are stored as
    an eight bit mask every eight items.
 
-   This implementation uses binary trees to speed up the search for the
-   longest match.
-
    Original code by Haruhiko Okumura, 4/6/1989.
    12-2-404 Green Heights, 580 Nagasawa, Yokosuka 239, Japan.
 
    Modified for use in the Allegro filesystem by Shawn Hargreaves.
 
    Use, distribute, and modify this code freely.
+
+   The compressor finds matches with hash chains over a sliding window
+   rather than the original binary trees. The window is kept as a flat
+   array, so candidates are compared without wrapping, and position p of
+   the window is position p & (N-1) of the ring buffer the decoder sees.
+   How far each chain is followed, and whether a match is given up in
+   favour of a longer one starting at the next byte, depends on the
+   compression level. The output is the same format as it always was.
 */
 
 
@@ -56,21 +63,52 @@
 #define THRESHOLD    2              /* LZ encode string into pos and length
 				       if match size is greater than this */
 
+#define HASH_BITS    12             /* hash chains for the compressor */
+#define HASH_SIZE    (1 << HASH_BITS)
+#define WIN_SIZE     (N*3)          /* flat window, slid N bytes at a time */
+#define NIL          -1
+
+#define LZSS_HASH(p)                                                      \
+   ((((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8) |                \
+      ((unsigned int)(p)[2] << 16)) * 2654435761U) >> (32 - HASH_BITS))
+
+
+/* how hard each compression level tries */
+static struct {
+   int chain;                       /* candidates examined per match */
+   int lazy;                        /* try a match at the next byte too? */
+} lzss_levels[] =
+{
+   { 2,    0 },                     /* level 1 */
+   { 4,    0 },
+   { 8,    0 },
+   { 16,   1 },
+   { 32,   1 },
+   { 64,   1 },
+   { 256,  1 },
+   { 1024, 1 },
+   { N,    1 }                      /* level 9 */
+};
+
+
+static int lzss_pack_level = 6;
+
 
 struct LZSS_PACK_DATA               /* stuff for doing LZ compression */
 {
-   int state;                       /* where have we got to in the pack? */
-   int i, c, len, r, s;
-   int last_match_length, code_buf_ptr;
+   int state;                       /* have we started packing yet? */
+   int level;
+   int cur;                         /* next window position to encode */
+   int end;                         /* end of the data read so far */
+   int ins;                         /* next position to add to the chains */
+   int next_at;                     /* where the match below was found */
+   int next_pos, next_len;
+   int code_buf_ptr;
    unsigned char mask;
-   char code_buf[17];
-   int match_position;
-   int match_length;
-   int lson[N+1];                   /* left children, */
-   int rson[N+257];                 /* right children, */
-   int dad[N+1];                    /* and parents, = binary search trees */
-   unsigned char text_buf[N+F-1];   /* ring buffer, with F-1 extra bytes
-				       for string comparison */
+   unsigned char code_buf[17];
+   int head[HASH_SIZE];             /* most recent position for each hash */
+   int prev[N];                     /* older positions with the same hash */
+   unsigned char win[WIN_SIZE];
 };
 
 
@@ -87,23 +125,35 @@ struct LZSS_UNPACK_DATA             /* for reading LZ files */
 
 /*** Compression (writing) ***/
 
+/* set_lzss_pack_level:
+ *  Sets how hard the compressor tries, from 1 (fastest) to 9 (smallest
+ *  output). Returns the previous level.
+ */
+int set_lzss_pack_level(int level)
+{
+   int old = lzss_pack_level;
+
+   lzss_pack_level = MID(1, level, 9);
+
+   return old;
+}
+
+
+
 /* create_lzss_pack_data:
  *  Creates a PACK_DATA structure.
  */
 LZSS_PACK_DATA *create_lzss_pack_data(void)
 {
    LZSS_PACK_DATA *dat;
-   int c;
 
    if ((dat = _AL_MALLOC_ATOMIC(sizeof(LZSS_PACK_DATA))) == NULL) {
       *allegro_errno = ENOMEM;
       return NULL;
    }
 
-   for (c=0; c < N - F; c++)
-      dat->text_buf[c] = 0;
-
    dat->state = 0;
+   dat->level = lzss_pack_level;
 
    return dat;
 }
@@ -122,302 +172,236 @@ void free_lzss_pack_data(LZSS_PACK_DATA *dat)
 
 
 
-/* lzss_inittree:
- *  For i = 0 to N-1, rson[i] and lson[i] will be the right and left 
- *  children of node i. These nodes need not be initialized. Also, dad[i] 
- *  is the parent of node i. These are initialized to N, which stands for 
- *  'not used.' For i = 0 to 255, rson[N+i+1] is the root of the tree for 
- *  strings that begin with character i. These are initialized to N. Note 
- *  there are 256 trees.
+/* lzss_start:
+ *  Gets ready to pack a new stream. The first N-F bytes of the window
+ *  hold the zeros the decoder's ring buffer starts with.
  */
-static void lzss_inittree(LZSS_PACK_DATA *dat)
+static void lzss_start(LZSS_PACK_DATA *dat)
 {
    int i;
 
-   for (i=N+1; i<=N+256; i++)
-      dat->rson[i] = N;
+   for (i=0; i<HASH_SIZE; i++)
+      dat->head[i] = NIL;
 
    for (i=0; i<N; i++)
-      dat->dad[i] = N;
+      dat->prev[i] = NIL;
+
+   memset(dat->win, 0, N-F);
+
+   dat->cur = dat->end = N-F;
+   dat->ins = N-F-F;                /* only the last few zeros are worth it */
+   dat->next_at = NIL;
+
+   dat->code_buf[0] = 0;
+      /* code_buf[1..16] saves eight units of code, and code_buf[0] works
+	 as eight flags, "1" representing that the unit is an unencoded
+	 letter (1 byte), "0" a position-and-length pair (2 bytes).
+	 Thus, eight units require at most 16 bytes of code. */
+
+   dat->code_buf_ptr = dat->mask = 1;
+   dat->state = 1;
 }
 
 
 
-/* lzss_insertnode:
- *  Inserts a string of length F, text_buf[r..r+F-1], into one of the trees 
- *  (text_buf[r]'th tree) and returns the longest-match position and length 
- *  via match_position and match_length. If match_length = F, then removes 
- *  the old node in favor of the new one, because the old one will be 
- *  deleted sooner. Note r plays double role, as tree node and position in 
- *  the buffer. 
+/* lzss_slide:
+ *  Moves the window down by N bytes to make room for more data. N is a
+ *  multiple of the ring size, so ring positions don't change.
  */
-static void lzss_insertnode(int r, LZSS_PACK_DATA *dat)
+static void lzss_slide(LZSS_PACK_DATA *dat)
 {
-   int i, p, cmp;
-   unsigned char *key;
-   unsigned char *text_buf = dat->text_buf;
-
-   cmp = 1;
-   key = &text_buf[r];
-   p = N + 1 + key[0];
-   dat->rson[r] = dat->lson[r] = N;
-   dat->match_length = 0;
-
-   for (;;) {
+   int i;
 
-      if (cmp >= 0) {
-	 if (dat->rson[p] != N)
-	    p = dat->rson[p];
-	 else {
-	    dat->rson[p] = r;
-	    dat->dad[r] = p;
-	    return;
-	 }
-      }
-      else {
-	 if (dat->lson[p] != N)
-	    p = dat->lson[p];
-	 else {
-	    dat->lson[p] = r;
-	    dat->dad[r] = p;
-	    return;
-	 }
-      }
+   memmove(dat->win, dat->win+N, dat->end-N);
 
-      for (i = 1; i < F; i++)
-	 if ((cmp = key[i] - text_buf[p + i]) != 0)
-	    break;
+   dat->cur -= N;
+   dat->end -= N;
+   dat->ins -= N;
 
-      if (i > dat->match_length) {
-	 dat->match_position = p;
-	 if ((dat->match_length = i) >= F)
-	    break;
-      }
+   if (dat->next_at != NIL) {
+      dat->next_at -= N;
+      dat->next_pos -= N;
    }
 
-   dat->dad[r] = dat->dad[p];
-   dat->lson[r] = dat->lson[p];
-   dat->rson[r] = dat->rson[p];
-   dat->dad[dat->lson[p]] = r;
-   dat->dad[dat->rson[p]] = r;
-   if (dat->rson[dat->dad[p]] == p)
-      dat->rson[dat->dad[p]] = r;
-   else
-      dat->lson[dat->dad[p]] = r;
-   dat->dad[p] = N;                 /* remove p */
+   for (i=0; i<HASH_SIZE; i++)
+      dat->head[i] = (dat->head[i] >= N) ? dat->head[i] - N : NIL;
+
+   for (i=0; i<N; i++)
+      dat->prev[i] = (dat->prev[i] >= N) ? dat->prev[i] - N : NIL;
 }
 
 
 
-/* lzss_deletenode:
- *  Removes a node from a tree.
+/* lzss_insert:
+ *  Adds the strings starting before pos to the hash chains.
  */
-static void lzss_deletenode(int p, LZSS_PACK_DATA *dat)
+static void lzss_insert(LZSS_PACK_DATA *dat, int pos)
 {
-   int q;
-
-   if (dat->dad[p] == N)
-      return;     /* not in tree */
+   int h;
 
-   if (dat->rson[p] == N)
-      q = dat->lson[p];
-   else
-      if (dat->lson[p] == N)
-	 q = dat->rson[p];
-      else {
-	 q = dat->lson[p];
-	 if (dat->rson[q] != N) {
-	    do {
-	       q = dat->rson[q];
-	    } while (dat->rson[q] != N);
-	    dat->rson[dat->dad[q]] = dat->lson[q];
-	    dat->dad[dat->lson[q]] = dat->dad[q];
-	    dat->lson[q] = dat->lson[p];
-	    dat->dad[dat->lson[p]] = q;
-	 }
-	 dat->rson[q] = dat->rson[p];
-	 dat->dad[dat->rson[p]] = q;
+   while (dat->ins < pos) {
+      if (dat->ins+THRESHOLD < dat->end) {
+	 h = LZSS_HASH(dat->win + dat->ins);
+	 dat->prev[dat->ins & (N-1)] = dat->head[h];
+	 dat->head[h] = dat->ins;
       }
-
-   dat->dad[q] = dat->dad[p];
-   if (dat->rson[dat->dad[p]] == p)
-      dat->rson[dat->dad[p]] = q;
-   else
-      dat->lson[dat->dad[p]] = q;
-
-   dat->dad[p] = N;
+      dat->ins++;
+   }
 }
 
 
 
-/* lzss_write:
- *  Packs size bytes from buf, using the pack information contained in dat.
- *  Returns 0 on success.
+/* lzss_match:
+ *  Looks for the longest string in the window matching the one at pos.
+ *  Returns its length and stores its position in match_pos, or returns
+ *  zero if there is nothing long enough to be worth encoding.
  */
-int lzss_write(PACKFILE *file, LZSS_PACK_DATA *dat, int size, unsigned char *buf, int last)
+static int lzss_match(LZSS_PACK_DATA *dat, int pos, int *match_pos)
 {
-   int i = dat->i;
-   int c = dat->c;
-   int len = dat->len;
-   int r = dat->r;
-   int s = dat->s;
-   int last_match_length = dat->last_match_length;
-   int code_buf_ptr = dat->code_buf_ptr;
-   unsigned char mask = dat->mask;
-   int ret = 0;
-
-   if (dat->state==2)
-      goto pos2;
-   else
-      if (dat->state==1)
-	 goto pos1;
-
-   dat->code_buf[0] = 0;
-      /* code_buf[1..16] saves eight units of code, and code_buf[0] works
-	 as eight flags, "1" representing that the unit is an unencoded
-	 letter (1 byte), "0" a position-and-length pair (2 bytes).
-	 Thus, eight units require at most 16 bytes of code. */
-
-   code_buf_ptr = mask = 1;
-
-   s = 0;
-   r = N - F;
-   lzss_inittree(dat);
-
-   for (len=0; (len < F) && (size > 0); len++) {
-      dat->text_buf[r+len] = *(buf++);
-      if (--size == 0) {
-	 if (!last) {
-	    dat->state = 1;
-	    goto getout;
+   unsigned char *win = dat->win;
+   unsigned char *key = win + pos;
+   int maxlen = MIN(F, dat->end - pos);
+   int limit = pos - (N-F);
+   int chain = lzss_levels[dat->level-1].chain;
+   int best = THRESHOLD;
+   int q, len;
+
+   if (maxlen <= THRESHOLD)
+      return 0;
+
+   lzss_insert(dat, pos);
+
+   q = dat->head[LZSS_HASH(key)];
+
+   while ((q >= limit) && (chain-- > 0)) {
+      if ((win[q+best] == key[best]) && (win[q] == key[0]) && (win[q+1] == key[1])) {
+	 for (len=2; (len < maxlen) && (win[q+len] == key[len]); len++)
+	    ;
+
+	 if (len > best) {
+	    best = len;
+	    *match_pos = q;
+	    if (len >= maxlen)
+	       break;
 	 }
       }
-      pos1:
-	 ; 
+      q = dat->prev[q & (N-1)];
    }
 
-   if (len == 0)
-      goto getout;
+   return (best > THRESHOLD) ? best : 0;
+}
 
-   for (i=1; i <= F; i++)
-      lzss_insertnode(r-i,dat);
-	    /* Insert the F strings, each of which begins with one or
-	       more 'space' characters. Note the order in which these
-	       strings are inserted. This way, degenerate trees will be
-	       less likely to occur. */
 
-   lzss_insertnode(r,dat);
-	    /* Finally, insert the whole string just read. match_length
-	       and match_position are set. */
 
-   do {
-      if (dat->match_length > len)
-	 dat->match_length = len;  /* match_length may be long near the end */
+/* lzss_flush_code:
+ *  Sends a group of up to eight units to the file.
+ */
+static int lzss_flush_code(PACKFILE *file, LZSS_PACK_DATA *dat)
+{
+   if ((file->is_normal_packfile) && (file->normal.passpos) &&
+       (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
+   {
+      dat->code_buf[0] ^= *file->normal.passpos;
+      file->normal.passpos++;
+      if (!*file->normal.passpos)
+	 file->normal.passpos = file->normal.passdata;
+   }
 
-      if (dat->match_length <= THRESHOLD) {
-	 dat->match_length = 1;  /* not long enough match: send one byte */
-	 dat->code_buf[0] |= mask;    /* 'send one byte' flag */
-	 dat->code_buf[code_buf_ptr++] = dat->text_buf[r]; /* send uncoded */
-      }
-      else {
-	 /* send position and length pair. Note match_length > THRESHOLD */
-	 dat->code_buf[code_buf_ptr++] = (unsigned char) dat->match_position;
-	 dat->code_buf[code_buf_ptr++] = (unsigned char)
-				     (((dat->match_position >> 4) & 0xF0) |
-				      (dat->match_length - (THRESHOLD + 1)));
-      }
+   pack_fwrite(dat->code_buf, dat->code_buf_ptr, file);
 
-      if ((mask <<= 1) == 0) {                  /* shift mask left one bit */
+   dat->code_buf[0] = 0;
+   dat->code_buf_ptr = dat->mask = 1;
 
-	 if ((file->is_normal_packfile) && (file->normal.passpos) &&
-	     (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
-	 {
-	    dat->code_buf[0] ^= *file->normal.passpos;
-	    file->normal.passpos++;
-	    if (!*file->normal.passpos)
-	       file->normal.passpos = file->normal.passdata;
-	 }
+   return pack_ferror(file) ? EOF : 0;
+}
 
-	 for (i=0; i<code_buf_ptr; i++)         /* send at most 8 units of */
-	    pack_putc(dat->code_buf[i], file);  /* code together */
 
-	 if (pack_ferror(file)) {
-	    ret = EOF;
-	    goto getout;
-	 }
-	 dat->code_buf[0] = 0;
-	 code_buf_ptr = mask = 1;
-      }
 
-      last_match_length = dat->match_length;
+/* lzss_write:
+ *  Packs size bytes from buf, using the pack information contained in dat.
+ *  Returns 0 on success.
+ */
+int lzss_write(PACKFILE *file, LZSS_PACK_DATA *dat, int size, unsigned char *buf, int last)
+{
+   int lazy = lzss_levels[dat->level-1].lazy;
+   int n, stop, len, pos, len2, pos2;
+
+   if (!dat->state)
+      lzss_start(dat);
 
-      for (i=0; (i < last_match_length) && (size > 0); i++) {
-	 c = *(buf++);
-	 if (--size == 0) {
-	    if (!last) {
-	       dat->state = 2;
-	       goto getout;
+   for (;;) {
+      n = MIN(size, WIN_SIZE - dat->end);
+      memcpy(dat->win + dat->end, buf, n);
+      dat->end += n;
+      buf += n;
+      size -= n;
+
+      /* unless this is the end, keep enough back to find the longest
+	 match at the next position too */
+      if ((last) && (size == 0))
+	 stop = dat->end;
+      else
+	 stop = dat->end - F;
+
+      while (dat->cur < stop) {
+	 if (dat->next_at == dat->cur) {
+	    len = dat->next_len;
+	    pos = dat->next_pos;
+	 }
+	 else
+	    len = lzss_match(dat, dat->cur, &pos);
+
+	 dat->next_at = NIL;
+
+	 if ((len) && (len < F) && (lazy)) {
+	    /* is there something better one byte on? */
+	    len2 = lzss_match(dat, dat->cur+1, &pos2);
+	    if (len2 > len) {
+	       dat->next_at = dat->cur+1;
+	       dat->next_len = len2;
+	       dat->next_pos = pos2;
+	       len = 0;
 	    }
 	 }
-	 pos2:
-	 lzss_deletenode(s,dat);    /* delete old strings and */
-	 dat->text_buf[s] = c;      /* read new bytes */
-	 if (s < F-1)
-	    dat->text_buf[s+N] = c; /* if the position is near the end of
-				       buffer, extend the buffer to make
-				       string comparison easier */
-	 s = (s+1) & (N-1);
-	 r = (r+1) & (N-1);         /* since this is a ring buffer,
-				       increment the position modulo N */
-
-	 lzss_insertnode(r,dat);    /* register the string in
-				       text_buf[r..r+F-1] */
-      }
 
-      while (i++ < last_match_length) {   /* after the end of text, */
-	 lzss_deletenode(s,dat);          /* no need to read, but */
-	 s = (s+1) & (N-1);               /* buffer may not be empty */
-	 r = (r+1) & (N-1);
-	 if (--len)
-	    lzss_insertnode(r,dat); 
+	 if (!len) {
+	    dat->code_buf[0] |= dat->mask;    /* 'send one byte' flag */
+	    dat->code_buf[dat->code_buf_ptr++] = dat->win[dat->cur];
+	    dat->cur++;
+	 }
+	 else {
+	    /* send position and length pair. Note len > THRESHOLD */
+	    pos &= (N-1);
+	    dat->code_buf[dat->code_buf_ptr++] = (unsigned char)pos;
+	    dat->code_buf[dat->code_buf_ptr++] = (unsigned char)
+					      (((pos >> 4) & 0xF0) |
+					       (len - (THRESHOLD + 1)));
+	    dat->cur += len;
+	 }
+
+	 if ((dat->mask <<= 1) == 0) {
+	    if (lzss_flush_code(file, dat))
+	       return EOF;
+	 }
       }
 
-   } while (len > 0);   /* until length of string to be processed is zero */
+      if (size == 0)
+	 break;
 
-   if (code_buf_ptr > 1) {         /* send remaining code */
+      if (dat->cur >= N*2)
+	 lzss_slide(dat);
+   }
 
-      if ((file->is_normal_packfile) && (file->normal.passpos) &&
-	  (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
-      {
-	 dat->code_buf[0] ^= *file->normal.passpos;
-	 file->normal.passpos++;
-	 if (!*file->normal.passpos)
-	    file->normal.passpos = file->normal.passdata;
+   if (last) {
+      if (dat->code_buf_ptr > 1) {   /* send remaining code */
+	 if (lzss_flush_code(file, dat))
+	    return EOF;
       }
 
-      for (i=0; i<code_buf_ptr; i++) {
-	 pack_putc(dat->code_buf[i], file);
-	 if (pack_ferror(file)) {
-	    ret = EOF;
-	    goto getout;
-	 }
-      }
+      dat->state = 0;
    }
 
-   dat->state = 0;
-
-   getout:
-
-   dat->i = i;
-   dat->c = c;
-   dat->len = len;
-   dat->r = r;
-   dat->s = s;
-   dat->last_match_length = last_match_length;
-   dat->code_buf_ptr = code_buf_ptr;
-   dat->mask = mask;
-
-   return ret;
+   return 0;
 }
 
 
@@ -459,6 +443,87 @@ void free_lzss_unpack_data(LZSS_UNPACK_DATA *dat)
 
 
 
+/* lzss_read_groups:
+ *  Decodes whole groups of eight units straight out of the buffer of a
+ *  normal packfile, which saves going through pack_getc() for every byte.
+ *  Stops when the buffer might not hold a complete group, or when there
+ *  is no longer room for the biggest possible group in buf, so the caller
+ *  always has something left to finish the slow way. Returns the number
+ *  of bytes added to buf.
+ */
+static int lzss_read_groups(PACKFILE *file, LZSS_UNPACK_DATA *dat, int *ring_pos, unsigned char *buf, int room)
+{
+   unsigned char *text_buf = dat->text_buf;
+   unsigned char *in = file->normal.buf_pos;
+   unsigned char *out = buf;
+   unsigned char *end = buf + room - 8*F;
+   int crypt = ((file->normal.passpos) && (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT));
+   int avail = file->normal.buf_size;
+   int r = *ring_pos;
+   int i, len, flags, n;
+
+   /* a group is at most 17 bytes, and one must be left in the buffer */
+   while ((avail > 17) && (out < end)) {
+      unsigned char *start = in;
+
+      flags = *(in++);
+
+      if (crypt) {
+	 flags ^= *file->normal.passpos;
+	 file->normal.passpos++;
+	 if (!*file->normal.passpos)
+	    file->normal.passpos = file->normal.passdata;
+      }
+
+      if ((flags == 0xFF) && (r <= N-8)) {
+	 /* eight bytes of literals */
+	 memcpy(text_buf+r, in, 8);
+	 memcpy(out, in, 8);
+	 r = (r + 8) & (N - 1);
+	 in += 8;
+	 out += 8;
+      }
+      else {
+	 for (n=0; n<8; n++, flags >>= 1) {
+	    if (flags & 1) {
+	       *(out++) = text_buf[r] = *(in++);
+	       r = (r + 1) & (N - 1);
+	    }
+	    else {
+	       i = in[0] | ((in[1] & 0xF0) << 4);
+	       len = (in[1] & 0x0F) + THRESHOLD + 1;
+	       in += 2;
+
+	       if ((i + len <= N) && (r + len <= N) && ((i + len <= r) || (r + len <= i))) {
+		  memcpy(text_buf+r, text_buf+i, len);
+		  memcpy(out, text_buf+i, len);
+		  r = (r + len) & (N - 1);
+		  out += len;
+	       }
+	       else {
+		  /* wraps around the ring, or overlaps itself */
+		  while (len--) {
+		     *(out++) = text_buf[r] = text_buf[i];
+		     i = (i + 1) & (N - 1);
+		     r = (r + 1) & (N - 1);
+		  }
+	       }
+	    }
+	 }
+      }
+
+      avail -= (int)(in - start);
+   }
+
+   file->normal.buf_pos = in;
+   file->normal.buf_size = avail;
+   *ring_pos = r;
+
+   return (int)(out - buf);
+}
+
+
+
 /* lzss_read:
  *  Unpacks from dat into buf, until either EOF is reached or s bytes have
  *  been extracted. Returns the number of bytes added to the buffer
@@ -472,6 +537,7 @@ int lzss_read(PACKFILE *file, LZSS_UNPACK_DATA *dat, int s, unsigned char *buf)
    int c = dat->c;
    unsigned int flags = dat->flags;
    int size = 0;
+   int n;
 
    if (dat->state==2)
       goto pos2;
@@ -484,9 +550,16 @@ int lzss_read(PACKFILE *file, LZSS_UNPACK_DATA *dat, int s, unsigned char *buf)
 
    for (;;) {
       if (((flags >>= 1) & 256) == 0) {
+	 if ((file->is_normal_packfile) && (!(file->normal.flags & PACKFILE_FLAG_WRITE)) &&
+	     (s - size > 8*F)) {
+	    n = lzss_read_groups(file, dat, &r, buf, s - size);
+	    buf += n;
+	    size += n;
+	 }
+
 	 if ((c = pack_getc(file)) == EOF)
 	    break;
-  
+
 	 if ((file->is_normal_packfile) && (file->normal.passpos) &&
 	     (file->normal.flags & PACKFILE_FLAG_OLD_CRYPT))
 	 {
@@ -510,7 +583,7 @@ int lzss_read(PACKFILE *file, LZSS_UNPACK_DATA *dat, int s, unsigned char *buf)
 	    goto getout;
 	 }
 	 pos1:
-	    ; 
+	    ;
       }
       else {
 	 if ((i = pack_getc(file)) == EOF)
@@ -529,7 +602,7 @@ int lzss_read(PACKFILE *file, LZSS_UNPACK_DATA *dat, int s, unsigned char *buf)
 	       goto getout;
 	    }
 	    pos2:
-	       ; 
+	       ;
 	 }
       }
    }
@@ -559,3 +632,58 @@ int _al_lzss_incomplete_state(AL_CONST LZSS_UNPACK_DATA *dat)
 {
    return dat->state == 2;
 }
+
+
+
+/* lzss_codec_*:
+ *  Adapt the LZSS routines to the PACKFILE_CODEC interface, so the file
+ *  code can treat them like any other compressor.
+ */
+static void *lzss_codec_create_packer(void)
+{
+   return create_lzss_pack_data();
+}
+
+static void lzss_codec_destroy_packer(void *dat)
+{
+   free_lzss_pack_data(dat);
+}
+
+static int lzss_codec_pack(PACKFILE *file, void *dat, int size, unsigned char *buf, int last)
+{
+   return lzss_write(file, dat, size, buf, last);
+}
+
+static void *lzss_codec_create_unpacker(void)
+{
+   return create_lzss_unpack_data();
+}
+
+static void lzss_codec_destroy_unpacker(void *dat)
+{
+   free_lzss_unpack_data(dat);
+}
+
+static int lzss_codec_unpack(PACKFILE *file, void *dat, int size, unsigned char *buf)
+{
+   return lzss_read(file, dat, size, buf);
+}
+
+static int lzss_codec_unpack_pending(void *dat)
+{
+   return _al_lzss_incomplete_state(dat);
+}
+
+
+
+PACKFILE_CODEC _al_lzss_codec =
+{
+   lzss_codec_create_packer,
+   lzss_codec_destroy_packer,
+   lzss_codec_pack,
+   lzss_codec_create_unpacker,
+   lzss_codec_destroy_unpacker,
+   lzss_codec_unpack,
+   lzss_codec_unpack_pending,
+   NULL
+};
@@ -19,6 +19,8 @@
 #include <math.h>
 
 #include "allegro.h"
+#include "allegro/internal/aintern.h"
+#include "c/csimd.h"
 
 
 
@@ -904,3 +906,145 @@ void set_projection_viewport(int x, int y, int w, int h)
    _persp_yoffset_f = y + h/2;
 }
 
+
+
+/* transform_v3d:
+ *  Helper for the fixed point batch functions. Each vertex is multiplied
+ *  by m if there is one, and then projected if project is set.
+ */
+static void transform_v3d(AL_CONST MATRIX *m, int n, AL_CONST V3D *in, V3D *out, int project)
+{
+   fixed x, y, z, tx, ty;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      x = in[i].x;
+      y = in[i].y;
+      z = in[i].z;
+
+      if (m) {
+	 tx = fixmul(x, m->v[0][0]) + fixmul(y, m->v[0][1]) + fixmul(z, m->v[0][2]) + m->t[0];
+	 ty = fixmul(x, m->v[1][0]) + fixmul(y, m->v[1][1]) + fixmul(z, m->v[1][2]) + m->t[1];
+	 z = fixmul(x, m->v[2][0]) + fixmul(y, m->v[2][1]) + fixmul(z, m->v[2][2]) + m->t[2];
+	 x = tx;
+	 y = ty;
+      }
+
+      if (project)
+	 persp_project(x, y, z, &x, &y);
+
+      out[i].x = x;
+      out[i].y = y;
+      out[i].z = z;
+      out[i].u = in[i].u;
+      out[i].v = in[i].v;
+      out[i].c = in[i].c;
+   }
+}
+
+
+
+/* transform_v3d_f:
+ *  Helper for the floating point batch functions. The SIMD transformer
+ *  handles whole blocks of vertices and the rest are done here, with
+ *  the maths in the same order so every vertex gets the same result.
+ */
+static void transform_v3d_f(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out, int project)
+{
+   float x, y, z, tx, ty, z1;
+   int i = 0;
+
+#ifdef ALLEGRO_SIMD
+   if (_al_simd_xform_v3d)
+      i = _al_simd_xform_v3d(m, n, in, out, project);
+#endif
+
+   for (; i < n; i++) {
+      x = in[i].x;
+      y = in[i].y;
+      z = in[i].z;
+
+      if (m) {
+	 tx = x * m->v[0][0] + y * m->v[0][1] + z * m->v[0][2] + m->t[0];
+	 ty = x * m->v[1][0] + y * m->v[1][1] + z * m->v[1][2] + m->t[1];
+	 z = x * m->v[2][0] + y * m->v[2][1] + z * m->v[2][2] + m->t[2];
+	 x = tx;
+	 y = ty;
+      }
+
+      if (project) {
+	 z1 = 1.0f / z;
+	 x = ((x * z1) * _persp_xscale_f) + _persp_xoffset_f;
+	 y = ((y * z1) * _persp_yscale_f) + _persp_yoffset_f;
+      }
+
+      out[i].x = x;
+      out[i].y = y;
+      out[i].z = z;
+      out[i].u = in[i].u;
+      out[i].v = in[i].v;
+      out[i].c = in[i].c;
+   }
+}
+
+
+
+/* apply_matrix_v3d:
+ *  Multiplies the positions of n vertices by a matrix, copying the
+ *  texture coordinates and colours across unchanged. The in and out 
+ *  arrays may be the same, but must not otherwise overlap.
+ */
+void apply_matrix_v3d(AL_CONST MATRIX *m, int n, AL_CONST V3D *in, V3D *out)
+{
+   ASSERT(m);
+   ASSERT(n >= 0);
+   ASSERT((in) || (n == 0));
+   ASSERT((out) || (n == 0));
+
+   transform_v3d(m, n, in, out, FALSE);
+}
+
+
+
+/* apply_matrix_v3d_f:
+ *  Floating point version of apply_matrix_v3d().
+ */
+void apply_matrix_v3d_f(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out)
+{
+   ASSERT(m);
+   ASSERT(n >= 0);
+   ASSERT((in) || (n == 0));
+   ASSERT((out) || (n == 0));
+
+   transform_v3d_f(m, n, in, out, FALSE);
+}
+
+
+
+/* persp_project_v3d:
+ *  Projects n vertices into screen space like persp_project(), after
+ *  first multiplying them by m unless that is NULL. The z coordinates
+ *  are kept so the results can go straight to polygon3d().
+ */
+void persp_project_v3d(AL_CONST MATRIX *m, int n, AL_CONST V3D *in, V3D *out)
+{
+   ASSERT(n >= 0);
+   ASSERT((in) || (n == 0));
+   ASSERT((out) || (n == 0));
+
+   transform_v3d(m, n, in, out, TRUE);
+}
+
+
+
+/* persp_project_v3d_f:
+ *  Floating point version of persp_project_v3d().
+ */
+void persp_project_v3d_f(AL_CONST MATRIX_f *m, int n, AL_CONST V3D_f *in, V3D_f *out)
+{
+   ASSERT(n >= 0);
+   ASSERT((in) || (n == 0));
+   ASSERT((out) || (n == 0));
+
+   transform_v3d_f(m, n, in, out, TRUE);
+}
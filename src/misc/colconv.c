@@ -67,10 +67,7 @@ static void build_rgb_scale_5235_table(int to_depth)
    /* 2nd table: g3b5 to r0g8b8 */
    for (i=0; i<256; i++) {
       blue = _rgb_scale_5[i&0x1f];
-      green=(i>>5)<<3;
-
-      if (green == 0x38)
-          green++;
+      green=((i>>5)<<3)+((i>>5)>>2);
 
       color = (green<<8) | blue;
       _colorconv_rgb_scale_5x35[256+i] = color;
@@ -101,13 +98,7 @@ static void build_rgb_scale_5335_table(int to_depth)
    /* 1st table: r5g3 to r8g8b0 */ 
    for (i=0; i<256; i++) {
       red = _rgb_scale_5[i>>3];
-      green=(i&7)<<5;
-
-      if (green >= 68)
-           green++;
-
-       if (green >= 160)
-           green++;
+      green=((i&7)<<5)+((i&7)>>1);
 
       color = (red<<16) | (green<<8);
       _colorconv_rgb_scale_5x35[i] = color;
@@ -123,9 +114,6 @@ static void build_rgb_scale_5335_table(int to_depth)
       blue = _rgb_scale_5[i&0x1f];
       green=(i>>5)<<2;
 
-      if (green == 0x1c)
-          green++;
-
       color = (green<<8) | blue;
       _colorconv_rgb_scale_5x35[256+i] = color;
 
@@ -238,6 +226,16 @@ unsigned char *_get_colorconv_map(void)
  */
 COLORCONV_BLITTER_FUNC *_get_colorconv_blitter(int from_depth, int to_depth)
 {
+   COLORCONV_BLITTER_FUNC *blitter;
+
+   /* vectorized versions, see src/c/cconv.c */
+   blitter = _get_colorconv_simd_blitter(from_depth, to_depth);
+   if (blitter) {
+      if (from_depth == 8)
+         create_indexed_palette(to_depth);
+      return blitter;
+   }
+
    switch (from_depth) {
 
 #ifdef ALLEGRO_COLOR8
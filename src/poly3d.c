@@ -24,9 +24,11 @@
 
 #include <limits.h>
 #include <float.h>
+#include <string.h>
 
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
+#include "c/csimd.h"
 
 #if defined ALLEGRO_ASMCAPA_HEADER && !defined ALLEGRO_NO_ASM
    #include ALLEGRO_ASMCAPA_HEADER
@@ -48,6 +50,33 @@ ZBUFFER *_zbuffer = NULL;
 SCANLINE_FILLER _optim_alternative_drawer;
 
 
+/* Hierarchical z-buffers keep, for each 8x8 tile, a value which is no
+ * larger than any 1/z stored in the tile. Drawing only ever makes 1/z
+ * values larger, so the bound stays valid without being touched and is
+ * just refreshed now and then to make it tighter. Polygons and spans whose
+ * nearest point is no nearer than that are hidden and can be skipped.
+ */
+#define ZTILE_SHIFT     3
+
+typedef struct ZBUFFER_TILES
+{
+   int refcount;                    /* shared with the sub-z-buffers */
+   BITMAP *root;                    /* the z-buffer they cover */
+   int w, h;                        /* size in tiles */
+   float *zmin;                     /* lower bound of 1/z in each tile */
+   unsigned char *dirty;            /* drawn on since zmin was computed */
+} ZBUFFER_TILES;
+
+
+/* bounding box and nearest depth of a polygon being culled */
+typedef struct ZCULL
+{
+   ZBUFFER_TILES *tiles;
+   int x1, y1, x2, y2;              /* in root z-buffer coordinates */
+   float z;
+} ZCULL;
+
+
 /* _fill_3d_edge_structure:
  *  Polygon helper function: initialises an edge structure for the 3d 
  *  rasterising code, using fixed point vertex structures. Returns 1 on
@@ -775,6 +804,126 @@ SCANLINE_FILLER _get_scanline_filler(int type, int *flags, POLYGON_SEGMENT *info
    };
    #endif
 
+   #ifdef ALLEGRO_SIMD
+   #ifdef ALLEGRO_COLOR16
+   static POLYTYPE_INFO polytype_info15s[] =
+   {
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_simd15,          _poly_scanline_atex16 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_mask_simd15,     _poly_scanline_atex_mask15 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_lit_simd15,      _poly_scanline_atex_lit15 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_mask_lit_simd15, _poly_scanline_atex_mask_lit15 },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL }
+   };
+
+   static POLYTYPE_INFO polytype_info16s[] =
+   {
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_simd16,          _poly_scanline_atex16 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_mask_simd16,     _poly_scanline_atex_mask16 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_lit_simd16,      _poly_scanline_atex_lit16 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_mask_lit_simd16, _poly_scanline_atex_mask_lit16 },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL }
+   };
+
+   static POLYTYPE_INFO polytype_info15zs[] =
+   {
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_simd15,          _poly_zbuf_atex16 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_mask_simd15,     _poly_zbuf_atex_mask15 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_lit_simd15,      _poly_zbuf_atex_lit15 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_mask_lit_simd15, _poly_zbuf_atex_mask_lit15 },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL }
+   };
+
+   static POLYTYPE_INFO polytype_info16zs[] =
+   {
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_simd16,          _poly_zbuf_atex16 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_mask_simd16,     _poly_zbuf_atex_mask16 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_lit_simd16,      _poly_zbuf_atex_lit16 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_mask_lit_simd16, _poly_zbuf_atex_mask_lit16 },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL }
+   };
+   #endif
+
+   #ifdef ALLEGRO_COLOR32
+   static POLYTYPE_INFO polytype_info32s[] =
+   {
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_simd32,          _poly_scanline_atex32 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_mask_simd32,     _poly_scanline_atex_mask32 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_lit_simd32,      _poly_scanline_atex_lit32 },
+      {  NULL,                                NULL },
+      {  _poly_scanline_ptex_mask_lit_simd32, _poly_scanline_atex_mask_lit32 },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL },
+      {  NULL,                                NULL }
+   };
+
+   static POLYTYPE_INFO polytype_info32zs[] =
+   {
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_simd32,          _poly_zbuf_atex32 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_mask_simd32,     _poly_zbuf_atex_mask32 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_lit_simd32,      _poly_zbuf_atex_lit32 },
+      {  NULL,                            NULL },
+      {  _poly_zbuf_ptex_mask_lit_simd32, _poly_zbuf_atex_mask_lit32 },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL },
+      {  NULL,                            NULL }
+   };
+   #endif
+   #endif
+
    int zbuf = type & POLYTYPE_ZBUF;
 
    int *interpinfo;
@@ -784,6 +933,10 @@ SCANLINE_FILLER _get_scanline_filler(int type, int *flags, POLYGON_SEGMENT *info
    POLYTYPE_INFO *typeinfo_mmx, *typeinfo_3d;
    #endif
 
+   #ifdef ALLEGRO_SIMD
+   POLYTYPE_INFO *typeinfo_simd = NULL, *typeinfo_zbuf_simd = NULL;
+   #endif
+
    switch (bitmap_color_depth(bmp)) {
 
       #ifdef ALLEGRO_COLOR8
@@ -810,6 +963,12 @@ SCANLINE_FILLER _get_scanline_filler(int type, int *flags, POLYGON_SEGMENT *info
 	    typeinfo_3d = polytype_info15d;
 	 #endif
 	    typeinfo_zbuf = polytype_info15z;
+	 #ifdef ALLEGRO_SIMD
+	    if (_al_simd_ptex_row16) {
+	       typeinfo_simd = polytype_info15s;
+	       typeinfo_zbuf_simd = polytype_info15zs;
+	    }
+	 #endif
 	    break;
 
 	 case 16:
@@ -820,6 +979,12 @@ SCANLINE_FILLER _get_scanline_filler(int type, int *flags, POLYGON_SEGMENT *info
 	    typeinfo_3d = polytype_info16d;
 	 #endif
 	    typeinfo_zbuf = polytype_info16z;
+	 #ifdef ALLEGRO_SIMD
+	    if (_al_simd_ptex_row16) {
+	       typeinfo_simd = polytype_info16s;
+	       typeinfo_zbuf_simd = polytype_info16zs;
+	    }
+	 #endif
 	    break;
 
       #endif
@@ -848,6 +1013,12 @@ SCANLINE_FILLER _get_scanline_filler(int type, int *flags, POLYGON_SEGMENT *info
 	    typeinfo_3d = polytype_info32d;
 	 #endif
 	    typeinfo_zbuf = polytype_info32z;
+	 #ifdef ALLEGRO_SIMD
+	    if (_al_simd_ptex_row32) {
+	       typeinfo_simd = polytype_info32s;
+	       typeinfo_zbuf_simd = polytype_info32zs;
+	    }
+	 #endif
 	    break;
 
       #endif
@@ -877,10 +1048,23 @@ SCANLINE_FILLER _get_scanline_filler(int type, int *flags, POLYGON_SEGMENT *info
 
    if (zbuf) {
       *flags |= INTERP_Z + INTERP_ZBUF;
+      #ifdef ALLEGRO_SIMD
+      if ((typeinfo_zbuf_simd) && (typeinfo_zbuf_simd[type].filler)) {
+	 _optim_alternative_drawer = typeinfo_zbuf_simd[type].alternative;
+	 return typeinfo_zbuf_simd[type].filler;
+      }
+      #endif
       _optim_alternative_drawer = typeinfo_zbuf[type].alternative;
       return typeinfo_zbuf[type].filler;
    }
 
+   #ifdef ALLEGRO_SIMD
+   if ((typeinfo_simd) && (typeinfo_simd[type].filler)) {
+      _optim_alternative_drawer = typeinfo_simd[type].alternative;
+      return typeinfo_simd[type].filler;
+   }
+   #endif
+
    #ifdef ALLEGRO_MMX
    if ((cpu_capabilities & CPU_MMX) && (typeinfo_mmx[type].filler)) {
       if ((cpu_capabilities & CPU_3DNOW) && (typeinfo_3d[type].filler)) {
@@ -931,6 +1115,224 @@ void _clip_polygon_segment_f(POLYGON_SEGMENT *info, int gap, int flags)
 
 
 
+/* ztile_refresh:
+ *  Recomputes the bound of a tile from the z-buffer contents.
+ */
+static void ztile_refresh(ZBUFFER_TILES *zt, int tx, int ty)
+{
+   BITMAP *root = zt->root;
+   int x1 = tx << ZTILE_SHIFT;
+   int y1 = ty << ZTILE_SHIFT;
+   int x2 = MIN(x1 + (1 << ZTILE_SHIFT), root->w);
+   int y2 = MIN(y1 + (1 << ZTILE_SHIFT), root->h);
+   float m = FLT_MAX;
+   int x, y;
+
+   for (y = y1; y < y2; y++) {
+      float *zb = (float *)root->line[y];
+
+      for (x = x1; x < x2; x++) {
+	 if (zb[x] < m)
+	    m = zb[x];
+      }
+   }
+
+   zt->zmin[ty * zt->w + tx] = m;
+   zt->dirty[ty * zt->w + tx] = FALSE;
+}
+
+
+
+/* zcull_bound:
+ *  Adds some slack to the nearest 1/z of a polygon, covering the rounding
+ *  of the interpolation done by the scanline fillers.
+ */
+static INLINE float zcull_bound(float z)
+{
+   return z + ((z < 0) ? -z : z) * (1.0 / 1024);
+}
+
+
+
+/* zcull_hidden:
+ *  Checks the tiles covering a box, in root z-buffer coordinates, against
+ *  the nearest 1/z of a polygon. Dirty tiles are refreshed first if asked.
+ */
+static int zcull_hidden(ZBUFFER_TILES *zt, int x1, int y1, int x2, int y2, float z, int refresh)
+{
+   int tx, ty, i;
+
+   x1 = MAX(x1, 0) >> ZTILE_SHIFT;
+   y1 = MAX(y1, 0) >> ZTILE_SHIFT;
+   x2 = MIN(x2, zt->root->w - 1) >> ZTILE_SHIFT;
+   y2 = MIN(y2, zt->root->h - 1) >> ZTILE_SHIFT;
+
+   for (ty = y1; ty <= y2; ty++) {
+      for (tx = x1; tx <= x2; tx++) {
+	 i = ty * zt->w + tx;
+
+	 if ((refresh) && (zt->dirty[i]) && (zt->zmin[i] < z))
+	    ztile_refresh(zt, tx, ty);
+
+	 if (zt->zmin[i] < z)
+	    return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+
+/* zcull_touch:
+ *  Marks the tiles covering the box of a polygon as drawn on.
+ */
+static void zcull_touch(ZCULL *zc)
+{
+   ZBUFFER_TILES *zt = zc->tiles;
+   int x1 = MAX(zc->x1, 0) >> ZTILE_SHIFT;
+   int y1 = MAX(zc->y1, 0) >> ZTILE_SHIFT;
+   int x2 = MIN(zc->x2, zt->root->w - 1) >> ZTILE_SHIFT;
+   int y2 = MIN(zc->y2, zt->root->h - 1) >> ZTILE_SHIFT;
+   int ty;
+
+   if ((x1 > x2) || (y1 > y2))
+      return;
+
+   for (ty = y1; ty <= y2; ty++)
+      memset(zt->dirty + ty * zt->w + x1, TRUE, x2 - x1 + 1);
+}
+
+
+
+/* zcull_box:
+ *  Finishes setting up a ZCULL from the screen box of a polygon, clipping
+ *  it and moving it to root z-buffer coordinates. Returns TRUE if the
+ *  polygon is hidden.
+ */
+static int zcull_box(BITMAP *bmp, ZCULL *zc)
+{
+   if (bmp->clip) {
+      zc->x1 = MAX(zc->x1, bmp->cl);
+      zc->y1 = MAX(zc->y1, bmp->ct);
+      zc->x2 = MIN(zc->x2, bmp->cr - 1);
+      zc->y2 = MIN(zc->y2, bmp->cb - 1);
+   }
+
+   zc->x1 += _zbuffer->x_ofs;
+   zc->x2 += _zbuffer->x_ofs;
+   zc->y1 += _zbuffer->y_ofs;
+   zc->y2 += _zbuffer->y_ofs;
+
+   if ((zc->x1 > zc->x2) || (zc->y1 > zc->y2))
+      return TRUE;
+
+   zc->z = zcull_bound(zc->z);
+
+   return zcull_hidden(zc->tiles, zc->x1, zc->y1, zc->x2, zc->y2, zc->z, TRUE);
+}
+
+
+
+/* zcull_polygon:
+ *  Sets up culling of a z-buffered polygon against the hierarchical
+ *  z-buffer, if there is one. Returns TRUE if the polygon is hidden.
+ */
+static int zcull_polygon(BITMAP *bmp, int type, int vc, V3D *vtx[], ZCULL *zc)
+{
+   fixed x1, y1, x2, y2, z;
+   int c;
+
+   zc->tiles = NULL;
+
+   if ((!(type & POLYTYPE_ZBUF)) || (!_zbuffer) || (!_zbuffer->extra))
+      return FALSE;
+
+   x1 = x2 = vtx[0]->x;
+   y1 = y2 = vtx[0]->y;
+   z = vtx[0]->z;
+
+   for (c=1; c<vc; c++) {
+      x1 = MIN(x1, vtx[c]->x);
+      x2 = MAX(x2, vtx[c]->x);
+      y1 = MIN(y1, vtx[c]->y);
+      y2 = MAX(y2, vtx[c]->y);
+      z = MIN(z, vtx[c]->z);
+   }
+
+   if (z <= 0)
+      return FALSE;
+
+   zc->tiles = _zbuffer->extra;
+   zc->x1 = fixfloor(x1);
+   zc->y1 = fixfloor(y1);
+   zc->x2 = fixceil(x2);
+   zc->y2 = fixceil(y2);
+   zc->z = 65536. / z;
+
+   return zcull_box(bmp, zc);
+}
+
+
+
+/* zcull_polygon_f:
+ *  Floating point version of zcull_polygon().
+ */
+static int zcull_polygon_f(BITMAP *bmp, int type, int vc, V3D_f *vtx[], ZCULL *zc)
+{
+   float x1, y1, x2, y2, z;
+   int c;
+
+   zc->tiles = NULL;
+
+   if ((!(type & POLYTYPE_ZBUF)) || (!_zbuffer) || (!_zbuffer->extra))
+      return FALSE;
+
+   x1 = x2 = vtx[0]->x;
+   y1 = y2 = vtx[0]->y;
+   z = vtx[0]->z;
+
+   for (c=1; c<vc; c++) {
+      x1 = MIN(x1, vtx[c]->x);
+      x2 = MAX(x2, vtx[c]->x);
+      y1 = MIN(y1, vtx[c]->y);
+      y2 = MAX(y2, vtx[c]->y);
+      z = MIN(z, vtx[c]->z);
+   }
+
+   /* leave anything odd, or out of fixed point range, to the per pixel test */
+   if ((!(z > 0)) || (!(x1 > -32000.0)) || (!(x2 < 32000.0)) ||
+       (!(y1 > -32000.0)) || (!(y2 < 32000.0)))
+      return FALSE;
+
+   zc->tiles = _zbuffer->extra;
+   zc->x1 = fixfloor(ftofix(x1));
+   zc->y1 = fixfloor(ftofix(y1));
+   zc->x2 = fixceil(ftofix(x2));
+   zc->y2 = fixceil(ftofix(y2));
+   zc->z = 1. / z;
+
+   return zcull_box(bmp, zc);
+}
+
+
+
+/* zcull_span:
+ *  Checks whether a z-buffered span is hidden by the tiles it crosses.
+ */
+static int zcull_span(int x, int y, int w, POLYGON_SEGMENT *info)
+{
+   ZBUFFER_TILES *zt = _zbuffer->extra;
+   float z = MAX(info->z, info->z + info->dz * (w - 1));
+
+   x += _zbuffer->x_ofs;
+   y += _zbuffer->y_ofs;
+
+   return zcull_hidden(zt, x, y, x + w - 1, y, zcull_bound(z), FALSE);
+}
+
+
+
 /* draw_polygon_segment: 
  *  Polygon helper function to fill a scanline. Calculates deltas for 
  *  whichever values need interpolating, clips the segment, and then calls
@@ -1061,11 +1463,18 @@ static void draw_polygon_segment(BITMAP *bmp, int ytop, int ybottom, POLYGON_EDG
 	       drawer = _optim_alternative_drawer;
 	    }
 
-            if (flags & INTERP_ZBUF) 
+            if (flags & INTERP_ZBUF) {
+	       /* the whole span may be hidden */
+	       if ((_zbuffer->extra) && (zcull_span(x, y, w, info)))
+		  w = 0;
+
                info->zbuf_addr = bmp_write_line(_zbuffer, y) + x * sizeof(float);
+	    }
 
-	    info->read_addr = bmp_read_line(bmp, y) + dx;
-	    drawer(bmp_write_line(bmp, y) + dx, w, info);
+	    if (w > 0) {
+	       info->read_addr = bmp_read_line(bmp, y) + dx;
+	       drawer(bmp_write_line(bmp, y) + dx, w, info);
+	    }
 	 }
       }
 
@@ -1151,11 +1560,16 @@ void _soft_polygon3d(BITMAP *bmp, int type, BITMAP *texture, int vc, V3D *vtx[])
    POLYGON_EDGE *list_edges = NULL;
    POLYGON_SEGMENT info;
    SCANLINE_FILLER drawer;
+   ZCULL zc;
    ASSERT(bmp);
 
    if (vc < 3)
       return;
 
+   /* skip it if the hierarchical z-buffer shows that it is hidden */
+   if (zcull_polygon(bmp, type, vc, vtx, &zc))
+      return;
+
    /* set up the drawing mode */
    drawer = _get_scanline_filler(type, &flags, &info, texture, bmp);
    if (!drawer)
@@ -1198,6 +1612,9 @@ void _soft_polygon3d(BITMAP *bmp, int type, BITMAP *texture, int vc, V3D *vtx[])
 
       /* render the polygon */
       do_polygon3d(bmp, top, bottom, start_edge, drawer, flags, vtx[0]->c, &info);
+
+      if (zc.tiles)
+	 zcull_touch(&zc);
    }
 }
 
@@ -1217,11 +1634,16 @@ void _soft_polygon3d_f(BITMAP *bmp, int type, BITMAP *texture, int vc, V3D_f *vt
    POLYGON_EDGE *list_edges = NULL;
    POLYGON_SEGMENT info;
    SCANLINE_FILLER drawer;
+   ZCULL zc;
    ASSERT(bmp);
 
    if (vc < 3)
       return;
 
+   /* skip it if the hierarchical z-buffer shows that it is hidden */
+   if (zcull_polygon_f(bmp, type, vc, vtx, &zc))
+      return;
+
    /* set up the drawing mode */
    drawer = _get_scanline_filler(type, &flags, &info, texture, bmp);
    if (!drawer)
@@ -1264,6 +1686,9 @@ void _soft_polygon3d_f(BITMAP *bmp, int type, BITMAP *texture, int vc, V3D_f *vt
 
       /* render the polygon */
       do_polygon3d(bmp, top, bottom, start_edge, drawer, flags, vtx[0]->c, &info);
+
+      if (zc.tiles)
+	 zcull_touch(&zc);
    }
 }
 
@@ -1367,11 +1792,18 @@ static void draw_triangle_part(BITMAP *bmp, int ytop, int ybottom, POLYGON_EDGE
 	       drawer = _optim_alternative_drawer;
 	    }
 
-            if (flags & INTERP_ZBUF) 
+            if (flags & INTERP_ZBUF) {
+	       /* the whole span may be hidden */
+	       if ((_zbuffer->extra) && (zcull_span(x, y, w, info)))
+		  w = 0;
+
                info->zbuf_addr = bmp_write_line(_zbuffer, y) + x * sizeof(float);
+	    }
 
-	    info->read_addr = bmp_read_line(bmp, y) + dx;
-	    drawer(bmp_write_line(bmp, y) + dx, w, info);
+	    if (w > 0) {
+	       info->read_addr = bmp_read_line(bmp, y) + dx;
+	       drawer(bmp_write_line(bmp, y) + dx, w, info);
+	    }
 	 }
       }
 
@@ -1536,11 +1968,20 @@ void _soft_triangle3d(BITMAP *bmp, int type, BITMAP *texture, V3D *v1, V3D *v2,
 
    int color = v1->c;
    V3D *vt1, *vt2, *vt3;
+   V3D *vtx[3];
    POLYGON_EDGE edge1, edge2;
    POLYGON_SEGMENT info;
    SCANLINE_FILLER drawer;
+   ZCULL zc;
    ASSERT(bmp);
 
+   /* skip it if the hierarchical z-buffer shows that it is hidden */
+   vtx[0] = v1;
+   vtx[1] = v2;
+   vtx[2] = v3;
+   if (zcull_polygon(bmp, type, 3, vtx, &zc))
+      return;
+
    /* set up the drawing mode */
    drawer = _get_scanline_filler(type, &flags, &info, texture, bmp);
    if (!drawer)
@@ -1602,6 +2043,9 @@ void _soft_triangle3d(BITMAP *bmp, int type, BITMAP *texture, V3D *v1, V3D *v2,
 
       bmp_unwrite_line(bmp);
       release_bitmap(bmp);
+
+      if (zc.tiles)
+	 zcull_touch(&zc);
    }
 
    /* reset fpu mode */
@@ -1626,11 +2070,20 @@ void _soft_triangle3d_f(BITMAP *bmp, int type, BITMAP *texture, V3D_f *v1, V3D_f
 
    int color = v1->c;
    V3D_f *vt1, *vt2, *vt3;
+   V3D_f *vtx[3];
    POLYGON_EDGE edge1, edge2;
    POLYGON_SEGMENT info;
    SCANLINE_FILLER drawer;
+   ZCULL zc;
    ASSERT(bmp);
 
+   /* skip it if the hierarchical z-buffer shows that it is hidden */
+   vtx[0] = v1;
+   vtx[1] = v2;
+   vtx[2] = v3;
+   if (zcull_polygon_f(bmp, type, 3, vtx, &zc))
+      return;
+
    /* set up the drawing mode */
    drawer = _get_scanline_filler(type, &flags, &info, texture, bmp);
    if (!drawer)
@@ -1692,6 +2145,9 @@ void _soft_triangle3d_f(BITMAP *bmp, int type, BITMAP *texture, V3D_f *v1, V3D_f
 
       bmp_unwrite_line(bmp);
       release_bitmap(bmp);
+
+      if (zc.tiles)
+	 zcull_touch(&zc);
    }
 
    /* reset fpu mode */
@@ -1768,6 +2224,56 @@ ZBUFFER *create_zbuffer(BITMAP *bmp)
 
 
 
+/* create_hierarchical_zbuffer:
+ *  Creates a new Z-buffer the size of the given bitmap, which also keeps
+ *  track of the farthest depth in each 8x8 tile so that hidden polygons
+ *  and spans can be skipped before they are rasterised.
+ */
+ZBUFFER *create_hierarchical_zbuffer(BITMAP *bmp)
+{
+   ZBUFFER *zbuf;
+   ZBUFFER_TILES *zt;
+   int n;
+   ASSERT(bmp);
+
+   zbuf = create_zbuffer(bmp);
+   if (!zbuf)
+      return NULL;
+
+   zt = _AL_MALLOC(sizeof(ZBUFFER_TILES));
+   if (!zt) {
+      destroy_bitmap(zbuf);
+      return NULL;
+   }
+
+   zt->refcount = 1;
+   zt->root = zbuf;
+   zt->w = (zbuf->w + (1 << ZTILE_SHIFT) - 1) >> ZTILE_SHIFT;
+   zt->h = (zbuf->h + (1 << ZTILE_SHIFT) - 1) >> ZTILE_SHIFT;
+   n = zt->w * zt->h;
+
+   zt->zmin = _AL_MALLOC(n * sizeof(float));
+   zt->dirty = _AL_MALLOC(n);
+
+   if ((!zt->zmin) || (!zt->dirty)) {
+      if (zt->zmin) _AL_FREE(zt->zmin);
+      if (zt->dirty) _AL_FREE(zt->dirty);
+      _AL_FREE(zt);
+      destroy_bitmap(zbuf);
+      return NULL;
+   }
+
+   /* the contents are undefined until the first clear_zbuffer() */
+   for (n--; n >= 0; n--)
+      zt->zmin[n] = -FLT_MAX;
+   memset(zt->dirty, TRUE, zt->w * zt->h);
+
+   zbuf->extra = zt;
+   return zbuf;
+}
+
+
+
 /* clear_zbuffer:
  *  Clears the given z-buffer, z is the value written in the z-buffer
  *  - it is 1/(z coordinate), z=0 meaning far away.
@@ -1782,6 +2288,36 @@ void clear_zbuffer(ZBUFFER *zbuf, float z)
 
    _zbuf_clip.zf = z;
    clear_to_color(zbuf, _zbuf_clip.zi);
+
+   if (zbuf->extra) {
+      ZBUFFER_TILES *zt = zbuf->extra;
+      int x1 = zbuf->cl + zbuf->x_ofs;
+      int y1 = zbuf->ct + zbuf->y_ofs;
+      int x2 = zbuf->cr + zbuf->x_ofs;
+      int y2 = zbuf->cb + zbuf->y_ofs;
+      int tx, ty, i;
+
+      for (ty = y1 >> ZTILE_SHIFT; ty <= (y2 - 1) >> ZTILE_SHIFT; ty++) {
+	 for (tx = x1 >> ZTILE_SHIFT; tx <= (x2 - 1) >> ZTILE_SHIFT; tx++) {
+	    int tx1 = tx << ZTILE_SHIFT;
+	    int ty1 = ty << ZTILE_SHIFT;
+	    int tx2 = MIN(tx1 + (1 << ZTILE_SHIFT), zt->root->w);
+	    int ty2 = MIN(ty1 + (1 << ZTILE_SHIFT), zt->root->h);
+
+	    i = ty * zt->w + tx;
+
+	    /* tiles cut by the edge of the cleared area keep some old values */
+	    if ((tx1 >= x1) && (ty1 >= y1) && (tx2 <= x2) && (ty2 <= y2)) {
+	       zt->zmin[i] = z;
+	       zt->dirty[i] = FALSE;
+	    }
+	    else {
+	       zt->zmin[i] = MIN(zt->zmin[i], z);
+	       zt->dirty[i] = TRUE;
+	    }
+	 }
+      }
+   }
 }
 
 
@@ -1794,6 +2330,19 @@ void destroy_zbuffer(ZBUFFER *zbuf)
    if (zbuf) {
       if (zbuf == _zbuffer)
 	 _zbuffer = NULL;
+
+      if (zbuf->extra) {
+	 ZBUFFER_TILES *zt = zbuf->extra;
+
+	 if (--zt->refcount == 0) {
+	    _AL_FREE(zt->zmin);
+	    _AL_FREE(zt->dirty);
+	    _AL_FREE(zt);
+	 }
+
+	 zbuf->extra = NULL;
+      }
+
       destroy_bitmap(zbuf);
    }
 }
@@ -1817,7 +2366,18 @@ void set_zbuffer(ZBUFFER *zbuf)
  */
 ZBUFFER *create_sub_zbuffer(ZBUFFER *parent, int x, int y, int width, int height)
 {
+   ZBUFFER *zbuf;
    ASSERT(parent);
+
    /* For now, just use the code for BITMAPs. */
-   return create_sub_bitmap(parent, x, y, width, height);
+   zbuf = create_sub_bitmap(parent, x, y, width, height);
+
+   /* share the tiles of a hierarchical z-buffer */
+   if ((zbuf) && (parent->extra)) {
+      ZBUFFER_TILES *zt = parent->extra;
+      zt->refcount++;
+      zbuf->extra = zt;
+   }
+
+   return zbuf;
 }
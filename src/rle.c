@@ -20,6 +20,158 @@
 
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
+#include "c/csimd.h"
+
+
+
+/* rle_span:
+ *  Returns the number of pixels from x on in a line of a memory bitmap
+ *  which are solid (if solid is set) or masked. As in draw_rle_sprite(),
+ *  only the low 24 bits of 32-bit pixels count.
+ */
+static int rle_span(AL_CONST unsigned char *line, int x, int w, int depth, int mask, int solid)
+{
+   int n;
+
+   solid = (solid != 0);
+
+   switch (depth) {
+
+      case 8:
+#ifdef ALLEGRO_SIMD
+	 if (_al_simd_span_row8)
+	    return _al_simd_span_row8(line + x, w - x, mask, solid);
+#endif
+	 for (n = x; (n < w) && ((line[n] != mask) == solid); n++)
+	    ;
+	 return n - x;
+
+      case 15:
+      case 16:
+#ifdef ALLEGRO_SIMD
+	 if (_al_simd_span_row16)
+	    return _al_simd_span_row16((uint16_t *)line + x, w - x, mask, solid);
+#endif
+	 for (n = x; (n < w) && ((((uint16_t *)line)[n] != mask) == solid); n++)
+	    ;
+	 return n - x;
+
+      case 24:
+	 for (n = x; (n < w) && (((int)READ3BYTES(line + n * 3) != mask) == solid); n++)
+	    ;
+	 return n - x;
+
+      case 32:
+#ifdef ALLEGRO_SIMD
+	 if (_al_simd_span_row32)
+	    return _al_simd_span_row32((uint32_t *)line + x, w - x, mask, solid);
+#endif
+	 for (n = x; (n < w) && ((int)((((uint32_t *)line)[n] & 0xFFFFFF) != (uint32_t)mask) == solid); n++)
+	    ;
+	 return n - x;
+   }
+
+   return w - x;
+}
+
+
+
+/* rle_encode:
+ *  Encodes a memory bitmap, or just counts the data elements needed if
+ *  p is NULL. Solid runs are split every 127 pixels, gaps every 128.
+ */
+static int rle_encode(BITMAP *bitmap, void *p)
+{
+   int depth = bitmap_color_depth(bitmap);
+   int mask = bitmap->vtable->mask_color;
+   int size = BYTES_PER_PIXEL(depth);
+   signed char *p8 = p;
+   int16_t *p16 = p;
+   int32_t *p32 = p;
+   int c = 0;
+   int x, y, n, run;
+
+   for (y=0; y<bitmap->h; y++) {
+      unsigned char *line = bitmap->line[y];
+
+      for (x=0; x<bitmap->w; ) {
+	 /* solid pixels */
+	 n = rle_span(line, x, bitmap->w, depth, mask, TRUE);
+
+	 while (n > 0) {
+	    run = MIN(n, 127);
+
+	    if (p) {
+	       switch (depth) {
+
+		  case 8:
+		     p8[c] = run;
+		     memcpy(p8 + c + 1, line + x, run);
+		     break;
+
+		  case 15:
+		  case 16:
+		     p16[c] = run;
+		     memcpy(p16 + c + 1, line + x * 2, run * 2);
+		     break;
+
+		  case 24: {
+		     unsigned char *s = line + x * 3;
+		     int i;
+		     p32[c] = run;
+		     for (i = 1; i <= run; i++, s += 3)
+			p32[c+i] = READ3BYTES(s);
+		     break;
+		  }
+
+		  case 32:
+		     p32[c] = run;
+		     memcpy(p32 + c + 1, line + x * 4, run * 4);
+		     break;
+	       }
+	    }
+
+	    c += 1 + run;
+	    x += run;
+	    n -= run;
+	 }
+
+	 if (x >= bitmap->w)
+	    break;
+
+	 /* masked pixels */
+	 n = rle_span(line, x, bitmap->w, depth, mask, FALSE);
+	 x += n;
+
+	 for (; n > 0; n -= run, c++) {
+	    run = MIN(n, 128);
+
+	    if (p) {
+	       if (size == 1)
+		  p8[c] = -run;
+	       else if (size == 2)
+		  p16[c] = -run;
+	       else
+		  p32[c] = -run;
+	    }
+	 }
+      }
+
+      /* end of line */
+      if (p) {
+	 if (size == 1)
+	    p8[c] = mask;
+	 else if (size == 2)
+	    p16[c] = mask;
+	 else
+	    p32[c] = mask;
+      }
+
+      c++;
+   }
+
+   return c;
+}
 
 
 
@@ -36,110 +188,30 @@
  *  For truecolor RLE sprites, the data and command bytes are both in the
  *  same format (16 or 32 bits, 24 bpp data is padded to 32 bit aligment), 
  *  and the mask color (bright pink) is used as the EOL marker.
+ *
+ *  The lines are read directly, so other bitmaps are copied to a memory
+ *  bitmap first. The encoder runs twice, once to size the sprite and
+ *  once to fill it in.
  */
 RLE_SPRITE *get_rle_sprite(BITMAP *bitmap)
 {
-   int depth;
+   BITMAP *tmp = NULL;
    RLE_SPRITE *s;
-   int x, y;
-   int run;
-   int pix;
+   int depth;
    int c;
    ASSERT(bitmap);
    
    depth = bitmap_color_depth(bitmap);
 
-   #define WRITE_TO_SPRITE8(x) {                                             \
-      _grow_scratch_mem(c+1);                                                \
-      p = (signed char *)_scratch_mem;                                       \
-      p[c] = x;                                                              \
-      c++;                                                                   \
-   }
-
-   #define WRITE_TO_SPRITE16(x) {                                            \
-      _grow_scratch_mem((c+1)*sizeof(int16_t));                              \
-      p = (int16_t *)_scratch_mem;                                           \
-      p[c] = x;                                                              \
-      c++;                                                                   \
-   }
-
-   #define WRITE_TO_SPRITE32(x) {                                            \
-      _grow_scratch_mem((c+1)*sizeof(int32_t));                              \
-      p = (int32_t *)_scratch_mem;                                           \
-      p[c] = x;                                                              \
-      c++;                                                                   \
+   if (!is_memory_bitmap(bitmap)) {
+      tmp = create_bitmap_ex(depth, bitmap->w, bitmap->h);
+      if (!tmp)
+	 return NULL;
+      blit(bitmap, tmp, 0, 0, 0, 0, bitmap->w, bitmap->h);
+      bitmap = tmp;
    }
 
-   /* helper for building an RLE run */
-   #define DO_RLE(bits)                                                      \
-   {                                                                         \
-      for (y=0; y<bitmap->h; y++) {                                          \
-	 run = -1;                                                           \
-	 for (x=0; x<bitmap->w; x++) {                                       \
-	    pix = getpixel(bitmap, x, y) & 0xFFFFFF;                         \
-	    if (pix != bitmap->vtable->mask_color) {                         \
-	       if ((run >= 0) && (p[run] > 0) && (p[run] < 127))             \
-		  p[run]++;                                                  \
-	       else {                                                        \
-		  run = c;                                                   \
-		  WRITE_TO_SPRITE##bits(1);                                  \
-	       }                                                             \
-	       WRITE_TO_SPRITE##bits(getpixel(bitmap, x, y));                \
-	    }                                                                \
-	    else {                                                           \
-	       if ((run >= 0) && (p[run] < 0) && (p[run] > -128))            \
-		  p[run]--;                                                  \
-	       else {                                                        \
-		  run = c;                                                   \
-		  WRITE_TO_SPRITE##bits(-1);                                 \
-	       }                                                             \
-	    }                                                                \
-	 }                                                                   \
-	 WRITE_TO_SPRITE##bits(bitmap->vtable->mask_color);                  \
-      }                                                                      \
-   }
-
-   c = 0;
-
-   switch (depth) {
-
-      #ifdef ALLEGRO_COLOR8
-
-	 case 8:
-	    {
-	       signed char *p = (signed char *)_scratch_mem;
-	       DO_RLE(8);
-	    }
-	    break;
-
-      #endif
-
-      #ifdef ALLEGRO_COLOR16
-
-	 case 15:
-	 case 16:
-	    {
-	       signed short *p = (signed short *)_scratch_mem;
-	       DO_RLE(16);
-	       c *= sizeof(short);
-	    }
-	    break;
-
-      #endif
-
-      #if (defined ALLEGRO_COLOR24) || (defined ALLEGRO_COLOR32)
-
-	 case 24:
-	 case 32:
-	    {
-	       int32_t *p = (int32_t *)_scratch_mem;
-	       DO_RLE(32);
-	       c *= sizeof(int32_t);
-	    }
-	    break;
-
-      #endif
-   }
+   c = rle_encode(bitmap, NULL) * BYTES_PER_PIXEL(depth == 24 ? 32 : depth);
 
    s = _AL_MALLOC(sizeof(RLE_SPRITE) + c);
 
@@ -148,9 +220,12 @@ RLE_SPRITE *get_rle_sprite(BITMAP *bitmap)
       s->h = bitmap->h;
       s->color_depth = depth;
       s->size = c;
-      memcpy(s->dat, _scratch_mem, c);
+      rle_encode(bitmap, s->dat);
    }
 
+   if (tmp)
+      destroy_bitmap(tmp);
+
    return s;
 }
 
@@ -39,14 +39,52 @@ static int scene_npoly = 0, scene_maxpoly = 0;
 static BITMAP *scene_bmp;
 static COLOR_MAP *scene_cmap;
 static int scene_alpha;
-static int last_x, scene_y;
-static uintptr_t scene_addr;
-static float last_z;
 static POLYGON_EDGE **hash = NULL;
 
 float scene_gap = 100.0;
 
 
+/* scanline state for rendering a range of rows */
+typedef struct SCENE_STRIP
+{
+   int y1, y2;                      /* rows [y1, y2) */
+   int y;                           /* current row */
+   uintptr_t addr;                  /* current row address */
+   int last_x;
+   float last_z;
+   int set_state;                   /* segments set the blender globals */
+   POLYGON_EDGE *inact;             /* edges not yet reached */
+   POLYGON_EDGE *active;            /* edges active on the first row */
+} SCENE_STRIP;
+
+
+#ifdef ALLEGRO_WORKER_THREADS
+
+/* Scenes on large memory bitmaps can be rendered as horizontal strips by
+ * the worker threads. Every edge is entered in the bin of each strip it
+ * crosses when it is submitted, and each strip then runs the usual
+ * scanline algorithm on private copies of its edges and polygons.
+ */
+#define STRIPS_PER_THREAD  4
+#define STRIP_MIN_ROWS     (1 << HASH_SHIFT)
+#define SCENE_MAX_STRIPS   (_AL_MAX_WORKERS * STRIPS_PER_THREAD)
+
+typedef struct SCENE_BIN
+{
+   int *edge;                       /* indices into scene_edge */
+   int count, size;
+   int first;                       /* offset of the strip's copies */
+} SCENE_BIN;
+
+static SCENE_BIN scene_bin[SCENE_MAX_STRIPS];
+static int scene_strips = 0, scene_strip_h;
+static int scene_binned;            /* FALSE if it can't be split */
+static POLYGON_INFO *scene_state;   /* blender settings shared by */
+static POLYGON_INFO *scene_blend;   /* all the polygons */
+
+#endif
+
+
 
 /* create_scene:
  *  Allocate memory for a scene, nedge and npoly are your estimate of how
@@ -107,6 +145,24 @@ void clear_scene(BITMAP* bmp)
 
    for (i=0; i<HASH_NUM; i++)
       hash[i] = NULL;
+
+#ifdef ALLEGRO_WORKER_THREADS
+   /* decide whether the scene will be split into strips */
+   scene_strips = _drawing_bands(bmp, bmp->cr - bmp->cl, bmp->cb - bmp->ct) * STRIPS_PER_THREAD;
+   if (scene_strips > 0) {
+      int rows = bmp->cb - bmp->ct;
+
+      scene_strips = MIN(scene_strips, rows / STRIP_MIN_ROWS);
+      scene_strip_h = (rows + scene_strips - 1) / scene_strips;
+      scene_strips = (rows + scene_strip_h - 1) / scene_strip_h;
+
+      for (i=0; i<scene_strips; i++)
+	 scene_bin[i].count = 0;
+   }
+
+   scene_binned = (scene_strips > 1);
+   scene_state = scene_blend = NULL;
+#endif
 }
 
 
@@ -131,6 +187,22 @@ void destroy_scene(void)
       hash = NULL;
    }
 
+#ifdef ALLEGRO_WORKER_THREADS
+   {
+      int i;
+
+      for (i=0; i<SCENE_MAX_STRIPS; i++) {
+	 if (scene_bin[i].edge) {
+	    _AL_FREE(scene_bin[i].edge);
+	    scene_bin[i].edge = NULL;
+	 }
+	 scene_bin[i].count = scene_bin[i].size = 0;
+      }
+
+      scene_strips = 0;
+   }
+#endif
+
    scene_maxedge = scene_maxpoly = 0;
 }
 
@@ -138,10 +210,10 @@ void destroy_scene(void)
 
 /* _add_edge_hash:
  *  Adds an edge structure to a linked list, returning the new head pointer.
- *  This function uses hash tables when sort_by_x == FALSE to speed up edge
- *  sorting.
+ *  This function uses the hash table when sort_by_x == FALSE to speed up
+ *  edge sorting.
  */
-static POLYGON_EDGE *_add_edge_hash(POLYGON_EDGE *list, POLYGON_EDGE *edge, int sort_by_x)
+static POLYGON_EDGE *_add_edge_hash(POLYGON_EDGE *list, POLYGON_EDGE *edge, int sort_by_x, POLYGON_EDGE **table)
 {
    POLYGON_EDGE *pos = list;
    POLYGON_EDGE *prev = NULL;
@@ -160,8 +232,8 @@ static POLYGON_EDGE *_add_edge_hash(POLYGON_EDGE *list, POLYGON_EDGE *edge, int
       
       ASSERT(i < HASH_NUM);
 
-      if (hash[i]) {
-         pos = hash[i];
+      if (table[i]) {
+         pos = table[i];
          prev = pos->prev;
          empty = 0;
       }
@@ -173,7 +245,7 @@ static POLYGON_EDGE *_add_edge_hash(POLYGON_EDGE *list, POLYGON_EDGE *edge, int
       }
       
       if (first || empty)
-         hash[i] = edge;
+         table[i] = edge;
    }
    
    edge->next = pos;
@@ -390,6 +462,73 @@ static void init_poly(int type, POLYGON_INFO *poly)
 
 
 
+#ifdef ALLEGRO_WORKER_THREADS
+
+/* bin_poly:
+ *  Checks that a new polygon can be drawn with the same blender settings
+ *  as the others, since the strips can't change them while they run.
+ */
+static void bin_poly(POLYGON_INFO *poly)
+{
+   if (poly->flags & INTERP_NOSOLID)
+      scene_binned = FALSE;
+
+   if (!scene_state)
+      scene_state = poly;
+   else if ((poly->cmap != scene_state->cmap) || (poly->alpha != scene_state->alpha))
+      scene_binned = FALSE;
+
+   if (poly->flags & INTERP_BLEND) {
+      if (!scene_blend)
+	 scene_blend = poly;
+      else if ((poly->b15 != scene_blend->b15) || (poly->b16 != scene_blend->b16) ||
+	       (poly->b24 != scene_blend->b24) || (poly->b32 != scene_blend->b32))
+	 scene_binned = FALSE;
+   }
+}
+
+
+
+/* bin_edge:
+ *  Enters a new edge in the bins of all the strips it crosses.
+ */
+static void bin_edge(POLYGON_EDGE *edge)
+{
+   int s, s2;
+
+   /* edges outside the clipping rectangle stop the renderer early */
+   if ((edge->top < scene_bmp->ct) || (edge->bottom >= scene_bmp->cb)) {
+      scene_binned = FALSE;
+      return;
+   }
+
+   s = (edge->top - scene_bmp->ct) / scene_strip_h;
+   s2 = (edge->bottom - scene_bmp->ct) / scene_strip_h;
+
+   for (; s<=s2; s++) {
+      SCENE_BIN *bin = &scene_bin[s];
+
+      if (bin->count >= bin->size) {
+	 int size = MAX(bin->size * 2, 64);
+	 int *p = _AL_REALLOC(bin->edge, size * sizeof(int));
+
+	 if (!p) {
+	    scene_binned = FALSE;
+	    return;
+	 }
+
+	 bin->edge = p;
+	 bin->size = size;
+      }
+
+      bin->edge[bin->count++] = edge - scene_edge;
+   }
+}
+
+#endif
+
+
+
 /* scene_polygon3d:
  *  Put a polygon in the rendering list. Nothing is really rendered at this
  *  moment. Should be called between clear_scene() and render_scene().
@@ -422,6 +561,10 @@ int scene_polygon3d(int type, BITMAP *texture, int vc, V3D *vtx[])
 
    init_poly(type, poly);
    poly->color = vtx[0]->c;
+#ifdef ALLEGRO_WORKER_THREADS
+   if (scene_binned)
+      bin_poly(poly);
+#endif
    poly_plane(vtx, poly, vc);
 
    v2 = vtx[vc-1];
@@ -433,7 +576,11 @@ int scene_polygon3d(int type, BITMAP *texture, int vc, V3D *vtx[])
 
       if (_fill_3d_edge_structure(edge, v1, v2, poly->flags, scene_bmp)) {
          edge->poly = poly;
-	 scene_inact = _add_edge_hash(scene_inact, edge, FALSE);
+	 scene_inact = _add_edge_hash(scene_inact, edge, FALSE, hash);
+#ifdef ALLEGRO_WORKER_THREADS
+	 if (scene_binned)
+	    bin_edge(edge);
+#endif
 	 edge++;
          scene_nedge++;
       }
@@ -467,6 +614,10 @@ int scene_polygon3d_f(int type, BITMAP *texture, int vc, V3D_f *vtx[])
 
    init_poly(type, poly);
    poly->color = vtx[0]->c;
+#ifdef ALLEGRO_WORKER_THREADS
+   if (scene_binned)
+      bin_poly(poly);
+#endif
    poly_plane_f(vtx, poly, vc);
 
    v2 = vtx[vc-1];
@@ -478,7 +629,11 @@ int scene_polygon3d_f(int type, BITMAP *texture, int vc, V3D_f *vtx[])
 
       if (_fill_3d_edge_structure_f(edge, v1, v2, poly->flags, scene_bmp)) {
          edge->poly = poly;
-	 scene_inact = _add_edge_hash(scene_inact, edge, FALSE);
+	 scene_inact = _add_edge_hash(scene_inact, edge, FALSE, hash);
+#ifdef ALLEGRO_WORKER_THREADS
+	 if (scene_binned)
+	    bin_edge(edge);
+#endif
 	 edge++;
          scene_nedge++;
       }
@@ -492,8 +647,8 @@ int scene_polygon3d_f(int type, BITMAP *texture, int vc, V3D_f *vtx[])
  *  Draws a piece of the scanline, corresponding to a polygon. The start and
  *  end values for x are taken from e01 and e02, the polygon style from poly.
  */
-static void scene_segment(POLYGON_EDGE *e01, POLYGON_EDGE *e02,
-                          POLYGON_INFO *poly)
+static void scene_segment(SCENE_STRIP *strip, POLYGON_EDGE *e01,
+                          POLYGON_EDGE *e02, POLYGON_INFO *poly)
 {
    int x, w, gap, flags;
    fixed step, width;
@@ -506,8 +661,8 @@ static void scene_segment(POLYGON_EDGE *e01, POLYGON_EDGE *e02,
    POLYGON_SEGMENT *info = &poly->info, *dat1, *dat2;
    SCANLINE_FILLER drawer;
 
-   if ((x01 < last_x) && (z01 < last_z))
-      x01 = last_x;
+   if ((x01 < strip->last_x) && (z01 < strip->last_z))
+      x01 = strip->last_x;
    if (scene_bmp->clip) {
       if (x01 < scene_bmp->cl)
          x01 = scene_bmp->cl;
@@ -599,31 +754,33 @@ static void scene_segment(POLYGON_EDGE *e01, POLYGON_EDGE *e02,
    else
       drawer = poly->drawer;
 
-   color_map = poly->cmap;
-   _blender_alpha = poly->alpha;
-   if (flags & INTERP_BLEND) {
-      _blender_col_15 = poly->b15;
-      _blender_col_16 = poly->b16;
-      _blender_col_24 = poly->b24;
-      _blender_col_32 = poly->b32;
+   if (strip->set_state) {
+      color_map = poly->cmap;
+      _blender_alpha = poly->alpha;
+      if (flags & INTERP_BLEND) {
+         _blender_col_15 = poly->b15;
+         _blender_col_16 = poly->b16;
+         _blender_col_24 = poly->b24;
+         _blender_col_32 = poly->b32;
+      }
    }
 
    if (drawer == _poly_scanline_dummy) {
       if (flags & INTERP_NOSOLID) {
          drawing_mode(poly->dmode, poly->dpat, poly->xanchor, poly->yanchor);
-         scene_bmp->vtable->hfill(scene_bmp, x, scene_y, x+w-1, poly->color);
+         scene_bmp->vtable->hfill(scene_bmp, x, strip->y, x+w-1, poly->color);
          solid_mode();
       }
       else
-         scene_bmp->vtable->hfill(scene_bmp, x, scene_y, x+w-1, poly->color);
+         scene_bmp->vtable->hfill(scene_bmp, x, strip->y, x+w-1, poly->color);
    } 
    else {
       int dx = x * BYTES_PER_PIXEL(bitmap_color_depth(scene_bmp));
       if (flags & INTERP_ZBUF)
-         info->zbuf_addr = bmp_write_line(_zbuffer, scene_y) + x * sizeof(float);
+         info->zbuf_addr = bmp_write_line(_zbuffer, strip->y) + x * sizeof(float);
 
-      info->read_addr = bmp_read_line(scene_bmp, scene_y) + dx;
-      drawer(scene_addr + dx, w, info);
+      info->read_addr = bmp_read_line(scene_bmp, strip->y) + dx;
+      drawer(strip->addr + dx, w, info);
    }
 }
 
@@ -635,8 +792,8 @@ static void scene_segment(POLYGON_EDGE *e01, POLYGON_EDGE *e02,
  *  with x values from e1 and e2. At entry, p is the top polygon.
  *  Returns nonzero if something was drawn.
  */
-static int scene_trans_seg(POLYGON_EDGE *e1, POLYGON_EDGE *e2,
-                           POLYGON_INFO *p0, POLYGON_INFO *p)
+static int scene_trans_seg(SCENE_STRIP *strip, POLYGON_EDGE *e1,
+                           POLYGON_EDGE *e2, POLYGON_INFO *p0, POLYGON_INFO *p)
 {
    int c;
 
@@ -651,7 +808,7 @@ static int scene_trans_seg(POLYGON_EDGE *e1, POLYGON_EDGE *e2,
 
    /* p is first opaque or the very last */
    while (p) {
-      scene_segment(e1, e2, p);
+      scene_segment(strip, e1, e2, p);
       p = p->prev;
    }
    return 1;
@@ -659,52 +816,62 @@ static int scene_trans_seg(POLYGON_EDGE *e1, POLYGON_EDGE *e2,
 
 
 
-/* render_scene:
- *  Renders all the specified scene_polygon3d()'s on the bitmap passed to
- *  clear_scene(). Rendering is done one scanline at a time, with no pixel
- *  being processed more than once. Note that between clear_scene() and
- *  render_scene() you shouldn't change the clip rectangle of the destination
- *  bitmap. Also, all the textures passed to scene_polygon3d() are stored
- *  as pointers only and actually used in render_scene().
+/* step_edge:
+ *  Moves an edge down to the next scanline.
  */
-void render_scene(void)
+static void step_edge(POLYGON_EDGE *edge)
 {
-   int p;
-   #ifdef ALLEGRO_DOS
-      int old87 = 0;
-   #endif
-   POLYGON_EDGE *edge, *start_edge = NULL;
-   POLYGON_EDGE *active_edges = NULL, *last_edge = NULL;
-   POLYGON_INFO *active_poly = NULL;
+   POLYGON_SEGMENT *dat = &edge->dat;
+   int flags = edge->poly->flags;
 
-   ASSERT(scene_maxedge > 0);
-   ASSERT(scene_maxpoly > 0);
-   
-   scene_cmap = color_map;
-   scene_alpha = _blender_alpha;
-   solid_mode();
-   /* set fpu to single-precision, truncate mode */
-   #ifdef ALLEGRO_DOS
-      old87 = _control87(PC_24 | RC_CHOP, MCW_PC | MCW_RC);
-   #endif
+   edge->x += edge->dx;
+   dat->z += dat->dz;
 
-   acquire_bitmap(scene_bmp);
-   bmp_select(scene_bmp);
+   if (!(flags & INTERP_FLAT)) {
+      if (flags & INTERP_1COL)
+	 dat->c += dat->dc;
+
+      if (flags & INTERP_3COL) {
+	 dat->r += dat->dr;
+	 dat->g += dat->dg;
+	 dat->b += dat->db;
+      }
 
-   for (p=0; p<scene_npoly; p++) {
-      scene_poly[p].inside = 0;
+      if (flags & INTERP_FIX_UV) {
+	 dat->u += dat->du;
+	 dat->v += dat->dv;
+      }
+
+      if (flags & INTERP_FLOAT_UV) {
+	 dat->fu += dat->dfu;
+	 dat->fv += dat->dfv;
+      }
    }
+}
 
-   /* for each scanline in the clip region... */
-   for (scene_y=scene_bmp->ct; scene_y<scene_bmp->cb; scene_y++) {
-      scene_addr = bmp_write_line(scene_bmp, scene_y);
+
+
+/* render_strip:
+ *  Renders the rows from strip->y1 to strip->y2, starting with the edges
+ *  in strip->active and picking up the ones in strip->inact as they are
+ *  reached. All the polygons must be outside at entry.
+ */
+static void render_strip(SCENE_STRIP *strip)
+{
+   POLYGON_EDGE *edge, *start_edge = NULL;
+   POLYGON_EDGE *active_edges = strip->active, *last_edge = NULL;
+   POLYGON_INFO *active_poly = NULL;
+
+   /* for each scanline in the strip... */
+   for (strip->y=strip->y1; strip->y<strip->y2; strip->y++) {
+      strip->addr = bmp_write_line(scene_bmp, strip->y);
 
       /* check for newly active edges */
-      edge = scene_inact;
-      while ((edge) && (edge->top == scene_y)) {
+      edge = strip->inact;
+      while ((edge) && (edge->top == strip->y)) {
 	 POLYGON_EDGE *next_edge = edge->next;
-	 scene_inact = _remove_edge(scene_inact, edge);
-	 active_edges = _add_edge_hash(active_edges, edge, TRUE);
+	 strip->inact = _remove_edge(strip->inact, edge);
+	 active_edges = _add_edge_hash(active_edges, edge, TRUE, NULL);
 	 edge = next_edge;
       }
 
@@ -712,8 +879,8 @@ void render_scene(void)
       if (!active_edges) continue;
 
       /* fill the scanline */
-      last_x = INT_MIN;
-      last_z = 0.0;
+      strip->last_x = INT_MIN;
+      strip->last_z = 0.0;
       for (edge=active_edges; edge; edge=edge->next) {
          int x = fixceil(edge->x);
          POLYGON_INFO *poly = edge->poly;
@@ -728,12 +895,12 @@ void render_scene(void)
 	    poly->right_edge = NULL;
 	    
             /* find its place in the list */
-            while (pos && far_z(scene_y, edge, pos)) {
+            while (pos && far_z(strip->y, edge, pos)) {
                prev = pos;
                pos = pos->next;
             }
             /* poly overlaps pos. Was pos visible ? */
-            if (scene_trans_seg(start_edge, edge, pos, active_poly)) {
+            if (scene_trans_seg(strip, start_edge, edge, pos, active_poly)) {
                start_edge = edge;
             }
             /* link */
@@ -750,11 +917,11 @@ void render_scene(void)
 	 else {
             poly->right_edge = edge;
             /* poly ends here. Was it visible ? */
-            if (scene_trans_seg(start_edge, edge, poly, active_poly)) {
+            if (scene_trans_seg(strip, start_edge, edge, poly, active_poly)) {
                start_edge = edge;
-               if (x > last_x) {
-                  last_x = x;
-                  last_z = edge->dat.z;
+               if (x > strip->last_x) {
+                  strip->last_x = x;
+                  strip->last_z = edge->dat.z;
                }
             }
             /* unlink */
@@ -775,39 +942,228 @@ void render_scene(void)
 
       while (edge) {
 	 POLYGON_EDGE *prev_edge = edge->prev;
-	 if (scene_y < edge->bottom) {
-            POLYGON_SEGMENT *dat = &edge->dat;
-            int flags = edge->poly->flags;
-
-	    edge->x += edge->dx;
-            dat->z += dat->dz;
-
-	    if (!(flags & INTERP_FLAT)) {
-	       if (flags & INTERP_1COL)
-	          dat->c += dat->dc;
-
-               if (flags & INTERP_3COL) {
-	          dat->r += dat->dr;
-	          dat->g += dat->dg;
-	          dat->b += dat->db;
-	       }
-
-	       if (flags & INTERP_FIX_UV) {
-	          dat->u += dat->du;
-	          dat->v += dat->dv;
-	       }
-
-	       if (flags & INTERP_FLOAT_UV) {
-	          dat->fu += dat->dfu;
-	          dat->fv += dat->dfv;
-	       }
-	    }
-
-            active_edges = _add_edge_hash(active_edges, edge, TRUE);
+	 if (strip->y < edge->bottom) {
+	    step_edge(edge);
+            active_edges = _add_edge_hash(active_edges, edge, TRUE, NULL);
 	 }
 	 edge = prev_edge;
       }
    }
+}
+
+
+
+#ifdef ALLEGRO_WORKER_THREADS
+
+/* strip job shared by the worker threads */
+typedef struct SCENE_JOB
+{
+   POLYGON_EDGE *edge;              /* copies of the binned edges */
+   POLYGON_INFO *poly;              /* copies of their polygons */
+   POLYGON_EDGE **carried;          /* room for sorting */
+} SCENE_JOB;
+
+
+
+/* compare_carried:
+ *  qsort() callback putting the edges which are already active at the top
+ *  of a strip in the order the single threaded renderer would have them.
+ *  That list is kept sorted on x, and ties keep the order they had on the
+ *  row above, so their x there decides; edges which have been tied since
+ *  the later of them became active have that one in front, or the first
+ *  submitted if they started together.
+ */
+static int compare_carried(AL_CONST void *e1, AL_CONST void *e2)
+{
+   AL_CONST POLYGON_EDGE *a = *(POLYGON_EDGE * AL_CONST *)e1;
+   AL_CONST POLYGON_EDGE *b = *(POLYGON_EDGE * AL_CONST *)e2;
+
+   if (a->x != b->x)
+      return (a->x < b->x) ? -1 : 1;
+
+   if (a->x - a->dx != b->x - b->dx)
+      return (a->x - a->dx < b->x - b->dx) ? -1 : 1;
+
+   if (a->top != b->top)
+      return (a->top > b->top) ? -1 : 1;
+
+   return (a < b) ? -1 : 1;
+}
+
+
+
+/* strip_job:
+ *  Worker callback rendering one strip. Takes private copies of the edges
+ *  and polygons in its bin, moves the edges which start higher up down to
+ *  the first row, and runs render_strip() on them.
+ */
+static void strip_job(void *data, int s)
+{
+   SCENE_JOB *job = (SCENE_JOB *)data;
+   SCENE_BIN *bin = &scene_bin[s];
+   POLYGON_EDGE *edge = job->edge + bin->first;
+   POLYGON_INFO *poly = job->poly + bin->first;
+   POLYGON_EDGE **carried = job->carried + bin->first;
+   POLYGON_EDGE *table[HASH_NUM];
+   POLYGON_INFO *last = NULL;
+   SCENE_STRIP strip;
+   int i, y, ncarried = 0;
+
+   strip.y1 = scene_bmp->ct + s * scene_strip_h;
+   strip.y2 = MIN(strip.y1 + scene_strip_h, scene_bmp->cb);
+   strip.set_state = FALSE;
+   strip.inact = NULL;
+   strip.active = NULL;
+
+   for (i=0; i<HASH_NUM; i++)
+      table[i] = NULL;
+
+   for (i=0; i<bin->count; i++, edge++) {
+      *edge = scene_edge[bin->edge[i]];
+
+      /* the edges of a polygon are next to each other */
+      if (edge->poly != last) {
+	 last = edge->poly;
+	 *poly = *last;
+	 poly->inside = 0;
+	 poly++;
+      }
+      edge->poly = poly - 1;
+
+      if (edge->top < strip.y1) {
+	 for (y=edge->top; y<strip.y1; y++)
+	    step_edge(edge);
+	 carried[ncarried++] = edge;
+      }
+      else
+	 strip.inact = _add_edge_hash(strip.inact, edge, FALSE, table);
+   }
+
+   if (ncarried > 0) {
+      qsort(carried, ncarried, sizeof(POLYGON_EDGE *), compare_carried);
+
+      for (i=0; i<ncarried; i++) {
+	 carried[i]->prev = (i > 0) ? carried[i-1] : NULL;
+	 carried[i]->next = (i < ncarried-1) ? carried[i+1] : NULL;
+      }
+
+      strip.active = carried[0];
+   }
+
+   render_strip(&strip);
+}
+
+
+
+/* render_strips:
+ *  Renders the scene as strips spread over the worker threads. Returns
+ *  FALSE if the scene has to be rendered in one go instead.
+ */
+static int render_strips(void)
+{
+   SCENE_JOB job;
+   int s, total = 0;
+
+   if (!scene_binned)
+      return FALSE;
+
+   for (s=0; s<scene_strips; s++) {
+      scene_bin[s].first = total;
+      total += scene_bin[s].count;
+   }
+
+   if (total == 0)
+      return FALSE;
+
+   job.edge = _AL_MALLOC(total * sizeof(POLYGON_EDGE));
+   job.poly = _AL_MALLOC(total * sizeof(POLYGON_INFO));
+   job.carried = _AL_MALLOC(total * sizeof(POLYGON_EDGE *));
+
+   if ((!job.edge) || (!job.poly) || (!job.carried)) {
+      if (job.edge) _AL_FREE(job.edge);
+      if (job.poly) _AL_FREE(job.poly);
+      if (job.carried) _AL_FREE(job.carried);
+      return FALSE;
+   }
+
+   /* all the polygons agree on these, so set them once for everybody */
+   if (scene_state) {
+      color_map = scene_state->cmap;
+      _blender_alpha = scene_state->alpha;
+   }
+
+   if (scene_blend) {
+      _blender_col_15 = scene_blend->b15;
+      _blender_col_16 = scene_blend->b16;
+      _blender_col_24 = scene_blend->b24;
+      _blender_col_32 = scene_blend->b32;
+   }
+
+   _al_run_workers(strip_job, &job, scene_strips);
+
+   _AL_FREE(job.edge);
+   _AL_FREE(job.poly);
+   _AL_FREE(job.carried);
+
+   return TRUE;
+}
+
+#endif
+
+
+
+/* render_scene:
+ *  Renders all the specified scene_polygon3d()'s on the bitmap passed to
+ *  clear_scene(). Rendering is done one scanline at a time, with no pixel
+ *  being processed more than once. Note that between clear_scene() and
+ *  render_scene() you shouldn't change the clip rectangle of the destination
+ *  bitmap. Also, all the textures passed to scene_polygon3d() are stored
+ *  as pointers only and actually used in render_scene().
+ *  If drawing threads are enabled, large memory bitmaps are rendered as
+ *  horizontal strips by the worker threads.
+ */
+void render_scene(void)
+{
+   int p, done = FALSE;
+   #ifdef ALLEGRO_DOS
+      int old87 = 0;
+   #endif
+
+   ASSERT(scene_maxedge > 0);
+   ASSERT(scene_maxpoly > 0);
+   
+   scene_cmap = color_map;
+   scene_alpha = _blender_alpha;
+   solid_mode();
+   /* set fpu to single-precision, truncate mode */
+   #ifdef ALLEGRO_DOS
+      old87 = _control87(PC_24 | RC_CHOP, MCW_PC | MCW_RC);
+   #endif
+
+   acquire_bitmap(scene_bmp);
+   bmp_select(scene_bmp);
+
+#ifdef ALLEGRO_WORKER_THREADS
+   done = render_strips();
+#endif
+
+   if (!done) {
+      SCENE_STRIP strip;
+
+      for (p=0; p<scene_npoly; p++) {
+	 scene_poly[p].inside = 0;
+      }
+
+      strip.y1 = scene_bmp->ct;
+      strip.y2 = scene_bmp->cb;
+      strip.set_state = TRUE;
+      strip.inact = scene_inact;
+      strip.active = NULL;
+
+      render_strip(&strip);
+
+      scene_inact = strip.inact;
+   }
 
    bmp_unwrite_line(scene_bmp);
    release_bitmap(scene_bmp);
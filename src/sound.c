@@ -979,7 +979,7 @@ SAMPLE *load_voc_pf(PACKFILE *f)
  */
 SAMPLE *load_wav(AL_CONST char *filename)
 {
-   PACKFILE *f;
+   PACKFILE *f, *ahead;
    SAMPLE *spl;
    ASSERT(filename);
 
@@ -987,6 +987,11 @@ SAMPLE *load_wav(AL_CONST char *filename)
    if (!f)
       return NULL;
 
+   /* the samples are read in order, so fetch them ahead of time */
+   ahead = pack_fopen_readahead(f, 0);
+   if (ahead)
+      f = ahead;
+
    spl = load_wav_pf(f);
 
    pack_fclose(f);
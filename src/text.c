@@ -20,6 +20,8 @@
  */
 
 
+#include <string.h>
+
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
 
@@ -79,42 +81,73 @@ void textout_right_ex(BITMAP *bmp, AL_CONST FONT *f, AL_CONST char *str, int x,
 /* textout_justify_ex:
  *  Like textout_ex(), but justifies the string to the specified area.
  */
-#define MAX_TOKEN  128
+#define MAX_TOKEN  TEXT_LAYOUT_MAX_WORDS
 
 void textout_justify_ex(BITMAP *bmp, AL_CONST FONT *f, AL_CONST char *str, int x1, int x2, int y, int diff, int color, int bg)
 {
    char toks[32];
    char *tok[MAX_TOKEN];
+   int len[MAX_TOKEN];
    char *strbuf, *strlast;
+   TEXT_LAYOUT *l;
    int i, minlen, last, space;
    float fleft, finc;
    ASSERT(bmp);
    ASSERT(f);
    ASSERT(str);
 
-   i = usetc(toks, ' ');
-   i += usetc(toks+i, '\t');
-   i += usetc(toks+i, '\n');
-   i += usetc(toks+i, '\r');
-   usetc(toks+i, 0);
-
-   /* count words and measure min length (without spaces) */ 
-   strbuf = _al_ustrdup(str);
-   if (!strbuf) {
-      /* Can't justify ! */
-      f->vtable->render(f, str, color, bg, bmp, x1, y);
-      return;
+   l = _text_layout(f, str, TRUE);
+
+   if (l) {
+      /* the words were measured before, so just copy them: drawing them
+       * can measure other strings and move things around in the cache
+       */
+      if ((l->words < 2) || (x2 - x1 - l->minlen <= 0) || (x2 - x1 - l->minlen > diff)) {
+         f->vtable->render(f, str, color, bg, bmp, x1, y);
+         return;
+      }
+
+      strbuf = _AL_MALLOC_ATOMIC(l->size);
+      if (!strbuf) {
+         f->vtable->render(f, str, color, bg, bmp, x1, y);
+         return;
+      }
+
+      memcpy(strbuf, l->tokens, l->size);
+      minlen = l->minlen;
+      last = l->words;
+
+      for (i=0; i<last; i++) {
+         tok[i] = strbuf + l->word[i].offset;
+         len[i] = l->word[i].width;
+      }
    }
-
-   minlen = 0;
-   last = 0;
-   tok[last] = ustrtok_r(strbuf, toks, &strlast);
-
-   while (tok[last]) {
-      minlen += text_length(f, tok[last]);
-      if (++last == MAX_TOKEN)
-         break;
-      tok[last] = ustrtok_r(NULL, toks, &strlast);
+   else {
+      i = usetc(toks, ' ');
+      i += usetc(toks+i, '\t');
+      i += usetc(toks+i, '\n');
+      i += usetc(toks+i, '\r');
+      usetc(toks+i, 0);
+
+      /* count words and measure min length (without spaces) */ 
+      strbuf = _al_ustrdup(str);
+      if (!strbuf) {
+         /* Can't justify ! */
+         f->vtable->render(f, str, color, bg, bmp, x1, y);
+         return;
+      }
+
+      minlen = 0;
+      last = 0;
+      tok[last] = ustrtok_r(strbuf, toks, &strlast);
+
+      while (tok[last]) {
+         len[last] = f->vtable->text_length(f, tok[last]);
+         minlen += len[last];
+         if (++last == MAX_TOKEN)
+            break;
+         tok[last] = ustrtok_r(NULL, toks, &strlast);
+      }
    }
 
    /* amount of room for space between words */
@@ -132,7 +165,7 @@ void textout_justify_ex(BITMAP *bmp, AL_CONST FONT *f, AL_CONST char *str, int x
    finc = (float)space / (float)(last-1);
    for (i=0; i<last; i++) {
       f->vtable->render(f, tok[i], color, bg, bmp, (int)fleft, y);
-      fleft += (float)text_length(f, tok[i]) + finc;
+      fleft += (float)len[i] + finc;
    }
 
    _AL_FREE(strbuf);
@@ -227,8 +260,14 @@ void textprintf_justify_ex(BITMAP *bmp, AL_CONST FONT *f, int x1, int x2, int y,
  */
 int text_length(AL_CONST FONT *f, AL_CONST char *str)
 {
+   TEXT_LAYOUT *l;
    ASSERT(f);
    ASSERT(str);
+
+   l = _text_layout(f, str, FALSE);
+   if (l)
+      return l->length;
+
    return f->vtable->text_length(f, str);
 }
 
@@ -252,6 +291,7 @@ int text_height(AL_CONST FONT *f)
 void destroy_font(FONT *f)
 {
    ASSERT(f);
+   _text_layout_flush(f);
    f->vtable->destroy(f);
 }
 
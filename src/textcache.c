@@ -0,0 +1,360 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Text measurement cache.
+ *
+ *      GUI code measures the same few labels over and over, so the
+ *      results of text_length() and the word splitting done by
+ *      textout_justify_ex() are remembered for the most recently used
+ *      strings. Entries are found by hashing the bytes of the string
+ *      together with the font and the current text encoding, so a hit
+ *      never has to decode any characters. Only Allegro's own kinds of
+ *      font are cached, since those of add-ons may measure text with
+ *      settings kept outside the font data.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+#define TEXT_CACHE_ENTRIES    256      /* strings remembered */
+#define TEXT_CACHE_BUCKETS    256      /* a power of two */
+#define TEXT_CACHE_MAX_SIZE   1024     /* longer strings aren't cached */
+
+
+typedef struct TEXT_CACHE_ENTRY
+{
+   TEXT_LAYOUT layout;
+   AL_CONST FONT *font;                /* the font it was measured with, */
+   void *data;                         /* its data and vtable at the time, */
+   FONT_VTABLE *vtable;
+   int char_404;                       /* and allegro_404_char */
+   int uformat;
+   unsigned long hash;
+   char *str;                          /* the string itself */
+   struct TEXT_CACHE_ENTRY *hnext;     /* next in the hash bucket */
+   struct TEXT_CACHE_ENTRY *prev;      /* towards the most recently used */
+   struct TEXT_CACHE_ENTRY *next;      /* towards the least recently used */
+} TEXT_CACHE_ENTRY;
+
+
+static TEXT_CACHE_ENTRY *text_cache_bucket[TEXT_CACHE_BUCKETS];
+static TEXT_CACHE_ENTRY *text_cache_head = NULL;
+static TEXT_CACHE_ENTRY *text_cache_tail = NULL;
+static int text_cache_count = 0;
+
+#define TEXT_CACHE_HASH(h, f)    (((h) ^ (((uintptr_t)(f)) >> 4)) & (TEXT_CACHE_BUCKETS - 1))
+
+
+
+/* text_cache_hash:
+ *  Hashes the bytes of a string, storing its size including the
+ *  terminator, or -1 if it is too long to be worth caching.
+ */
+static unsigned long text_cache_hash(AL_CONST char *str, int unicode, int *size)
+{
+   AL_CONST unsigned char *p = (AL_CONST unsigned char *)str;
+   AL_CONST unsigned char *end = p + TEXT_CACHE_MAX_SIZE;
+   unsigned long h = 2166136261UL;
+
+   if (unicode) {
+      /* 16 bit characters end with two zero bytes */
+      while ((p[0]) || (p[1])) {
+	 h = (h ^ p[0]) * 16777619UL;
+	 h = (h ^ p[1]) * 16777619UL;
+	 p += 2;
+	 if (p >= end) {
+	    *size = -1;
+	    return 0;
+	 }
+      }
+      p += 2;
+   }
+   else {
+      while (*p) {
+	 h = (h ^ *p) * 16777619UL;
+	 p++;
+	 if (p >= end) {
+	    *size = -1;
+	    return 0;
+	 }
+      }
+      p++;
+   }
+
+   *size = (int)(p - (AL_CONST unsigned char *)str);
+   return h;
+}
+
+
+
+/* text_cache_unlink:
+ *  Takes an entry out of the recently used list.
+ */
+static void text_cache_unlink(TEXT_CACHE_ENTRY *e)
+{
+   if (e->prev)
+      e->prev->next = e->next;
+   else
+      text_cache_head = e->next;
+
+   if (e->next)
+      e->next->prev = e->prev;
+   else
+      text_cache_tail = e->prev;
+}
+
+
+
+/* text_cache_push:
+ *  Puts an entry at the front of the recently used list.
+ */
+static void text_cache_push(TEXT_CACHE_ENTRY *e)
+{
+   e->prev = NULL;
+   e->next = text_cache_head;
+
+   if (text_cache_head)
+      text_cache_head->prev = e;
+   else
+      text_cache_tail = e;
+
+   text_cache_head = e;
+}
+
+
+
+/* text_cache_forget_words:
+ *  Frees the word list of an entry.
+ */
+static void text_cache_forget_words(TEXT_CACHE_ENTRY *e)
+{
+   if (e->layout.tokens) {
+      _AL_FREE(e->layout.tokens);
+      e->layout.tokens = NULL;
+   }
+
+   if (e->layout.word) {
+      _AL_FREE(e->layout.word);
+      e->layout.word = NULL;
+   }
+
+   e->layout.words = -1;
+   e->layout.minlen = 0;
+}
+
+
+
+/* text_cache_remove:
+ *  Frees an entry.
+ */
+static void text_cache_remove(TEXT_CACHE_ENTRY *e)
+{
+   TEXT_CACHE_ENTRY **p = &text_cache_bucket[TEXT_CACHE_HASH(e->hash, e->font)];
+
+   while (*p != e)
+      p = &(*p)->hnext;
+
+   *p = e->hnext;
+
+   text_cache_unlink(e);
+   text_cache_forget_words(e);
+   _AL_FREE(e);
+   text_cache_count--;
+}
+
+
+
+/* text_cache_exit:
+ *  Frees the cache when Allegro exits.
+ */
+static void text_cache_exit(void)
+{
+   _text_layout_flush(NULL);
+}
+
+
+
+/* text_cache_measure:
+ *  Measures the string of an entry with the font as it is now.
+ */
+static void text_cache_measure(TEXT_CACHE_ENTRY *e, AL_CONST FONT *f)
+{
+   e->data = f->data;
+   e->vtable = f->vtable;
+   e->char_404 = allegro_404_char;
+   e->layout.length = f->vtable->text_length(f, e->str);
+   text_cache_forget_words(e);
+}
+
+
+
+/* text_cache_split:
+ *  Splits the string of an entry into words the way textout_justify_ex()
+ *  always has, and measures them. Returns FALSE if there is no memory.
+ */
+static int text_cache_split(TEXT_CACHE_ENTRY *e, AL_CONST FONT *f)
+{
+   TEXT_LAYOUT_WORD word[TEXT_LAYOUT_MAX_WORDS];
+   TEXT_LAYOUT *l = &e->layout;
+   char toks[32];
+   char *tok, *last;
+   int i, n;
+
+   i = usetc(toks, ' ');
+   i += usetc(toks+i, '\t');
+   i += usetc(toks+i, '\n');
+   i += usetc(toks+i, '\r');
+   usetc(toks+i, 0);
+
+   l->tokens = _AL_MALLOC_ATOMIC(l->size);
+   if (!l->tokens)
+      return FALSE;
+
+   memcpy(l->tokens, e->str, l->size);
+
+   l->minlen = 0;
+   n = 0;
+   tok = ustrtok_r(l->tokens, toks, &last);
+
+   while (tok) {
+      word[n].offset = (int)(tok - l->tokens);
+      word[n].width = f->vtable->text_length(f, tok);
+      l->minlen += word[n].width;
+      if (++n == TEXT_LAYOUT_MAX_WORDS)
+	 break;
+      tok = ustrtok_r(NULL, toks, &last);
+   }
+
+   if (n > 0) {
+      l->word = _AL_MALLOC_ATOMIC(n * sizeof(TEXT_LAYOUT_WORD));
+      if (!l->word) {
+	 text_cache_forget_words(e);
+	 return FALSE;
+      }
+      memcpy(l->word, word, n * sizeof(TEXT_LAYOUT_WORD));
+   }
+
+   l->words = n;
+   return TRUE;
+}
+
+
+
+/* _text_layout:
+ *  Returns the cached measurements of a string, measuring it first if it
+ *  isn't in the cache. If words is set the string is also split into
+ *  words. Returns NULL if the string can't be cached, in which case the
+ *  caller measures it directly. The result stays valid until the next
+ *  call, or until the font is destroyed.
+ */
+TEXT_LAYOUT *_text_layout(AL_CONST FONT *f, AL_CONST char *str, int words)
+{
+   TEXT_CACHE_ENTRY **bucket, *e;
+   unsigned long hash;
+   int uformat = get_uformat();
+   int size;
+
+   ASSERT(f);
+   ASSERT(str);
+
+   /* other encodings may have zero bytes in the middle of a string */
+   if ((uformat != U_ASCII) && (uformat != U_ASCII_CP) &&
+       (uformat != U_UTF8) && (uformat != U_UNICODE))
+      return NULL;
+
+   /* fonts of other kinds may measure with state we can't see */
+   if ((f->vtable != &_font_vtable_mono) && (f->vtable != &_font_vtable_color) &&
+       (f->vtable != &_font_vtable_trans) && (f->vtable != &_font_vtable_aa))
+      return NULL;
+
+   hash = text_cache_hash(str, (uformat == U_UNICODE), &size);
+   if (size < 0)
+      return NULL;
+
+   bucket = &text_cache_bucket[TEXT_CACHE_HASH(hash, f)];
+
+   for (e = *bucket; e; e = e->hnext) {
+      if ((e->hash == hash) && (e->font == f) && (e->uformat == uformat) &&
+	  (e->layout.size == size) && (memcmp(e->str, str, size) == 0))
+	 break;
+   }
+
+   if (e) {
+      if ((e->data != f->data) || (e->vtable != f->vtable) ||
+	  (e->char_404 != allegro_404_char))
+	 text_cache_measure(e, f);
+
+      if (e != text_cache_head) {
+	 text_cache_unlink(e);
+	 text_cache_push(e);
+      }
+   }
+   else {
+      if (text_cache_count >= TEXT_CACHE_ENTRIES)
+	 text_cache_remove(text_cache_tail);
+
+      e = _AL_MALLOC(sizeof(TEXT_CACHE_ENTRY) + size);
+      if (!e)
+	 return NULL;
+
+      e->str = (char *)(e + 1);
+      memcpy(e->str, str, size);
+
+      e->font = f;
+      e->uformat = uformat;
+      e->hash = hash;
+      e->layout.size = size;
+      e->layout.tokens = NULL;
+      e->layout.word = NULL;
+      text_cache_measure(e, f);
+
+      e->hnext = *bucket;
+      *bucket = e;
+      text_cache_push(e);
+
+      if (!text_cache_count++)
+	 _add_exit_func(text_cache_exit, "text_cache_exit");
+   }
+
+   if ((words) && (e->layout.words < 0)) {
+      if (!text_cache_split(e, f))
+	 return NULL;
+   }
+
+   return &e->layout;
+}
+
+
+
+/* _text_layout_flush:
+ *  Forgets the strings measured with a font, or with any font if f is
+ *  NULL. Called when fonts are destroyed or their glyphs change, and when
+ *  the codepage changes under U_ASCII_CP strings.
+ */
+void _text_layout_flush(AL_CONST FONT *f)
+{
+   TEXT_CACHE_ENTRY *e, *next;
+
+   for (e = text_cache_head; e; e = next) {
+      next = e->next;
+      if ((!f) || (e->font == f))
+	 text_cache_remove(e);
+   }
+
+   if (!text_cache_count)
+      _remove_exit_func(text_cache_exit);
+}
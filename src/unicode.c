@@ -584,6 +584,9 @@ void set_ucodepage(AL_CONST unsigned short *table, AL_CONST unsigned short *extr
    ASSERT(table);
    codepage_table = table;
    codepage_extras = extras;
+
+   /* the same bytes may now be different characters */
+   _text_layout_flush(NULL);
 }
 
 
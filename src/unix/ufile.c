@@ -40,6 +40,12 @@
 #ifdef ALLEGRO_HAVE_SYS_TIME_H
   #include <sys/time.h>
 #endif
+
+#ifdef ALLEGRO_HAVE_MMAP
+   #include <fcntl.h>
+   #include <unistd.h>
+   #include <sys/mman.h>
+#endif
 #ifdef ALLEGRO_HAVE_TIME_H
   #include <time.h>
 #endif
@@ -78,6 +84,58 @@ uint64_t _al_file_size_ex(AL_CONST char *filename)
 
 
 
+/* _al_file_map:
+ *  Maps a whole file into memory. The mapping is private, so pages only
+ *  get copied when they are written to and the file itself is never
+ *  changed. Returns NULL if the file can't be mapped.
+ */
+void *_al_file_map(AL_CONST char *filename, uint64_t *size)
+{
+#ifdef ALLEGRO_HAVE_MMAP
+   struct stat s;
+   char tmp[1024];
+   void *p;
+   int fd;
+
+   fd = open(uconvert(filename, U_CURRENT, tmp, U_UTF8, sizeof(tmp)), O_RDONLY);
+   if (fd < 0) {
+      *allegro_errno = errno;
+      return NULL;
+   }
+
+   if ((fstat(fd, &s) != 0) || (s.st_size <= 0) ||
+       ((uint64_t)s.st_size != (size_t)s.st_size)) {
+      close(fd);
+      return NULL;
+   }
+
+   p = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (p == MAP_FAILED)
+      return NULL;
+
+   *size = s.st_size;
+   return p;
+#else
+   return NULL;
+#endif
+}
+
+
+
+/* _al_file_unmap:
+ *  Releases a mapping made by _al_file_map().
+ */
+void _al_file_unmap(void *p, uint64_t size)
+{
+#ifdef ALLEGRO_HAVE_MMAP
+   munmap(p, size);
+#endif
+}
+
+
+
 /* _al_file_time:
  *  Returns the timestamp of the specified file.
  */
@@ -28,6 +28,7 @@
 #include <signal.h>
 #include <sys/time.h>
 #include <limits.h>
+#include <unistd.h>
 
 
 #ifndef ALLEGRO_MACOSX
@@ -381,5 +382,364 @@ void _unix_unlock_mutex(void *handle)
    }
 }
 
+
+
+
+/* state of the worker pool, all protected by work_mutex, which like the
+ * conditions outlives the workers; pool_mutex is held while they come
+ * and go, so that resizing the pool doesn't disturb anyone using it
+ */
+static pthread_t workers[_AL_MAX_WORKERS];
+static int num_workers = 0;
+static int workers_quit = FALSE;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static void (*work_proc)(void *data, int job);
+static void *work_data;
+static int work_jobs;
+static int work_next;
+static int work_done;
+static int work_busy;
+static int work_generation;
+
+
+
+/* do_jobs:
+ *  Takes jobs off the current batch until there are none left. Called
+ *  and returns with work_mutex held.
+ */
+static void do_jobs(void)
+{
+   void (*proc)(void *data, int job) = work_proc;
+   void *data = work_data;
+
+   while (work_next < work_jobs) {
+      int job = work_next++;
+
+      pthread_mutex_unlock(&work_mutex);
+      proc(data, job);
+      pthread_mutex_lock(&work_mutex);
+
+      if (++work_done == work_jobs)
+	 pthread_cond_signal(&done_cond);
+   }
+}
+
+
+
+/* worker_threadfunc:
+ *  Thread function for the workers, which sleep until a new batch of
+ *  jobs is posted.
+ */
+static void *worker_threadfunc(void *arg)
+{
+   sigset_t mask;
+   int generation;
+
+   /* signals are for the main thread */
+   sigfillset(&mask);
+   pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+   pthread_mutex_lock(&work_mutex);
+
+   generation = work_generation;
+
+   for (;;) {
+      while ((work_generation == generation) && (!workers_quit))
+	 pthread_cond_wait(&work_cond, &work_mutex);
+
+      if (workers_quit)
+	 break;
+
+      generation = work_generation;
+      do_jobs();
+   }
+
+   pthread_mutex_unlock(&work_mutex);
+
+   return NULL;
+}
+
+
+
+/* _al_cpu_count:
+ *  Returns the number of processors available.
+ */
+int _al_cpu_count(void)
+{
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+   return (n > 0) ? (int)n : 1;
+}
+
+
+
+/* add_workers:
+ *  Starts workers until there are enough for the given number of threads,
+ *  counting the one calling _al_run_workers(). Called with pool_mutex
+ *  held. Returns the number of threads available.
+ */
+static int add_workers(int threads)
+{
+   pthread_t thread;
+
+   if (threads > _AL_MAX_WORKERS)
+      threads = _AL_MAX_WORKERS;
+
+   while (num_workers < threads - 1) {
+      if (pthread_create(&thread, NULL, worker_threadfunc, NULL))
+	 break;
+
+      pthread_mutex_lock(&work_mutex);
+      workers[num_workers++] = thread;
+      pthread_mutex_unlock(&work_mutex);
+   }
+
+   return num_workers + 1;
+}
+
+
+
+/* stop_workers:
+ *  Shuts down the worker threads. Called with pool_mutex held. A batch
+ *  which is running meanwhile is finished by the thread that posted it.
+ */
+static void stop_workers(void)
+{
+   int i, n;
+
+   if (!num_workers)
+      return;
+
+   pthread_mutex_lock(&work_mutex);
+   workers_quit = TRUE;
+   n = num_workers;
+   num_workers = 0;
+   pthread_cond_broadcast(&work_cond);
+   pthread_mutex_unlock(&work_mutex);
+
+   for (i = 0; i < n; i++)
+      pthread_join(workers[i], NULL);
+
+   pthread_mutex_lock(&work_mutex);
+   workers_quit = FALSE;
+   pthread_mutex_unlock(&work_mutex);
+}
+
+
+
+/* _al_start_workers:
+ *  Sets up the pool so that jobs are spread over the given number of
+ *  threads, counting the one calling _al_run_workers(). Returns the
+ *  number of threads actually available.
+ */
+int _al_start_workers(int threads)
+{
+   if (threads > _AL_MAX_WORKERS)
+      threads = _AL_MAX_WORKERS;
+
+   pthread_mutex_lock(&pool_mutex);
+
+   if (threads != num_workers + 1) {
+      stop_workers();
+      if (threads > 1)
+	 add_workers(threads);
+   }
+
+   threads = num_workers + 1;
+
+   pthread_mutex_unlock(&pool_mutex);
+
+   return threads;
+}
+
+
+
+/* _al_grow_workers:
+ *  Like _al_start_workers(), but only ever adds workers, so it is safe
+ *  while other threads are using the pool.
+ */
+int _al_grow_workers(int threads)
+{
+   pthread_mutex_lock(&pool_mutex);
+   threads = add_workers(threads);
+   pthread_mutex_unlock(&pool_mutex);
+
+   return threads;
+}
+
+
+
+/* _al_stop_workers:
+ *  Shuts down the worker threads.
+ */
+void _al_stop_workers(void)
+{
+   pthread_mutex_lock(&pool_mutex);
+   stop_workers();
+   pthread_mutex_unlock(&pool_mutex);
+}
+
+
+
+/* _al_run_workers:
+ *  Calls proc(data, job) for each job from 0 to jobs-1, spread over the
+ *  worker threads and the calling thread, and waits for all of them to
+ *  finish. Jobs may run in any order.
+ */
+void _al_run_workers(void (*proc)(void *data, int job), void *data, int jobs)
+{
+   int i;
+
+   if (jobs > 1) {
+      pthread_mutex_lock(&work_mutex);
+
+      /* the pool may already be busy with a job from another thread */
+      if ((num_workers) && (!work_busy)) {
+	 work_busy = TRUE;
+	 work_proc = proc;
+	 work_data = data;
+	 work_jobs = jobs;
+	 work_next = 0;
+	 work_done = 0;
+	 work_generation++;
+	 pthread_cond_broadcast(&work_cond);
+
+	 /* lend a hand rather than sitting idle */
+	 do_jobs();
+
+	 while (work_done < work_jobs)
+	    pthread_cond_wait(&done_cond, &work_mutex);
+
+	 work_busy = FALSE;
+	 pthread_mutex_unlock(&work_mutex);
+	 return;
+      }
+
+      pthread_mutex_unlock(&work_mutex);
+   }
+
+   for (i = 0; i < jobs; i++)
+      proc(data, i);
+}
+
+
+/* state of the I/O thread; the lock outlives it, so callers can use it
+ * to decide whether to start one
+ */
+static pthread_t io_thread;
+static int io_running = FALSE;
+static pthread_mutex_t io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+static void (*io_proc)(void);
+
+
+
+/* io_threadfunc:
+ *  Thread function for the I/O thread.
+ */
+static void *io_threadfunc(void *arg)
+{
+   sigset_t mask;
+
+   /* signals are for the main thread */
+   sigfillset(&mask);
+   pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+   io_proc();
+
+   return NULL;
+}
+
+
+
+/* _al_start_io_thread:
+ *  Called with the lock held, starts a thread which runs proc, for
+ *  reading files in the background. Returns TRUE if the thread is running.
+ */
+int _al_start_io_thread(void (*proc)(void))
+{
+   if (io_running)
+      return TRUE;
+
+   io_proc = proc;
+
+   if (pthread_create(&io_thread, NULL, io_threadfunc, NULL))
+      return FALSE;
+
+   io_running = TRUE;
+   return TRUE;
+}
+
+
+
+/* _al_stop_io_thread:
+ *  Waits for the proc of the I/O thread to return.
+ */
+void _al_stop_io_thread(void)
+{
+   if (!io_running)
+      return;
+
+   pthread_join(io_thread, NULL);
+
+   io_running = FALSE;
+}
+
+
+
+/* _al_in_io_thread:
+ *  Called with the lock held, tells whether the caller is the I/O thread.
+ */
+int _al_in_io_thread(void)
+{
+   return (io_running) && (pthread_equal(pthread_self(), io_thread));
+}
+
+
+
+/* _al_lock_io:
+ *  Locks the state shared with the I/O thread. This works whether or not
+ *  the thread is running.
+ */
+void _al_lock_io(void)
+{
+   pthread_mutex_lock(&io_mutex);
+}
+
+
+
+/* _al_unlock_io:
+ *  Unlocks the state shared with the I/O thread.
+ */
+void _al_unlock_io(void)
+{
+   pthread_mutex_unlock(&io_mutex);
+}
+
+
+
+/* _al_wait_io:
+ *  Called with the lock held, sleeps until _al_wake_io() is called.
+ *  May also return early, so the caller must check what it waits for.
+ */
+void _al_wait_io(void)
+{
+   pthread_cond_wait(&io_cond, &io_mutex);
+}
+
+
+
+/* _al_wake_io:
+ *  Called with the lock held, wakes all the threads in _al_wait_io().
+ */
+void _al_wake_io(void)
+{
+   pthread_cond_broadcast(&io_cond);
+}
+
 #endif	/* ALLEGRO_HAVE_LIBPTHREAD */
 
@@ -87,6 +87,64 @@ uint64_t _al_file_size_ex(AL_CONST char *filename)
 
 
 
+/* _al_file_map:
+ *  Maps a whole file into memory. The view is copy-on-write, so pages
+ *  only get copied when they are written to and the file itself is never
+ *  changed. Returns NULL if the file can't be mapped.
+ */
+void *_al_file_map(AL_CONST char *filename, uint64_t *size)
+{
+   char tmp[1024];
+   HANDLE file, mapping;
+   LARGE_INTEGER len;
+   void *p = NULL;
+
+   if (get_filename_encoding() != U_UNICODE) {
+      file = CreateFileA(uconvert(filename, U_CURRENT, tmp, U_ASCII, sizeof(tmp)),
+                         GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+   }
+   else {
+      file = CreateFileW((wchar_t*)uconvert(filename, U_CURRENT, tmp, U_UNICODE, sizeof(tmp)),
+                         GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+   }
+
+   if (file == INVALID_HANDLE_VALUE)
+      return NULL;
+
+   len.LowPart = GetFileSize(file, (DWORD *)&len.HighPart);
+
+   if ((len.LowPart != INVALID_FILE_SIZE) && (len.QuadPart > 0) &&
+       ((uint64_t)len.QuadPart == (SIZE_T)len.QuadPart)) {
+      mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+      if (mapping) {
+         p = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+         CloseHandle(mapping);
+      }
+   }
+
+   CloseHandle(file);
+
+   if (p)
+      *size = len.QuadPart;
+
+   return p;
+}
+
+
+
+/* _al_file_unmap:
+ *  Releases a mapping made by _al_file_map().
+ */
+void _al_file_unmap(void *p, uint64_t size)
+{
+   UnmapViewOfFile(p);
+}
+
+
+
 /* _al_file_time:
  *  Returns the timestamp of the specified file.
  */
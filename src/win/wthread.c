@@ -24,6 +24,7 @@
 
 #ifndef SCAN_DEPEND
    #include <objbase.h>
+   #include <process.h>
 #endif
 
 #ifndef ALLEGRO_WINDOWS
@@ -147,3 +148,436 @@ void sys_directx_unlock_mutex(void *handle)
    LeaveCriticalSection(cs);
 }
 
+
+
+/* state of the worker pool, all protected by work_cs, which like the
+ * semaphore and event outlives the workers; pool_cs is held while they
+ * come and go, so that resizing the pool doesn't disturb anyone using it
+ */
+static HANDLE workers[_AL_MAX_WORKERS];
+static int num_workers = 0;
+static int workers_quit = FALSE;
+static LONG pool_init_state = 0;    /* 0 none, 1 under way, 2 done */
+static CRITICAL_SECTION pool_cs;
+static CRITICAL_SECTION work_cs;
+static HANDLE work_sem;
+static HANDLE done_event;
+
+static void (*work_proc)(void *data, int job);
+static void *work_data;
+static int work_jobs;
+static int work_next;
+static int work_done;
+static int work_busy;
+
+
+
+/* do_jobs:
+ *  Takes jobs off the current batch until there are none left. Called
+ *  and returns inside work_cs.
+ */
+static void do_jobs(void)
+{
+   void (*proc)(void *data, int job) = work_proc;
+   void *data = work_data;
+
+   while (work_next < work_jobs) {
+      int job = work_next++;
+
+      LeaveCriticalSection(&work_cs);
+      proc(data, job);
+      EnterCriticalSection(&work_cs);
+
+      if (++work_done == work_jobs)
+	 SetEvent(done_event);
+   }
+}
+
+
+
+/* worker_threadfunc:
+ *  Thread function for the workers, which sleep until a new batch of
+ *  jobs is posted.
+ */
+static unsigned __stdcall worker_threadfunc(void *arg)
+{
+   for (;;) {
+      WaitForSingleObject(work_sem, INFINITE);
+
+      EnterCriticalSection(&work_cs);
+
+      if (workers_quit) {
+	 LeaveCriticalSection(&work_cs);
+	 break;
+      }
+
+      do_jobs();
+
+      LeaveCriticalSection(&work_cs);
+   }
+
+   return 0;
+}
+
+
+
+/* _al_cpu_count:
+ *  Returns the number of processors available.
+ */
+int _al_cpu_count(void)
+{
+   SYSTEM_INFO info;
+
+   GetSystemInfo(&info);
+
+   return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+
+
+/* pool_init:
+ *  Sets up the locks, semaphore and event of the pool, once, even if
+ *  several threads get here at the same time.
+ */
+static void pool_init(void)
+{
+   if (InterlockedCompareExchange(&pool_init_state, 2, 2) == 2)
+      return;
+
+   if (InterlockedCompareExchange(&pool_init_state, 1, 0) == 0) {
+      InitializeCriticalSection(&pool_cs);
+      InitializeCriticalSection(&work_cs);
+      work_sem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+      done_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+      InterlockedExchange(&pool_init_state, 2);
+   }
+   else {
+      while (InterlockedCompareExchange(&pool_init_state, 2, 2) != 2)
+	 Sleep(0);
+   }
+}
+
+
+
+/* add_workers:
+ *  Starts workers until there are enough for the given number of threads,
+ *  counting the one calling _al_run_workers(). Called inside pool_cs.
+ *  Returns the number of threads available.
+ */
+static int add_workers(int threads)
+{
+   HANDLE thread;
+
+   if (threads > _AL_MAX_WORKERS)
+      threads = _AL_MAX_WORKERS;
+
+   while (num_workers < threads - 1) {
+      thread = (HANDLE)_beginthreadex(NULL, 0, worker_threadfunc, NULL, 0, NULL);
+      if (!thread)
+	 break;
+
+      EnterCriticalSection(&work_cs);
+      workers[num_workers++] = thread;
+      LeaveCriticalSection(&work_cs);
+   }
+
+   return num_workers + 1;
+}
+
+
+
+/* stop_workers:
+ *  Shuts down the worker threads. Called inside pool_cs. A batch which is
+ *  running meanwhile is finished by the thread that posted it.
+ */
+static void stop_workers(void)
+{
+   int i, n;
+
+   if (!num_workers)
+      return;
+
+   EnterCriticalSection(&work_cs);
+   workers_quit = TRUE;
+   n = num_workers;
+   num_workers = 0;
+   LeaveCriticalSection(&work_cs);
+
+   ReleaseSemaphore(work_sem, n, NULL);
+   WaitForMultipleObjects(n, workers, TRUE, INFINITE);
+
+   for (i = 0; i < n; i++)
+      CloseHandle(workers[i]);
+
+   EnterCriticalSection(&work_cs);
+   workers_quit = FALSE;
+   LeaveCriticalSection(&work_cs);
+}
+
+
+
+/* _al_start_workers:
+ *  Sets up the pool so that jobs are spread over the given number of
+ *  threads, counting the one calling _al_run_workers(). Returns the
+ *  number of threads actually available.
+ */
+int _al_start_workers(int threads)
+{
+   if (threads > _AL_MAX_WORKERS)
+      threads = _AL_MAX_WORKERS;
+
+   pool_init();
+   EnterCriticalSection(&pool_cs);
+
+   if (threads != num_workers + 1) {
+      stop_workers();
+      if (threads > 1)
+	 add_workers(threads);
+   }
+
+   threads = num_workers + 1;
+
+   LeaveCriticalSection(&pool_cs);
+
+   return threads;
+}
+
+
+
+/* _al_grow_workers:
+ *  Like _al_start_workers(), but only ever adds workers, so it is safe
+ *  while other threads are using the pool.
+ */
+int _al_grow_workers(int threads)
+{
+   pool_init();
+   EnterCriticalSection(&pool_cs);
+   threads = add_workers(threads);
+   LeaveCriticalSection(&pool_cs);
+
+   return threads;
+}
+
+
+
+/* _al_stop_workers:
+ *  Shuts down the worker threads.
+ */
+void _al_stop_workers(void)
+{
+   pool_init();
+   EnterCriticalSection(&pool_cs);
+   stop_workers();
+   LeaveCriticalSection(&pool_cs);
+}
+
+
+
+/* _al_run_workers:
+ *  Calls proc(data, job) for each job from 0 to jobs-1, spread over the
+ *  worker threads and the calling thread, and waits for all of them to
+ *  finish. Jobs may run in any order.
+ */
+void _al_run_workers(void (*proc)(void *data, int job), void *data, int jobs)
+{
+   int i;
+
+   if ((pool_init_state == 2) && (jobs > 1)) {
+      EnterCriticalSection(&work_cs);
+
+      /* the pool may already be busy with a job from another thread */
+      if ((num_workers) && (!work_busy)) {
+	 work_busy = TRUE;
+	 work_proc = proc;
+	 work_data = data;
+	 work_jobs = jobs;
+	 work_next = 0;
+	 work_done = 0;
+	 ResetEvent(done_event);
+
+	 ReleaseSemaphore(work_sem, MIN(num_workers, jobs - 1), NULL);
+
+	 /* lend a hand rather than sitting idle */
+	 do_jobs();
+
+	 if (work_done < work_jobs) {
+	    LeaveCriticalSection(&work_cs);
+	    WaitForSingleObject(done_event, INFINITE);
+	    EnterCriticalSection(&work_cs);
+	 }
+
+	 work_busy = FALSE;
+	 LeaveCriticalSection(&work_cs);
+	 return;
+      }
+
+      LeaveCriticalSection(&work_cs);
+   }
+
+   for (i = 0; i < jobs; i++)
+      proc(data, i);
+}
+
+
+
+/* state of the I/O thread, all protected by io_cs, which is set up the
+ * first time it is needed and then kept, so callers can use it to decide
+ * whether to start a thread
+ */
+static HANDLE io_thread;
+static unsigned io_thread_id;
+static int io_running = FALSE;
+static LONG io_init_state = 0;            /* 0 none, 1 under way, 2 done */
+static CRITICAL_SECTION io_cs;
+static HANDLE io_event;
+static int io_waiters;
+static int io_release;
+static int io_generation;
+static void (*io_proc)(void);
+
+
+
+/* io_init:
+ *  Sets up io_cs and io_event, once, even if several threads get here
+ *  at the same time.
+ */
+static void io_init(void)
+{
+   if (InterlockedCompareExchange(&io_init_state, 2, 2) == 2)
+      return;
+
+   if (InterlockedCompareExchange(&io_init_state, 1, 0) == 0) {
+      InitializeCriticalSection(&io_cs);
+      io_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+      io_waiters = io_release = io_generation = 0;
+      InterlockedExchange(&io_init_state, 2);
+   }
+   else {
+      while (InterlockedCompareExchange(&io_init_state, 2, 2) != 2)
+	 Sleep(0);
+   }
+}
+
+
+
+/* io_threadfunc:
+ *  Thread function for the I/O thread.
+ */
+static unsigned __stdcall io_threadfunc(void *arg)
+{
+   io_proc();
+
+   return 0;
+}
+
+
+
+/* _al_start_io_thread:
+ *  Called inside io_cs, starts a thread which runs proc, for reading
+ *  files in the background. Returns TRUE if the thread is running.
+ */
+int _al_start_io_thread(void (*proc)(void))
+{
+   if (io_running)
+      return TRUE;
+
+   io_proc = proc;
+
+   io_thread = (HANDLE)_beginthreadex(NULL, 0, io_threadfunc, NULL, 0, &io_thread_id);
+   if (!io_thread)
+      return FALSE;
+
+   io_running = TRUE;
+   return TRUE;
+}
+
+
+
+/* _al_stop_io_thread:
+ *  Waits for the proc of the I/O thread to return.
+ */
+void _al_stop_io_thread(void)
+{
+   if (!io_running)
+      return;
+
+   WaitForSingleObject(io_thread, INFINITE);
+   CloseHandle(io_thread);
+
+   io_running = FALSE;
+}
+
+
+
+/* _al_in_io_thread:
+ *  Called inside io_cs, tells whether the caller is the I/O thread.
+ */
+int _al_in_io_thread(void)
+{
+   return (io_running) && (GetCurrentThreadId() == io_thread_id);
+}
+
+
+
+/* _al_lock_io:
+ *  Locks the state shared with the I/O thread. This works whether or not
+ *  the thread is running.
+ */
+void _al_lock_io(void)
+{
+   io_init();
+   EnterCriticalSection(&io_cs);
+}
+
+
+
+/* _al_unlock_io:
+ *  Unlocks the state shared with the I/O thread.
+ */
+void _al_unlock_io(void)
+{
+   LeaveCriticalSection(&io_cs);
+}
+
+
+
+/* _al_wait_io:
+ *  Called inside io_cs, sleeps until _al_wake_io() is called. The event
+ *  stays set until every thread it was set for has woken, so none of
+ *  them can miss it. May also return early, so the caller must check
+ *  what it waits for.
+ */
+void _al_wait_io(void)
+{
+   int generation = io_generation;
+
+   io_waiters++;
+
+   for (;;) {
+      LeaveCriticalSection(&io_cs);
+      WaitForSingleObject(io_event, INFINITE);
+      EnterCriticalSection(&io_cs);
+
+      if ((io_release > 0) && (io_generation != generation))
+	 break;
+   }
+
+   io_waiters--;
+
+   if (--io_release == 0)
+      ResetEvent(io_event);
+}
+
+
+
+/* _al_wake_io:
+ *  Called inside io_cs, wakes all the threads in _al_wait_io().
+ */
+void _al_wake_io(void)
+{
+   if (io_waiters > 0) {
+      SetEvent(io_event);
+      io_release = io_waiters;
+      io_generation++;
+   }
+}
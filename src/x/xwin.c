@@ -155,6 +155,23 @@ void *allegro_icon = icon_xpm;
 int _xwin_last_line = -1;
 int _xwin_in_gfx_call = 0;
 
+/* Screen updates are collected per tile and pushed to the window from
+ * the background handler, skipping tiles whose pixels hash the same as
+ * the last time they were pushed.
+ */
+#define XWIN_TILE_SHIFT    5
+#define XWIN_TILE_SIZE     (1 << XWIN_TILE_SHIFT)
+
+#define XWIN_TILE_DIRTY    1
+#define XWIN_TILE_HASHED   2
+
+static unsigned char *_xwin_tile_flags = NULL;
+static uint64_t *_xwin_tile_hash = NULL;
+static int *_xwin_tile_runs = NULL;
+static int _xwin_tiles_w = 0;
+static int _xwin_tiles_h = 0;
+static int _xwin_dirty_tiles = FALSE;
+
 static COLORCONV_BLITTER_FUNC *blitter_func = NULL;
 static int use_bgr_palette_hack = FALSE; /* use BGR hack for color conversion palette? */
 
@@ -209,6 +226,10 @@ static void _xwin_private_set_warped_mouse_mode(int permanent);
 static void _xwin_private_redraw_window(int x, int y, int w, int h);
 static int _xwin_private_scroll_screen(int x, int y);
 static void _xwin_private_update_screen(int x, int y, int w, int h);
+static void _xwin_private_put_screen(int x, int y, int w, int h);
+static int _xwin_private_create_dirty_tiles(void);
+static void _xwin_private_destroy_dirty_tiles(void);
+static void _xwin_private_flush_dirty_tiles(void);
 static void _xwin_private_set_window_title(AL_CONST char *name);
 static void _xwin_private_set_window_name(AL_CONST char *name, AL_CONST char *group);
 static int _xwin_private_get_pointer_mapping(unsigned char map[], int nmap);
@@ -909,6 +930,8 @@ BITMAP *_xwin_create_screen(GFX_DRIVER *drv, int w, int h,
  */
 static void _xwin_private_destroy_screen(void)
 {
+   _xwin_private_destroy_dirty_tiles();
+
    if (_xwin.buffer_line != 0) {
       _AL_FREE(_xwin.buffer_line);
       _xwin.buffer_line = 0;
@@ -1032,6 +1055,12 @@ static BITMAP *_xwin_private_create_screen_bitmap(GFX_DRIVER *drv,
 	 _xwin.buffer_line[line] = _xwin.buffer_line[line - 1] + bytes_per_buffer_line;
    }
 
+   /* Create tables for tracking screen updates.  */
+   if (!_xwin_private_create_dirty_tiles()) {
+      ustrzcpy(allegro_error, ALLEGRO_ERROR_SIZE, get_config_text("Not enough memory"));
+      return 0;
+   }
+
    /* Create bitmap.  */
    bmp = _make_bitmap(_xwin.virtual_width, _xwin.virtual_height,
 		      (uintptr_t) (_xwin.screen_line[0]), drv,
@@ -2198,8 +2227,10 @@ static void _xwin_private_set_palette_range(AL_CONST PALETTE p, int from, int to
       (*(_xwin.set_colors))(p, from, to);
 
       /* Update XImage and window.  */
-      if (!_xwin.matching_formats)
-	 _xwin_private_update_screen(0, 0, _xwin.virtual_width, _xwin.virtual_height);
+      if (!_xwin.matching_formats) {
+	 _xwin_private_flush_dirty_tiles();
+	 _xwin_private_put_screen(0, 0, _xwin.virtual_width, _xwin.virtual_height);
+      }
    }
 }
 
@@ -2258,6 +2289,8 @@ static void _xwin_private_set_window_defaults(void)
  */
 static void _xwin_private_flush_buffers(void)
 {
+   _xwin_private_flush_dirty_tiles();
+
    if (_xwin.display != 0)
       XSync(_xwin.display, False);
 }
@@ -2280,7 +2313,7 @@ void _xwin_vsync(void)
       int prev = retrace_count;
 
       XLOCK();
-      XSync(_xwin.display, False);
+      _xwin_private_flush_buffers();
       XUNLOCK();
 
       do {
@@ -2293,7 +2326,7 @@ void _xwin_vsync(void)
        * has a similar effect.
        */
       XLOCK();
-      XSync(_xwin.display, False);
+      _xwin_private_flush_buffers();
       XUNLOCK();
    }
 }
@@ -2605,6 +2638,8 @@ void _xwin_redraw_window(int x, int y, int w, int h)
  */
 static int _xwin_private_scroll_screen(int x, int y)
 {
+   _xwin_private_flush_dirty_tiles();
+
    _xwin.scroll_x = x;
    _xwin.scroll_y = y;
    (*_xwin_window_redrawer)(0, 0, _xwin.screen_width, _xwin.screen_height);
@@ -2636,10 +2671,10 @@ int _xwin_scroll_screen(int x, int y)
 
 
 
-/* _xwin_update_screen:
- *  Update part of the screen.
+/* _xwin_put_screen:
+ *  Converts part of the screen and pushes it to the window right away.
  */
-static void _xwin_private_update_screen(int x, int y, int w, int h)
+static void _xwin_private_put_screen(int x, int y, int w, int h)
 {
    /* Update frame buffer with screen contents.  */
    if (_xwin.screen_to_buffer != 0) {
@@ -2673,6 +2708,239 @@ static void _xwin_private_update_screen(int x, int y, int w, int h)
    (*_xwin_window_redrawer)(x - _xwin.scroll_x, y - _xwin.scroll_y, w, h);
 }
 
+
+
+/* _xwin_create_dirty_tiles:
+ *  Allocates the tables for tracking screen updates.
+ */
+static int _xwin_private_create_dirty_tiles(void)
+{
+   int tiles;
+
+   _xwin_private_destroy_dirty_tiles();
+
+   _xwin_tiles_w = (_xwin.virtual_width + XWIN_TILE_SIZE - 1) >> XWIN_TILE_SHIFT;
+   _xwin_tiles_h = (_xwin.virtual_height + XWIN_TILE_SIZE - 1) >> XWIN_TILE_SHIFT;
+   tiles = _xwin_tiles_w * _xwin_tiles_h;
+
+   _xwin_tile_flags = _AL_MALLOC_ATOMIC(tiles);
+   _xwin_tile_hash = _AL_MALLOC_ATOMIC(tiles * sizeof(uint64_t));
+   _xwin_tile_runs = _AL_MALLOC_ATOMIC(_xwin_tiles_w * 2 * 2 * sizeof(int));
+
+   if ((!_xwin_tile_flags) || (!_xwin_tile_hash) || (!_xwin_tile_runs)) {
+      _xwin_private_destroy_dirty_tiles();
+      return FALSE;
+   }
+
+   memset(_xwin_tile_flags, 0, tiles);
+   _xwin_dirty_tiles = FALSE;
+
+   return TRUE;
+}
+
+
+
+/* _xwin_destroy_dirty_tiles:
+ *  Frees the tables for tracking screen updates.
+ */
+static void _xwin_private_destroy_dirty_tiles(void)
+{
+   if (_xwin_tile_flags) {
+      _AL_FREE(_xwin_tile_flags);
+      _xwin_tile_flags = NULL;
+   }
+
+   if (_xwin_tile_hash) {
+      _AL_FREE(_xwin_tile_hash);
+      _xwin_tile_hash = NULL;
+   }
+
+   if (_xwin_tile_runs) {
+      _AL_FREE(_xwin_tile_runs);
+      _xwin_tile_runs = NULL;
+   }
+
+   _xwin_tiles_w = _xwin_tiles_h = 0;
+   _xwin_dirty_tiles = FALSE;
+}
+
+
+
+/* _xwin_hash_tile:
+ *  Hashes the screen pixels of a tile.
+ */
+static uint64_t _xwin_private_hash_tile(int x, int y, int w, int h)
+{
+   int bpp = BYTES_PER_PIXEL(_xwin.screen_depth);
+   int bytes = w * bpp;
+   uint64_t hash = 0xCBF29CE484222325ULL;
+   uint64_t v;
+   int i;
+
+   for (; h > 0; h--, y++) {
+      unsigned char *p = _xwin.screen_line[y] + x * bpp;
+
+      for (i = 0; i + 8 <= bytes; i += 8) {
+	 memcpy(&v, p + i, 8);
+	 hash = (hash ^ v) * 0x100000001B3ULL;
+	 hash ^= hash >> 32;
+      }
+
+      for (; i < bytes; i++)
+	 hash = (hash ^ p[i]) * 0x100000001B3ULL;
+   }
+
+   return hash;
+}
+
+
+
+/* _xwin_put_tile_run:
+ *  Pushes a rectangle of changed tiles to the window.
+ */
+static void _xwin_private_put_tile_run(int tx, int ty, int tw, int th)
+{
+   _xwin_private_put_screen(tx << XWIN_TILE_SHIFT, ty << XWIN_TILE_SHIFT,
+			    tw << XWIN_TILE_SHIFT, th << XWIN_TILE_SHIFT);
+}
+
+
+
+/* _xwin_flush_dirty_tiles:
+ *  Pushes the tiles which were drawn onto and have actually changed since
+ *  the last time to the window. Horizontal runs of changed tiles are
+ *  merged with identical runs on the row above, so that a full screen
+ *  update is still done with a single put.
+ */
+static void _xwin_private_flush_dirty_tiles(void)
+{
+   int *prev_runs, *runs, *tmp;
+   int num_prev = 0, num_runs;
+   int tx, ty, i, j;
+
+   if (!_xwin_dirty_tiles)
+      return;
+
+   _xwin_dirty_tiles = FALSE;
+
+   /* Each run is stored as start, length and height, rows are kept in
+    * two halves of the runs array.
+    */
+   prev_runs = _xwin_tile_runs;
+   runs = _xwin_tile_runs + _xwin_tiles_w * 2;
+
+   for (ty = 0; ty < _xwin_tiles_h; ty++) {
+      unsigned char *flags = _xwin_tile_flags + ty * _xwin_tiles_w;
+      uint64_t *hashes = _xwin_tile_hash + ty * _xwin_tiles_w;
+      int y = ty << XWIN_TILE_SHIFT;
+      int h = MIN(XWIN_TILE_SIZE, _xwin.virtual_height - y);
+      int start = -1;
+
+      num_runs = 0;
+
+      for (tx = 0; tx <= _xwin_tiles_w; tx++) {
+	 int changed = FALSE;
+
+	 if ((tx < _xwin_tiles_w) && (flags[tx] & XWIN_TILE_DIRTY)) {
+	    int x = tx << XWIN_TILE_SHIFT;
+	    uint64_t hash = _xwin_private_hash_tile(x, y, MIN(XWIN_TILE_SIZE, _xwin.virtual_width - x), h);
+
+	    if (!(flags[tx] & XWIN_TILE_HASHED) || (hashes[tx] != hash)) {
+	       hashes[tx] = hash;
+	       changed = TRUE;
+	    }
+
+	    flags[tx] = XWIN_TILE_HASHED;
+	 }
+
+	 if (changed) {
+	    if (start < 0)
+	       start = tx;
+	 }
+	 else if (start >= 0) {
+	    runs[num_runs * 2] = start;
+	    runs[num_runs * 2 + 1] = tx - start;
+	    num_runs++;
+	    start = -1;
+	 }
+      }
+
+      /* Extend identical runs from the row above, put the others.  */
+      for (i = 0; i < num_prev; i++) {
+	 for (j = 0; j < num_runs; j++) {
+	    if ((runs[j * 2] == prev_runs[i * 2]) && (runs[j * 2 + 1] == (prev_runs[i * 2 + 1] & 0xFFFF)))
+	       break;
+	 }
+
+	 if (j < num_runs) {
+	    /* Carry the height over in the upper bits of the length.  */
+	    runs[j * 2 + 1] += (prev_runs[i * 2 + 1] & ~0xFFFF) + 0x10000;
+	 }
+	 else {
+	    int th = (prev_runs[i * 2 + 1] >> 16) + 1;
+	    _xwin_private_put_tile_run(prev_runs[i * 2], ty - th, prev_runs[i * 2 + 1] & 0xFFFF, th);
+	 }
+      }
+
+      tmp = prev_runs;
+      prev_runs = runs;
+      runs = tmp;
+      num_prev = num_runs;
+   }
+
+   for (i = 0; i < num_prev; i++) {
+      int th = (prev_runs[i * 2 + 1] >> 16) + 1;
+      _xwin_private_put_tile_run(prev_runs[i * 2], _xwin_tiles_h - th, prev_runs[i * 2 + 1] & 0xFFFF, th);
+   }
+}
+
+
+
+/* _xwin_update_screen:
+ *  Update part of the screen.
+ */
+static void _xwin_private_update_screen(int x, int y, int w, int h)
+{
+   int tx1, ty1, tx2, ty2, ty;
+
+   if (!_xwin_tile_flags) {
+      _xwin_private_put_screen(x, y, w, h);
+      return;
+   }
+
+   /* Clip updated region.  */
+   if (x < 0) {
+      w += x;
+      x = 0;
+   }
+   if (y < 0) {
+      h += y;
+      y = 0;
+   }
+   if (w > _xwin.virtual_width - x)
+      w = _xwin.virtual_width - x;
+   if (h > _xwin.virtual_height - y)
+      h = _xwin.virtual_height - y;
+   if ((w <= 0) || (h <= 0))
+      return;
+
+   /* Mark the tiles it touches, they are pushed by _xwin_flush_buffers().  */
+   tx1 = x >> XWIN_TILE_SHIFT;
+   ty1 = y >> XWIN_TILE_SHIFT;
+   tx2 = (x + w - 1) >> XWIN_TILE_SHIFT;
+   ty2 = (y + h - 1) >> XWIN_TILE_SHIFT;
+
+   for (ty = ty1; ty <= ty2; ty++) {
+      unsigned char *flags = _xwin_tile_flags + ty * _xwin_tiles_w;
+      int tx;
+
+      for (tx = tx1; tx <= tx2; tx++)
+	 flags[tx] |= XWIN_TILE_DIRTY;
+   }
+
+   _xwin_dirty_tiles = TRUE;
+}
+
 void _xwin_update_screen(int x, int y, int w, int h)
 {
    _xwin_lock(NULL);
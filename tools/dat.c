@@ -39,6 +39,7 @@ static int changed = 0;
 
 static int opt_command = 0;
 static int opt_compression = -1;
+static char *opt_codec = NULL;
 static int opt_strip = -1;
 static int opt_sort = -1;
 static int opt_relf = FALSE;
@@ -101,6 +102,7 @@ static void usage(void)
    printf("\t'-c0' no compression\n");
    printf("\t'-c1' compress objects individually\n");
    printf("\t'-c2' global compression on the entire datafile\n");
+   printf("\t'-codec name' compresses with 'lzss' (the default), 'lz4' or 'lz4i'\n");
    printf("\t'-d' deletes the named objects from the datafile\n");
    printf("\t'-dither' dithers when reducing color depths\n");
    printf("\t'-e' extracts the named objects from the datafile\n");
@@ -126,6 +128,7 @@ static void usage(void)
    printf("\t'-v' selects verbose mode\n");
    printf("\t'-w' always updates the entire contents of the datafile\n");
    printf("\t'-x' alias for -e\n");
+   printf("\t'-z1' to '-z9' compression effort: 1 is fastest, 9 packs best\n");
    printf("\t'-007 password' sets the file encryption key\n");
    printf("\t'PROP=value' sets object properties\n");
 }
@@ -851,6 +854,17 @@ int main(int argc, char *argv[])
 	       break;
 
 	    case 'c':
+	       if (stricmp(argv[c]+2, "odec") == 0) {
+		  if ((opt_codec) || (c >= argc-1) ||
+		      ((stricmp(argv[c+1], "lzss") != 0) && (stricmp(argv[c+1], "lz4") != 0) &&
+		       (stricmp(argv[c+1], "lz4i") != 0))) {
+		     usage();
+		     return 1;
+		  }
+		  opt_codec = argv[++c];
+		  break;
+	       }
+
 	       if ((opt_compression >= 0) || 
 		   (argv[c][2] < '0') || (argv[c][2] > '2')) {
 		  usage();
@@ -971,6 +985,14 @@ int main(int argc, char *argv[])
 	       opt_verbose = TRUE;
 	       break;
 
+	    case 'z':
+	       if ((argv[c][2] < '1') || (argv[c][2] > '9') || (argv[c][3])) {
+		  usage();
+		  return 1;
+	       }
+	       set_lzss_pack_level(argv[c][2] - '0');
+	       break;
+
 	    case '0':
 	       if ((opt_password) || (c >= argc-1)) {
 		  usage();
@@ -1016,6 +1038,7 @@ int main(int argc, char *argv[])
    if ((!opt_datafilename) || 
        ((!opt_command) && 
 	(opt_compression < 0) && 
+	(!opt_codec) && 
 	(opt_strip < 0) && 
 	(opt_sort < 0) &&
 	(!opt_numprops) &&
@@ -1139,7 +1162,7 @@ int main(int argc, char *argv[])
 	 }
       }
 
-      if ((!err) && ((changed) || (opt_compression >= 0) || (opt_strip >= 0) || (opt_sort >= 0))) {
+      if ((!err) && ((changed) || (opt_compression >= 0) || (opt_codec) || (opt_strip >= 0) || (opt_sort >= 0))) {
 	 DATEDIT_SAVE_DATAFILE_OPTIONS options;
 
 	 options.pack = opt_compression;
@@ -1148,6 +1171,7 @@ int main(int argc, char *argv[])
 	 options.verbose = opt_verbose;
 	 options.write_msg = TRUE;
 	 options.backup = FALSE;
+	 options.codec = opt_codec;
 
 	 if (!datedit_save_datafile(datafile, opt_datafilename, opt_fixed_prop, &options, opt_password))
 	    err = 1;
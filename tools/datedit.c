@@ -227,7 +227,8 @@ static int export_datafile(AL_CONST DATAFILE *dat, AL_CONST char *filename)
 					    FALSE, /* verbose   */
 					    FALSE, /* write_msg */
 					    FALSE, /* backup    */
-					    FALSE  /* rel. path */ };
+					    FALSE, /* rel. path */
+					    NULL   /* codec     */ };
 
    return datedit_save_datafile((DATAFILE *)dat->dat, filename, NULL, &options, NULL);
 }
@@ -1133,6 +1134,24 @@ int datedit_packtype(int pack)
 
 
 
+/* fixup function for the codec options, returning its magic number */
+int datedit_codectype(AL_CONST char *codec)
+{
+   if (codec)
+      datedit_set_property(&datedit_info, DAT_CODC, codec);
+   else
+      codec = get_datafile_property(&datedit_info, DAT_CODC);
+
+   if (stricmp(codec, "lz4") == 0)
+      return F_LZ4_MAGIC;
+   else if (stricmp(codec, "lz4i") == 0)
+      return F_LZ4I_MAGIC;
+   else
+      return F_PACK_MAGIC;
+}
+
+
+
 /* fixup function for the sort options */
 int datedit_sorttype(int sort)
 {
@@ -1159,13 +1178,14 @@ int datedit_save_datafile(DATAFILE *dat, AL_CONST char *name, AL_CONST int *fixe
 {
    char *pretty_name;
    char backup_name[256];
-   int pack, strip, sort;
+   int pack, strip, sort, codec;
    PACKFILE *f;
    int ret;
 
    packfile_password(password);
 
    pack = datedit_packtype(options->pack);
+   codec = set_packfile_codec(datedit_codectype(options->codec));
    strip = datedit_striptype(options->strip);
    sort = datedit_sorttype(options->sort);
 
@@ -1196,6 +1216,8 @@ int datedit_save_datafile(DATAFILE *dat, AL_CONST char *name, AL_CONST int *fixe
    else
       ret = FALSE;
 
+   set_packfile_codec(codec);
+
    if (ret == FALSE) {
       delete_file(pretty_name);
       datedit_error("Error writing %s", pretty_name);
@@ -32,6 +32,7 @@
 #define DAT_XSIZ  DAT_ID('X','S','I','Z')
 #define DAT_YSIZ  DAT_ID('Y','S','I','Z')
 #define DAT_PACK  DAT_ID('P','A','C','K')
+#define DAT_CODC  DAT_ID('C','O','D','C')
 #define DAT_SORT  DAT_ID('S','O','R','T')
 #define DAT_HNAM  DAT_ID('H','N','A','M')
 #define DAT_HPRE  DAT_ID('H','P','R','E')
@@ -141,6 +142,7 @@ typedef struct DATEDIT_SAVE_DATAFILE_OPTIONS {
    int write_msg;
    int backup;
    int relative;
+   AL_CONST char *codec;
 } DATEDIT_SAVE_DATAFILE_OPTIONS;
 
 
@@ -2106,6 +2106,7 @@ static int save(int strip)
       options.write_msg = FALSE;
       options.backup = (opt_menu[MENU_BACKUP].flags & D_SELECTED);
       options.relative = (opt_menu[MENU_RELF].flags & D_SELECTED);
+      options.codec = NULL;
 
       if (!datedit_save_datafile(datafile, grabber_data_file, NULL, &options, password))
 	 err = TRUE;
@@ -2475,6 +2475,7 @@ int main(int argc, char *argv[])
 	 options.verbose = (opt_veryverbose || (opt_verbose && opt_compression));
 	 options.write_msg = TRUE;
 	 options.backup = FALSE;
+	 options.codec = NULL;
 
 	 if (!datedit_save_datafile(datafile, opt_datafile, NULL, &options, NULL))
 	    err = 1;
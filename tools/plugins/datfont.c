@@ -102,6 +102,28 @@ static void plot_font(AL_CONST DATAFILE *dat, int x, int y)
 
             mf = mf->next;
         }
+    } else if(is_aa_font(f)) {
+        FONT_AA_DATA* af = f->data;
+
+        while(af) {
+            for(ch = af->begin; ch < af->end; ch++) {
+                bufpos = usetc(buf, ch);
+                usetc(buf + bufpos, 0);
+
+                if(text_length(f, buf) + cx + 4 > SCREEN_W) {
+                    cx = x;
+                    y += text_height(f) + 4;
+                }
+
+                if(y > SCREEN_H) break;
+
+                textout_ex(screen, f, buf, cx, y, gui_fg_color, -1);
+
+                cx += text_length(f, buf) + 4;
+            }
+
+            af = af->next;
+        }
     } else {
         FONT_COLOR_DATA* cf = f->data;
 
@@ -132,7 +154,7 @@ static void plot_font(AL_CONST DATAFILE *dat, int x, int y)
 static void get_font_desc(AL_CONST DATAFILE *dat, char *s)
 {
    FONT *fnt = (FONT *)dat->dat;
-   char *mono = (is_mono_font(fnt)) ? "mono" : "color";
+   char *mono = (is_mono_font(fnt)) ? "mono" : ((is_aa_font(fnt)) ? "anti-aliased" : "color");
    int ranges = 0;
    int glyphs = 0;
 
@@ -144,6 +166,14 @@ static void get_font_desc(AL_CONST DATAFILE *dat, char *s)
             glyphs += mf->end - mf->begin;
             mf = mf->next;
         }
+    } else if(is_aa_font(fnt)) {
+        FONT_AA_DATA* af = fnt->data;
+
+        while(af) {
+            ranges++;
+            glyphs += af->end - af->begin;
+            af = af->next;
+        }
     } else {
         FONT_COLOR_DATA* cf = fnt->data;
 
@@ -189,6 +219,13 @@ static int export_font(AL_CONST DATAFILE* dat, AL_CONST char* filename)
                 pack_fputs(tmp, pack);
                 mf = mf->next;
             }
+        } else if(is_aa_font(f)) {
+            FONT_AA_DATA* af = f->data;
+            while(af) {
+                sprintf(tmp, "%s 0x%04X 0x%04X\n", (af == f->data) ? get_filename(buf) : "-", af->begin, af->end - 1);
+                pack_fputs(tmp, pack);
+                af = af->next;
+            }
         } else {
             FONT_COLOR_DATA* cf = f->data;
             while(cf) {
@@ -206,6 +243,8 @@ static int export_font(AL_CONST DATAFILE* dat, AL_CONST char* filename)
 
         if(is_mono_font(f)) {
             if( ((FONT_MONO_DATA*)f->data) ->next) multi = 1;
+        } else if(is_aa_font(f)) {
+            if( ((FONT_AA_DATA*)f->data) ->next) multi = 1;
         } else {
             if( ((FONT_COLOR_DATA*)f->data)->next) multi = 1;
         }
@@ -230,6 +269,20 @@ static int export_font(AL_CONST DATAFILE* dat, AL_CONST char* filename)
 
             mf = mf->next;
         }
+    } else if(is_aa_font(f)) {
+        FONT_AA_DATA* af = f->data;
+
+        while(af) {
+            for(i = af->begin; i < af->end; i++) {
+                FONT_AA_GLYPH* g = af->glyphs[i - af->begin];
+
+                max++;
+                if(g->w + 1 > w) w = g->w + 1;
+                if(g->h > h) h = g->h;
+            }
+
+            af = af->next;
+        }
     } else {
         FONT_COLOR_DATA* cf = f->data;
         int i;
@@ -266,6 +319,18 @@ static int export_font(AL_CONST DATAFILE* dat, AL_CONST char* filename)
 
             mf = mf->next;
         }
+    } else if(is_aa_font(f)) {
+        FONT_AA_DATA* af = f->data;
+
+        /* the bitmap is 8 bit, so this keeps pixels more than half covered */
+        while(af) {
+            for(i = af->begin; i < af->end; i++) {
+                textprintf_ex(bmp, f, 1 + w * (max & 15), 1 + h * (max / 16), 1, 0, "%c", i);
+                max++;
+            }
+
+            af = af->next;
+        }
     } else {
         FONT_COLOR_DATA* cf = f->data;
 
@@ -410,6 +475,34 @@ static void upgrade_to_color(FONT* f)
 
 
 
+/* upgrade_to_aa:
+ *  Helper function. Turns a font of any kind into an anti-aliased font
+ *  in place, returning FALSE if there was not enough memory.
+ */
+static int upgrade_to_aa(FONT* f)
+{
+    FONT* aa;
+    void* data;
+
+    if(is_aa_font(f)) return TRUE;
+
+    aa = create_aa_font(f, 0);
+    if(!aa) return FALSE;
+
+    /* swap the contents, so the old glyphs go away with aa */
+    data = f->data;
+    f->data = aa->data;
+    aa->data = data;
+    aa->vtable = f->vtable;
+    f->vtable = font_vtable_aa;
+
+    destroy_font(aa);
+
+    return TRUE;
+}
+
+
+
 static DATAFILE *fonts_datafile;
 
 /* Get a list of fonts for a font datafile */
@@ -490,6 +583,14 @@ static DATAFILE *grab_font(int type, AL_CONST char *filename, DATAFILE_PROPERTY
          import_grx_message(filename);
       }
    }
+
+   /* alpha channels make good coverage maps for anti-aliased text */
+   if (font && font_has_alpha(font)) {
+      id = datedit_ask("Convert to an anti-aliased font using the alpha channel");
+      if (id == 'y' || id == 'Y')
+	 upgrade_to_aa(font);
+   }
+
    return datedit_construct(type, font, 0, prop);
 }
 
@@ -678,6 +779,52 @@ static int save_color_font(FONT* f, PACKFILE* pack)
 
 
 
+/* helper for save_font, below */
+static int save_aa_font(FONT* f, PACKFILE* pack)
+{
+    FONT_AA_DATA* af = f->data;
+    int i = 0;
+
+   *allegro_errno = 0;
+
+    /* count number of ranges */
+    while(af) {
+        i++;
+        af = af->next;
+    }
+    pack_mputw(i, pack);
+
+    af = f->data;
+
+    while(af) {
+
+        /* anti-aliased, begin, end-1 */
+        pack_putc(-8, pack);
+        pack_mputl(af->begin, pack);
+        pack_mputl(af->end - 1, pack);
+
+        for(i = af->begin; i < af->end; i++) {
+            FONT_AA_GLYPH* g = af->glyphs[i - af->begin];
+
+            pack_mputw(g->w, pack);
+            pack_mputw(g->h, pack);
+            pack_mputl(g->advance, pack);
+
+	    pack_fwrite(g->dat, g->w * g->h, pack);
+        }
+
+        af = af->next;
+
+    }
+
+   if (*allegro_errno)
+      return FALSE;
+   else
+      return TRUE;
+}
+
+
+
 /* saves a font into a datafile */
 static int save_font(DATAFILE *dat, AL_CONST int *fixed_prop, int pack, int pack_kids, int strip, int sort, int verbose, int extra, PACKFILE *f)
 {
@@ -687,6 +834,8 @@ static int save_font(DATAFILE *dat, AL_CONST int *fixed_prop, int pack, int pack
 
     if (is_mono_font(font))
        return save_mono_font(font, f);
+    else if (is_aa_font(font))
+       return save_aa_font(font, f);
     else
        return save_color_font(font, f);
 }
@@ -800,6 +949,10 @@ static int import_proc(int msg, DIALOG *d, int c)
             FONT_MONO_DATA* mf = fnt->data;
             import_end = (mf->end += (base - mf->begin));
             import_begin = mf->begin = base;
+        } else if(is_aa_font(fnt)) {
+            FONT_AA_DATA* af = fnt->data;
+            import_end = (af->end += (base - af->begin));
+            import_begin = af->begin = base;
         } else {
             FONT_COLOR_DATA* cf = fnt->data;
             import_end = (cf->end += (base - cf->begin));
@@ -821,8 +974,13 @@ static int import_proc(int msg, DIALOG *d, int c)
 	    }
 
 	    if(!is_compatible_font(f, fnt)) {
-	        upgrade_to_color(f);
-	        upgrade_to_color(fnt);
+	        if(is_aa_font(f) || is_aa_font(fnt)) {
+	            upgrade_to_aa(f);
+	            upgrade_to_aa(fnt);
+	        } else {
+	            upgrade_to_color(f);
+	            upgrade_to_color(fnt);
+	        }
 	    }
 
 	    f = the_font;
@@ -843,6 +1001,21 @@ static int import_proc(int msg, DIALOG *d, int c)
                 mf2->next = mf->next;
                 mf->next = mf2;
             }
+        } else if(is_aa_font(f)) {
+            FONT_AA_DATA* af = f->data, * af2 = fnt->data;
+
+            if(af->begin > import_begin) {
+                af2->next = af;
+                f->data = af2;
+            } else {
+                i++;
+                while(af->next && af->next->begin < import_begin) {
+                    af = af->next;
+                    i++;
+                }
+                af2->next = af->next;
+                af->next = af2;
+            }
         } else {
             FONT_COLOR_DATA* cf = f->data, * cf2 = fnt->data;
 
@@ -909,6 +1082,28 @@ static int delete_proc(int msg, DIALOG *d, int c)
             free(mf->glyphs);
             free(mf);
 
+        } else if(is_aa_font(fnt)) {
+
+            FONT_AA_DATA* af = fnt->data, * af_prev = 0;
+
+            if(!af->next) {
+                alert("Deletion not possible:", "fonts must always have at", "least one character range", "Sorry", NULL, 13, 0);
+                return D_O_K;
+            }
+
+            i = view_font_dlg[RANGE_LIST].d1;
+            while(i--) {
+                af_prev = af;
+                af = af->next;
+            }
+
+            if(af_prev) af_prev->next = af->next;
+            else fnt->data = af->next;
+
+            for(i = af->begin; i < af->end; i++) free(af->glyphs[i - af->begin]);
+            free(af->glyphs);
+            free(af);
+
         } else {
 
             FONT_COLOR_DATA* cf = fnt->data, * cf_prev = 0;
@@ -951,6 +1146,7 @@ static int font_view_proc(int msg, DIALOG *d, int c)
 {
    BITMAP** bits = 0;
    FONT_GLYPH** gl = 0;
+   FONT_AA_GLYPH** ag = 0;
    FONT *fnt;
    int x, y, w, h, i;
    int font_h;
@@ -986,6 +1182,15 @@ static int font_view_proc(int msg, DIALOG *d, int c)
         begin = mf->begin;
         end = mf->end;
 
+     } else if(is_aa_font(fnt)) {
+
+        FONT_AA_DATA* af = fnt->data;
+        while(i--) af = af->next;
+
+        ag = af->glyphs;
+        begin = af->begin;
+        end = af->end;
+
      } else {
 
         FONT_COLOR_DATA* cf = fnt->data;
@@ -1005,13 +1210,17 @@ static int font_view_proc(int msg, DIALOG *d, int c)
 	       w = gl[i - begin]->w;
 	       h = gl[i - begin]->h;
 	    }
+	    else if (ag) {
+	       w = ag[i - begin]->w;
+	       h = ag[i - begin]->h;
+	    }
 	    else {
 	        w = bits[i - begin]->w;
 	        h = bits[i - begin]->h;
 	    }
 
 	    textprintf_ex(d->dp, font, 32, y+font_h/2-4, gui_fg_color, gui_mg_color, "U+%04X %3dx%-3d %c", i, w, h, i);
-	    textprintf_ex(d->dp, fnt, 200, y, (gl ? gui_fg_color : -1), makecol(0xC0, 0xC0, 0xC0), "%c", i);
+	    textprintf_ex(d->dp, fnt, 200, y, ((gl || ag) ? gui_fg_color : -1), makecol(0xC0, 0xC0, 0xC0), "%c", i);
 
 	    y += font_h * 3/2;
 	 }